@@ -0,0 +1,209 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Throughput of strip charts: values are added to a full chart (so
+ * each new value pushes out the oldest one) and the rate at which this
+ * can be done is printed. First only the storage gets measured, with
+ * the form frozen so nothing gets drawn. Then bar, line, filled and
+ * spike charts with 256 and 1024 values (4 and 1 pixels per value) are
+ * updated with and without scroll mode, waiting for the X server to
+ * finish drawing after each value.
+ *
+ *   usage: chartbench [values]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "include/forms.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define AREA_W    1024      /* width of the area the values are drawn in */
+#define AREA_H    300
+#define STORE     1000000   /* values added without drawing */
+
+static FL_FORM *form;
+static FL_OBJECT *chart;
+
+
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ * Returns the i-th value (from a table, so that computing it doesn't
+ * get measured as well)
+ ***************************************/
+
+static double
+value( long i )
+{
+    static double values[ 4096 ];
+    static int done;
+
+    if ( ! done )
+    {
+        for ( done = 0; done < 4096; done++ )
+            values[ done ] = 50.0 + 40.0 * sin( done * 0.02 ) + rand( ) % 10;
+    }
+
+    return values[ i & 4095 ];
+}
+
+
+/***************************************
+ * Replaces the chart by a new one of the given type and fills it
+ ***************************************/
+
+static void
+prepare( int type,
+         int maxnumb,
+         int scroll )
+{
+    int i;
+
+    fl_freeze_form( form );
+
+    /* With a border width of 1 the values get drawn into an area 10
+       pixels smaller than the chart */
+
+    if ( chart )
+    {
+        fl_delete_object( chart );
+        fl_free_object( chart );
+    }
+
+    fl_addto_form( form );
+    chart = fl_add_chart( type, 10, 10, AREA_W + 10, AREA_H + 10, "" );
+    fl_set_object_bw( chart, 1 );
+    fl_end_form( );
+
+    fl_set_chart_maxnumb( chart, maxnumb );
+    fl_set_chart_bounds( chart, 0.0, 100.0 );
+
+    for ( i = 0; i < maxnumb; i++ )
+        fl_add_chart_value( chart, value( i ), "", FL_BLUE );
+
+    fl_set_chart_scroll( chart, scroll );
+    fl_unfreeze_form( form );
+    XSync( fl_get_display( ), False );
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+    static const int types[ ] = { FL_BAR_CHART, FL_LINE_CHART,
+                                  FL_FILL_CHART, FL_SPIKE_CHART };
+    static const char *names[ ] = { "bar", "line", "filled", "spike" };
+    static const int maxnumbs[ ] = { 256, 1024 };
+    int values = 5000,
+        t,
+        m,
+        scroll;
+    long i;
+    double start,
+           rate[ 2 ];
+
+    fl_initialize( &argc, argv, 0, 0, 0 );
+
+    if ( argc > 1 && ( values = atoi( argv[ 1 ] ) ) < 1 )
+    {
+        fprintf( stderr, "usage: %s [values]\n", argv[ 0 ] );
+        return 1;
+    }
+
+    form = fl_bgn_form( FL_UP_BOX, AREA_W + 30, AREA_H + 30 );
+    fl_end_form( );
+
+    fl_show_form( form, FL_PLACE_CENTER, FL_FULLBORDER, "chart benchmark" );
+    fl_check_forms( );
+
+    /* Storage only */
+
+    prepare( FL_LINE_CHART, FL_CHART_MAX, 0 );
+    fl_freeze_form( form );
+
+    start = now( );
+    for ( i = 0; i < STORE; i++ )
+        fl_add_chart_value( chart, value( i ), "", FL_BLUE );
+    start = now( ) - start;
+
+    fl_unfreeze_form( form );
+    printf( "%d values added to a full chart of %d without drawing: "
+            "%.1f Mvalues/s\n\n", STORE, FL_CHART_MAX,
+            1.0e-6 * STORE / start );
+
+    /* Drawing */
+
+    printf( "%d values added, values per second:\n", values );
+    printf( "%-6s %7s %12s %12s\n", "type", "values", "full redraw",
+            "scroll" );
+
+    for ( t = 0; t < 4; t++ )
+        for ( m = 0; m < 2; m++ )
+        {
+            for ( scroll = 0; scroll < 2; scroll++ )
+            {
+                prepare( types[ t ], maxnumbs[ m ], scroll );
+
+                start = now( );
+                for ( i = 0; i < values; i++ )
+                {
+                    fl_add_chart_value( chart, value( i ), "", FL_BLUE );
+                    XSync( fl_get_display( ), False );
+                }
+                rate[ scroll ] = values / ( now( ) - start );
+            }
+
+            printf( "%-6s %7d %12.0f %12.0f\n", names[ t ], maxnumbs[ m ],
+                    rate[ 0 ], rate[ 1 ] );
+            fflush( stdout );
+        }
+
+    fl_finish( );
+    return 0;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,588 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Test and benchmark for flimage_convolve() (doesn't need a display).
+ *
+ * Without arguments two tests are run:
+ *
+ *  1. The results are compared to those of the convolution code the
+ *     library used before (copied below) for the inputs where that
+ *     code was correct, and they must be identical. The old code wrote
+ *     its results back into the pixels it was still reading from, so
+ *     it only was correct for 3x3 kernels where the top row and the
+ *     entry left of the center are zero. The results now differ (and
+ *     that's accepted) for all other kernels since
+ *       - the old code fed back its own output as described above,
+ *       - it started at the second row for all kernel sizes, so 5x5
+ *         and larger kernels read rows above the image,
+ *       - it stopped half the kernel width (instead of its height)
+ *         before the last row,
+ *       - for RGB images and kernels other than 3x3 and 5x5 it stored
+ *         the new green value into the blue component,
+ *       - for 3x3 kernels it clamped gray values to 255 instead of the
+ *         maximum gray value of the image.
+ *
+ *  2. For kernels of all odd sizes up to 9x9, with and without being
+ *     separable, the results are compared with those of a simple
+ *     reference implementation for 8, 12 and 16 bit gray and RGB
+ *     images and for different numbers of threads.
+ *
+ * With '-bench [size]' the throughput of the old and the new code is
+ * measured instead, for a size x size image (4096 x 4096 by default).
+ *
+ *   usage: convtest [-bench [size]]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/forms.h"
+#include "image/flimage.h"
+
+#define NUM_TESTS  300
+
+#define IS_GRAY( t )  ( ( t ) == FL_IMAGE_GRAY || ( t ) == FL_IMAGE_GRAY16 )
+
+
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ * Keeps the library from reporting progress
+ ***************************************/
+
+static int
+noop( FL_IMAGE   * im  FL_UNUSED_ARG,
+      const char * s   FL_UNUSED_ARG )
+{
+    return 0;
+}
+
+
+/***************************************
+ * The old code for 3x3 kernels, working in place on the whole image
+ ***************************************/
+
+#define VectorP3( k, b, i )     (   k[ 0 ] * b[ i - 1 ]     \
+                                  + k[ 1 ] * b[ i ]         \
+                                  + k[ 2 ] * b[ i + 1 ] )
+
+#define conv3x3( cm, m, r, c )  (   VectorP3( cm[ 0 ], m[ r - 1 ], c )    \
+                                  + VectorP3( cm[ 1 ], m[ r + 0 ], c )    \
+                                  + VectorP3( cm[ 2 ], m[ r + 1 ], c ) )
+
+#define NormAndClamp( pc, w, max )                        \
+            do {                                          \
+                if ( pc < 0 )                             \
+                    pc = 0;                               \
+                else if ( ( pc /=w ) > ( max ) )          \
+                    pc = ( max );                         \
+             } while ( 0 )
+
+static void
+old_convolve3x3( FL_IMAGE * im,
+                 int     ** kernel )
+{
+    int h = im->h - 1,
+        w = im->w - 1,
+        weight = 0,
+        newr,
+        newg,
+        newb,
+        row,
+        col,
+        i;
+
+    for ( i = 0; i < 9; i++ )
+        weight += kernel[ 0 ][ i ];
+
+    for ( row = 1; row < h; row++ )
+        for ( col = 1; col < w; col++ )
+            if ( IS_GRAY( im->type ) )
+            {
+                newr = conv3x3( kernel, im->gray, row, col );
+                NormAndClamp( newr, weight, FL_PCMAX );
+                im->gray[ row ][ col ] = newr;
+            }
+            else
+            {
+                newr = conv3x3( kernel, im->red, row, col );
+                newg = conv3x3( kernel, im->green, row, col );
+                newb = conv3x3( kernel, im->blue, row, col );
+
+                NormAndClamp( newr, weight, FL_PCMAX );
+                NormAndClamp( newg, weight, FL_PCMAX );
+                NormAndClamp( newb, weight, FL_PCMAX );
+
+                im->red[ row ][ col ] = newr;
+                im->green[ row ][ col ] = newg;
+                im->blue[ row ][ col ] = newb;
+            }
+}
+
+
+/***************************************
+ * Reference implementation: reads from a copy of the pixels and
+ * leaves a border of half the kernel size unchanged
+ ***************************************/
+
+static void
+ref_plane( void      ** mat,
+           int          is_gray,
+           int          w,
+           int          h,
+           int       ** kernel,
+           int          krow,
+           int          kcol,
+           int          weight,
+           int          maxval )
+{
+    unsigned short **g = ( unsigned short ** ) mat;
+    unsigned char **c = ( unsigned char ** ) mat;
+    int *src = fl_malloc( w * h * sizeof *src );
+    int kh = krow / 2,
+        kw = kcol / 2,
+        x,
+        y,
+        i,
+        j,
+        v;
+
+    for ( y = 0; y < h; y++ )
+        for ( x = 0; x < w; x++ )
+            src[ y * w + x ] = is_gray ? g[ y ][ x ] : c[ y ][ x ];
+
+    for ( y = kh; y < h - kh; y++ )
+        for ( x = kw; x < w - kw; x++ )
+        {
+            for ( v = 0, i = 0; i < krow; i++ )
+                for ( j = 0; j < kcol; j++ )
+                    v +=   kernel[ i ][ j ]
+                         * src[ ( y - kh + i ) * w + x - kw + j ];
+
+            NormAndClamp( v, weight, maxval );
+
+            if ( is_gray )
+                g[ y ][ x ] = v;
+            else
+                c[ y ][ x ] = v;
+        }
+
+    fl_free( src );
+}
+
+
+static void
+ref_convolve( FL_IMAGE  * im,
+              int      ** kernel,
+              int         krow,
+              int         kcol )
+{
+    int weight = 0,
+        i;
+
+    for ( i = 0; i < krow * kcol; i++ )
+        weight += kernel[ 0 ][ i ];
+
+    if ( IS_GRAY( im->type ) )
+        ref_plane( ( void ** ) im->gray, 1, im->w, im->h, kernel, krow, kcol,
+                   weight, im->gray_maxval );
+    else
+    {
+        ref_plane( ( void ** ) im->red, 0, im->w, im->h, kernel, krow, kcol,
+                   weight, FL_PCMAX );
+        ref_plane( ( void ** ) im->green, 0, im->w, im->h, kernel, krow, kcol,
+                   weight, FL_PCMAX );
+        ref_plane( ( void ** ) im->blue, 0, im->w, im->h, kernel, krow, kcol,
+                   weight, FL_PCMAX );
+    }
+}
+
+
+/***************************************
+ * Creates an image with random pixels
+ ***************************************/
+
+static FL_IMAGE *
+random_image( int type,
+              int w,
+              int h,
+              int maxval )
+{
+    FL_IMAGE *im = flimage_alloc( );
+    long i;
+
+    im->type = type;
+    im->w = w;
+    im->h = h;
+    flimage_getmem( im );
+
+    if ( IS_GRAY( type ) )
+    {
+        im->gray_maxval = maxval;
+        for ( i = 0; i < ( long ) w * h; i++ )
+            im->gray[ 0 ][ i ] = rand( ) % ( maxval + 1 );
+    }
+    else
+        for ( i = 0; i < ( long ) w * h; i++ )
+        {
+            im->red[ 0 ][ i ]   = rand( ) & 0xff;
+            im->green[ 0 ][ i ] = rand( ) & 0xff;
+            im->blue[ 0 ][ i ]  = rand( ) & 0xff;
+        }
+
+    return im;
+}
+
+
+/***************************************
+ * Makes an identical copy of an image
+ ***************************************/
+
+static FL_IMAGE *
+copy_image( FL_IMAGE * src )
+{
+    FL_IMAGE *im = flimage_alloc( );
+    size_t n = ( size_t ) src->w * src->h;
+
+    im->type = src->type;
+    im->w = src->w;
+    im->h = src->h;
+    flimage_getmem( im );
+    im->gray_maxval = src->gray_maxval;
+
+    if ( IS_GRAY( src->type ) )
+        memcpy( im->gray[ 0 ], src->gray[ 0 ], n * sizeof **im->gray );
+    else
+    {
+        memcpy( im->red[ 0 ], src->red[ 0 ], n );
+        memcpy( im->green[ 0 ], src->green[ 0 ], n );
+        memcpy( im->blue[ 0 ], src->blue[ 0 ], n );
+    }
+
+    return im;
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+same_image( FL_IMAGE * a,
+            FL_IMAGE * b )
+{
+    size_t n = ( size_t ) a->w * a->h;
+
+    if ( IS_GRAY( a->type ) )
+        return ! memcmp( a->gray[ 0 ], b->gray[ 0 ], n * sizeof **a->gray );
+
+    return    ! memcmp( a->red[ 0 ], b->red[ 0 ], n )
+           && ! memcmp( a->green[ 0 ], b->green[ 0 ], n )
+           && ! memcmp( a->blue[ 0 ], b->blue[ 0 ], n );
+}
+
+
+/***************************************
+ * Fills in a random kernel with a positive weight, if 'sep' is set
+ * it's the product of a column and a row vector
+ ***************************************/
+
+static void
+random_kernel( int ** k,
+               int    krow,
+               int    kcol,
+               int    sep )
+{
+    int a[ 9 ],
+        b[ 9 ],
+        weight = 0,
+        i,
+        j;
+
+    if ( sep )
+    {
+        for ( i = 0; i < krow; i++ )
+            a[ i ] = rand( ) % 7 - 2;
+        for ( j = 0; j < kcol; j++ )
+            b[ j ] = rand( ) % 7 - 2;
+        a[ krow / 2 ] = b[ kcol / 2 ] = 3;
+
+        for ( i = 0; i < krow; i++ )
+            for ( j = 0; j < kcol; j++ )
+                k[ i ][ j ] = a[ i ] * b[ j ];
+    }
+    else
+        for ( i = 0; i < krow * kcol; i++ )
+            k[ 0 ][ i ] = rand( ) % 11 - 3;
+
+    for ( i = 0; i < krow * kcol; i++ )
+        weight += k[ 0 ][ i ];
+
+    if ( weight <= 0 )
+        k[ krow / 2 ][ kcol / 2 ] += 1 - weight;
+}
+
+
+/***************************************
+ * Compares with the old code for 3x3 kernels that don't read
+ * pixels it already had overwritten
+ ***************************************/
+
+static int
+test_old( void )
+{
+    int **k = fl_get_matrix( 3, 3, sizeof **k );
+    FL_IMAGE *im,
+             *old;
+    int failed = 0,
+        t;
+
+    for ( t = 0; t < NUM_TESTS; t++ )
+    {
+        im = random_image( t & 1 ? FL_IMAGE_RGB : FL_IMAGE_GRAY,
+                           3 + rand( ) % 200, 3 + rand( ) % 200, 255 );
+        old = copy_image( im );
+
+        random_kernel( k, 3, 3, t % 3 == 0 );
+        k[ 0 ][ 0 ] = k[ 0 ][ 1 ] = k[ 0 ][ 2 ] = k[ 1 ][ 0 ] = 0;
+        if ( k[ 1 ][ 1 ] + k[ 1 ][ 2 ] + k[ 2 ][ 0 ] + k[ 2 ][ 1 ]
+             + k[ 2 ][ 2 ] <= 0 )
+            k[ 1 ][ 1 ] = 1 - k[ 1 ][ 2 ] - k[ 2 ][ 0 ] - k[ 2 ][ 1 ]
+                          - k[ 2 ][ 2 ];
+
+        flimage_set_max_threads( t % 4 );
+        old_convolve3x3( old, k );
+        flimage_convolve( im, k, 3, 3 );
+
+        if ( ! same_image( im, old ) )
+        {
+            fprintf( stderr, "old/new mismatch: %s %dx%d\n",
+                     t & 1 ? "RGB" : "gray", im->w, im->h );
+            failed++;
+        }
+
+        flimage_free( old );
+        flimage_free( im );
+    }
+
+    fl_free_matrix( k );
+    printf( "comparison with old code: %d of %d failed\n", failed,
+            NUM_TESTS );
+    return failed;
+}
+
+
+/***************************************
+ * Compares with the reference implementation for all kernel sizes
+ ***************************************/
+
+static int
+test_ref( void )
+{
+    static const int maxvals[ ] = { 255, 4095, 65535, 0 };
+    FL_IMAGE *im,
+             *ref;
+    int **k;
+    int failed = 0,
+        krow,
+        kcol,
+        sep,
+        type,
+        t;
+
+    for ( t = 0; t < NUM_TESTS; t++ )
+    {
+        krow = 1 + 2 * ( rand( ) % 5 );
+        kcol = 1 + 2 * ( rand( ) % 5 );
+        sep = t % 3 == 0;
+        type = t % 4 == 3 ? FL_IMAGE_RGB :
+               t % 4 == 0 ? FL_IMAGE_GRAY : FL_IMAGE_GRAY16;
+
+        im = random_image( type, kcol + rand( ) % 150, krow + rand( ) % 300,
+                           maxvals[ t % 4 ] );
+        ref = copy_image( im );
+
+        k = fl_get_matrix( krow, kcol, sizeof **k );
+        random_kernel( k, krow, kcol, sep );
+
+        flimage_set_max_threads( t % 5 );
+        ref_convolve( ref, k, krow, kcol );
+        flimage_convolve( im, k, krow, kcol );
+
+        if ( ! same_image( im, ref ) )
+        {
+            fprintf( stderr, "mismatch: %s %dx%d, %s %dx%d kernel\n",
+                     type == FL_IMAGE_RGB ? "RGB" : "gray", im->w, im->h,
+                     sep ? "separable" : "general", krow, kcol );
+            failed++;
+        }
+
+        fl_free_matrix( k );
+        flimage_free( ref );
+        flimage_free( im );
+    }
+
+    printf( "comparison with reference: %d of %d failed\n", failed,
+            NUM_TESTS );
+    return failed;
+}
+
+
+/***************************************
+ * Prints the throughput for one kind of image and kernel
+ ***************************************/
+
+static void
+bench_one( FL_IMAGE   * im,
+           const char * name,
+           int       ** k,
+           int          krow,
+           int          kcol,
+           int          threads )
+{
+    double t;
+
+    flimage_set_max_threads( threads );
+
+    if ( threads == 0 )
+    {
+        t = now( );
+        old_convolve3x3( im, k );
+        t = now( ) - t;
+    }
+    else
+    {
+        t = now( );
+        flimage_convolve( im, k, krow, kcol );
+        t = now( ) - t;
+    }
+
+    printf( "%-5s %-14s %-4s %7d %10.3f %10.1f\n",
+            IS_GRAY( im->type ) ? "gray" : "RGB", name,
+            threads ? "new" : "old", FL_max( threads, 1 ), t,
+            1.0e-6 * im->w * im->h / t );
+    fflush( stdout );
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+bench( int size )
+{
+    static int binomial[ ] = { 1, 4, 6, 4, 1 };
+    int **sharpen = fl_get_matrix( 3, 3, sizeof **sharpen );
+    int **sep = fl_get_matrix( 5, 5, sizeof **sep );
+    int **gen = fl_get_matrix( 5, 5, sizeof **gen );
+    FL_IMAGE *im[ 2 ];
+    int i,
+        j,
+        n;
+
+    for ( i = 0; i < 9; i++ )
+        sharpen[ 0 ][ i ] = -1;
+    sharpen[ 1 ][ 1 ] = 9;
+
+    for ( i = 0; i < 5; i++ )
+        for ( j = 0; j < 5; j++ )
+        {
+            sep[ i ][ j ] = binomial[ i ] * binomial[ j ];
+            gen[ i ][ j ] = -1;
+        }
+    gen[ 2 ][ 2 ] = 25;
+
+    im[ 0 ] = random_image( FL_IMAGE_GRAY16, size, size, 65535 );
+    im[ 1 ] = random_image( FL_IMAGE_RGB, size, size, 0 );
+
+    printf( "%d x %d pixels\n", size, size );
+    printf( "%-5s %-14s %-4s %7s %10s %10s\n", "image", "kernel", "code",
+            "threads", "seconds", "Mpixel/s" );
+
+    for ( i = 0; i < 2; i++ )
+    {
+        bench_one( im[ i ], "3x3", sharpen, 3, 3, 0 );
+
+        for ( n = 1; n <= 8; n *= 2 )
+        {
+            bench_one( im[ i ], "3x3", sharpen, 3, 3, n );
+            bench_one( im[ i ], "5x5 separable", sep, 5, 5, n );
+            bench_one( im[ i ], "5x5 general", gen, 5, 5, n );
+        }
+    }
+
+    flimage_free( im[ 0 ] );
+    flimage_free( im[ 1 ] );
+    fl_free_matrix( sharpen );
+    fl_free_matrix( sep );
+    fl_free_matrix( gen );
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+    static FLIMAGE_SETUP setup;
+    int failed;
+
+    setup.visual_cue = noop;
+    flimage_setup( &setup );
+
+    srand( 1 );
+
+    if ( argc > 1 && ! strcmp( argv[ 1 ], "-bench" ) )
+    {
+        bench( argc > 2 ? atoi( argv[ 2 ] ) : 4096 );
+        return 0;
+    }
+
+    failed = test_old( ) + test_ref( );
+
+    return failed ? 1 : 0;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
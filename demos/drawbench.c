@@ -0,0 +1,244 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Counts the X requests needed for redrawing forms and measures the time
+ * per frame. Rectangles, lines and polygons drawn while a form gets
+ * redrawn are collected and sent in batches of the same kind and color,
+ * so redrawing a complete form should need far fewer requests than
+ * redrawing its objects one by one. Forms with
+ *   - boxes of different styles and colors,
+ *   - the same boxes with labels on every other row (text can't be
+ *     batched),
+ *   - an xyplot with tics, a grid and 300 points and
+ *   - boxes with free objects in between (whose drawing isn't batched
+ *     since it may mix our functions with direct Xlib calls)
+ * are tested. The requests per redraw of the form, the requests for
+ * redrawing all objects one by one and the time per frame are printed.
+ *
+ *   usage: drawbench [frames]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "include/forms.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define COLS  20
+#define ROWS  20
+#define BW    30
+#define BH    20
+
+static const int boxtypes[ ] = { FL_UP_BOX, FL_DOWN_BOX, FL_FRAME_BOX,
+                                 FL_BORDER_BOX, FL_EMBOSSED_BOX,
+                                 FL_SHADOW_BOX, FL_ROUNDED_BOX,
+                                 FL_FLAT_BOX };
+static const FL_COLOR boxcols[ ] = { FL_COL1, FL_MCOL, FL_SLATEBLUE,
+                                     FL_COL1 };
+
+
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ * Handler for the free objects, drawing a small bar diagram
+ ***************************************/
+
+static int
+free_handler( FL_OBJECT * obj,
+              int         event,
+              FL_Coord    mx   FL_UNUSED_ARG,
+              FL_Coord    my   FL_UNUSED_ARG,
+              int         key  FL_UNUSED_ARG,
+              void      * ev   FL_UNUSED_ARG )
+{
+    int i;
+
+    if ( event != FL_DRAW )
+        return 0;
+
+    fl_rectbound( obj->x, obj->y, obj->w, obj->h, FL_WHITE );
+    for ( i = 0; i < 4; i++ )
+        fl_rectf( obj->x + 2 + i * ( obj->w - 4 ) / 4,
+                  obj->y + obj->h - 2 - ( i + 1 ) * ( obj->h - 4 ) / 4,
+                  ( obj->w - 4 ) / 4 - 1, ( i + 1 ) * ( obj->h - 4 ) / 4,
+                  FL_RED );
+    fl_line( obj->x + 2, obj->y + obj->h / 2, obj->x + obj->w - 3,
+             obj->y + obj->h / 2, FL_BLACK );
+    return 0;
+}
+
+
+/***************************************
+ * Creates the form for one of the tests
+ ***************************************/
+
+static FL_FORM *
+make_form( int test )
+{
+    FL_FORM *form;
+    FL_OBJECT *obj;
+    int i,
+        j;
+
+    form = fl_bgn_form( FL_FLAT_BOX, COLS * BW + 20, ROWS * BH + 20 );
+
+    if ( test == 2 )
+    {
+        float x[ 300 ],
+              y[ 300 ];
+
+        for ( i = 0; i < 300; i++ )
+        {
+            x[ i ] = i;
+            y[ i ] = rand( ) % 100;
+        }
+
+        obj = fl_add_xyplot( FL_NORMAL_XYPLOT, 10, 10, COLS * BW,
+                             ROWS * BH, "" );
+        fl_set_xyplot_xgrid( obj, FL_GRID_MINOR );
+        fl_set_xyplot_ygrid( obj, FL_GRID_MAJOR );
+        fl_set_xyplot_data( obj, x, y, 300, "", "", "" );
+    }
+    else
+        for ( j = 0; j < ROWS; j++ )
+            for ( i = 0; i < COLS; i++ )
+            {
+                FL_Coord x = 10 + i * BW,
+                         y = 10 + j * BH;
+
+                if ( test == 3 && ( i + j ) % 10 == 0 )
+                {
+                    fl_add_free( FL_NORMAL_FREE, x + 2, y + 2, BW - 4,
+                                 BH - 4, "", free_handler );
+                    continue;
+                }
+
+                obj = fl_add_box( boxtypes[ ( i + j ) % 8 ], x + 2, y + 2,
+                                  BW - 4, BH - 4,
+                                  test == 1 && j % 2 ? "ab" : "" );
+                fl_set_object_color( obj, boxcols[ ( i * j ) % 4 ], FL_COL1 );
+                fl_set_object_bw( obj, ( i + j ) % 2 ? 1 : -2 );
+            }
+
+    fl_end_form( );
+
+    return form;
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+    static const char *names[ ] = { "boxes", "boxes with labels",
+                                    "xyplot", "boxes and free objects" };
+    Display *dpy;
+    FL_FORM *form;
+    FL_OBJECT *obj;
+    unsigned long form_req,
+                  obj_req;
+    int frames = 200,
+        test,
+        i;
+    double t;
+
+    fl_initialize( &argc, argv, 0, 0, 0 );
+    dpy = fl_get_display( );
+
+    if ( argc > 1 && ( frames = atoi( argv[ 1 ] ) ) < 1 )
+    {
+        fprintf( stderr, "usage: %s [frames]\n", argv[ 0 ] );
+        return 1;
+    }
+
+    srand( 1 );
+
+    printf( "%-24s %14s %14s %10s\n", "", "requests/form",
+            "one by one", "ms/frame" );
+
+    for ( test = 0; test < 4; test++ )
+    {
+        form = make_form( test );
+        fl_show_form( form, FL_PLACE_CENTER, FL_FULLBORDER, "draw benchmark" );
+        XSync( dpy, False );
+        while ( XPending( dpy ) )
+            fl_check_forms( );
+
+        /* Requests for a redraw of the complete form */
+
+        form_req = XNextRequest( dpy );
+        fl_redraw_form( form );
+        form_req = XNextRequest( dpy ) - form_req;
+        XSync( dpy, False );
+
+        /* Requests for redrawing all objects, each on its own (except the
+           forms background box, which would redraw everything on top) */
+
+        obj_req = XNextRequest( dpy );
+        for ( obj = form->first->next; obj; obj = obj->next )
+            fl_redraw_object( obj );
+        obj_req = XNextRequest( dpy ) - obj_req;
+        XSync( dpy, False );
+
+        t = now( );
+        for ( i = 0; i < frames; i++ )
+        {
+            fl_redraw_form( form );
+            XSync( dpy, False );
+        }
+        t = now( ) - t;
+
+        printf( "%-24s %14lu %14lu %10.3f\n", names[ test ], form_req,
+                obj_req, 1.0e3 * t / frames );
+        fflush( stdout );
+
+        fl_hide_form( form );
+        fl_free_form( form );
+    }
+
+    fl_finish( );
+    return 0;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,323 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Benchmark for reading single planes of a large FITS data cube
+ * (doesn't need a display). A cube of 64 planes of 4096x4096 16 bit
+ * pixels (2 GB) is written to a temporary file, unless the name of an
+ * existing FITS file is given. Then the times for opening it and
+ * reading the first plane, for jumping to the middle and the last
+ * plane and for stepping through some planes one after the other are
+ * printed. For comparison, the time for just reading all data up to
+ * the middle plane with fread() is printed as well - that's what had
+ * to be done at least before planes could be reached directly.
+ * Where possible the file's pages are dropped from the cache before
+ * each step.
+ *
+ *   usage: fitsbench [width height planes | file]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "include/forms.h"
+#include "image/flimage.h"
+
+#define STEPS  8
+
+static const char *filename;
+static double t_start;
+
+
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+noop( FL_IMAGE   * im  FL_UNUSED_ARG,
+      const char * s   FL_UNUSED_ARG )
+{
+    return 0;
+}
+
+
+/***************************************
+ * Gets the file's pages out of the cache (if the system allows) and
+ * starts the clock
+ ***************************************/
+
+static void
+start( void )
+{
+#ifdef POSIX_FADV_DONTNEED
+    int fd = open( filename, O_RDONLY );
+
+    if ( fd >= 0 )
+    {
+        posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+        close( fd );
+    }
+#endif
+
+    t_start = now( );
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+report( const char * what,
+        double       bytes )
+{
+    double t = now( ) - t_start;
+
+    printf( "%-32s %9.3f s", what, t );
+    if ( bytes > 0 )
+        printf( "  %8.1f MB/s", 1.0e-6 * bytes / t );
+    putchar( '\n' );
+    fflush( stdout );
+}
+
+
+/***************************************
+ * Writes a FITS header card (padded to 80 characters)
+ ***************************************/
+
+static void
+card( FILE       * fp,
+      const char * key,
+      long         value )
+{
+    char buf[ 81 ];
+
+    if ( key )
+        sprintf( buf, "%-8s= %20ld", key, value );
+    else
+        strcpy( buf, "END" );
+
+    fprintf( fp, "%-80s", buf );
+}
+
+
+/***************************************
+ * Writes a cube of 16 bit pixels
+ ***************************************/
+
+static int
+write_cube( FILE * fp,
+            int    w,
+            int    h,
+            int    d )
+{
+    unsigned char *row = malloc( 2 * w );
+    long pos;
+    int i,
+        j,
+        k;
+
+    if ( ! row )
+        return -1;
+
+    fprintf( fp, "%-80s", "SIMPLE  =                    T" );
+    card( fp, "BITPIX", 16 );
+    card( fp, "NAXIS", 3 );
+    card( fp, "NAXIS1", w );
+    card( fp, "NAXIS2", h );
+    card( fp, "NAXIS3", d );
+    card( fp, "DATAMIN", 0 );
+    card( fp, "DATAMAX", 4095 );
+    card( fp, NULL, 0 );
+
+    for ( pos = ftell( fp ); pos % 2880; pos++ )
+        putc( ' ', fp );
+
+    for ( k = 0; k < d; k++ )
+        for ( j = 0; j < h; j++ )
+        {
+            for ( i = 0; i < w; i++ )
+            {
+                int v = ( i * 7 + j * 3 + k * 11 ) & 4095;
+
+                row[ 2 * i ]     = v >> 8;
+                row[ 2 * i + 1 ] = v;
+            }
+
+            fwrite( row, 2, w, fp );
+        }
+
+    for ( pos = ftell( fp ); pos % 2880; pos++ )
+        putc( 0, fp );
+
+    free( row );
+    return fclose( fp );
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+    static FLIMAGE_SETUP setup;
+    static char name[ ] = "/tmp/fitsbenchXXXXXX";
+    FL_IMAGE *im;
+    FILE *fp;
+    char buf[ 64 ];
+    double plane;
+    long n;
+    int w = 4096,
+        h = 4096,
+        d = 64,
+        fd,
+        i;
+
+    if ( argc == 2 )
+        filename = argv[ 1 ];
+    else if ( argc == 4 )
+    {
+        w = atoi( argv[ 1 ] );
+        h = atoi( argv[ 2 ] );
+        d = atoi( argv[ 3 ] );
+    }
+
+    if ( argc == 3 || argc > 4 || w < 1 || h < 1 || d < 1 )
+    {
+        fprintf( stderr, "usage: %s [width height planes | file]\n",
+                 argv[ 0 ] );
+        return 1;
+    }
+
+    flimage_enable_fits( );
+    setup.visual_cue = noop;
+    setup.max_frames = 1;
+    flimage_setup( &setup );
+
+    if ( ! filename )
+    {
+        if ( ( fd = mkstemp( name ) ) < 0 || ! ( fp = fdopen( fd, "wb" ) ) )
+        {
+            perror( "fitsbench" );
+            return 1;
+        }
+
+        filename = name;
+        printf( "writing %dx%dx%d cube (%.2f GB)\n", w, h, d,
+                2.0e-9 * w * h * d );
+        fflush( stdout );
+
+        if ( write_cube( fp, w, h, d ) )
+        {
+            perror( name );
+            unlink( name );
+            return 1;
+        }
+    }
+
+    start( );
+
+    if ( ! ( im = flimage_open( filename ) ) || ! flimage_read( im ) )
+    {
+        fprintf( stderr, "can't read %s\n", filename );
+        if ( filename == name )
+            unlink( name );
+        return 1;
+    }
+
+    plane = 2.0 * im->w * im->h;
+    report( "open and read first plane", plane );
+
+    d = im->total_frames;
+    printf( "%d plane(s) of %dx%d\n", d, im->w, im->h );
+
+    if ( d > 1 && im->random_frame )
+    {
+        start( );
+        im->random_frame( im, ( d + 1 ) / 2 );
+        sprintf( buf, "jump to plane %d", ( d + 1 ) / 2 );
+        report( buf, plane );
+
+        start( );
+        im->random_frame( im, d );
+        sprintf( buf, "jump to plane %d", d );
+        report( buf, plane );
+
+        im->random_frame( im, 1 );
+        start( );
+        for ( i = 1; i < STEPS && i < d; i++ )
+            im->next_frame( im );
+        sprintf( buf, "step through %d planes", i - 1 );
+        report( buf, plane * ( i - 1 ) );
+
+        /* What reaching the middle plane costs at least when all data
+           before it have to be read */
+
+        if ( ( fp = fopen( filename, "rb" ) ) )
+        {
+            char *data = malloc( 1 << 20 );
+
+            start( );
+            for ( n = 0; n < ( d + 1 ) / 2 * plane; n += 1 << 20 )
+                if ( fread( data, 1, 1 << 20, fp ) == 0 )
+                    break;
+            report( "fread() up to middle plane", n );
+
+            free( data );
+            fclose( fp );
+        }
+    }
+
+    flimage_free( im );
+
+    if ( filename == name )
+        unlink( name );
+
+    return 0;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,254 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Benchmark for forms with very many objects, like large dashboards.
+ * A form with 10000 objects (by default) is built: a raster of boxes,
+ * buttons and text fields with a few frames and large boxes lying
+ * across them. Then the times for
+ *   - creating and showing the form,
+ *   - redrawing it completely,
+ *   - redrawing single objects,
+ *   - redrawing small exposed areas (as when a window on top of the
+ *     form gets moved),
+ *   - finding the object under the mouse (the pointer is warped to
+ *     random positions and the resulting events are handled),
+ *   - moving objects and
+ *   - deleting objects
+ * are printed. All of these should depend on the size of the area
+ * involved, not the number of objects in the form.
+ *
+ *   usage: formbench [objects]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "include/forms.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define COLS     100
+#define CW       16
+#define CH       12
+#define REPEATS  1000
+
+static FL_FORM *form;
+static FL_OBJECT **objs;
+static int nobjs;
+
+
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ * Handles all events that are already there or still come in
+ ***************************************/
+
+static void
+handle_events( void )
+{
+    XSync( fl_get_display( ), False );
+    while ( XPending( fl_get_display( ) ) )
+        fl_check_forms( );
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+report( const char * what,
+        double       t,
+        int          n )
+{
+    if ( n > 1 )
+        printf( "%-36s %10.3f ms  (%d times)\n", what, 1.0e3 * t / n, n );
+    else
+        printf( "%-36s %10.3f ms\n", what, 1.0e3 * t );
+    fflush( stdout );
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+    Display *dpy;
+    FL_Coord w,
+             h;
+    double t;
+    char label[ 32 ];
+    int i;
+
+    fl_initialize( &argc, argv, 0, 0, 0 );
+    dpy = fl_get_display( );
+
+    nobjs = argc > 1 ? atoi( argv[ 1 ] ) : 10000;
+
+    if ( nobjs < COLS )
+    {
+        fprintf( stderr, "usage: %s [objects]\n", argv[ 0 ] );
+        return 1;
+    }
+
+    objs = malloc( nobjs * sizeof *objs );
+    w = COLS * CW;
+    h = ( nobjs + COLS - 1 ) / COLS * CH;
+
+    srand( 1 );
+
+    t = now( );
+
+    form = fl_bgn_form( FL_UP_BOX, w, h );
+
+    for ( i = 0; i < nobjs; i++ )
+    {
+        FL_Coord x = i % COLS * CW,
+                 y = i / COLS * CH;
+
+        if ( i % 500 == 250 )           /* something lying across others */
+            objs[ i ] = fl_add_frame( FL_ENGRAVED_FRAME, x, y, 8 * CW,
+                                      4 * CH, "" );
+        else if ( i % 500 == 499 )
+            objs[ i ] = fl_add_box( FL_BORDER_BOX, x - 3 * CW, y - 2 * CH,
+                                    3 * CW, 2 * CH, "" );
+        else if ( i % 3 == 0 )
+        {
+            sprintf( label, "%d", i );
+            objs[ i ] = fl_add_text( FL_NORMAL_TEXT, x, y, CW, CH, label );
+            fl_set_object_lsize( objs[ i ], FL_TINY_SIZE );
+        }
+        else if ( i % 3 == 1 )
+            objs[ i ] = fl_add_button( FL_NORMAL_BUTTON, x, y, CW, CH, "" );
+        else
+            objs[ i ] = fl_add_box( FL_UP_BOX, x, y, CW, CH, "" );
+    }
+
+    fl_end_form( );
+    report( "create form", now( ) - t, 1 );
+
+    t = now( );
+    fl_show_form( form, FL_PLACE_CENTER, FL_FULLBORDER, "Form benchmark" );
+    handle_events( );
+    report( "show form", now( ) - t, 1 );
+
+    t = now( );
+    for ( i = 0; i < 5; i++ )
+    {
+        fl_redraw_form( form );
+        XSync( dpy, False );
+    }
+    report( "redraw form", now( ) - t, 5 );
+
+    t = now( );
+    for ( i = 0; i < REPEATS; i++ )
+    {
+        fl_redraw_object( objs[ rand( ) % nobjs ] );
+        XSync( dpy, False );
+    }
+    report( "redraw an object", now( ) - t, REPEATS );
+
+    /* Make the X server send expose events for small areas */
+
+    t = now( );
+    for ( i = 0; i < REPEATS; i++ )
+    {
+        XClearArea( dpy, form->window, rand( ) % w, rand( ) % h, 50, 50,
+                    True );
+        handle_events( );
+    }
+    report( "redraw an exposed 50x50 area", now( ) - t, REPEATS );
+
+    /* Mouse movements, each resulting in a search for the object under
+       the mouse (and the highlighting of buttons entered and left) */
+
+    t = now( );
+    for ( i = 0; i < REPEATS; i++ )
+    {
+        XWarpPointer( dpy, None, form->window, 0, 0, 0, 0, rand( ) % w,
+                      rand( ) % h );
+        handle_events( );
+    }
+    report( "move the mouse", now( ) - t, REPEATS );
+
+    /* Moving objects, without and with drawing */
+
+    fl_freeze_form( form );
+    t = now( );
+    for ( i = 0; i < REPEATS; i++ )
+        fl_set_object_position( objs[ rand( ) % nobjs ], rand( ) % w,
+                                rand( ) % h );
+    report( "move an object, form frozen", now( ) - t, REPEATS );
+
+    t = now( );
+    fl_unfreeze_form( form );
+    XSync( dpy, False );
+    report( "unfreeze form", now( ) - t, 1 );
+
+    t = now( );
+    for ( i = 0; i < REPEATS; i++ )
+    {
+        fl_set_object_position( objs[ rand( ) % nobjs ], rand( ) % w,
+                                rand( ) % h );
+        XSync( dpy, False );
+    }
+    report( "move an object", now( ) - t, REPEATS );
+
+    /* Deleting objects, back to front */
+
+    t = now( );
+    for ( i = 0; i < REPEATS && i < nobjs; i++ )
+    {
+        fl_delete_object( objs[ nobjs - 1 - i ] );
+        XSync( dpy, False );
+        fl_free_object( objs[ nobjs - 1 - i ] );
+    }
+    report( "delete an object", now( ) - t, i );
+
+    fl_hide_form( form );
+    fl_free_form( form );
+    free( objs );
+    fl_finish( );
+    return 0;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,760 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Round trip test and benchmark for reading and writing GIF files
+ * (doesn't need a display).
+ *
+ * Without arguments colormapped images of various sizes, numbers of
+ * colors and contents (runs, noise and a mix of both) are written with
+ * flimage_dump(), plain and interlaced, as well as a few multi-frame
+ * images with frames that do and don't fit the first frame's colormap.
+ * Each file is
+ *   - decoded by the simple (independent) GIF decoder below, and the
+ *     colors of all pixels of all frames must be those of the image,
+ *   - read back with flimage_load(), and again all colors must match,
+ *   - written out again from what was read, and the new file must be
+ *     identical, byte by byte, to the first one.
+ *
+ * With "-bench [size]" the times for writing and reading a plot-like
+ * and a noisy image (2048x2048 by default) and a 20 frame animation of
+ * the plot are printed.
+ *
+ *   usage: giftest [-bench [size]]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "include/forms.h"
+#include "image/flimage.h"
+
+#define MAX_FRAMES  20
+
+static char file1[ ] = "/tmp/giftest1XXXXXX";
+static char file2[ ] = "/tmp/giftest2XXXXXX";
+
+
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+noop( FL_IMAGE   * im  FL_UNUSED_ARG,
+      const char * s   FL_UNUSED_ARG )
+{
+    return 0;
+}
+
+
+/***************************************
+ * Creates a colormapped image with 'ncolors' colors (starting at
+ * color 'first' of a fixed palette). 'kind' 0 gives long runs, 1 noise
+ * and 2 a mix of both.
+ ***************************************/
+
+static FL_IMAGE *
+make_image( int w,
+            int h,
+            int ncolors,
+            int first,
+            int kind )
+{
+    FL_IMAGE *im = flimage_alloc( );
+    int i,
+        x,
+        y;
+
+    im->type = FL_IMAGE_CI;
+    im->w = w;
+    im->h = h;
+    im->map_len = ncolors;
+    flimage_getmem( im );
+
+    for ( i = 0; i < ncolors; i++ )
+    {
+        int c = first + i;
+
+        im->red_lut[ i ]   = ( c * 37 ) & 255;
+        im->green_lut[ i ] = ( c * 101 + 17 ) & 255;
+        im->blue_lut[ i ]  = ( c * 13 + c / 16 ) & 255;
+    }
+
+    for ( y = 0; y < h; y++ )
+        for ( x = 0; x < w; x++ )
+        {
+            int noisy =    kind == 1
+                        || ( kind == 2 && ( y / 8 + x / 50 ) % 3 == 0 );
+
+            im->ci[ y ][ x ] = ( noisy ? rand( ) : x / 13 + y / 7 ) % ncolors;
+        }
+
+    return im;
+}
+
+
+/***************************************
+ * Creates an RGB image looking like a plot (or, if 'noise' is set,
+ * with lots of noise) and converts it to a colormapped one
+ ***************************************/
+
+static FL_IMAGE *
+make_plot( int n,
+           int frame,
+           int noise )
+{
+    FL_IMAGE *im = flimage_alloc( );
+    int x,
+        y,
+        d;
+
+    im->type = FL_IMAGE_RGB;
+    im->w = im->h = n;
+    flimage_getmem( im );
+
+    for ( y = 0; y < n; y++ )
+        for ( x = 0; x < n; x++ )
+        {
+            int grid = x % 64 == 0 || y % 64 == 0;
+
+            im->red[ y ][ x ]   = noise ? rand( ) : grid ? 200 : 250;
+            im->green[ y ][ x ] = noise ? x * y : grid ? 200 : 250;
+            im->blue[ y ][ x ]  = noise ? x + y : grid ? 200 : 240;
+        }
+
+    for ( x = 0; x < n; x++ )
+    {
+        int y1 = n / 2 + n / 3 * sin( ( x + frame * 10 ) / 50.0 ),
+            y2 = n / 2 + n / 4 * cos( ( x - frame * 7 ) / 30.0 );
+
+        for ( d = -1; d <= 1; d++ )
+        {
+            im->red[ y1 + d ][ x ]   = 255;
+            im->green[ y1 + d ][ x ] = im->blue[ y1 + d ][ x ] = 0;
+            im->red[ y2 + d ][ x ]   = im->green[ y2 + d ][ x ] = 0;
+            im->blue[ y2 + d ][ x ]  = 255;
+        }
+    }
+
+    flimage_convert( im, FL_IMAGE_CI, 256 );
+    return im;
+}
+
+
+/***************************************
+ * Returns the color of a pixel of a colormapped image
+ ***************************************/
+
+static unsigned int
+color_of( FL_IMAGE * im,
+          int        x,
+          int        y )
+{
+    int c = im->ci[ y ][ x ];
+
+    return FL_PACK3( im->red_lut[ c ], im->green_lut[ c ], im->blue_lut[ c ] );
+}
+
+
+/*********************************************************************
+ * A simple GIF decoder, written straight from the specification
+ *********************************************************************/
+
+typedef struct {
+    const unsigned char * p,
+                        * end;
+    int                   left;     /* bytes left in the data sub-block */
+    unsigned long         bits;
+    int                   nbits;
+} BITS;
+
+
+/***************************************
+ * Returns the next code of 'size' bits, -1 at the end of the data
+ ***************************************/
+
+static int
+next_code( BITS * b,
+           int    size )
+{
+    int code;
+
+    while ( b->nbits < size )
+    {
+        if ( ! b->left )
+        {
+            if ( b->p >= b->end || ! ( b->left = *b->p++ ) )
+                return -1;
+        }
+
+        if ( b->p >= b->end )
+            return -1;
+
+        b->bits |= ( unsigned long ) *b->p++ << b->nbits;
+        b->nbits += 8;
+        b->left--;
+    }
+
+    code = b->bits & ( ( 1 << size ) - 1 );
+    b->bits >>= size;
+    b->nbits -= size;
+    return code;
+}
+
+
+/***************************************
+ * Decodes the LZW data at 'p' into 'out' ('n' pixels), returns a
+ * pointer to behind the data or NULL on errors
+ ***************************************/
+
+static const unsigned char *
+lzw_decode( const unsigned char * p,
+            const unsigned char * end,
+            unsigned char       * out,
+            long                  n )
+{
+    static unsigned short prefix[ 4096 ];
+    static unsigned char suffix[ 4096 ],
+                         stack[ 4097 ];
+    BITS b;
+    int min_size = *p++,
+        clear = 1 << min_size,
+        size = min_size + 1,
+        next = clear + 2,
+        old = -1,
+        first = 0,
+        code;
+    long done = 0;
+
+    if ( min_size < 2 || min_size > 8 )
+        return NULL;
+
+    b.p = p;
+    b.end = end;
+    b.left = 0;
+    b.bits = 0;
+    b.nbits = 0;
+
+    while ( ( code = next_code( &b, size ) ) >= 0 && code != clear + 1 )
+    {
+        int in = code,
+            sp = 0;
+
+        if ( code == clear )
+        {
+            size = min_size + 1;
+            next = clear + 2;
+            old = -1;
+            continue;
+        }
+
+        if ( old < 0 )
+        {
+            if ( code >= clear || done >= n )
+                return NULL;
+            out[ done++ ] = first = code;
+            old = code;
+            continue;
+        }
+
+        if ( code > next )
+            return NULL;
+
+        if ( code == next )
+        {
+            stack[ sp++ ] = first;
+            code = old;
+        }
+
+        while ( code > clear )
+        {
+            stack[ sp++ ] = suffix[ code ];
+            code = prefix[ code ];
+        }
+
+        stack[ sp++ ] = first = code;
+
+        if ( done + sp > n )
+            return NULL;
+
+        while ( sp > 0 )
+            out[ done++ ] = stack[ --sp ];
+
+        if ( next < 4096 )
+        {
+            prefix[ next ] = old;
+            suffix[ next ] = first;
+            if ( ++next == 1 << size && size < 12 )
+                size++;
+        }
+
+        old = in;
+    }
+
+    if ( code < 0 || done != n )
+        return NULL;
+
+    /* Skip what's left of the data sub-blocks */
+
+    p = b.p + b.left;
+    while ( p < end && *p )
+        p += *p + 1;
+
+    return p < end ? p + 1 : NULL;
+}
+
+
+/***************************************
+ * Returns the row in the image of the n-th row stored in the file
+ ***************************************/
+
+static int
+interlaced_row( int n,
+                int h )
+{
+    static const int start[ ] = { 0, 4, 2, 1 },
+                     step[ ]  = { 8, 8, 4, 2 };
+    int pass;
+
+    for ( pass = 0; pass < 4; pass++ )
+    {
+        int rows = ( h - start[ pass ] + step[ pass ] - 1 ) / step[ pass ];
+
+        if ( n < rows )
+            return start[ pass ] + n * step[ pass ];
+        n -= rows;
+    }
+
+    return -1;
+}
+
+
+/***************************************
+ * Decodes the file and compares the colors of all frames with those of
+ * the images, returns the number of frames found or -1 on errors
+ ***************************************/
+
+static int
+check_file( const char * name,
+            FL_IMAGE   * im )
+{
+    FILE *fp = fopen( name, "rb" );
+    unsigned char *data,
+                  *pixels = NULL;
+    const unsigned char *p,
+                        *end,
+                        *gmap = NULL,
+                        *map;
+    long size;
+    int frames = 0,
+        ok = 1;
+
+    if ( ! fp )
+        return -1;
+
+    fseek( fp, 0, SEEK_END );
+    size = ftell( fp );
+    rewind( fp );
+    data = malloc( size );
+    size = fread( data, 1, size, fp );
+    fclose( fp );
+
+    p = data;
+    end = data + size;
+
+    if (    size < 13
+         || ( memcmp( p, "GIF89a", 6 ) && memcmp( p, "GIF87a", 6 ) ) )
+        ok = 0;
+    else
+    {
+        if ( p[ 10 ] & 0x80 )
+            gmap = p + 13;
+        p += 13 + ( p[ 10 ] & 0x80 ? 3 << ( ( p[ 10 ] & 7 ) + 1 ) : 0 );
+    }
+
+    while ( ok && p < end && *p != ';' )
+    {
+        if ( *p == '!' )                    /* extension */
+        {
+            for ( p += 2; p < end && *p; p += *p + 1 )
+                /* empty */ ;
+            p++;
+        }
+        else if ( *p == ',' && p + 10 <= end )
+        {
+            int w = p[ 5 ] | p[ 6 ] << 8,
+                h = p[ 7 ] | p[ 8 ] << 8,
+                flags = p[ 9 ],
+                x,
+                y;
+
+            map = flags & 0x80 ? p + 10 : gmap;
+            p += 10 + ( flags & 0x80 ? 3 << ( ( flags & 7 ) + 1 ) : 0 );
+
+            pixels = realloc( pixels, ( size_t ) w * h );
+
+            if (    ! im || ! map || p >= end
+                 || w != im->w || h != im->h
+                 || ! ( p = lzw_decode( p, end, pixels, ( long ) w * h ) ) )
+            {
+                ok = 0;
+                break;
+            }
+
+            for ( y = 0; y < h && ok; y++ )
+            {
+                int row = flags & 0x40 ? interlaced_row( y, h ) : y;
+
+                for ( x = 0; x < w && ok; x++ )
+                {
+                    const unsigned char *c = map + 3 * pixels[ y * w + x ];
+
+                    ok =    ( unsigned int ) FL_PACK3( c[ 0 ], c[ 1 ], c[ 2 ] )
+                         == color_of( im, x, row );
+                }
+            }
+
+            im = im->next;
+            frames++;
+        }
+        else
+            ok = 0;
+    }
+
+    ok = ok && p < end;
+
+    free( pixels );
+    free( data );
+
+    return ok ? frames : -1;
+}
+
+
+/*********************************************************************
+ * The tests
+ *********************************************************************/
+
+/***************************************
+ * Returns if the two files have identical contents
+ ***************************************/
+
+static int
+same_files( const char * name1,
+            const char * name2 )
+{
+    FILE *fp1 = fopen( name1, "rb" ),
+         *fp2 = fopen( name2, "rb" );
+    int c1 = 0,
+        c2 = 0;
+
+    if ( fp1 && fp2 )
+        do
+        {
+            c1 = getc( fp1 );
+            c2 = getc( fp2 );
+        } while ( c1 == c2 && c1 != EOF );
+
+    if ( fp1 )
+        fclose( fp1 );
+    if ( fp2 )
+        fclose( fp2 );
+
+    return fp1 && fp2 && c1 == c2;
+}
+
+
+/***************************************
+ * Does the round trip for an image (with all its frames), returns 0 on
+ * success
+ ***************************************/
+
+static int
+round_trip( FL_IMAGE   * im,
+            const char * what )
+{
+    FL_IMAGE *ld,
+             *a,
+             *b;
+    int frames = 0,
+        x,
+        y;
+    const char *err = NULL;
+
+    for ( a = im; a; a = a->next )
+        frames++;
+
+    if ( flimage_dump( im, file1, "gif" ) < 0 )
+        err = "writing failed";
+    else if ( check_file( file1, im ) != frames )
+        err = "wrong pixels in file";
+    else if ( ! ( ld = flimage_load( file1 ) ) )
+        err = "reading failed";
+    else
+    {
+        for ( a = im, b = ld; a && b && ! err; a = a->next, b = b->next )
+        {
+            if ( a->w != b->w || a->h != b->h )
+                err = "wrong size after reading";
+
+            for ( y = 0; y < a->h && ! err; y++ )
+                for ( x = 0; x < a->w && ! err; x++ )
+                    if ( color_of( a, x, y ) != color_of( b, x, y ) )
+                        err = "wrong pixels after reading";
+        }
+
+        if ( ! err && ( a || b ) )
+            err = "wrong number of frames after reading";
+        else if ( ! err && flimage_dump( ld, file2, "gif" ) < 0 )
+            err = "writing again failed";
+        else if ( ! err && ! same_files( file1, file2 ) )
+            err = "file differs after writing again";
+
+        flimage_free( ld );
+    }
+
+    if ( err )
+        printf( "%s: %s\n", what, err );
+
+    return err != NULL;
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+test( void )
+{
+    static const int sizes[ ][ 2 ] = { { 1, 1 }, { 7, 3 }, { 37, 23 },
+                                       { 300, 200 } };
+    static const int colors[ ] = { 2, 4, 16, 100, 256 };
+    static const char *kinds[ ] = { "runs", "noise", "mixed" };
+    FL_IMAGE *im,
+             *f;
+    char what[ 128 ];
+    int failures = 0,
+        count = 0,
+        s,
+        c,
+        k,
+        il;
+
+    for ( il = 0; il < 2; il++ )
+    {
+        flimage_gif_output_options( il );
+
+        for ( s = 0; s < 4; s++ )
+            for ( c = 0; c < 5; c++ )
+                for ( k = 0; k < 3; k++, count++ )
+                {
+                    im = make_image( sizes[ s ][ 0 ], sizes[ s ][ 1 ],
+                                     colors[ c ], 0, k );
+                    sprintf( what, "%dx%d, %d colors, %s%s",
+                             im->w, im->h, colors[ c ], kinds[ k ],
+                             il ? ", interlaced" : "" );
+                    failures += round_trip( im, what );
+                    flimage_free( im );
+                }
+
+        /* Multi-frame images: the second frame only uses colors of the
+           first one, the third one needs a local colormap */
+
+        for ( c = 0; c < 5; c++, count++ )
+        {
+            im = make_image( 64, 48, colors[ c ], 0, 2 );
+            f = im->next = make_image( 64, 48, FL_max( colors[ c ] / 2, 2 ),
+                                       0, 1 );
+            f->next = make_image( 64, 48, colors[ c ], 7, 0 );
+
+            sprintf( what, "3 frames, %d colors%s", colors[ c ],
+                     il ? ", interlaced" : "" );
+            failures += round_trip( im, what );
+
+            while ( im )
+            {
+                f = im->next;
+                im->next = NULL;
+                flimage_free( im );
+                im = f;
+            }
+        }
+    }
+
+    flimage_gif_output_options( 0 );
+
+    printf( "%d of %d images failed\n", failures, count );
+    return failures;
+}
+
+
+/*********************************************************************
+ * The benchmark
+ *********************************************************************/
+
+static void
+bench_one( FL_IMAGE   * im,
+           const char * what )
+{
+    FL_IMAGE *ld;
+    double t_write,
+           t_read;
+    int frames = 0,
+        reps = 0;
+    FILE *fp;
+    long size = 0;
+
+    for ( ld = im; ld; ld = ld->next )
+        frames++;
+
+    t_write = now( );
+    do
+        flimage_dump( im, file1, "gif" );
+    while ( ++reps < 3 || now( ) - t_write < 1.0 );
+    t_write = ( now( ) - t_write ) / reps;
+
+    reps = 0;
+    t_read = now( );
+    do
+        flimage_free( flimage_load( file1 ) );
+    while ( ++reps < 3 || now( ) - t_read < 1.0 );
+    t_read = ( now( ) - t_read ) / reps;
+
+    if ( ( fp = fopen( file1, "rb" ) ) )
+    {
+        fseek( fp, 0, SEEK_END );
+        size = ftell( fp );
+        fclose( fp );
+    }
+
+    printf( "%-28s %9ld bytes  write %8.4f s  read %8.4f s"
+            "  (%.1f / %.1f Mpixel/s)\n", what, size, t_write, t_read,
+            1.0e-6 * frames * im->w * im->h / t_write,
+            1.0e-6 * frames * im->w * im->h / t_read );
+    fflush( stdout );
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+bench( int n )
+{
+    FL_IMAGE *im,
+             *f;
+    char what[ 64 ];
+    int i;
+
+    im = make_plot( n, 0, 0 );
+    sprintf( what, "plot %dx%d", n, n );
+    bench_one( im, what );
+    flimage_free( im );
+
+    im = make_plot( n, 0, 1 );
+    sprintf( what, "noise %dx%d", n, n );
+    bench_one( im, what );
+    flimage_free( im );
+
+    n = FL_min( n, 512 );
+    im = f = make_plot( n, 0, 0 );
+    for ( i = 1; i < MAX_FRAMES; i++ )
+        f = f->next = make_plot( n, i, 0 );
+
+    sprintf( what, "%d frames plot %dx%d", MAX_FRAMES, n, n );
+    bench_one( im, what );
+
+    while ( im )
+    {
+        f = im->next;
+        im->next = NULL;
+        flimage_free( im );
+        im = f;
+    }
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+    static FLIMAGE_SETUP setup;
+    int fd1,
+        fd2,
+        failed = 0;
+
+    if ( ( fd1 = mkstemp( file1 ) ) < 0 || ( fd2 = mkstemp( file2 ) ) < 0 )
+    {
+        perror( "giftest" );
+        return 1;
+    }
+
+    close( fd1 );
+    close( fd2 );
+
+    setup.visual_cue = noop;
+    setup.max_frames = MAX_FRAMES;
+    setup.delay = 100;
+    setup.no_auto_extension = 1;
+    flimage_setup( &setup );
+    flimage_enable_gif( );
+
+    srand( 1 );
+
+    if ( argc > 1 && ! strcmp( argv[ 1 ], "-bench" ) )
+        bench( argc > 2 ? FL_max( atoi( argv[ 2 ] ), 16 ) : 2048 );
+    else
+        failed = test( );
+
+    unlink( file1 );
+    unlink( file2 );
+
+    return failed ? 1 : 0;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -19,12 +19,17 @@
 
 
 /*
- * Convert an image file using the image support of Forms Library.
+ * Convert image files using the image support of Forms Library.
  *
  *  Usage: iconvert [-version][-verbose][-help] inputimage outimage [fmt]
  *     output image format is determined by the extension or
  *     by fmt if present.
  *
+ *         iconvert [options] -outdir dir -fmt fmt inputimage ...
+ *     converts all input images into files with the same base name
+ *     in dir, with several threads working on different files at
+ *     the same time. See usage() for the options.
+ *
  *  Exit status:  0 (success) 1 (bad command line)  3 (conversion failed)
  *
  *  T.C. Zhao (03/1999)
@@ -36,15 +41,71 @@
 #endif
 
 #include <stdlib.h>
+#include <unistd.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 #include "include/forms.h"
 #include "image/flimage.h"
 
+#define MAX_JOBS  64
+
+/* What to do with each image in batch mode */
+
+typedef struct
+{
+    const char  * outdir;
+    const char  * fmt;
+    const char  * ext;          /* extension of output files */
+    int           jobs;
+    int           bench;
+    int           quiet;
+    int           scale_w,      /* scale to this size if > 0 */
+                  scale_h;
+    int           crop[ 4 ];    /* margins to cut off left, top,
+                                   right and bottom */
+    int        ** kernel;       /* convolve with it if not NULL */
+} OPTIONS;
+
+/* State shared by the threads working on a batch */
+
+typedef struct
+{
+    char * const   * files;
+    int              nfiles;
+    int              next;      /* next file to be handed out */
+    int              done;
+    int              failed;
+    int              report;    /* print progress */
+    double           pixels;    /* pixels read so far */
+    double           start,
+                     last_report;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_t  mutex;
+#endif
+} BATCH;
+
+typedef struct
+{
+    BATCH * batch;
+    int     index;
+} WORKER;
+
+static OPTIONS opt;
+
 static void initialize( void );
 static void usage( const char *,
                    int );
 static int parse_command_line( int *,
                                char ** );
+static int run_batch( char * const *,
+                      int,
+                      int,
+                      int );
+static void bench( char * const *,
+                   int );
 
 
 /***************************************
@@ -61,6 +122,23 @@ main( int    argc,
     initialize( );
     args = argv + parse_command_line( &argc, argv );
 
+    if ( opt.outdir || opt.bench )
+    {
+        if ( argc < 2 )
+        {
+            usage( argv[ 0 ], 1 );
+            exit( 1 );
+        }
+
+        if ( opt.bench )
+        {
+            bench( args + 1, argc - 1 );
+            return 0;
+        }
+
+        return run_batch( args + 1, argc - 1, opt.jobs, ! opt.quiet ) ? 3 : 0;
+    }
+
     if (   argc < 3 ||
          ! ( fmt = ( argc >= 4 ? args[ 3 ] : strrchr( args[ 2 ], '.' ) ) ) )
     {
@@ -87,8 +165,9 @@ usage( const char * cmd,
         i,
         k;
 
-    fprintf( stderr, "Usage: %s [-verbose][-help] infile outfile [fmt]\n",
-             cmd );
+    fprintf( stderr, "Usage: %s [-verbose][-help] infile outfile [fmt]\n"
+             "       %s [options] -outdir dir -fmt fmt infile ...\n",
+             cmd, cmd );
 
     if ( ! more )
        exit( 1 );
@@ -111,6 +190,20 @@ usage( const char * cmd,
     if ( k % 6 )
         fputc( '\n', stderr );
 
+    fputs( " Options for converting many files at once:\n"
+           "  -outdir dir      write the output files into dir\n"
+           "  -fmt fmt         output format (default: ppm)\n"
+           "  -jobs n          number of files converted at the same time\n"
+           "                   (default: one per processor)\n"
+           "  -crop l,t,r,b    cut off margins of the given widths\n"
+           "  -scale WxH       scale to W by H pixels\n"
+           "  -sharpen         sharpen the images\n"
+           "  -smooth          smooth the images\n"
+           "  -quiet           don't report progress\n"
+           "  -bench           measure the throughput for 1, 2, 4, ...\n"
+           "                   jobs, output files get thrown away\n",
+           stderr );
+
     exit( 1 );
 }
 
@@ -128,6 +221,60 @@ noop( FL_IMAGE   * im  FL_UNUSED_ARG,
 }
 
 
+/***************************************
+ * In batch mode errors are reported together with the file name
+ ***************************************/
+
+static void
+report_error( FL_IMAGE   * im,
+              const char * s )
+{
+    if ( s && *s )
+        fprintf( stderr, "\n%s: %s\n", im->infile, s );
+}
+
+
+/***************************************
+ * Returns the number of processors, or 1 if unknown
+ ***************************************/
+
+static int
+processors( void )
+{
+    int n = 1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+    n = sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+
+    return FL_clamp( n, 1, MAX_JOBS );
+}
+
+
+/***************************************
+ * Finds the extension for files of the format 'fmt'
+ ***************************************/
+
+static const char *
+format_extension( const char * fmt )
+{
+    const FLIMAGE_FORMAT_INFO *info;
+    int n = flimage_get_number_of_formats( ),
+        i;
+
+    for ( i = 1; i <= n; i++ )
+    {
+        info = flimage_get_format_info( i );
+        if (    ( info->read_write & FLIMAGE_WRITABLE )
+             && (    ! strcmp( info->short_name, fmt )
+                  || ! strcmp( info->extension, fmt ) ) )
+            return fl_strdup( info->extension );
+    }
+
+    return NULL;
+}
+
+
 /***************************************
  ***************************************/
 
@@ -139,6 +286,7 @@ parse_command_line( int  * argc,
     static FLIMAGE_SETUP setup;
 
     setup.visual_cue = noop;
+    opt.jobs = processors( );
 
     for ( i = 1; i < *argc && *argv[ i ] == '-'; )
     {
@@ -152,10 +300,75 @@ parse_command_line( int  * argc,
             usage( argv[ 0 ], 1 );
             i++;
         }
+        else if ( strncmp( argv[ i ], "-outd", 5 ) == 0 && i + 1 < *argc )
+        {
+            opt.outdir = argv[ i + 1 ];
+            i += 2;
+        }
+        else if ( strncmp( argv[ i ], "-fmt", 4 ) == 0 && i + 1 < *argc )
+        {
+            opt.fmt = argv[ i + 1 ];
+            i += 2;
+        }
+        else if ( strncmp( argv[ i ], "-j", 2 ) == 0 && i + 1 < *argc )
+        {
+            opt.jobs = FL_clamp( atoi( argv[ i + 1 ] ), 1, MAX_JOBS );
+            i += 2;
+        }
+        else if (    strncmp( argv[ i ], "-cr", 3 ) == 0
+                  && i + 1 < *argc
+                  && sscanf( argv[ i + 1 ], "%d,%d,%d,%d", opt.crop,
+                             opt.crop + 1, opt.crop + 2, opt.crop + 3 ) == 4 )
+            i += 2;
+        else if (    strncmp( argv[ i ], "-sc", 3 ) == 0
+                  && i + 1 < *argc
+                  && sscanf( argv[ i + 1 ], "%dx%d",
+                             &opt.scale_w, &opt.scale_h ) == 2
+                  && opt.scale_w > 0
+                  && opt.scale_h > 0 )
+            i += 2;
+        else if ( strncmp( argv[ i ], "-sh", 3 ) == 0 )
+        {
+            opt.kernel = FLIMAGE_SHARPEN;
+            i++;
+        }
+        else if ( strncmp( argv[ i ], "-sm", 3 ) == 0 )
+        {
+            opt.kernel = FLIMAGE_SMOOTH;
+            i++;
+        }
+        else if ( strncmp( argv[ i ], "-q", 2 ) == 0 )
+        {
+            opt.quiet = 1;
+            i++;
+        }
+        else if ( strncmp( argv[ i ], "-b", 2 ) == 0 )
+        {
+            opt.bench = 1;
+            i++;
+        }
         else
             usage( argv[ 0 ], 0 );
     }
 
+    if ( opt.outdir || opt.bench )
+    {
+        setup.visual_cue = noop;
+        setup.error_message = report_error;
+
+        if ( ! opt.fmt )
+            opt.fmt = "ppm";
+
+        if ( ! ( opt.ext = format_extension( opt.fmt ) ) )
+        {
+            fprintf( stderr, "%s: unknown output format %s\n",
+                     argv[ 0 ], opt.fmt );
+            exit( 1 );
+        }
+    }
+
+    /* All of the setup must be done before any threads get started */
+
     flimage_setup( &setup );
     *argc -= i - 1;
 
@@ -184,6 +397,308 @@ initialize( void )
 }
 
 
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ * Runs the crop/scale/convolve stages on all frames of an image
+ ***************************************/
+
+static int
+process_image( FL_IMAGE * im )
+{
+    int status = 0;
+
+    for ( ; im && status >= 0; im = im->next )
+    {
+        if ( opt.crop[ 0 ] || opt.crop[ 1 ] || opt.crop[ 2 ] || opt.crop[ 3 ] )
+            status = flimage_crop( im, opt.crop[ 0 ], opt.crop[ 1 ],
+                                   opt.crop[ 2 ], opt.crop[ 3 ] );
+
+        if ( status >= 0 && opt.scale_w > 0 )
+            status = flimage_scale( im, opt.scale_w, opt.scale_h,
+                                    FLIMAGE_SUBPIXEL );
+
+        if ( status >= 0 && opt.kernel )
+            status = flimage_convolve( im, opt.kernel, 0, 0 );
+    }
+
+    return status;
+}
+
+
+/***************************************
+ * Returns the (allocated) output file name for input file 'in'. When
+ * benchmarking each worker writes all its output into the same
+ * scratch file.
+ ***************************************/
+
+static char *
+output_name( const char * in,
+             int          worker )
+{
+    const char *dir = opt.outdir ? opt.outdir : "/tmp",
+               *base,
+               *dot;
+    char *out;
+    int n;
+
+    if ( opt.bench )
+    {
+        out = fl_malloc( strlen( dir ) + strlen( opt.ext ) + 64 );
+        sprintf( out, "%s/iconvert-%d-%d.%s", dir, ( int ) getpid( ),
+                 worker, opt.ext );
+        return out;
+    }
+
+    base = ( base = strrchr( in, '/' ) ) ? base + 1 : in;
+    if ( ! ( dot = strrchr( base, '.' ) ) || dot == base )
+        dot = base + strlen( base );
+
+    n = dot - base;
+    out = fl_malloc( strlen( dir ) + n + strlen( opt.ext ) + 3 );
+    sprintf( out, "%s/%.*s.%s", dir, n, base, opt.ext );
+    return out;
+}
+
+
+/***************************************
+ * Hands out the index of the next file to convert, -1 when there are
+ * none left. Also books the results of the previous file and reports
+ * the progress every now and then.
+ ***************************************/
+
+static int
+next_file( BATCH  * b,
+           int      prev_status,
+           double   prev_pixels )
+{
+    int n;
+    double t;
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock( &b->mutex );
+#endif
+
+    if ( prev_status )
+    {
+        b->done++;
+        b->failed += prev_status < 0;
+        b->pixels += prev_pixels;
+
+        if (    b->report
+             && ( ( t = now( ) ) - b->last_report > 0.5
+                  || b->done == b->nfiles ) )
+        {
+            t -= b->start;
+            fprintf( stderr, "\r%d of %d files (%d failed), %.1f files/s, "
+                     "%.2f Mpixel/s ", b->done, b->nfiles, b->failed,
+                     t > 0.0 ? b->done / t : 0.0,
+                     t > 0.0 ? 1.0e-6 * b->pixels / t : 0.0 );
+            b->last_report = b->start + t;
+        }
+    }
+
+    n = b->next < b->nfiles ? b->next++ : -1;
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock( &b->mutex );
+#endif
+
+    return n;
+}
+
+
+/***************************************
+ * Converts files until there are none left. Each file is handled
+ * start to end by the same thread with its own FL_IMAGE, so the only
+ * thing the threads need to agree on is which file to do next.
+ ***************************************/
+
+static void *
+worker( void * data )
+{
+    WORKER *w = data;
+    BATCH *b = w->batch;
+    FL_IMAGE *im,
+             *frame;
+    char *out;
+    int status = 0,
+        i;
+    double pixels = 0.0;
+
+    while ( ( i = next_file( b, status, pixels ) ) >= 0 )
+    {
+        status = -1;
+        pixels = 0.0;
+
+        if ( ! ( im = flimage_load( b->files[ i ] ) ) )
+            continue;
+
+        for ( frame = im; frame; frame = frame->next )
+            pixels += ( double ) frame->w * frame->h;
+
+        out = output_name( b->files[ i ], w->index );
+
+        if (    process_image( im ) >= 0
+             && flimage_dump( im, out, opt.fmt ) >= 0 )
+            status = 1;
+
+        fl_free( out );
+        flimage_free( im );
+    }
+
+    return NULL;
+}
+
+
+/***************************************
+ * Converts the 'n' files using 'jobs' threads. Returns the number of
+ * files that couldn't be converted, 'seconds' and 'pixels' (if not
+ * NULL) get the time used and the number of pixels read.
+ ***************************************/
+
+static int
+convert_files( char * const * files,
+               int            n,
+               int            jobs,
+               int            report,
+               double       * seconds,
+               double       * pixels )
+{
+    BATCH b;
+    WORKER w[ MAX_JOBS ];
+#ifdef HAVE_PTHREAD_H
+    pthread_t tid[ MAX_JOBS ];
+    int started[ MAX_JOBS ];
+#endif
+    int i;
+
+    memset( &b, 0, sizeof b );
+    b.files = files;
+    b.nfiles = n;
+    b.report = report;
+    b.start = b.last_report = now( );
+
+    jobs = FL_clamp( jobs, 1, FL_min( n, MAX_JOBS ) );
+
+    /* Several files at a time already keep all processors busy, the
+       library shouldn't split the work on each image on top of that */
+
+    flimage_set_max_threads( jobs > 1 ? 1 : 0 );
+
+    for ( i = 0; i < jobs; i++ )
+    {
+        w[ i ].batch = &b;
+        w[ i ].index = i;
+    }
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_init( &b.mutex, NULL );
+
+    for ( i = 1; i < jobs; i++ )
+        started[ i ] = ! pthread_create( tid + i, NULL, worker, w + i );
+#endif
+
+    worker( w );
+
+#ifdef HAVE_PTHREAD_H
+    for ( i = 1; i < jobs; i++ )
+        if ( started[ i ] )
+            pthread_join( tid[ i ], NULL );
+
+    pthread_mutex_destroy( &b.mutex );
+#endif
+
+    if ( seconds )
+        *seconds = now( ) - b.start;
+    if ( pixels )
+        *pixels = b.pixels;
+
+    return b.failed;
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+run_batch( char * const * files,
+           int            n,
+           int            jobs,
+           int            report )
+{
+    double t,
+           pixels;
+    int failed = convert_files( files, n, jobs, report, &t, &pixels );
+
+    if ( report )
+        fprintf( stderr, "\n%d files converted, %d failed, %.2f s using "
+                 "%d jobs\n", n - failed, failed, t, FL_min( jobs, n ) );
+
+    return failed;
+}
+
+
+/***************************************
+ * Converts all files with 1, 2, 4, ... threads and prints the timings
+ ***************************************/
+
+static void
+bench( char * const * files,
+       int            n )
+{
+    double t,
+           t1 = 0.0,
+           pixels;
+    int jobs,
+        failed,
+        i;
+    char *out;
+
+    printf( "%d files, output format %s\n", n, opt.fmt );
+    printf( "%5s %10s %10s %12s %8s\n",
+            "jobs", "seconds", "files/s", "Mpixel/s", "speedup" );
+
+    for ( jobs = 1; ; jobs = FL_min( 2 * jobs, opt.jobs ) )
+    {
+        failed = convert_files( files, n, jobs, 0, &t, &pixels );
+
+        if ( jobs == 1 )
+            t1 = t;
+
+        printf( "%5d %10.3f %10.1f %12.2f %8.2f", jobs, t,
+                t > 0.0 ? n / t : 0.0, t > 0.0 ? 1.0e-6 * pixels / t : 0.0,
+                t > 0.0 ? t1 / t : 0.0 );
+        if ( failed )
+            printf( "  (%d failed)", failed );
+        putchar( '\n' );
+        fflush( stdout );
+
+        if ( jobs >= opt.jobs )
+            break;
+    }
+
+    for ( i = 0; i < opt.jobs; i++ )
+    {
+        out = output_name( NULL, i );
+        unlink( out );
+        fl_free( out );
+    }
+}
+
+
 /*
  * Local variables:
  * tab-width: 4
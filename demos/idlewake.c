@@ -0,0 +1,187 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Counts how often an idle program wakes up: a form gets shown and
+ * the main loop is left alone for some seconds, then the number of
+ * voluntary context switches (i.e. how often the process went to
+ * sleep) per second is printed. With nothing to do that should be
+ * close to zero.
+ *
+ * With '-signal' a callback for SIGALRM is installed and an interval
+ * timer raises the signal four times per second. Then also the delay
+ * between the signal getting raised and the callback being invoked
+ * is reported, it should stay far below a millisecond (and the number
+ * of wakeups shouldn't be much more than the four per second caused
+ * by the signals themselves).
+ *
+ *   usage: idlewake [-signal] [seconds]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "include/forms.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#define SIGNAL_INTERVAL  250000L     /* in us */
+
+static double start;
+static long start_switches;
+static int nsignals;
+static double delay_sum,
+              delay_max;
+
+
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ ***************************************/
+
+static long
+context_switches( void )
+{
+    struct rusage ru;
+
+    getrusage( RUSAGE_SELF, &ru );
+    return ru.ru_nvcsw;
+}
+
+
+/***************************************
+ * Signal callback, the n-th signal is expected to have been raised
+ * at n times the timer interval after the start
+ ***************************************/
+
+static void
+signal_cb( int    sig   FL_UNUSED_ARG,
+           void * data  FL_UNUSED_ARG )
+{
+    double delay = now( ) - start - ++nsignals * 1.0e-6 * SIGNAL_INTERVAL;
+
+    delay_sum += delay;
+    delay_max = FL_max( delay_max, delay );
+}
+
+
+/***************************************
+ * Invoked when time is up, prints the results
+ ***************************************/
+
+static void
+done_cb( int    id  FL_UNUSED_ARG,
+         void * data  FL_UNUSED_ARG )
+{
+    double t = now( ) - start;
+    long n = context_switches( ) - start_switches;
+
+    printf( "%.1f s idle: %ld wakeups, %.2f per second\n", t, n, n / t );
+
+    if ( nsignals )
+        printf( "%d signals: mean delay %.3f ms, max %.3f ms\n", nsignals,
+                1.0e3 * delay_sum / nsignals, 1.0e3 * delay_max );
+
+    fl_finish( );
+    exit( 0 );
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+    FL_FORM *form;
+    int use_signal = 0,
+        seconds = 10,
+        i;
+
+    fl_initialize( &argc, argv, 0, 0, 0 );
+
+    for ( i = 1; i < argc; i++ )
+        if ( ! strcmp( argv[ i ], "-signal" ) )
+            use_signal = 1;
+        else if ( ( seconds = atoi( argv[ i ] ) ) <= 0 )
+        {
+            fprintf( stderr, "usage: %s [-signal] [seconds]\n", argv[ 0 ] );
+            return 1;
+        }
+
+    form = fl_bgn_form( FL_UP_BOX, 300, 60 );
+    fl_add_text( FL_NORMAL_TEXT, 10, 10, 280, 40,
+                 "Sitting idle, don't touch..." );
+    fl_end_form( );
+
+    fl_show_form( form, FL_PLACE_CENTER, FL_FULLBORDER, "Idle wakeups" );
+
+    /* Let things settle down before starting to count */
+
+    fl_check_forms( );
+    fl_msleep( 200 );
+    fl_check_forms( );
+
+    fl_add_timeout( 1000L * seconds, done_cb, NULL );
+
+    start = now( );
+    start_switches = context_switches( );
+
+    if ( use_signal )
+    {
+        struct itimerval it;
+
+        fl_add_signal_callback( SIGALRM, signal_cb, NULL );
+        it.it_interval.tv_sec  = it.it_value.tv_sec  = 0;
+        it.it_interval.tv_usec = it.it_value.tv_usec = SIGNAL_INTERVAL;
+        start = now( );
+        setitimer( ITIMER_REAL, &it, NULL );
+    }
+
+    fl_do_forms( );
+
+    return 0;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
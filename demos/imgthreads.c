@@ -0,0 +1,441 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Stress test for reading and writing images on several threads at
+ * once (doesn't need a display). A test image is written in each
+ * format that can be written without a display (PPM, PGM, PBM, GIF
+ * with two frames, JPEG, PNG, TIFF, XWD, FITS, BMP, XBM, SGI and a
+ * gzip'ed PPM) and read back to get a checksum of its pixels. Then
+ * each thread reads all of the files again and again, each in a
+ * different order, compares the checksums and writes the image out
+ * in its format. Meanwhile one of the threads keeps looking at the
+ * format table, calling flimage_setup() and registering a format
+ * anew. Any difference or failure is reported.
+ *
+ * The races this is meant to find often don't show up as wrong
+ * results, so it should also be run when built with ThreadSanitizer,
+ * e.g. with CFLAGS="-g -O1 -fsanitize=thread" for the whole tree.
+ *
+ *   usage: imgthreads [threads [loops]]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include "include/forms.h"
+#include "image/flimage.h"
+
+#define MAX_THREADS  64
+
+typedef struct {
+    const char    * fmt;        /* format to write the file in */
+    const char    * ext;
+    int             frames;
+    char            name[ 64 ];
+    int             w,
+                    h;
+    unsigned long   sum;        /* checksum of the pixels read */
+} TESTFILE;
+
+static TESTFILE files[ ] = {
+    { "ppm",  "ppm",    1, "", 0, 0, 0 },
+    { "pgm",  "pgm",    1, "", 0, 0, 0 },
+    { "pbm",  "pbm",    1, "", 0, 0, 0 },
+    { "gif",  "gif",    2, "", 0, 0, 0 },
+#ifndef NO_JPEG
+    { "jpeg", "jpg",    1, "", 0, 0, 0 },
+#endif
+    { "png",  "png",    1, "", 0, 0, 0 },
+    { "tiff", "tif",    1, "", 0, 0, 0 },
+    { "xwd",  "xwd",    1, "", 0, 0, 0 },
+    { "fits", "fits",   1, "", 0, 0, 0 },
+    { "bmp",  "bmp",    1, "", 0, 0, 0 },
+    { "xbm",  "xbm",    1, "", 0, 0, 0 },
+    { "iris", "rgb",    1, "", 0, 0, 0 },
+    { "ppm",  "ppm.gz", 1, "", 0, 0, 0 }
+};
+
+#define NUM_FILES  ( int ) ( sizeof files / sizeof *files )
+
+static char dir[ ] = "/tmp/imgthreadsXXXXXX";
+static int loops = 5;
+static int failures;
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t fail_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+/***************************************
+ ***************************************/
+
+static int
+noop( FL_IMAGE   * im  FL_UNUSED_ARG,
+      const char * s   FL_UNUSED_ARG )
+{
+    return 0;
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+show_error( FL_IMAGE   * im  FL_UNUSED_ARG,
+            const char * s )
+{
+    if ( s && *s )
+        fprintf( stderr, "%s\n", s );
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+failed( long         thread,
+        const char * what,
+        const char * name )
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock( &fail_mutex );
+#endif
+
+    failures++;
+    fprintf( stderr, "thread %ld: %s %s\n", thread, what, name );
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock( &fail_mutex );
+#endif
+}
+
+
+/***************************************
+ * Swallows the library's diagnostics - it complains each time a format
+ * gets registered again, and real failures show in the return values
+ ***************************************/
+
+static void
+quiet( const char * where  FL_UNUSED_ARG,
+       const char * fmt    FL_UNUSED_ARG,
+       ... )
+{
+}
+
+
+/***************************************
+ * Sets up the library, which is also done while the threads run
+ ***************************************/
+
+static void
+setup_library( int max_frames )
+{
+    FLIMAGE_SETUP setup;
+
+    memset( &setup, 0, sizeof setup );
+    setup.visual_cue = noop;
+    setup.error_message = show_error;
+    setup.max_frames = max_frames;
+    setup.no_auto_extension = 1;
+    flimage_setup( &setup );
+}
+
+
+/***************************************
+ * Returns a checksum of the pixels of all frames (converting them to
+ * RGB on the way)
+ ***************************************/
+
+static unsigned long
+checksum( FL_IMAGE * im )
+{
+    unsigned long s = 0;
+    int x,
+        y;
+
+    for ( ; im; im = im->next )
+    {
+        flimage_convert( im, FL_IMAGE_RGB, 0 );
+
+        for ( y = 0; y < im->h; y++ )
+            for ( x = 0; x < im->w; x++ )
+                s =   s * 31 + im->red[ y ][ x ] * 7
+                    + im->green[ y ][ x ] * 3 + im->blue[ y ][ x ];
+    }
+
+    return s;
+}
+
+
+/***************************************
+ ***************************************/
+
+static FL_IMAGE *
+make_image( int w,
+            int h,
+            int seed )
+{
+    FL_IMAGE *im = flimage_alloc( );
+    int x,
+        y;
+
+    im->type = FL_IMAGE_RGB;
+    im->w = w;
+    im->h = h;
+    flimage_getmem( im );
+
+    for ( y = 0; y < h; y++ )
+        for ( x = 0; x < w; x++ )
+        {
+            im->red[ y ][ x ]   = ( x * 4 + seed ) & 255;
+            im->green[ y ][ x ] = ( y * 3 ) & 255;
+            im->blue[ y ][ x ]  = ( ( x ^ y ) * 8 ) & 255;
+        }
+
+    return im;
+}
+
+
+/***************************************
+ * Writes the test files and gets the reference checksums, returns the
+ * number of files that could be made
+ ***************************************/
+
+static int
+make_files( void )
+{
+    FL_IMAGE *im,
+             *ld;
+    char cmd[ 128 ];
+    int n = 0,
+        i;
+
+    for ( i = 0; i < NUM_FILES; i++ )
+    {
+        TESTFILE *f = files + i;
+        int gz = strstr( f->ext, ".gz" ) != NULL;
+
+        im = make_image( 97 + i, 61 + 2 * i, i );
+        if ( f->frames > 1 )
+            im->next = make_image( im->w, im->h, 77 );
+
+        sprintf( f->name, "%s/in%d.%s", dir, i, f->ext );
+        if ( gz )
+            f->name[ strlen( f->name ) - 3 ] = '\0';
+
+        if ( flimage_dump( im, f->name, f->fmt ) < 0 )
+        {
+            unlink( f->name );
+            *f->name = '\0';
+        }
+        else if ( gz )
+        {
+            sprintf( cmd, "gzip -f %s", f->name );
+            if ( system( cmd ) == 0 )
+                strcat( f->name, ".gz" );
+            else
+            {
+                unlink( f->name );
+                *f->name = '\0';
+            }
+        }
+
+        if ( im->next )
+            flimage_free( im->next );
+        im->next = NULL;
+        flimage_free( im );
+
+        if ( ! *f->name )
+            fprintf( stderr, "can't write %s file, skipped\n", f->ext );
+        else if ( ! ( ld = flimage_load( f->name ) ) )
+        {
+            fprintf( stderr, "can't read %s\n", f->name );
+            unlink( f->name );
+            *f->name = '\0';
+        }
+        else
+        {
+            f->w = ld->w;
+            f->h = ld->h;
+            f->sum = checksum( ld );
+            flimage_free( ld );
+            n++;
+        }
+    }
+
+    return n;
+}
+
+
+/***************************************
+ * What each thread does
+ ***************************************/
+
+static void *
+worker( void * arg )
+{
+    long t = ( long ) arg;
+    char out[ 64 ];
+    FL_IMAGE *im;
+    int l,
+        k,
+        i;
+
+    for ( l = 0; l < loops; l++ )
+        for ( k = 0; k < NUM_FILES; k++ )
+        {
+            TESTFILE *f = files + ( k + t ) % NUM_FILES;
+
+            if ( ! *f->name )
+                continue;
+
+            if ( ! ( im = flimage_load( f->name ) ) )
+            {
+                failed( t, "can't read", f->name );
+                continue;
+            }
+
+            if ( im->w != f->w || im->h != f->h || checksum( im ) != f->sum )
+                failed( t, "got wrong pixels from", f->name );
+
+            sprintf( out, "%s/t%ld.%s", dir, t, f->ext );
+            if ( ! strstr( f->ext, ".gz" ) )
+            {
+                if ( flimage_dump( im, out, f->fmt ) < 0 )
+                    failed( t, "can't write", out );
+                unlink( out );
+            }
+
+            flimage_free( im );
+
+            /* The first thread also fiddles with the library's state */
+
+            if ( t == 0 )
+            {
+                int n = flimage_get_number_of_formats( );
+
+                for ( i = 1; i <= n; i++ )
+                    if ( ! flimage_get_format_info( i )->short_name )
+                        failed( t, "bad format table entry", "" );
+
+                setup_library( 10 + l );
+                flimage_enable_xbm( );
+            }
+        }
+
+    return NULL;
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_t tid[ MAX_THREADS ];
+    int started[ MAX_THREADS ];
+#endif
+    int threads = 8,
+        i;
+
+    if ( argc > 1 )
+        threads = atoi( argv[ 1 ] );
+    if ( argc > 2 )
+        loops = atoi( argv[ 2 ] );
+
+    if ( threads < 1 || threads > MAX_THREADS || loops < 1 )
+    {
+        fprintf( stderr, "usage: %s [threads [loops]]\n", argv[ 0 ] );
+        return 1;
+    }
+
+    if ( ! mkdtemp( dir ) )
+    {
+        perror( "imgthreads" );
+        return 1;
+    }
+
+    fl_set_error_handler( quiet );
+    setup_library( 10 );
+
+    flimage_enable_gif( );
+#ifndef NO_JPEG
+    flimage_enable_jpeg( );
+#endif
+    flimage_enable_png( );
+    flimage_enable_tiff( );
+    flimage_enable_xwd( );
+    flimage_enable_fits( );
+    flimage_enable_bmp( );
+    flimage_enable_xbm( );
+    flimage_enable_sgi( );
+
+    printf( "%d files, %d threads, %d loops\n", make_files( ), threads,
+            loops );
+    fflush( stdout );
+
+    /* Leave it to the threads to keep the processors busy */
+
+    flimage_set_max_threads( 1 );
+
+#ifdef HAVE_PTHREAD_H
+    for ( i = 1; i < threads; i++ )
+        started[ i ] = ! pthread_create( tid + i, NULL, worker,
+                                         ( void * ) ( long ) i );
+#endif
+
+    worker( NULL );
+
+#ifdef HAVE_PTHREAD_H
+    for ( i = 1; i < threads; i++ )
+        if ( started[ i ] )
+            pthread_join( tid[ i ], NULL );
+#endif
+
+    for ( i = 0; i < NUM_FILES; i++ )
+        if ( *files[ i ].name )
+            unlink( files[ i ].name );
+    rmdir( dir );
+
+    printf( "%d failure(s)\n", failures );
+    return failures != 0;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
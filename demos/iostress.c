@@ -0,0 +1,313 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Stress test for IO callbacks: opens thousands of pipes, registers
+ * a callback for the read end of each of them and then repeatedly
+ * writes a byte into a randomly picked pipe, measuring the time until
+ * the callback for it gets invoked from fl_check_forms().
+ *
+ * For comparison the same is done with a loop that works like the
+ * select() based code the library used before: the fd_sets get
+ * rebuilt from the list of all callbacks before each call of select()
+ * and all of them are checked afterwards. Since select() can't deal
+ * with fds of FD_SETSIZE or above only the pipes with smaller fds
+ * take part in that run.
+ *
+ *   usage: iostress [npipes [rounds]]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "include/forms.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+
+
+typedef struct {
+    int rfd;
+    int wfd;
+} PIPE;
+
+static PIPE *pipes;
+static int npipes;
+static int hits;
+
+
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ * Makes sure we may open enough files for 'n' pipes
+ ***************************************/
+
+static int
+raise_fd_limit( int n )
+{
+    struct rlimit rl;
+    rlim_t need = 2 * ( rlim_t ) n + 64;
+
+    if ( getrlimit( RLIMIT_NOFILE, &rl ) < 0 )
+        return -1;
+
+    if ( rl.rlim_cur >= need )
+        return 0;
+
+    if ( rl.rlim_max != RLIM_INFINITY && rl.rlim_max < need )
+        return -1;
+
+    rl.rlim_cur = need;
+    return setrlimit( RLIMIT_NOFILE, &rl );
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+open_pipes( int n )
+{
+    int fds[ 2 ];
+
+    pipes = fl_malloc( n * sizeof *pipes );
+
+    for ( npipes = 0; npipes < n; npipes++ )
+    {
+        if ( pipe( fds ) < 0 )
+        {
+            fprintf( stderr, "pipe() failed after %d pipes: %s\n",
+                     npipes, strerror( errno ) );
+            break;
+        }
+
+        fcntl( fds[ 0 ], F_SETFL, O_NONBLOCK );
+        pipes[ npipes ].rfd = fds[ 0 ];
+        pipes[ npipes ].wfd = fds[ 1 ];
+    }
+
+    return npipes;
+}
+
+
+/***************************************
+ * Callback for the read end of a pipe
+ ***************************************/
+
+static void
+io_cb( int    fd,
+       void * data  FL_UNUSED_ARG )
+{
+    char c;
+
+    while ( read( fd, &c, 1 ) == 1 )
+        hits++;
+}
+
+
+/***************************************
+ * Prints the results of a run
+ ***************************************/
+
+static void
+report( const char * name,
+        int          n,
+        int          rounds,
+        double       total,
+        double       worst )
+{
+    printf( "%-8s %7d %8d %12.1f %12.1f\n", name, n, rounds,
+            1.0e6 * total / rounds, 1.0e6 * worst );
+    fflush( stdout );
+}
+
+
+/***************************************
+ * Writes into random pipes and waits for the library to invoke
+ * the callbacks
+ ***************************************/
+
+static void
+run_library( int rounds )
+{
+    double t,
+           total = 0.0,
+           worst = 0.0;
+    int i,
+        k;
+
+    for ( i = 0; i < npipes; i++ )
+        fl_add_io_callback( pipes[ i ].rfd, FL_READ, io_cb, NULL );
+
+    hits = 0;
+    for ( i = 0; i < rounds; i++ )
+    {
+        k = rand( ) % npipes;
+
+        t = now( );
+        if ( write( pipes[ k ].wfd, "x", 1 ) != 1 )
+            break;
+        while ( hits == i )
+            fl_check_forms( );
+        t = now( ) - t;
+
+        total += t;
+        worst = FL_max( worst, t );
+    }
+
+    for ( i = 0; i < npipes; i++ )
+        fl_remove_io_callback( pipes[ i ].rfd, FL_READ, io_cb );
+
+    report( "library", npipes, rounds, total, worst );
+}
+
+
+/***************************************
+ * Does the same using the algorithm of the old select() based
+ * code: rebuild the fd_set, wait and then check every fd.
+ ***************************************/
+
+static void
+run_select( int rounds )
+{
+    fd_set rfds;
+    struct timeval tv;
+    double t,
+           total = 0.0,
+           worst = 0.0;
+    int n,
+        maxfd,
+        i,
+        j,
+        k;
+
+    for ( n = 0; n < npipes && pipes[ n ].rfd < FD_SETSIZE; n++ )
+        /* empty */ ;
+
+    if ( n == 0 )
+        return;
+
+    hits = 0;
+    for ( i = 0; i < rounds; i++ )
+    {
+        k = rand( ) % n;
+
+        t = now( );
+        if ( write( pipes[ k ].wfd, "x", 1 ) != 1 )
+            break;
+
+        while ( hits == i )
+        {
+            FD_ZERO( &rfds );
+            for ( maxfd = -1, j = 0; j < n; j++ )
+            {
+                FD_SET( pipes[ j ].rfd, &rfds );
+                maxfd = FL_max( maxfd, pipes[ j ].rfd );
+            }
+
+            tv.tv_sec  = 0;
+            tv.tv_usec = 1000;
+            if ( select( maxfd + 1, &rfds, NULL, NULL, &tv ) <= 0 )
+                continue;
+
+            for ( j = 0; j < n; j++ )
+                if ( FD_ISSET( pipes[ j ].rfd, &rfds ) )
+                    io_cb( pipes[ j ].rfd, NULL );
+        }
+
+        t = now( ) - t;
+        total += t;
+        worst = FL_max( worst, t );
+    }
+
+    report( "select", n, rounds, total, worst );
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+    int n = 4000,
+        rounds = 20000;
+
+    fl_initialize( &argc, argv, 0, 0, 0 );
+
+    if ( argc > 1 )
+        n = atoi( argv[ 1 ] );
+    if ( argc > 2 )
+        rounds = atoi( argv[ 2 ] );
+
+    if ( n < 1 || rounds < 1 )
+    {
+        fprintf( stderr, "usage: %s [npipes [rounds]]\n", argv[ 0 ] );
+        return 1;
+    }
+
+    if ( raise_fd_limit( n ) < 0 )
+        fprintf( stderr, "Can't raise fd limit, fewer pipes get used\n" );
+
+    if ( open_pipes( n ) == 0 )
+        return 1;
+
+    printf( "%-8s %7s %8s %12s %12s\n",
+            "loop", "pipes", "rounds", "mean us", "max us" );
+
+    srand( 1 );
+    run_library( rounds );
+    srand( 1 );
+    run_select( rounds );
+
+    fl_finish( );
+    return 0;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
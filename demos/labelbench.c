@@ -0,0 +1,160 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Benchmark for drawing and measuring labels: a form with 2000 buttons,
+ * each with a different label in one of several font styles and sizes,
+ * gets redrawn a number of times. Then the widths and dimensions of all
+ * labels are measured repeatedly. Average times are printed.
+ *
+ *   usage: labelbench [redraws]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "include/forms.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COLS      40
+#define ROWS      50
+#define NUM_OBJS  ( COLS * ROWS )
+#define BW        30
+#define BH        18
+#define MEASURES  100
+
+static const int styles[ ] = { FL_NORMAL_STYLE, FL_BOLD_STYLE,
+                               FL_ITALIC_STYLE, FL_FIXED_STYLE,
+                               FL_TIMES_STYLE };
+static const int sizes[ ] = { FL_TINY_SIZE, FL_SMALL_SIZE,
+                              FL_NORMAL_SIZE, FL_MEDIUM_SIZE };
+
+static char labels[ NUM_OBJS ][ 32 ];
+
+
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+    FL_FORM *form;
+    FL_OBJECT *obj;
+    double t;
+    int redraws = 50,
+        w,
+        h,
+        i,
+        j;
+    long sum = 0;
+
+    fl_initialize( &argc, argv, 0, 0, 0 );
+
+    if ( argc > 1 && ( redraws = atoi( argv[ 1 ] ) ) < 1 )
+    {
+        fprintf( stderr, "usage: %s [redraws]\n", argv[ 0 ] );
+        return 1;
+    }
+
+    form = fl_bgn_form( FL_UP_BOX, COLS * BW, ROWS * BH );
+
+    for ( i = 0; i < NUM_OBJS; i++ )
+    {
+        if ( i % 7 == 0 )
+            sprintf( labels[ i ], "B%d\nline 2", i );
+        else
+            sprintf( labels[ i ], "Button %d", i );
+
+        obj = fl_add_button( FL_NORMAL_BUTTON, i % COLS * BW, i / COLS * BH,
+                             BW, BH, labels[ i ] );
+        fl_set_object_lstyle( obj, styles[ i % 5 ] );
+        fl_set_object_lsize( obj, sizes[ i / 5 % 4 ] );
+    }
+
+    fl_end_form( );
+
+    fl_show_form( form, FL_PLACE_CENTER, FL_FULLBORDER, "Label benchmark" );
+    fl_check_forms( );
+    XSync( fl_get_display( ), False );
+
+    t = now( );
+    for ( i = 0; i < redraws; i++ )
+    {
+        fl_redraw_form( form );
+        XSync( fl_get_display( ), False );
+    }
+    t = now( ) - t;
+
+    printf( "%d objects, %d redraws: %.2f ms per redraw\n",
+            NUM_OBJS, redraws, 1.0e3 * t / redraws );
+
+    t = now( );
+    for ( j = 0; j < MEASURES; j++ )
+        for ( i = 0; i < NUM_OBJS; i++ )
+            sum += fl_get_string_width( styles[ i % 5 ], sizes[ i / 5 % 4 ],
+                                        labels[ i ], strlen( labels[ i ] ) );
+    t = now( ) - t;
+
+    printf( "fl_get_string_width():     %.3f us per label\n",
+            1.0e6 * t / ( MEASURES * NUM_OBJS ) );
+
+    t = now( );
+    for ( j = 0; j < MEASURES; j++ )
+        for ( i = 0; i < NUM_OBJS; i++ )
+        {
+            fl_get_string_dimension( styles[ i % 5 ], sizes[ i / 5 % 4 ],
+                                     labels[ i ], strlen( labels[ i ] ),
+                                     &w, &h );
+            sum += w + h;
+        }
+    t = now( ) - t;
+
+    printf( "fl_get_string_dimension(): %.3f us per label (checksum %ld)\n",
+            1.0e6 * t / ( MEASURES * NUM_OBJS ), sum );
+
+    fl_finish( );
+    return 0;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
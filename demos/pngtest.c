@@ -0,0 +1,684 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Test and benchmark for reading and writing PNG files (doesn't need
+ * a display, but zlib).
+ *
+ * Without arguments PNG files are crafted for all color types and bit
+ * depths (gray at 1, 2, 4, 8 and 16 bits, RGB and RGBA at 8 and 16 bits,
+ * gray+alpha at 8 and 16 bits and palette images at 1, 2, 4 and 8 bits),
+ * each in several sizes, with and without Adam7 interlacing. The rows
+ * use randomly chosen filters and the image data are split over two
+ * IDAT chunks. Each file is loaded and the pixels are compared with
+ * what was written. Then the image is saved as PNG, loaded again and
+ * must come out unchanged.
+ *
+ * With '-bench [size]' a size x size RGB image (2048 x 2048 by default)
+ * is written and the time for loading it is measured, both directly and
+ * the way it was done before, i.e. by converting it with pngtopnm and
+ * then reading the resulting PPM file (if pngtopnm is installed).
+ *
+ *   usage: pngtest [-bench [size]]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "include/forms.h"
+#include "image/flimage.h"
+
+#if defined HAVE_ZLIB_H && defined HAVE_LIBZ
+
+#include <zlib.h>
+
+#define PNG_GRAY        0
+#define PNG_RGB         2
+#define PNG_PALETTE     3
+#define PNG_GRAY_ALPHA  4
+#define PNG_RGB_ALPHA   6
+
+typedef struct {
+    int              w,
+                     h,
+                     color_type,
+                     depth,
+                     interlace;
+    unsigned short * samples;       /* w * h * channels */
+    unsigned char    plte[ 3 * 256 ];
+    int              plte_len;
+    int              tran_index;    /* transparent palette entry or -1 */
+} PNG_SPEC;
+
+static char dir[ ] = "/tmp/pngtestXXXXXX";
+
+
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+noop( FL_IMAGE   * im  FL_UNUSED_ARG,
+      const char * s   FL_UNUSED_ARG )
+{
+    return 0;
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+channels( int color_type )
+{
+    return   color_type == PNG_RGB        ? 3
+           : color_type == PNG_GRAY_ALPHA ? 2
+           : color_type == PNG_RGB_ALPHA  ? 4 : 1;
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+put4( unsigned char * p,
+      unsigned long   v )
+{
+    p[ 0 ] = v >> 24;
+    p[ 1 ] = v >> 16;
+    p[ 2 ] = v >> 8;
+    p[ 3 ] = v;
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+write_chunk( FILE                * fp,
+             const char          * type,
+             const unsigned char * data,
+             unsigned long         len )
+{
+    unsigned char buf[ 4 ];
+    unsigned long crc = crc32( 0, ( const Bytef * ) type, 4 );
+
+    put4( buf, len );
+    fwrite( buf, 1, 4, fp );
+    fwrite( type, 1, 4, fp );
+    fwrite( data, 1, len, fp );
+    put4( buf, crc32( crc, data, len ) );
+    fwrite( buf, 1, 4, fp );
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+paeth( int a,
+       int b,
+       int c )
+{
+    int p = a + b - c,
+        pa = abs( p - a ),
+        pb = abs( p - b ),
+        pc = abs( p - c );
+
+    return ( pa <= pb && pa <= pc ) ? a : pb <= pc ? b : c;
+}
+
+
+/***************************************
+ * Packs the samples of the pixels x0, x0 + dx, ... of row 'y' into
+ * 'out' and returns the number of bytes
+ ***************************************/
+
+static int
+pack_row( PNG_SPEC      * sp,
+          int             y,
+          int             x0,
+          int             dx,
+          unsigned char * out )
+{
+    int ch = channels( sp->color_type ),
+        bits = 0,
+        n = 0,
+        acc = 0,
+        x,
+        c,
+        v;
+
+    for ( x = x0; x < sp->w; x += dx )
+        for ( c = 0; c < ch; c++ )
+        {
+            v = sp->samples[ ( y * sp->w + x ) * ch + c ];
+
+            if ( sp->depth == 16 )
+            {
+                out[ n++ ] = v >> 8;
+                out[ n++ ] = v;
+            }
+            else if ( sp->depth == 8 )
+                out[ n++ ] = v;
+            else
+            {
+                acc = ( acc << sp->depth ) | v;
+                if ( ( bits += sp->depth ) == 8 )
+                {
+                    out[ n++ ] = acc;
+                    acc = bits = 0;
+                }
+            }
+        }
+
+    if ( bits )
+        out[ n++ ] = acc << ( 8 - bits );
+
+    return n;
+}
+
+
+/***************************************
+ * Writes the image described by 'sp' as a PNG file, using random
+ * filters for the rows
+ ***************************************/
+
+static int
+write_png( PNG_SPEC   * sp,
+           const char * name,
+           int          random_filters )
+{
+    static const int x0[ ] = { 0, 4, 0, 2, 0, 1, 0 },
+                     y0[ ] = { 0, 0, 4, 0, 2, 0, 1 },
+                     dx[ ] = { 8, 8, 4, 4, 2, 2, 1 },
+                     dy[ ] = { 8, 8, 8, 4, 4, 2, 2 };
+    int ch = channels( sp->color_type ),
+        bpp = FL_max( ch * sp->depth / 8, 1 ),
+        row_bytes = ( sp->w * ch * sp->depth + 7 ) / 8,
+        passes = sp->interlace ? 7 : 1,
+        p,
+        y,
+        n,
+        f,
+        i;
+    unsigned char *raw = fl_malloc( 2 * ( row_bytes + 1 ) * sp->h + 64 ),
+                  *row = fl_malloc( row_bytes ),
+                  *prev = fl_calloc( 1, row_bytes ),
+                  *out = raw,
+                  *z,
+                  hdr[ 13 ];
+    uLongf zlen;
+    FILE *fp;
+
+    for ( p = 0; p < passes; p++ )
+    {
+        int px = sp->interlace ? x0[ p ] : 0,
+            py = sp->interlace ? y0[ p ] : 0,
+            pdx = sp->interlace ? dx[ p ] : 1,
+            pdy = sp->interlace ? dy[ p ] : 1;
+
+        if ( px >= sp->w || py >= sp->h )
+            continue;
+
+        memset( prev, 0, row_bytes );
+
+        for ( y = py; y < sp->h; y += pdy )
+        {
+            n = pack_row( sp, y, px, pdx, row );
+            f = random_filters ? rand( ) % 5 : 4;
+            *out++ = f;
+
+            for ( i = 0; i < n; i++ )
+            {
+                int a = i >= bpp ? row[ i - bpp ] : 0,
+                    b = prev[ i ],
+                    c = i >= bpp ? prev[ i - bpp ] : 0,
+                    pred[ 5 ];
+
+                pred[ 0 ] = 0;
+                pred[ 1 ] = a;
+                pred[ 2 ] = b;
+                pred[ 3 ] = ( a + b ) >> 1;
+                pred[ 4 ] = paeth( a, b, c );
+                *out++ = row[ i ] - pred[ f ];
+            }
+
+            memcpy( prev, row, n );
+        }
+    }
+
+    zlen = compressBound( out - raw );
+    z = fl_malloc( zlen );
+    compress( z, &zlen, raw, out - raw );
+
+    if ( ! ( fp = fopen( name, "wb" ) ) )
+        return -1;
+
+    fwrite( "\211PNG\r\n\032\n", 1, 8, fp );
+
+    put4( hdr, sp->w );
+    put4( hdr + 4, sp->h );
+    hdr[ 8 ] = sp->depth;
+    hdr[ 9 ] = sp->color_type;
+    hdr[ 10 ] = hdr[ 11 ] = 0;
+    hdr[ 12 ] = sp->interlace;
+    write_chunk( fp, "IHDR", hdr, 13 );
+
+    if ( sp->color_type == PNG_PALETTE )
+        write_chunk( fp, "PLTE", sp->plte, 3 * sp->plte_len );
+
+    if ( sp->tran_index >= 0 )
+    {
+        unsigned char trns[ 256 ];
+
+        memset( trns, 255, sizeof trns );
+        trns[ sp->tran_index ] = 0;
+        write_chunk( fp, "tRNS", trns, sp->tran_index + 1 );
+    }
+
+    write_chunk( fp, "tEXt", ( const unsigned char * ) "Comment\0pngtest",
+                 15 );
+
+    n = zlen > 1 ? 1 + rand( ) % ( zlen - 1 ) : zlen;
+    write_chunk( fp, "IDAT", z, n );
+    write_chunk( fp, "IDAT", z + n, zlen - n );
+    write_chunk( fp, "IEND", NULL, 0 );
+
+    fl_free( z );
+    fl_free( prev );
+    fl_free( row );
+    fl_free( raw );
+
+    return fclose( fp );
+}
+
+
+/***************************************
+ * Checks that the loaded image has the pixels that got written
+ ***************************************/
+
+static int
+check_pixels( PNG_SPEC * sp,
+              FL_IMAGE * im )
+{
+    int ch = channels( sp->color_type ),
+        maxs = ( 1 << sp->depth ) - 1,
+        shift = sp->depth == 16 ? 8 : 0,
+        x,
+        y,
+        i;
+    unsigned short *s;
+
+    if ( im->w != sp->w || im->h != sp->h )
+        return 0;
+
+    if ( sp->color_type == PNG_PALETTE )
+    {
+        if ( im->type != FL_IMAGE_CI || im->map_len != sp->plte_len )
+            return 0;
+
+        for ( i = 0; i < sp->plte_len; i++ )
+            if (    im->red_lut[ i ]   != sp->plte[ 3 * i ]
+                 || im->green_lut[ i ] != sp->plte[ 3 * i + 1 ]
+                 || im->blue_lut[ i ]  != sp->plte[ 3 * i + 2 ] )
+                return 0;
+
+        if ( im->tran_index != sp->tran_index )
+            return 0;
+    }
+    else if ( sp->color_type == PNG_RGB || sp->color_type == PNG_RGB_ALPHA )
+    {
+        if ( im->type != FL_IMAGE_RGB )
+            return 0;
+    }
+    else if ( im->type != ( sp->depth == 16 ?
+                            FL_IMAGE_GRAY16 : FL_IMAGE_GRAY ) )
+        return 0;
+
+    for ( y = 0; y < sp->h; y++ )
+        for ( x = 0; x < sp->w; x++ )
+        {
+            s = sp->samples + ( y * sp->w + x ) * ch;
+
+            switch ( sp->color_type )
+            {
+                case PNG_PALETTE :
+                    if ( im->ci[ y ][ x ] != s[ 0 ] )
+                        return 0;
+                    break;
+
+                case PNG_RGB_ALPHA :
+                    if ( im->alpha[ y ][ x ] != s[ 3 ] >> shift )
+                        return 0;
+                    /* fall through */
+
+                case PNG_RGB :
+                    if (    im->red[ y ][ x ]   != s[ 0 ] >> shift
+                         || im->green[ y ][ x ] != s[ 1 ] >> shift
+                         || im->blue[ y ][ x ]  != s[ 2 ] >> shift )
+                        return 0;
+                    break;
+
+                default :                 /* gray, alpha gets dropped */
+                    if ( im->gray[ y ][ x ] !=
+                                 ( sp->depth < 8 ? s[ 0 ] * 255 / maxs
+                                                 : s[ 0 ] ) )
+                        return 0;
+                    break;
+            }
+        }
+
+    return 1;
+}
+
+
+/***************************************
+ * Checks that two images have the same type, size and pixels
+ ***************************************/
+
+static int
+same_image( FL_IMAGE * a,
+            FL_IMAGE * b )
+{
+    size_t n = ( size_t ) a->w * a->h;
+    int i;
+
+    if ( a->type != b->type || a->w != b->w || a->h != b->h )
+        return 0;
+
+    if ( a->type == FL_IMAGE_RGB )
+        return    ! memcmp( a->red[ 0 ], b->red[ 0 ], n )
+               && ! memcmp( a->green[ 0 ], b->green[ 0 ], n )
+               && ! memcmp( a->blue[ 0 ], b->blue[ 0 ], n );
+
+    if ( a->type == FL_IMAGE_CI )
+    {
+        if ( a->map_len != b->map_len )
+            return 0;
+
+        for ( i = 0; i < a->map_len; i++ )
+            if (    a->red_lut[ i ]   != b->red_lut[ i ]
+                 || a->green_lut[ i ] != b->green_lut[ i ]
+                 || a->blue_lut[ i ]  != b->blue_lut[ i ] )
+                return 0;
+
+        return ! memcmp( a->ci[ 0 ], b->ci[ 0 ], n * sizeof **a->ci );
+    }
+
+    return    a->gray_maxval == b->gray_maxval
+           && ! memcmp( a->gray[ 0 ], b->gray[ 0 ], n * sizeof **a->gray );
+}
+
+
+/***************************************
+ * Crafts, loads, saves and reloads one file, returns 0 on success
+ ***************************************/
+
+static int
+test_one( int color_type,
+          int depth,
+          int interlace,
+          int w,
+          int h )
+{
+    PNG_SPEC sp;
+    FL_IMAGE *im,
+             *im2 = NULL;
+    char in[ 64 ],
+         out[ 64 ];
+    const char *what = "round trip failed";
+    int ch = channels( color_type ),
+        n = w * h * ch,
+        maxs = ( 1 << depth ) - 1,
+        ok = 0,
+        i;
+
+    sp.w = w;
+    sp.h = h;
+    sp.color_type = color_type;
+    sp.depth = depth;
+    sp.interlace = interlace;
+    sp.tran_index = -1;
+    sp.plte_len = 0;
+    sp.samples = fl_malloc( n * sizeof *sp.samples );
+
+    if ( color_type == PNG_PALETTE )
+    {
+        sp.plte_len = 1 + rand( ) % ( maxs + 1 );
+        for ( i = 0; i < 3 * sp.plte_len; i++ )
+            sp.plte[ i ] = rand( );
+        if ( w > 1 )
+            sp.tran_index = rand( ) % sp.plte_len;
+        maxs = sp.plte_len - 1;
+    }
+
+    for ( i = 0; i < n; i++ )
+        sp.samples[ i ] =   ( ( rand( ) & 0xff ) << 8 | ( rand( ) & 0xff ) )
+                          % ( maxs + 1 );
+
+    sprintf( in, "%s/in.png", dir );
+    sprintf( out, "%s/out.png", dir );
+
+    if (    write_png( &sp, in, 1 ) == 0
+         && ( im = flimage_load( in ) ) )
+    {
+        if ( ( ok = check_pixels( &sp, im ) ) )
+            ok =    flimage_dump( im, out, "png" ) >= 0
+                 && ( im2 = flimage_load( out ) )
+                 && same_image( im, im2 );
+        else
+            what = "wrong pixels";
+
+        flimage_free( im );
+        if ( im2 )
+            flimage_free( im2 );
+    }
+
+    if ( ! ok )
+        fprintf( stderr, "%s: color type %d, %d bit, %dx%d%s\n", what,
+                 color_type, depth, w, h, interlace ? ", interlaced" : "" );
+
+    fl_free( sp.samples );
+    unlink( in );
+    unlink( out );
+
+    return ! ok;
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+test( void )
+{
+    static const struct {
+        int color_type,
+            depth;
+    } kinds[ ] = { { PNG_GRAY, 1 }, { PNG_GRAY, 2 }, { PNG_GRAY, 4 },
+                   { PNG_GRAY, 8 }, { PNG_GRAY, 16 },
+                   { PNG_RGB, 8 }, { PNG_RGB, 16 },
+                   { PNG_PALETTE, 1 }, { PNG_PALETTE, 2 },
+                   { PNG_PALETTE, 4 }, { PNG_PALETTE, 8 },
+                   { PNG_GRAY_ALPHA, 8 }, { PNG_GRAY_ALPHA, 16 },
+                   { PNG_RGB_ALPHA, 8 }, { PNG_RGB_ALPHA, 16 } };
+    static const int sizes[ ][ 2 ] = { { 1, 1 }, { 3, 5 }, { 9, 9 },
+                                       { 37, 23 } };
+    int nkinds = sizeof kinds / sizeof *kinds,
+        nsizes = sizeof sizes / sizeof *sizes,
+        failed = 0,
+        total = 0,
+        k,
+        s,
+        il;
+
+    for ( k = 0; k < nkinds; k++ )
+        for ( il = 0; il < 2; il++ )
+            for ( s = 0; s < nsizes; s++, total++ )
+                failed += test_one( kinds[ k ].color_type, kinds[ k ].depth,
+                                    il, sizes[ s ][ 0 ], sizes[ s ][ 1 ] );
+
+    printf( "%d of %d files failed\n", failed, total );
+    return failed;
+}
+
+
+/***************************************
+ * Measures the time for loading a PNG file directly and via pngtopnm
+ ***************************************/
+
+static void
+bench( int size )
+{
+    PNG_SPEC sp;
+    FL_IMAGE *im;
+    char png[ 64 ],
+         ppm[ 64 ],
+         cmd[ 160 ];
+    double t;
+    int n = 10,
+        x,
+        y,
+        c,
+        i;
+
+    sp.w = sp.h = size;
+    sp.color_type = PNG_RGB;
+    sp.depth = 8;
+    sp.interlace = 0;
+    sp.tran_index = -1;
+    sp.samples = fl_malloc( 3 * size * size * sizeof *sp.samples );
+
+    /* Smooth gradients with a bit of noise, which compress about as
+       well as photos */
+
+    for ( y = 0; y < size; y++ )
+        for ( x = 0; x < size; x++ )
+            for ( c = 0; c < 3; c++ )
+                sp.samples[ 3 * ( y * size + x ) + c ] =
+                    ( ( x * ( c + 1 ) + y * ( 3 - c ) ) / 8 + rand( ) % 8 )
+                    & 0xff;
+
+    sprintf( png, "%s/bench.png", dir );
+    sprintf( ppm, "%s/bench.ppm", dir );
+    write_png( &sp, png, 0 );
+    fl_free( sp.samples );
+
+    printf( "%d x %d RGB image\n", size, size );
+
+    t = now( );
+    for ( i = 0; i < n; i++ )
+        if ( ( im = flimage_load( png ) ) )
+            flimage_free( im );
+    t = now( ) - t;
+    printf( "direct:   %8.2f ms per load\n", 1.0e3 * t / n );
+
+    sprintf( cmd, "pngtopnm %s > %s 2>/dev/null", png, ppm );
+
+    t = now( );
+    for ( i = 0; i < n; i++ )
+    {
+        if ( system( cmd ) != 0 )
+            break;
+        if ( ( im = flimage_load( ppm ) ) )
+            flimage_free( im );
+        unlink( ppm );
+    }
+    t = now( ) - t;
+
+    if ( i < n )
+        printf( "pngtopnm not available, can't time the filter path\n" );
+    else
+        printf( "pngtopnm: %8.2f ms per load\n", 1.0e3 * t / n );
+
+    unlink( png );
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+    static FLIMAGE_SETUP setup;
+    int failed = 0;
+
+    setup.visual_cue = noop;
+    flimage_setup( &setup );
+    flimage_enable_png( );
+
+    if ( ! mkdtemp( dir ) )
+    {
+        perror( "mkdtemp" );
+        return 1;
+    }
+
+    srand( 1 );
+
+    if ( argc > 1 && ! strcmp( argv[ 1 ], "-bench" ) )
+        bench( argc > 2 ? atoi( argv[ 2 ] ) : 2048 );
+    else
+        failed = test( );
+
+    rmdir( dir );
+    return failed ? 1 : 0;
+}
+
+#else
+
+int
+main( void )
+{
+    fprintf( stderr, "PNG files are read and written directly only if "
+             "zlib is available\n" );
+    return 0;
+}
+
+#endif
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
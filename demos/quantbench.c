@@ -0,0 +1,1148 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Quality and timing of the conversion of RGB images to 256 colors
+ * with the median cut quantizer (doesn't need a display). Each image
+ * is converted with a copy of the single threaded code the library
+ * used before, with Floyd-Steinberg dithering, and then with the
+ * library, with Floyd-Steinberg and with ordered dithering, each with
+ * one thread and with one thread per processor. Printed are the times,
+ * the RMS error per color component and the RMS error after blurring
+ * both the original and the result with a 5x5 box filter (which is
+ * closer to what the eye sees of a dithered image). For the library's
+ * Floyd-Steinberg dithering also the number of pixels that differ from
+ * the result of the old code is printed (it should be 0). The test set
+ * consists of three synthetic 2048x2048 images - a smooth gradient,
+ * smooth color waves with noise and a pattern with hard edges - and any
+ * image files given on the command line.
+ *
+ *   usage: quantbench [-size n] [file ...]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "include/forms.h"
+#include "image/flimage.h"
+
+
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+noop( FL_IMAGE   * im  FL_UNUSED_ARG,
+      const char * s   FL_UNUSED_ARG )
+{
+    return 0;
+}
+
+
+/*********************************************************************
+ * The median cut quantizer with Floyd-Steinberg dithering the way the
+ * library did it before the histogram and the inverse colormap got
+ * computed on several threads (only the part for RGB images, without
+ * the progress reports). It's the 2-pass quantizer from the JPEG
+ * distribution of the Independent JPEG Group, Copyright (C) 1991-1996,
+ * Thomas G. Lane.
+ *********************************************************************/
+
+#define C0_SCALE       2        /* scale R distances by this much */
+#define C1_SCALE       3        /* scale G distances by this much */
+#define C2_SCALE       1        /* and B by this much */
+
+#define MAXJSAMPLE     FL_PCMAX
+#define MAXNUMCOLORS   ( MAXJSAMPLE + 1 )
+
+#define HIST_C0_BITS   5
+#define HIST_C1_BITS   6
+#define HIST_C2_BITS   5
+
+#define HIST_C0_ELEMS  ( 1 << HIST_C0_BITS )
+#define HIST_C1_ELEMS  ( 1 << HIST_C1_BITS )
+#define HIST_C2_ELEMS  ( 1 << HIST_C2_BITS )
+
+#define C0_SHIFT       ( FL_PCBITS - HIST_C0_BITS )
+#define C1_SHIFT       ( FL_PCBITS - HIST_C1_BITS )
+#define C2_SHIFT       ( FL_PCBITS - HIST_C2_BITS )
+
+#define BOX_C0_LOG     ( HIST_C0_BITS - 3 )
+#define BOX_C1_LOG     ( HIST_C1_BITS - 3 )
+#define BOX_C2_LOG     ( HIST_C2_BITS - 3 )
+
+#define BOX_C0_ELEMS   ( 1 << BOX_C0_LOG )
+#define BOX_C1_ELEMS   ( 1 << BOX_C1_LOG )
+#define BOX_C2_ELEMS   ( 1 << BOX_C2_LOG )
+
+#define BOX_C0_SHIFT   ( C0_SHIFT + BOX_C0_LOG )
+#define BOX_C1_SHIFT   ( C1_SHIFT + BOX_C1_LOG )
+#define BOX_C2_SHIFT   ( C2_SHIFT + BOX_C2_LOG )
+
+#define STEP_C0        ( ( 1 << C0_SHIFT ) * C0_SCALE )
+#define STEP_C1        ( ( 1 << C1_SHIFT ) * C1_SCALE )
+#define STEP_C2        ( ( 1 << C2_SHIFT ) * C2_SCALE )
+
+typedef unsigned short histcell;
+typedef histcell hist1d[ HIST_C2_ELEMS ];
+typedef hist1d *hist2d;
+typedef hist2d *hist3d;
+
+typedef struct {
+    int  c0min,
+         c0max;
+    int  c1min,
+         c1max;
+    int  c2min,
+         c2max;
+    int  volume;
+    long colorcount;
+} OLD_BOX;
+
+typedef struct {
+    hist3d   histogram;
+    short  * fserrors;
+    int    * error_limiter;
+    int      on_odd_row;
+    int    * colormap[ 3 ];
+    int      actual_number_of_colors;
+} OLD_SPEC;
+
+
+/***************************************
+ * Locates the colormap entries close enough to an update box to be
+ * candidates for the nearest entry to some cell in the box
+ ***************************************/
+
+static int
+old_find_nearby_colors( OLD_SPEC      * sp,
+                        int             minc0,
+                        int             minc1,
+                        int             minc2,
+                        unsigned char   colorlist[ ] )
+{
+    int maxc[ 3 ],
+        minc[ 3 ],
+        centerc[ 3 ];
+    static const int scale[ 3 ] = { C0_SCALE, C1_SCALE, C2_SCALE };
+    int i,
+        k,
+        x,
+        ncolors,
+        minmaxdist,
+        min_dist,
+        max_dist,
+        tdist;
+    int mindist[ MAXNUMCOLORS ];
+
+    minc[ 0 ] = minc0;
+    minc[ 1 ] = minc1;
+    minc[ 2 ] = minc2;
+    maxc[ 0 ] = minc0 + ( ( 1 << BOX_C0_SHIFT ) - ( 1 << C0_SHIFT ) );
+    maxc[ 1 ] = minc1 + ( ( 1 << BOX_C1_SHIFT ) - ( 1 << C1_SHIFT ) );
+    maxc[ 2 ] = minc2 + ( ( 1 << BOX_C2_SHIFT ) - ( 1 << C2_SHIFT ) );
+
+    for ( k = 0; k < 3; k++ )
+        centerc[ k ] = ( minc[ k ] + maxc[ k ] ) >> 1;
+
+    minmaxdist = 0x7FFFFFFFL;
+
+    for ( i = 0; i < sp->actual_number_of_colors; i++ )
+    {
+        min_dist = max_dist = 0;
+
+        for ( k = 0; k < 3; k++ )
+        {
+            x = sp->colormap[ k ][ i ];
+
+            if ( x < minc[ k ] )
+            {
+                tdist = ( x - minc[ k ] ) * scale[ k ];
+                min_dist += tdist * tdist;
+                tdist = ( x - maxc[ k ] ) * scale[ k ];
+                max_dist += tdist * tdist;
+            }
+            else if ( x > maxc[ k ] )
+            {
+                tdist = ( x - maxc[ k ] ) * scale[ k ];
+                min_dist += tdist * tdist;
+                tdist = ( x - minc[ k ] ) * scale[ k ];
+                max_dist += tdist * tdist;
+            }
+            else
+            {
+                tdist =   ( x - ( x <= centerc[ k ] ? maxc[ k ] : minc[ k ] ) )
+                        * scale[ k ];
+                max_dist += tdist * tdist;
+            }
+        }
+
+        mindist[ i ] = min_dist;
+        if ( max_dist < minmaxdist )
+            minmaxdist = max_dist;
+    }
+
+    for ( ncolors = i = 0; i < sp->actual_number_of_colors; i++ )
+        if ( mindist[ i ] <= minmaxdist )
+            colorlist[ ncolors++ ] = i;
+
+    return ncolors;
+}
+
+
+/***************************************
+ * Finds the closest of the candidate colors for each cell in the update
+ * box (using Thomas' incremental distance calculation)
+ ***************************************/
+
+static void
+old_find_best_colors( OLD_SPEC      * sp,
+                      int             minc0,
+                      int             minc1,
+                      int             minc2,
+                      int             numcolors,
+                      unsigned char   colorlist[ ],
+                      unsigned char   bestcolor[ ] )
+{
+    int bestdist[ BOX_C0_ELEMS * BOX_C1_ELEMS * BOX_C2_ELEMS ];
+    int ic0,
+        ic1,
+        ic2,
+        i,
+        icolor,
+        dist0,
+        dist1,
+        dist2,
+        xx0,
+        xx1,
+        xx2,
+        inc0,
+        inc1,
+        inc2;
+    int *bptr;
+    unsigned char *cptr;
+
+    for ( i = 0; i < BOX_C0_ELEMS * BOX_C1_ELEMS * BOX_C2_ELEMS; i++ )
+        bestdist[ i ] = 0x7FFFFFFFL;
+
+    for ( i = 0; i < numcolors; i++ )
+    {
+        icolor = colorlist[ i ];
+
+        inc0 = ( minc0 - sp->colormap[ 0 ][ icolor ] ) * C0_SCALE;
+        dist0 = inc0 * inc0;
+        inc1 = ( minc1 - sp->colormap[ 1 ][ icolor ] ) * C1_SCALE;
+        dist0 += inc1 * inc1;
+        inc2 = ( minc2 - sp->colormap[ 2 ][ icolor ] ) * C2_SCALE;
+        dist0 += inc2 * inc2;
+
+        inc0 = inc0 * 2 * STEP_C0 + STEP_C0 * STEP_C0;
+        inc1 = inc1 * 2 * STEP_C1 + STEP_C1 * STEP_C1;
+        inc2 = inc2 * 2 * STEP_C2 + STEP_C2 * STEP_C2;
+
+        bptr = bestdist;
+        cptr = bestcolor;
+        xx0 = inc0;
+
+        for ( ic0 = BOX_C0_ELEMS - 1; ic0 >= 0; ic0-- )
+        {
+            dist1 = dist0;
+            xx1 = inc1;
+
+            for ( ic1 = BOX_C1_ELEMS - 1; ic1 >= 0; ic1-- )
+            {
+                dist2 = dist1;
+                xx2 = inc2;
+
+                for ( ic2 = BOX_C2_ELEMS - 1; ic2 >= 0; ic2-- )
+                {
+                    if ( dist2 < *bptr )
+                    {
+                        *bptr = dist2;
+                        *cptr = icolor;
+                    }
+
+                    dist2 += xx2;
+                    xx2 += 2 * STEP_C2 * STEP_C2;
+                    bptr++;
+                    cptr++;
+                }
+
+                dist1 += xx1;
+                xx1 += 2 * STEP_C1 * STEP_C1;
+            }
+
+            dist0 += xx0;
+            xx0 += 2 * STEP_C0 * STEP_C0;
+        }
+    }
+}
+
+
+/***************************************
+ * Fills the inverse colormap entries of the update box that contains
+ * histogram cell c0/c1/c2
+ ***************************************/
+
+static void
+old_fill_inverse_cmap( OLD_SPEC * sp,
+                       int        c0,
+                       int        c1,
+                       int        c2 )
+{
+    unsigned char colorlist[ MAXNUMCOLORS ],
+                  bestcolor[ BOX_C0_ELEMS * BOX_C1_ELEMS * BOX_C2_ELEMS ],
+                  *cptr = bestcolor;
+    int minc0,
+        minc1,
+        minc2,
+        ic0,
+        ic1,
+        ic2,
+        numcolors;
+
+    c0 >>= BOX_C0_LOG;
+    c1 >>= BOX_C1_LOG;
+    c2 >>= BOX_C2_LOG;
+
+    minc0 = ( c0 << BOX_C0_SHIFT ) + ( ( 1 << C0_SHIFT ) >> 1 );
+    minc1 = ( c1 << BOX_C1_SHIFT ) + ( ( 1 << C1_SHIFT ) >> 1 );
+    minc2 = ( c2 << BOX_C2_SHIFT ) + ( ( 1 << C2_SHIFT ) >> 1 );
+
+    numcolors = old_find_nearby_colors( sp, minc0, minc1, minc2, colorlist );
+    old_find_best_colors( sp, minc0, minc1, minc2, numcolors, colorlist,
+                          bestcolor );
+
+    c0 <<= BOX_C0_LOG;
+    c1 <<= BOX_C1_LOG;
+    c2 <<= BOX_C2_LOG;
+
+    for ( ic0 = 0; ic0 < BOX_C0_ELEMS; ic0++ )
+        for ( ic1 = 0; ic1 < BOX_C1_ELEMS; ic1++ )
+        {
+            histcell *cachep = &sp->histogram[ c0 + ic0 ][ c1 + ic1 ][ c2 ];
+
+            for ( ic2 = 0; ic2 < BOX_C2_ELEMS; ic2++ )
+                *cachep++ = *cptr++ + 1;
+        }
+}
+
+
+/***************************************
+ * Second pass: Floyd-Steinberg dithering with serpentine scanning,
+ * filling the inverse colormap cache as colors are encountered
+ ***************************************/
+
+static void
+old_pass2_fs_dither( OLD_SPEC        * sp,
+                     unsigned char  ** red,
+                     unsigned char  ** green,
+                     unsigned char  ** blue,
+                     unsigned short ** output_buf,
+                     int               width,
+                     int               num_rows )
+{
+    int *error_limit = sp->error_limiter;
+    int row,
+        col,
+        k,
+        dir,
+        dir3;
+
+    for ( row = 0; row < num_rows; row++ )
+    {
+        unsigned char *in[ 3 ];
+        unsigned short *outptr = output_buf[ row ];
+        short *errorptr;
+        int cur[ 3 ] = { 0, 0, 0 },
+            belowerr[ 3 ] = { 0, 0, 0 },
+            bpreverr[ 3 ] = { 0, 0, 0 };
+
+        in[ 0 ] = red[ row ];
+        in[ 1 ] = green[ row ];
+        in[ 2 ] = blue[ row ];
+
+        if ( sp->on_odd_row )
+        {
+            for ( k = 0; k < 3; k++ )
+                in[ k ] += width - 1;
+            outptr += width - 1;
+            dir = -1;
+            dir3 = -3;
+            errorptr = sp->fserrors + ( width + 1 ) * 3;
+            sp->on_odd_row = 0;
+        }
+        else
+        {
+            dir = 1;
+            dir3 = 3;
+            errorptr = sp->fserrors;
+            sp->on_odd_row = 1;
+        }
+
+        for ( col = 0; col < width; col++ )
+        {
+            histcell *cachep;
+            int pixcode;
+
+            for ( k = 0; k < 3; k++ )
+            {
+                cur[ k ] = ( cur[ k ] + errorptr[ dir3 + k ] + 8 ) >> 4;
+                cur[ k ] = error_limit[ cur[ k ] ] + *in[ k ];
+                cur[ k ] = FL_PCCLAMP( cur[ k ] );
+            }
+
+            cachep = &sp->histogram[ cur[ 0 ] >> C0_SHIFT ]
+                                   [ cur[ 1 ] >> C1_SHIFT ]
+                                   [ cur[ 2 ] >> C2_SHIFT ];
+
+            if ( *cachep == 0 )
+                old_fill_inverse_cmap( sp, cur[ 0 ] >> C0_SHIFT,
+                                       cur[ 1 ] >> C1_SHIFT,
+                                       cur[ 2 ] >> C2_SHIFT );
+
+            *outptr = pixcode = *cachep - 1;
+
+            /* Distribute the error: 3/16 to the pixel below before,
+               5/16 below, 1/16 below after and 7/16 to the next one */
+
+            for ( k = 0; k < 3; k++ )
+            {
+                int bnexterr,
+                    delta;
+
+                cur[ k ] -= sp->colormap[ k ][ pixcode ];
+                bnexterr = cur[ k ];
+                delta = cur[ k ] * 2;
+                cur[ k ] += delta;
+                errorptr[ k ] = bpreverr[ k ] + cur[ k ];
+                cur[ k ] += delta;
+                bpreverr[ k ] = belowerr[ k ] + cur[ k ];
+                belowerr[ k ] = bnexterr;
+                cur[ k ] += delta;
+                in[ k ] += dir;
+            }
+
+            outptr += dir;
+            errorptr += dir3;
+        }
+
+        for ( k = 0; k < 3; k++ )
+            errorptr[ k ] = bpreverr[ k ];
+    }
+}
+
+
+/***************************************
+ * Shrinks the bounds of a box to enclose only nonzero histogram cells
+ * and recomputes its volume and population
+ ***************************************/
+
+static void
+old_update_box( OLD_SPEC * sp,
+                OLD_BOX  * boxp )
+{
+    hist3d histogram = sp->histogram;
+    histcell *histp;
+    int c0,
+        c1,
+        c2,
+        c0min = boxp->c0min,
+        c0max = boxp->c0max,
+        c1min = boxp->c1min,
+        c1max = boxp->c1max,
+        c2min = boxp->c2min,
+        c2max = boxp->c2max,
+        dist0,
+        dist1,
+        dist2;
+    long ccount = 0;
+
+    if ( c0max > c0min )
+        for ( c0 = c0min; c0 <= c0max; c0++ )
+            for ( c1 = c1min; c1 <= c1max; c1++ )
+            {
+                histp = &histogram[ c0 ][ c1 ][ c2min ];
+                for ( c2 = c2min; c2 <= c2max; c2++ )
+                    if ( *histp++ != 0 )
+                    {
+                        boxp->c0min = c0min = c0;
+                        goto have_c0min;
+                    }
+            }
+
+ have_c0min:
+
+    if ( c0max > c0min )
+        for ( c0 = c0max; c0 >= c0min; c0-- )
+            for ( c1 = c1min; c1 <= c1max; c1++ )
+            {
+                histp = &histogram[ c0 ][ c1 ][ c2min ];
+                for ( c2 = c2min; c2 <= c2max; c2++ )
+                    if ( *histp++ != 0 )
+                    {
+                        boxp->c0max = c0max = c0;
+                        goto have_c0max;
+                    }
+            }
+
+ have_c0max:
+
+    if ( c1max > c1min )
+        for ( c1 = c1min; c1 <= c1max; c1++ )
+            for ( c0 = c0min; c0 <= c0max; c0++ )
+            {
+                histp = &histogram[ c0 ][ c1 ][ c2min ];
+                for ( c2 = c2min; c2 <= c2max; c2++ )
+                    if ( *histp++ != 0 )
+                    {
+                        boxp->c1min = c1min = c1;
+                        goto have_c1min;
+                    }
+            }
+
+ have_c1min:
+
+    if ( c1max > c1min )
+        for ( c1 = c1max; c1 >= c1min; c1-- )
+            for ( c0 = c0min; c0 <= c0max; c0++ )
+            {
+                histp = &histogram[ c0 ][ c1 ][ c2min ];
+                for ( c2 = c2min; c2 <= c2max; c2++ )
+                    if ( *histp++ != 0 )
+                    {
+                        boxp->c1max = c1max = c1;
+                        goto have_c1max;
+                    }
+            }
+
+ have_c1max:
+
+    if ( c2max > c2min )
+        for ( c2 = c2min; c2 <= c2max; c2++ )
+            for ( c0 = c0min; c0 <= c0max; c0++ )
+            {
+                histp = &histogram[ c0 ][ c1min ][ c2 ];
+                for ( c1 = c1min; c1 <= c1max;
+                      c1++, histp += HIST_C2_ELEMS )
+                    if ( *histp != 0 )
+                    {
+                        boxp->c2min = c2min = c2;
+                        goto have_c2min;
+                    }
+            }
+
+ have_c2min:
+
+    if ( c2max > c2min )
+        for ( c2 = c2max; c2 >= c2min; c2-- )
+            for ( c0 = c0min; c0 <= c0max; c0++ )
+            {
+                histp = &histogram[ c0 ][ c1min ][ c2 ];
+                for ( c1 = c1min; c1 <= c1max;
+                      c1++, histp += HIST_C2_ELEMS )
+                    if ( *histp != 0 )
+                    {
+                        boxp->c2max = c2max = c2;
+                        goto have_c2max;
+                    }
+            }
+
+ have_c2max:
+
+    dist0 = ( ( c0max - c0min ) << C0_SHIFT ) * C0_SCALE;
+    dist1 = ( ( c1max - c1min ) << C1_SHIFT ) * C1_SCALE;
+    dist2 = ( ( c2max - c2min ) << C2_SHIFT ) * C2_SCALE;
+    boxp->volume = dist0 * dist0 + dist1 * dist1 + dist2 * dist2;
+
+    for ( c0 = c0min; c0 <= c0max; c0++ )
+        for ( c1 = c1min; c1 <= c1max; c1++ )
+        {
+            histp = &histogram[ c0 ][ c1 ][ c2min ];
+            for ( c2 = c2min; c2 <= c2max; c2++ )
+                if ( *histp++ != 0 )
+                    ccount++;
+        }
+
+    boxp->colorcount = ccount;
+}
+
+
+/***************************************
+ * Splits boxes until there are enough of them: first the ones with the
+ * largest population, then the ones with the largest volume, always
+ * halving the longest (scaled) axis
+ ***************************************/
+
+static int
+old_median_cut( OLD_SPEC * sp,
+                OLD_BOX  * boxlist,
+                int        numboxes,
+                int        desired_colors )
+{
+    while ( numboxes < desired_colors )
+    {
+        OLD_BOX *b1 = NULL,
+                *b2;
+        long maxc = 0;
+        int c[ 3 ],
+            n,
+            i,
+            lb;
+
+        for ( i = 0; i < numboxes; i++ )
+            if ( numboxes * 2 <= desired_colors )
+            {
+                if ( boxlist[ i ].colorcount > maxc && boxlist[ i ].volume )
+                {
+                    b1 = boxlist + i;
+                    maxc = b1->colorcount;
+                }
+            }
+            else if ( boxlist[ i ].volume > maxc )
+            {
+                b1 = boxlist + i;
+                maxc = b1->volume;
+            }
+
+        if ( ! b1 )
+            break;
+
+        b2 = boxlist + numboxes;
+        *b2 = *b1;
+
+        c[ 0 ] = ( ( b1->c0max - b1->c0min ) << C0_SHIFT ) * C0_SCALE;
+        c[ 1 ] = ( ( b1->c1max - b1->c1min ) << C1_SHIFT ) * C1_SCALE;
+        c[ 2 ] = ( ( b1->c2max - b1->c2min ) << C2_SHIFT ) * C2_SCALE;
+
+        /* Ties are broken in favor of green, then red */
+
+        n = 1;
+        if ( c[ 0 ] > c[ 1 ] )
+            n = 0;
+        if ( c[ 2 ] > c[ n ] )
+            n = 2;
+
+        if ( n == 0 )
+        {
+            lb = ( b1->c0max + b1->c0min ) / 2;
+            b1->c0max = lb;
+            b2->c0min = lb + 1;
+        }
+        else if ( n == 1 )
+        {
+            lb = ( b1->c1max + b1->c1min ) / 2;
+            b1->c1max = lb;
+            b2->c1min = lb + 1;
+        }
+        else
+        {
+            lb = ( b1->c2max + b1->c2min ) / 2;
+            b1->c2max = lb;
+            b2->c2min = lb + 1;
+        }
+
+        old_update_box( sp, b1 );
+        old_update_box( sp, b2 );
+        numboxes++;
+    }
+
+    return numboxes;
+}
+
+
+/***************************************
+ * Sets the colormap entry for a box to the mean of its pixels
+ ***************************************/
+
+static void
+old_compute_color( OLD_SPEC * sp,
+                   OLD_BOX  * boxp,
+                   int        icolor )
+{
+    long total = 0,
+         c0total = 0,
+         c1total = 0,
+         c2total = 0,
+         count;
+    int c0,
+        c1,
+        c2;
+
+    for ( c0 = boxp->c0min; c0 <= boxp->c0max; c0++ )
+        for ( c1 = boxp->c1min; c1 <= boxp->c1max; c1++ )
+            for ( c2 = boxp->c2min; c2 <= boxp->c2max; c2++ )
+                if ( ( count = sp->histogram[ c0 ][ c1 ][ c2 ] ) != 0 )
+                {
+                    total += count;
+                    c0total += (   ( c0 << C0_SHIFT )
+                                 + ( ( 1 << C0_SHIFT ) >> 1 ) ) * count;
+                    c1total += (   ( c1 << C1_SHIFT )
+                                 + ( ( 1 << C1_SHIFT ) >> 1 ) ) * count;
+                    c2total += (   ( c2 << C2_SHIFT )
+                                 + ( ( 1 << C2_SHIFT ) >> 1 ) ) * count;
+                }
+
+    sp->colormap[ 0 ][ icolor ] = ( c0total + ( total >> 1 ) ) / total;
+    sp->colormap[ 1 ][ icolor ] = ( c1total + ( total >> 1 ) ) / total;
+    sp->colormap[ 2 ][ icolor ] = ( c2total + ( total >> 1 ) ) / total;
+}
+
+
+/***************************************
+ * Builds the error limiting table: errors are mapped 1:1 up to 1/16 of
+ * the range, 1:2 up to 3/16 and clamped beyond that
+ ***************************************/
+
+static int *
+old_error_limit( void )
+{
+    int *table = malloc( ( MAXJSAMPLE * 2 + 1 ) * sizeof *table );
+    int step = ( MAXJSAMPLE + 1 ) / 16,
+        in,
+        out;
+
+    table += MAXJSAMPLE;
+
+    for ( out = in = 0; in < step; in++, out++ )
+    {
+        table[  in ] =  out;
+        table[ -in ] = -out;
+    }
+
+    for ( ; in < step * 3; in++, out += ( in & 1 ) ? 0 : 1 )
+    {
+        table[  in ] =  out;
+        table[ -in ] = -out;
+    }
+
+    for ( ; in <= MAXJSAMPLE; in++ )
+    {
+        table[  in ] =  out;
+        table[ -in ] = -out;
+    }
+
+    return table;
+}
+
+
+/***************************************
+ * Quantizes an RGB image the old way into 'ci' and the color lookup
+ * tables, returns the number of colors used
+ ***************************************/
+
+static int
+old_quantize_rgb( FL_IMAGE        * im,
+                  int               max_color,
+                  unsigned short ** ci,
+                  int             * red_lut,
+                  int             * green_lut,
+                  int             * blue_lut )
+{
+    OLD_SPEC sp;
+    OLD_BOX *boxlist = malloc( max_color * sizeof *boxlist );
+    int i,
+        row,
+        col,
+        numboxes;
+
+    sp.error_limiter = old_error_limit( );
+    sp.fserrors = calloc( ( im->w + 2 ) * 3, sizeof *sp.fserrors );
+    sp.histogram = malloc( HIST_C0_ELEMS * sizeof *sp.histogram );
+    for ( i = 0; i < HIST_C0_ELEMS; i++ )
+        sp.histogram[ i ] = calloc( HIST_C1_ELEMS, sizeof **sp.histogram );
+    sp.colormap[ 0 ] = red_lut;
+    sp.colormap[ 1 ] = green_lut;
+    sp.colormap[ 2 ] = blue_lut;
+
+    /* First pass: the histogram */
+
+    for ( row = 0; row < im->h; row++ )
+        for ( col = im->w; --col >= 0; )
+        {
+            histcell *histp = &sp.histogram[ im->red[   row ][ col ]
+                                             >> C0_SHIFT ]
+                                           [ im->green[ row ][ col ]
+                                             >> C1_SHIFT ]
+                                           [ im->blue[  row ][ col ]
+                                             >> C2_SHIFT ];
+
+            if ( ++*histp == 0 )
+                --*histp;
+        }
+
+    /* Selection of the colors */
+
+    boxlist[ 0 ].c0min = 0;
+    boxlist[ 0 ].c0max = MAXJSAMPLE >> C0_SHIFT;
+    boxlist[ 0 ].c1min = 0;
+    boxlist[ 0 ].c1max = MAXJSAMPLE >> C1_SHIFT;
+    boxlist[ 0 ].c2min = 0;
+    boxlist[ 0 ].c2max = MAXJSAMPLE >> C2_SHIFT;
+    old_update_box( &sp, boxlist );
+
+    numboxes = old_median_cut( &sp, boxlist, 1, max_color );
+
+    for ( i = 0; i < numboxes; i++ )
+        old_compute_color( &sp, boxlist + i, i );
+    sp.actual_number_of_colors = numboxes;
+
+    /* Second pass, reusing the histogram as the inverse colormap cache */
+
+    for ( i = 0; i < HIST_C0_ELEMS; i++ )
+        memset( sp.histogram[ i ], 0,
+                HIST_C1_ELEMS * HIST_C2_ELEMS * sizeof( histcell ) );
+
+    sp.on_odd_row = 0;
+    old_pass2_fs_dither( &sp, im->red, im->green, im->blue, ci, im->w,
+                         im->h );
+
+    for ( i = 0; i < HIST_C0_ELEMS; i++ )
+        free( sp.histogram[ i ] );
+    free( sp.histogram );
+    free( sp.fserrors );
+    free( sp.error_limiter - MAXJSAMPLE );
+    free( boxlist );
+
+    return numboxes;
+}
+
+
+/***************************************
+ * Creates one of the synthetic test images
+ ***************************************/
+
+static FL_IMAGE *
+make_image( int kind,
+            int n )
+{
+    FL_IMAGE *im = flimage_alloc( );
+    unsigned int s = 1;
+    int i,
+        j;
+
+    im->type = FL_IMAGE_RGB;
+    im->w = im->h = n;
+
+    if ( flimage_getmem( im ) < 0 )
+    {
+        fprintf( stderr, "out of memory\n" );
+        exit( 1 );
+    }
+
+    for ( j = 0; j < n; j++ )
+        for ( i = 0; i < n; i++ )
+        {
+            double x = ( double ) i / n,
+                   y = ( double ) j / n,
+                   r,
+                   g,
+                   b;
+
+            s = s * 1103515245 + 12345;
+
+            if ( kind == 0 )
+            {
+                r = x;
+                g = y;
+                b = 1.0 - x * y;
+            }
+            else if ( kind == 1 )
+            {
+                r =   0.5 + 0.5 * sin( 9 * x + 3 * y ) * cos( 5 * y )
+                    + ( ( s >> 16 ) % 21 - 10 ) / 255.0;
+                g = 0.5 + 0.5 * sin( 4 * x * y + 7 * y );
+                b = 0.5 + 0.5 * cos( 11 * x - 2 * y * y );
+            }
+            else
+            {
+                r = ( ( i / 37 + j / 23 ) % 5 ) / 4.0;
+                g = fmod( x * 7, 1.0 );
+                b = ( ( i ^ j ) & 255 ) / 255.0;
+            }
+
+            im->red[ j ][ i ]   = FL_clamp( ( int ) ( r * 255 ), 0, 255 );
+            im->green[ j ][ i ] = FL_clamp( ( int ) ( g * 255 ), 0, 255 );
+            im->blue[ j ][ i ]  = FL_clamp( ( int ) ( b * 255 ), 0, 255 );
+        }
+
+    return im;
+}
+
+
+/***************************************
+ * Returns the difference between the color of the quantized image and
+ * the original at a pixel for one of the color components
+ ***************************************/
+
+static int
+diff( FL_IMAGE * q,
+      FL_IMAGE * orig,
+      int        k,
+      int        x,
+      int        y )
+{
+    int c = q->ci[ y ][ x ];
+
+    if ( k == 0 )
+        return q->red_lut[ c ] - orig->red[ y ][ x ];
+    else if ( k == 1 )
+        return q->green_lut[ c ] - orig->green[ y ][ x ];
+    return q->blue_lut[ c ] - orig->blue[ y ][ x ];
+}
+
+
+/***************************************
+ * Calculates the RMS error, plain and after blurring both images
+ * with a 5x5 box filter (evaluated at every third pixel)
+ ***************************************/
+
+static void
+quality( FL_IMAGE * q,
+         FL_IMAGE * orig,
+         double   * plain,
+         double   * blurred )
+{
+    double e = 0.0,
+           eb = 0.0;
+    long n = 0;
+    int x,
+        y,
+        k,
+        dx,
+        dy;
+
+    for ( y = 0; y < orig->h; y++ )
+        for ( x = 0; x < orig->w; x++ )
+            for ( k = 0; k < 3; k++ )
+            {
+                int d = diff( q, orig, k, x, y );
+
+                e += d * d;
+            }
+
+    for ( y = 2; y < orig->h - 2; y += 3 )
+        for ( x = 2; x < orig->w - 2; x += 3, n++ )
+            for ( k = 0; k < 3; k++ )
+            {
+                double s = 0.0;
+
+                for ( dy = -2; dy <= 2; dy++ )
+                    for ( dx = -2; dx <= 2; dx++ )
+                        s += diff( q, orig, k, x + dx, y + dy );
+
+                s /= 25;
+                eb += s * s;
+            }
+
+    *plain = sqrt( e / ( 3.0 * orig->w * orig->h ) );
+    *blurred = n ? sqrt( eb / ( 3.0 * n ) ) : 0.0;
+}
+
+
+/***************************************
+ * Quantizes the image with the old code or, with a copy of it, with the
+ * given dither method and number of threads, prints the results and
+ * returns the quantized image. For Floyd-Steinberg dithering also the
+ * number of pixels with a different color than in the result of the
+ * old code is printed.
+ ***************************************/
+
+static FL_IMAGE *
+run( FL_IMAGE   * orig,
+     const char * name,
+     int          dither,
+     int          threads,
+     FL_IMAGE   * ref )
+{
+    FL_IMAGE *q = flimage_alloc( );
+    size_t size = ( size_t ) orig->w * orig->h;
+    double t,
+           plain,
+           blurred;
+    char differ[ 16 ] = "-";
+
+    q->w = orig->w;
+    q->h = orig->h;
+
+    if ( ! ref )
+    {
+        q->type = FL_IMAGE_CI;
+        q->map_len = 256;
+        flimage_getmem( q );
+
+        t = now( );
+        q->map_len = old_quantize_rgb( orig, 256, q->ci, q->red_lut,
+                                       q->green_lut, q->blue_lut );
+        t = now( ) - t;
+    }
+    else
+    {
+        q->type = FL_IMAGE_RGB;
+        flimage_getmem( q );
+        memcpy( q->red[ 0 ],   orig->red[ 0 ],   size );
+        memcpy( q->green[ 0 ], orig->green[ 0 ], size );
+        memcpy( q->blue[ 0 ],  orig->blue[ 0 ],  size );
+
+        flimage_set_dither( dither );
+        flimage_set_max_threads( threads );
+
+        t = now( );
+        flimage_convert( q, FL_IMAGE_CI, 256 );
+        t = now( ) - t;
+    }
+
+    if ( ref && dither == FLIMAGE_FS_DITHER )
+    {
+        long n = 0,
+             i;
+
+        for ( i = 0; i < ( long ) size; i++ )
+        {
+            int c = q->ci[ 0 ][ i ],
+                cr = ref->ci[ 0 ][ i ];
+
+            n +=    q->red_lut[ c ]   != ref->red_lut[ cr ]
+                 || q->green_lut[ c ] != ref->green_lut[ cr ]
+                 || q->blue_lut[ c ]  != ref->blue_lut[ cr ];
+        }
+
+        sprintf( differ, "%ld", n );
+    }
+
+    quality( q, orig, &plain, &blurred );
+
+    printf( "%-16s %-19s %-8s %8.3f %7d %8.2f %8.2f %9s\n", name,
+            ! ref ? "Floyd-Steinberg old"
+                  : dither == FLIMAGE_FS_DITHER ? "Floyd-Steinberg"
+                                                : "ordered",
+            threads ? "1" : "per CPU", t, q->map_len, plain, blurred,
+            differ );
+    fflush( stdout );
+
+    return q;
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+test( FL_IMAGE   * im,
+      const char * name )
+{
+    FL_IMAGE *ref;
+
+    if ( im->type != FL_IMAGE_RGB )
+        flimage_convert( im, FL_IMAGE_RGB, 0 );
+
+    ref = run( im, name, FLIMAGE_FS_DITHER, 1, NULL );
+    flimage_free( run( im, name, FLIMAGE_FS_DITHER, 1, ref ) );
+    flimage_free( run( im, name, FLIMAGE_FS_DITHER, 0, ref ) );
+    flimage_free( run( im, name, FLIMAGE_ORDERED_DITHER, 1, ref ) );
+    flimage_free( run( im, name, FLIMAGE_ORDERED_DITHER, 0, ref ) );
+    flimage_free( ref );
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+    static const char *names[ ] = { "gradient", "waves+noise", "edges" };
+    static FLIMAGE_SETUP setup;
+    FL_IMAGE *im;
+    int n = 2048,
+        i;
+
+    if ( argc > 2 && strcmp( argv[ 1 ], "-size" ) == 0 )
+    {
+        if ( ( n = atoi( argv[ 2 ] ) ) < 5 )
+        {
+            fprintf( stderr, "usage: %s [-size n] [file ...]\n", argv[ 0 ] );
+            return 1;
+        }
+
+        argc -= 2;
+        argv += 2;
+    }
+
+    setup.visual_cue = noop;
+    flimage_setup( &setup );
+
+    flimage_enable_png( );
+    flimage_enable_bmp( );
+    flimage_enable_gif( );
+    flimage_enable_tiff( );
+#ifndef NO_JPEG
+    flimage_enable_jpeg( );
+#endif
+
+    printf( "image            dither              threads  time (s)  colors"
+            "      RMS  blurred  differing\n" );
+
+    for ( i = 0; i < 3; i++ )
+    {
+        im = make_image( i, n );
+        test( im, names[ i ] );
+        flimage_free( im );
+    }
+
+    for ( i = 1; i < argc; i++ )
+        if ( ( im = flimage_load( argv[ i ] ) ) )
+        {
+            test( im, argv[ i ] );
+            flimage_free( im );
+        }
+        else
+            fprintf( stderr, "can't load %s\n", argv[ i ] );
+
+    return 0;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,455 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Benchmark for flimage_rotate() on a large RGB image (8192x8192 by
+ * default, doesn't need a display). Each rotation is also done the
+ * way the library did it before rotations got tiled and run in
+ * parallel: walking through the output pixel by pixel in row order,
+ * computing each source position in floating point (and, for
+ * rotations by multiples of 90 degrees, reading the source column by
+ * column). Both times are printed and the results are compared:
+ * rotations by multiples of 90 degrees must be identical, for other
+ * angles the new code rounds where the old one truncated, so most
+ * bilinear (subpixel) results differ by one or two units, and a few
+ * nearest neighbour picks at exact pixel boundaries may differ.
+ *
+ *   usage: rotbench [size [threads]]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "include/forms.h"
+#include "image/flimage.h"
+
+#define FILL  FL_PACK3( 10, 20, 30 )
+
+static struct {
+    int deg;
+    int subp;
+} cases[ ] = {
+    {  900, 0 },
+    { 1800, 0 },
+    { 2700, 0 },
+    {  450, 0 },
+    {  450, 1 },
+    {   15, 1 }
+};
+
+#define NUM_CASES  ( int ) ( sizeof cases / sizeof *cases )
+
+
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+noop( FL_IMAGE   * im  FL_UNUSED_ARG,
+      const char * s   FL_UNUSED_ARG )
+{
+    return 0;
+}
+
+
+/***************************************
+ * Creates a square RGB image with gradients and some noise
+ ***************************************/
+
+static FL_IMAGE *
+make_image( int n )
+{
+    FL_IMAGE *im = flimage_alloc( );
+    int x,
+        y;
+
+    im->type = FL_IMAGE_RGB;
+    im->w = im->h = n;
+    im->fill_color = FILL;
+
+    if ( flimage_getmem( im ) < 0 )
+    {
+        fprintf( stderr, "out of memory\n" );
+        exit( 1 );
+    }
+
+    srand( 1 );
+
+    for ( y = 0; y < n; y++ )
+        for ( x = 0; x < n; x++ )
+        {
+            im->red[ y ][ x ]   = x * 255 / n;
+            im->green[ y ][ x ] = rand( );
+            im->blue[ y ][ x ]  = y * 255 / n;
+        }
+
+    return im;
+}
+
+
+/***************************************
+ * Rotation by a multiple of 90 degrees of one color plane of an
+ * image of size 'n' the old way
+ ***************************************/
+
+static unsigned char **
+old_rotate_plane( unsigned char ** in,
+                  int              n,
+                  int              deg )
+{
+    unsigned char **out = fl_get_matrix( n, n, 1 ),
+                  *p = out[ 0 ];
+    int i,
+        j;
+
+    if ( deg == 900 )
+        for ( j = n - 1; j >= 0; j-- )
+            for ( i = 0; i < n; i++ )
+                *p++ = in[ i ][ j ];
+    else if ( deg == 2700 )
+        for ( j = 0; j < n; j++ )
+            for ( i = n - 1; i >= 0; i-- )
+                *p++ = in[ i ][ j ];
+    else
+        for ( i = n * n - 1; i >= 0; i-- )
+            *p++ = in[ 0 ][ i ];
+
+    return out;
+}
+
+
+/***************************************
+ * Rotation by an arbitrary angle the old way: the source position of
+ * each output pixel is computed from per-row and per-column tables in
+ * floating point, bilinear interpolation done with float weights. The
+ * size of the result and the shifts are calculated as in flimage_warp().
+ ***************************************/
+
+static void
+old_rotate_rgb( FL_IMAGE         * im,
+                int                deg,
+                int                subp,
+                unsigned char ** * out,
+                int              * nwp,
+                int              * nhp )
+{
+    unsigned char **in[ 3 ];
+    float m[ 2 ][ 2 ],
+          inv[ 2 ][ 2 ],
+          x[ 4 ],
+          y[ 4 ],
+          xmin = 0.0,
+          xmax = 0.0,
+          ymin = 0.0,
+          ymax = 0.0;
+    float *lutx0,
+          *luty0,
+          *lutx1,
+          *luty1;
+    int fill[ 3 ],
+        shift[ 2 ],
+        w = im->w,
+        h = im->h,
+        nw,
+        nh,
+        r,
+        c,
+        k,
+        i;
+
+    m[ 0 ][ 0 ] = m[ 1 ][ 1 ] = cos( deg * M_PI / 1800.0 );
+    m[ 0 ][ 1 ] = sin( deg * M_PI / 1800.0 );
+    m[ 1 ][ 0 ] = -m[ 0 ][ 1 ];
+
+    inv[ 0 ][ 0 ] =  m[ 1 ][ 1 ];
+    inv[ 1 ][ 0 ] = -m[ 1 ][ 0 ];
+    inv[ 0 ][ 1 ] = -m[ 0 ][ 1 ];
+    inv[ 1 ][ 1 ] =  m[ 0 ][ 0 ];
+
+    x[ 0 ] = y[ 0 ] = 0.0;
+    x[ 1 ] = m[ 0 ][ 0 ] * w;
+    y[ 1 ] = m[ 1 ][ 0 ] * w;
+    x[ 2 ] = m[ 0 ][ 0 ] * w + m[ 0 ][ 1 ] * h;
+    y[ 2 ] = m[ 1 ][ 0 ] * w + m[ 1 ][ 1 ] * h;
+    x[ 3 ] = m[ 0 ][ 1 ] * h;
+    y[ 3 ] = m[ 1 ][ 1 ] * h;
+
+    for ( i = 1; i < 4; i++ )
+    {
+        xmin = FL_min( xmin, x[ i ] );
+        xmax = FL_max( xmax, x[ i ] );
+        ymin = FL_min( ymin, y[ i ] );
+        ymax = FL_max( ymax, y[ i ] );
+    }
+
+    shift[ 0 ] = -( int ) FL_nint( xmin );
+    shift[ 1 ] = -( int ) FL_nint( ymin );
+    *nwp = nw = xmax - xmin + 0.5;
+    *nhp = nh = ymax - ymin + 0.5;
+
+    lutx0 = fl_malloc( nw * sizeof *lutx0 );
+    luty0 = fl_malloc( nw * sizeof *luty0 );
+    lutx1 = fl_malloc( nh * sizeof *lutx1 );
+    luty1 = fl_malloc( nh * sizeof *luty1 );
+
+    for ( i = 0; i < nw; i++ )
+    {
+        lutx0[ i ] = inv[ 0 ][ 0 ] * ( i - shift[ 0 ] );
+        luty0[ i ] = inv[ 1 ][ 0 ] * ( i - shift[ 0 ] );
+    }
+
+    for ( i = 0; i < nh; i++ )
+    {
+        lutx1[ i ] = inv[ 0 ][ 1 ] * ( i - shift[ 1 ] );
+        luty1[ i ] = inv[ 1 ][ 1 ] * ( i - shift[ 1 ] );
+    }
+
+    in[ 0 ] = im->red;
+    in[ 1 ] = im->green;
+    in[ 2 ] = im->blue;
+    fill[ 0 ] = FL_GETR( im->fill_color );
+    fill[ 1 ] = FL_GETG( im->fill_color );
+    fill[ 2 ] = FL_GETB( im->fill_color );
+
+    for ( k = 0; k < 3; k++ )
+        out[ k ] = fl_get_matrix( nh, nw, 1 );
+
+    for ( r = 0; r < nh; r++ )
+        for ( c = 0; c < nw; c++ )
+        {
+            float fx = lutx0[ c ] + lutx1[ r ],
+                  fy = luty0[ c ] + luty1[ r ];
+
+            if ( ! subp )
+            {
+                int ix = fx + 0.1,
+                    iy = fy + 0.1;
+                int outside = ix < 0 || ix > w - 1 || iy < 0 || iy > h - 1;
+
+                for ( k = 0; k < 3; k++ )
+                    out[ k ][ r ][ c ] =
+                                outside ? fill[ k ] : in[ k ][ iy ][ ix ];
+            }
+            else if ( fx <= -1.0f || fy <= -1.0f || fx >= w || fy >= h )
+            {
+                for ( k = 0; k < 3; k++ )
+                    out[ k ][ r ][ c ] = fill[ k ];
+            }
+            else
+            {
+                int ix = fx < 0.0 ? -1 : ( int ) fx,
+                    iy = fy < 0.0 ? -1 : ( int ) fy;
+                float wx = fx - ix,
+                      wy = fy - iy;
+
+                for ( k = 0; k < 3; k++ )
+                {
+                    unsigned char **p = in[ k ];
+                    int s00 = ix >= 0 && iy >= 0 ? p[ iy ][ ix ] : fill[ k ],
+                        s10 =   ix < w - 1 && iy >= 0
+                              ? p[ iy ][ ix + 1 ] : fill[ k ],
+                        s01 =   ix >= 0 && iy < h - 1
+                              ? p[ iy + 1 ][ ix ] : fill[ k ],
+                        s11 =   ix < w - 1 && iy < h - 1
+                              ? p[ iy + 1 ][ ix + 1 ] : fill[ k ];
+
+                    out[ k ][ r ][ c ] =
+                          ( s00 * ( 1 - wx ) + s10 * wx ) * ( 1 - wy )
+                        + ( s01 * ( 1 - wx ) + s11 * wx ) * wy;
+                }
+            }
+        }
+
+    fl_free( lutx0 );
+    fl_free( luty0 );
+    fl_free( lutx1 );
+    fl_free( luty1 );
+}
+
+
+/***************************************
+ * Counts the differing pixels (and the maximum difference) between
+ * two rotated images
+ ***************************************/
+
+static long
+compare( FL_IMAGE * a,
+         FL_IMAGE * b,
+         int      * maxdiff )
+{
+    long count = 0,
+         i;
+
+    *maxdiff = 0;
+
+    if ( a->w != b->w || a->h != b->h )
+    {
+        *maxdiff = 256;
+        return ( long ) b->w * b->h;
+    }
+
+    for ( i = 0; i < ( long ) a->w * a->h; i++ )
+    {
+        int diff = abs( a->red[ 0 ][ i ] - b->red[ 0 ][ i ] );
+
+        diff = FL_max( diff, abs( a->green[ 0 ][ i ] - b->green[ 0 ][ i ] ) );
+        diff = FL_max( diff, abs( a->blue[ 0 ][ i ] - b->blue[ 0 ][ i ] ) );
+
+        if ( diff )
+            count++;
+        *maxdiff = FL_max( *maxdiff, diff );
+    }
+
+    return count;
+}
+
+
+/***************************************
+ * Rotates the image the old way, replacing its pixels by the result
+ * (as flimage_rotate() does)
+ ***************************************/
+
+static void
+old_rotate( FL_IMAGE * im,
+            int        deg,
+            int        subp )
+{
+    unsigned char **out[ 3 ];
+    int nw = im->w,
+        nh = im->h;
+
+    if ( deg % 900 == 0 )
+    {
+        out[ 0 ] = old_rotate_plane( im->red,   im->w, deg );
+        out[ 1 ] = old_rotate_plane( im->green, im->w, deg );
+        out[ 2 ] = old_rotate_plane( im->blue,  im->w, deg );
+    }
+    else
+        old_rotate_rgb( im, deg, subp, out, &nw, &nh );
+
+    fl_free_matrix( im->red );
+    fl_free_matrix( im->green );
+    fl_free_matrix( im->blue );
+    im->red   = out[ 0 ];
+    im->green = out[ 1 ];
+    im->blue  = out[ 2 ];
+    im->w = nw;
+    im->h = nh;
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+    static FLIMAGE_SETUP setup;
+    int n = 8192,
+        failures = 0,
+        i;
+
+    if (    ( argc > 1 && ( n = atoi( argv[ 1 ] ) ) < 2 )
+         || ( argc > 2 && atoi( argv[ 2 ] ) < 0 ) )
+    {
+        fprintf( stderr, "usage: %s [size [threads]]\n", argv[ 0 ] );
+        return 1;
+    }
+
+    if ( argc > 2 )
+        flimage_set_max_threads( atoi( argv[ 2 ] ) );
+
+    setup.visual_cue = noop;
+    flimage_setup( &setup );
+
+    printf( "%dx%d RGB image\n", n, n );
+    printf( "angle  interpolation     old (s)   new (s)  speedup"
+            "   differing  max diff\n" );
+
+    for ( i = 0; i < NUM_CASES; i++ )
+    {
+        FL_IMAGE *old = make_image( n ),
+                 *new = make_image( n );
+        int deg = cases[ i ].deg,
+            subp = cases[ i ].subp,
+            maxdiff;
+        double t_old,
+               t_new;
+        long diff;
+
+        t_old = now( );
+        old_rotate( old, deg, subp );
+        t_old = now( ) - t_old;
+
+        t_new = now( );
+        flimage_rotate( new, deg, subp ? FLIMAGE_SUBPIXEL : 0 );
+        t_new = now( ) - t_new;
+
+        diff = compare( new, old, &maxdiff );
+
+        printf( "%5.1f  %-13s %9.3f %9.3f %7.1fx %11ld %9d\n",
+                deg / 10.0, subp ? "bilinear" : "nearest", t_old, t_new,
+                t_old / t_new, diff, maxdiff );
+        fflush( stdout );
+
+        /* Multiples of 90 degrees must give identical results, for
+           other angles allow for the rounding differences */
+
+        if (    ( deg % 900 == 0 && diff )
+             || ( ! subp && diff > ( long ) new->w * new->h / 200 )
+             || ( subp && maxdiff > 3 ) )
+            failures++;
+
+        flimage_free( old );
+        flimage_free( new );
+    }
+
+    if ( failures )
+        printf( "%d case(s) differ by more than expected\n", failures );
+
+    return failures != 0;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,247 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Benchmark for flimage_scale() (doesn't need a display). A square RGB,
+ * 16 bit gray and color index image (2048x2048 by default) is shrunk to
+ * half its size, to 37% (an uneven factor, so each output pixel gets a
+ * different set of weights) and enlarged by a factor of 1.5, with the
+ * older methods, pixel replication (FLIMAGE_NOSUBPIXEL) and box
+ * averaging (FLIMAGE_SUBPIXEL), and with the bilinear, bicubic and
+ * Lanczos3 filters. The times in ms are printed. Each time is the best
+ * of a few runs, each on a fresh copy of the image.
+ *
+ *   usage: scalebench [size [threads]]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "include/forms.h"
+#include "image/flimage.h"
+
+#define RUNS  3
+
+static struct {
+    const char *name;
+    int         option;
+} methods[ ] = {
+    { "replicate", FLIMAGE_NOSUBPIXEL },
+    { "box",       FLIMAGE_SUBPIXEL   },
+    { "bilinear",  FLIMAGE_BILINEAR   },
+    { "bicubic",   FLIMAGE_BICUBIC    },
+    { "lanczos3",  FLIMAGE_LANCZOS    }
+};
+
+#define NUM_METHODS  ( int ) ( sizeof methods / sizeof *methods )
+
+static const double factors[ ] = { 0.5, 0.37, 1.5 };
+
+#define NUM_FACTORS  ( int ) ( sizeof factors / sizeof *factors )
+
+
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+noop( FL_IMAGE   * im  FL_UNUSED_ARG,
+      const char * s   FL_UNUSED_ARG )
+{
+    return 0;
+}
+
+
+/***************************************
+ * Creates a square image of the given type with gradients and noise
+ ***************************************/
+
+static FL_IMAGE *
+make_image( int type,
+            int n )
+{
+    FL_IMAGE *im = flimage_alloc( );
+    int x,
+        y;
+
+    im->type = type;
+    im->w = im->h = n;
+
+    if ( type == FL_IMAGE_CI )
+        im->map_len = 256;
+    else if ( type == FL_IMAGE_GRAY16 )
+        im->gray_maxval = 4095;
+
+    if ( flimage_getmem( im ) < 0 )
+    {
+        fprintf( stderr, "out of memory\n" );
+        exit( 1 );
+    }
+
+    srand( 1 );
+
+    if ( type == FL_IMAGE_CI )
+        for ( x = 0; x < 256; x++ )
+        {
+            im->red_lut[ x ]   = x;
+            im->green_lut[ x ] = ( x * 7 ) & 255;
+            im->blue_lut[ x ]  = 255 - x;
+        }
+
+    for ( y = 0; y < n; y++ )
+        for ( x = 0; x < n; x++ )
+            if ( type == FL_IMAGE_RGB )
+            {
+                im->red[ y ][ x ]   = x * 255 / n;
+                im->green[ y ][ x ] = rand( );
+                im->blue[ y ][ x ]  = y * 255 / n;
+            }
+            else if ( type == FL_IMAGE_GRAY16 )
+                im->gray[ y ][ x ] = ( x + y ) * 2047 / n + rand( ) % 64;
+            else
+                im->ci[ y ][ x ] = ( x / 8 + y / 8 ) & 255;
+
+    return im;
+}
+
+
+/***************************************
+ * Returns the shortest time for scaling a copy of the image
+ ***************************************/
+
+static double
+time_scale( FL_IMAGE * im,
+            int        nw,
+            int        nh,
+            int        option )
+{
+    double best = 0.0;
+    int i;
+
+    for ( i = 0; i < RUNS; i++ )
+    {
+        FL_IMAGE *copy = flimage_dup( im );
+        double t = now( );
+
+        if ( flimage_scale( copy, nw, nh, option ) < 0 )
+        {
+            fprintf( stderr, "scaling failed\n" );
+            exit( 1 );
+        }
+
+        t = now( ) - t;
+        if ( i == 0 || t < best )
+            best = t;
+
+        flimage_free( copy );
+    }
+
+    return best;
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+    static const int types[ ] = { FL_IMAGE_RGB, FL_IMAGE_GRAY16,
+                                  FL_IMAGE_CI };
+    static const char *names[ ] = { "RGB", "gray16", "CI" };
+    static FLIMAGE_SETUP setup;
+    int n = 2048,
+        t,
+        f,
+        m;
+
+    if (    ( argc > 1 && ( n = atoi( argv[ 1 ] ) ) < 4 )
+         || ( argc > 2 && atoi( argv[ 2 ] ) < 0 ) )
+    {
+        fprintf( stderr, "usage: %s [size [threads]]\n", argv[ 0 ] );
+        return 1;
+    }
+
+    if ( argc > 2 )
+        flimage_set_max_threads( atoi( argv[ 2 ] ) );
+
+    setup.visual_cue = noop;
+    flimage_setup( &setup );
+
+    printf( "%dx%d images, times in ms\n", n, n );
+    printf( "%-7s %-11s", "image", "new size" );
+    for ( m = 0; m < NUM_METHODS; m++ )
+        printf( " %9s", methods[ m ].name );
+    printf( "\n" );
+
+    for ( t = 0; t < 3; t++ )
+    {
+        FL_IMAGE *im = make_image( types[ t ], n );
+
+        for ( f = 0; f < NUM_FACTORS; f++ )
+        {
+            int nw = n * factors[ f ] + 0.5;
+            char size[ 32 ];
+
+            sprintf( size, "%dx%d", nw, nw );
+            printf( "%-7s %-11s", names[ t ], size );
+
+            for ( m = 0; m < NUM_METHODS; m++ )
+            {
+                printf( " %9.1f",
+                        1.0e3 * time_scale( im, nw, nw,
+                                            methods[ m ].option ) );
+                fflush( stdout );
+            }
+
+            printf( "\n" );
+        }
+
+        flimage_free( im );
+    }
+
+    return 0;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,209 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Measures how many frames per second flimage_display() manages for
+ * an RGB image that gets modified before each frame (the image library
+ * uses shared memory for that if the X server supports the MIT-SHM
+ * extension). For comparison the frame rate for just sending an
+ * XImage of the same size with XPutImage(), i.e. over the connection
+ * to the X server, is measured as well.
+ *
+ *   usage: shmbench [width height [frames]]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "include/forms.h"
+#include "image/flimage.h"
+
+#ifdef HAVE_XSHM
+#include <X11/extensions/XShm.h>
+#endif
+
+
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+noop( FL_IMAGE   * im  FL_UNUSED_ARG,
+      const char * s   FL_UNUSED_ARG )
+{
+    return 0;
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+report( const char * what,
+        int          frames,
+        double       t,
+        double       bytes )
+{
+    printf( "%-24s %8.1f frames/s %10.1f MB/s\n", what, frames / t,
+            1.0e-6 * bytes * frames / t );
+    fflush( stdout );
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+    static FLIMAGE_SETUP setup;
+    Display *dpy;
+    FL_FORM *form;
+    FL_IMAGE *im;
+    XImage *xim;
+    GC gc;
+    double t,
+           bytes;
+    int w = 1024,
+        h = 768,
+        frames = 200,
+        depth,
+        shm = 0,
+        f,
+        x,
+        y;
+
+    fl_initialize( &argc, argv, 0, 0, 0 );
+    dpy = fl_get_display( );
+
+    if ( argc > 2 )
+    {
+        w = atoi( argv[ 1 ] );
+        h = atoi( argv[ 2 ] );
+    }
+
+    if ( argc > 3 )
+        frames = atoi( argv[ 3 ] );
+
+    if ( w < 1 || h < 1 || frames < 1 )
+    {
+        fprintf( stderr, "usage: %s [width height [frames]]\n", argv[ 0 ] );
+        return 1;
+    }
+
+    setup.visual_cue = noop;
+    flimage_setup( &setup );
+
+#ifdef HAVE_XSHM
+    shm = XShmQueryExtension( dpy );
+#endif
+
+    form = fl_bgn_form( FL_NO_BOX, w, h );
+    fl_end_form( );
+    fl_show_form( form, FL_PLACE_CENTER, FL_FULLBORDER, "SHM benchmark" );
+    fl_check_forms( );
+
+    depth = fl_state[ fl_vmode ].depth;
+    printf( "%d x %d pixels, depth %d, MIT-SHM %savailable\n", w, h, depth,
+            shm ? "" : "not " );
+
+    /* XImage for sending the pixels with XPutImage() */
+
+    gc = XCreateGC( dpy, form->window, 0, NULL );
+    xim = XCreateImage( dpy, fl_state[ fl_vmode ].xvinfo->visual, depth,
+                        ZPixmap, 0, NULL, w, h, 32, 0 );
+    xim->data = calloc( xim->bytes_per_line, h );
+    bytes = ( double ) xim->bytes_per_line * h;
+
+    im = flimage_alloc( );
+    im->type = FL_IMAGE_RGB;
+    im->w = w;
+    im->h = h;
+    flimage_getmem( im );
+
+    /* Moving color gradients, so each frame needs to be converted anew */
+
+    XSync( dpy, False );
+    t = now( );
+
+    for ( f = 0; f < frames; f++ )
+    {
+        for ( y = 0; y < h; y++ )
+            for ( x = 0; x < w; x++ )
+            {
+                im->red[ y ][ x ]   = x + f;
+                im->green[ y ][ x ] = y + 2 * f;
+                im->blue[ y ][ x ]  = x + y - f;
+            }
+
+        im->modified = 1;
+        flimage_display( im, form->window );
+    }
+
+    XSync( dpy, False );
+    report( "flimage_display()", frames, now( ) - t, bytes );
+
+    /* Just sending the pixels, changing a byte each time */
+
+    XSync( dpy, False );
+    t = now( );
+
+    for ( f = 0; f < frames; f++ )
+    {
+        xim->data[ f % ( xim->bytes_per_line * h ) ] = f;
+        XPutImage( dpy, form->window, gc, xim, 0, 0, 0, 0, w, h );
+    }
+
+    XSync( dpy, False );
+    report( "XPutImage() only", frames, now( ) - t, bytes );
+
+    XDestroyImage( xim );
+    XFreeGC( dpy, gc );
+    flimage_free( im );
+    fl_finish( );
+
+    return 0;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
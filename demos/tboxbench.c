@@ -0,0 +1,218 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Benchmark for browsers with lots of lines: writes a file with (by
+ * default) a million lines, loads it into a browser, scrolls around
+ * in it, inserts and deletes lines in the middle and finally adds the
+ * same number of lines one by one. The time each step took is printed.
+ *
+ *   usage: tboxbench [lines]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "include/forms.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define NUM_SCROLLS   2000
+#define NUM_EDITS     10000
+
+static double t_start;
+
+
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ * Makes sure all drawing requests have been dealt with by the
+ * X server before stopping the clock
+ ***************************************/
+
+static void
+report( const char * what,
+        int          count )
+{
+    double t;
+
+    XSync( fl_get_display( ), False );
+    t = now( ) - t_start;
+
+    printf( "%-28s %10.3f s", what, t );
+    if ( count > 1 )
+        printf( "  %10.2f us each", 1.0e6 * t / count );
+    putchar( '\n' );
+    fflush( stdout );
+
+    t_start = now( );
+}
+
+
+/***************************************
+ * Writes a file with 'n' lines of varying length, some of them
+ * with format specifiers
+ ***************************************/
+
+static int
+write_file( const char * name,
+            int          n )
+{
+    FILE *fp = fopen( name, "w" );
+    int i;
+
+    if ( ! fp )
+        return -1;
+
+    for ( i = 0; i < n; i++ )
+        switch ( i % 4 )
+        {
+            case 0 :
+                fprintf( fp, "@bLine %d\n", i );
+                break;
+
+            case 1 :
+                fprintf( fp, "Line %d: The quick brown fox jumps over the "
+                         "lazy dog\n", i );
+                break;
+
+            case 2 :
+                fprintf( fp, "@C1Line %d in red\n", i );
+                break;
+
+            default :
+                fprintf( fp, "%d\n", i );
+                break;
+        }
+
+    return fclose( fp );
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+    FL_FORM *form;
+    FL_OBJECT *br;
+    char name[ ] = "/tmp/tboxbenchXXXXXX";
+    char buf[ 64 ];
+    int n = 1000000,
+        fd,
+        i;
+
+    fl_initialize( &argc, argv, 0, 0, 0 );
+
+    if ( argc > 1 && ( n = atoi( argv[ 1 ] ) ) < 1 )
+    {
+        fprintf( stderr, "usage: %s [lines]\n", argv[ 0 ] );
+        return 1;
+    }
+
+    if ( ( fd = mkstemp( name ) ) < 0 )
+    {
+        perror( "mkstemp" );
+        return 1;
+    }
+    close( fd );
+
+    form = fl_bgn_form( FL_UP_BOX, 500, 600 );
+    br = fl_add_browser( FL_NORMAL_BROWSER, 10, 10, 480, 580, "" );
+    fl_end_form( );
+
+    fl_show_form( form, FL_PLACE_CENTER, FL_FULLBORDER, "Textbox benchmark" );
+    fl_check_forms( );
+
+    printf( "%d lines\n", n );
+
+    t_start = now( );
+    if ( write_file( name, n ) < 0 )
+    {
+        perror( name );
+        return 1;
+    }
+    report( "writing file", 1 );
+
+    fl_load_browser( br, name );
+    fl_check_forms( );
+    report( "loading file", 1 );
+
+    srand( 1 );
+    for ( i = 0; i < NUM_SCROLLS; i++ )
+        fl_set_browser_topline( br, 1 + rand( ) % n );
+    report( "scrolling to random lines", NUM_SCROLLS );
+
+    fl_set_browser_topline( br, 1 );
+    for ( i = 0; i < NUM_SCROLLS; i++ )
+        fl_set_browser_topline( br, 1 + i * 40 );
+    report( "scrolling page-wise", NUM_SCROLLS );
+
+    for ( i = 0; i < NUM_EDITS; i++ )
+    {
+        sprintf( buf, "Inserted line %d", i );
+        fl_insert_browser_line( br, 1 + rand( ) % n, buf );
+    }
+    report( "inserting lines", NUM_EDITS );
+
+    for ( i = 0; i < NUM_EDITS; i++ )
+        fl_delete_browser_line( br, 1 + rand( ) % n );
+    report( "deleting lines", NUM_EDITS );
+
+    fl_clear_browser( br );
+    report( "clearing", 1 );
+
+    fl_freeze_form( form );
+    for ( i = 0; i < n; i++ )
+    {
+        sprintf( buf, "Line %d", i );
+        fl_add_browser_line( br, buf );
+    }
+    fl_unfreeze_form( form );
+    report( "adding lines one by one", n );
+
+    unlink( name );
+    fl_finish( );
+    return 0;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,231 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Benchmark for timeouts with very many of them pending, like in
+ * programs where each of thousands of widgets has its own timeout.
+ * For a growing number n of pending timeouts (which expire in 10 to
+ * 100 seconds, so they stay pending) the times per operation for
+ *   - adding the n timeouts,
+ *   - removing a random one of them and adding a new one,
+ *   - a pass through the main loop, i.e. a call of fl_check_forms(),
+ *     with none of the timeouts expired (a pipe that always has data
+ *     keeps fl_check_forms() from waiting for the next timeout),
+ *   - dealing with expired timeouts (some thousand timeouts of 0 ms are
+ *     added and fl_check_forms() is called until all their callbacks
+ *     have been invoked) and
+ *   - removing all n timeouts in random order
+ * are printed, together with the ratio to the time for the smallest n.
+ * With timeouts kept in a heap the times for a pass through the main
+ * loop should stay constant and the others grow with log(n) only (for
+ * large n also cache misses add to it).
+ *
+ *   usage: timeoutbench [max_timeouts]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "include/forms.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define MIN_TIMEOUTS  1000
+#define OPS           10000       /* timeouts replaced or expired per n */
+
+static int expired;
+
+
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+count_cb( int    id    FL_UNUSED_ARG,
+          void * data  FL_UNUSED_ARG )
+{
+    expired++;
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+io_cb( int    fd    FL_UNUSED_ARG,
+       void * data  FL_UNUSED_ARG )
+{
+}
+
+
+/***************************************
+ * Returns a random delay between 10 and 100 seconds
+ ***************************************/
+
+static long
+long_delay( void )
+{
+    return 10000 + rand( ) % 90000;
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+    int max_n = 64000,
+        n,
+        i;
+    int *ids;
+    int fds[ 2 ];
+    double base[ 5 ] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+
+    fl_initialize( &argc, argv, 0, 0, 0 );
+
+    if ( argc > 1 && ( max_n = atoi( argv[ 1 ] ) ) < MIN_TIMEOUTS )
+    {
+        fprintf( stderr, "usage: %s [max_timeouts (at least %d)]\n",
+                 argv[ 0 ], MIN_TIMEOUTS );
+        return 1;
+    }
+
+    if ( pipe( fds ) < 0 || write( fds[ 1 ], "x", 1 ) != 1 )
+    {
+        perror( "pipe" );
+        return 1;
+    }
+
+    fl_add_io_callback( fds[ 0 ], FL_READ, io_cb, NULL );
+
+    ids = malloc( max_n * sizeof *ids );
+    srand( 1 );
+
+    /* Warm up, so the first round doesn't include setting things up */
+
+    for ( i = 0; i < max_n; i++ )
+        ids[ i ] = fl_add_timeout( long_delay( ), count_cb, NULL );
+    for ( i = 0; i < max_n; i++ )
+        fl_remove_timeout( ids[ i ] );
+
+    printf( "time per operation in us (and relative to n = %d)\n",
+            MIN_TIMEOUTS );
+    printf( "%7s %13s %13s %13s %13s %13s\n", "n", "add", "remove+add",
+            "loop pass", "expire", "remove" );
+
+    for ( n = MIN_TIMEOUTS; n <= max_n; n *= 2 )
+    {
+        double t[ 5 ];
+        int k;
+
+        /* Adding n timeouts */
+
+        t[ 0 ] = now( );
+        for ( i = 0; i < n; i++ )
+            ids[ i ] = fl_add_timeout( long_delay( ), count_cb, NULL );
+        t[ 0 ] = ( now( ) - t[ 0 ] ) / n;
+
+        /* Replacing random ones */
+
+        t[ 1 ] = now( );
+        for ( i = 0; i < OPS; i++ )
+        {
+            int j = rand( ) % n;
+
+            fl_remove_timeout( ids[ j ] );
+            ids[ j ] = fl_add_timeout( long_delay( ), count_cb, NULL );
+        }
+        t[ 1 ] = ( now( ) - t[ 1 ] ) / OPS;
+
+        /* Passes through the main loop without anything to do */
+
+        t[ 2 ] = now( );
+        for ( i = 0; i < OPS; i++ )
+            fl_check_forms( );
+        t[ 2 ] = ( now( ) - t[ 2 ] ) / OPS;
+
+        /* Expiry: all OPS timeouts are due at the first call of
+           fl_check_forms(), only a few calls should be needed */
+
+        expired = 0;
+        t[ 3 ] = now( );
+        for ( i = 0; i < OPS; i++ )
+            fl_add_timeout( 0, count_cb, NULL );
+        while ( expired < OPS )
+            fl_check_forms( );
+        t[ 3 ] = ( now( ) - t[ 3 ] ) / OPS;
+
+        /* Removing all of them in random order */
+
+        for ( i = n - 1; i > 0; i-- )
+        {
+            int j = rand( ) % ( i + 1 ),
+                id = ids[ i ];
+
+            ids[ i ] = ids[ j ];
+            ids[ j ] = id;
+        }
+
+        t[ 4 ] = now( );
+        for ( i = 0; i < n; i++ )
+            fl_remove_timeout( ids[ i ] );
+        t[ 4 ] = ( now( ) - t[ 4 ] ) / n;
+
+        printf( "%7d", n );
+        for ( k = 0; k < 5; k++ )
+        {
+            if ( n == MIN_TIMEOUTS )
+                base[ k ] = t[ k ];
+            printf( " %7.3f %4.1fx", 1.0e6 * t[ k ], t[ k ] / base[ k ] );
+        }
+        printf( "\n" );
+        fflush( stdout );
+    }
+
+    fl_remove_io_callback( fds[ 0 ], FL_READ, io_cb );
+    free( ids );
+    fl_finish( );
+    return 0;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
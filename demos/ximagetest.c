@@ -0,0 +1,338 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Test and benchmark for the conversion of RGB images to XImages for
+ * TrueColor visuals. Besides the layout of the server's default visual
+ * the usual 8-8-8 (RGB and BGR), 5-6-5 and 5-5-5 layouts are tried by
+ * passing flimage_to_ximage() a made-up visual, each with both byte
+ * orders (the display's byte order gets changed while the XImage is
+ * created - the XImage is never sent to the server). Every pixel of
+ * the result is compared to what the masks of the visual demand.
+ * With "-bench" the number of pixels converted per second for each
+ * layout is printed in addition.
+ *
+ *   usage: ximagetest [-bench [width height]]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/forms.h"
+#include "image/flimage.h"
+
+#define REPEATS  20
+
+typedef struct {
+    const char    * name;
+    int             depth;
+    unsigned long   rmask,
+                    gmask,
+                    bmask;
+} LAYOUT;
+
+static LAYOUT layouts[ ] = {
+    { "default visual", 0,  0,        0,      0        },
+    { "8-8-8 RGB",      24, 0xff0000, 0xff00, 0xff     },
+    { "8-8-8 BGR",      24, 0xff,     0xff00, 0xff0000 },
+    { "5-6-5",          16, 0xf800,   0x7e0,  0x1f     },
+    { "5-5-5",          15, 0x7c00,   0x3e0,  0x1f     }
+};
+
+#define NUM_LAYOUTS  ( int ) ( sizeof layouts / sizeof *layouts )
+
+
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+noop( FL_IMAGE   * im  FL_UNUSED_ARG,
+      const char * s   FL_UNUSED_ARG )
+{
+    return 0;
+}
+
+
+/***************************************
+ * Returns the value of an 8 bit color component placed into a mask
+ ***************************************/
+
+static unsigned long
+place( unsigned int  v,
+       unsigned long mask )
+{
+    int shift = 0,
+        bits = 0;
+
+    while ( ! ( mask & ( 1UL << shift ) ) )
+        shift++;
+    while ( mask & ( 1UL << ( shift + bits ) ) )
+        bits++;
+
+    return ( ( unsigned long ) v >> ( 8 - bits ) ) << shift;
+}
+
+
+/***************************************
+ * Reads a pixel from the XImage, honouring its byte order
+ ***************************************/
+
+static unsigned long
+get_pixel( XImage * xi,
+           int      x,
+           int      y )
+{
+    unsigned char *p = ( unsigned char * ) xi->data + y * xi->bytes_per_line
+                       + x * ( xi->bits_per_pixel / 8 );
+    unsigned long v = 0;
+    int n = xi->bits_per_pixel / 8,
+        i;
+
+    if ( xi->byte_order == MSBFirst )
+        for ( i = 0; i < n; i++ )
+            v = ( v << 8 ) | p[ i ];
+    else
+        for ( i = n - 1; i >= 0; i-- )
+            v = ( v << 8 ) | p[ i ];
+
+    return v;
+}
+
+
+/***************************************
+ * Gets rid of the XImage unless it's a shared memory one that the
+ * library keeps for reuse
+ ***************************************/
+
+static void
+drop_ximage( FL_IMAGE * im )
+{
+    if ( im->ximage && ! im->xshm )
+        XDestroyImage( ( XImage * ) im->ximage );
+    im->ximage = NULL;
+}
+
+
+/***************************************
+ * Converts the image for the visual and byte order and checks the
+ * result, returns the number of wrong pixels (or -1 if the conversion
+ * failed)
+ ***************************************/
+
+static long
+check( FL_IMAGE          * im,
+       XWindowAttributes * xwa,
+       int                 byte_order,
+       int                 bench )
+{
+    Display *dpy = fl_get_display( );
+    Visual *v = xwa->visual;
+    unsigned long mask = v->red_mask | v->green_mask | v->blue_mask;
+    int old_order = ImageByteOrder( dpy );
+    long bad = 0;
+    double t = 0.0;
+    XImage *xi;
+    int ret,
+        x,
+        y,
+        i;
+
+    ( ( _XPrivDisplay ) dpy )->byte_order = byte_order;
+    ret = flimage_to_ximage( im, fl_root, xwa );
+
+    if ( ret == 0 && bench )
+    {
+        t = now( );
+        for ( i = 0; i < REPEATS && ret == 0; i++ )
+        {
+            drop_ximage( im );
+            ret = flimage_to_ximage( im, fl_root, xwa );
+        }
+        t = now( ) - t;
+    }
+
+    ( ( _XPrivDisplay ) dpy )->byte_order = old_order;
+
+    if ( ret != 0 || ! ( xi = im->ximage ) )
+        return -1;
+
+    for ( y = 0; y < im->h; y++ )
+        for ( x = 0; x < im->w; x++ )
+        {
+            unsigned long want =   place( im->red[ y ][ x ],   v->red_mask )
+                                 | place( im->green[ y ][ x ], v->green_mask )
+                                 | place( im->blue[ y ][ x ],  v->blue_mask );
+
+            if ( ( get_pixel( xi, x, y ) & mask ) != want && bad++ < 3 )
+                fprintf( stderr, "  pixel (%d,%d): got 0x%lx, want 0x%lx\n",
+                         x, y, get_pixel( xi, x, y ) & mask, want );
+        }
+
+    printf( "  %s %2d bpp:", byte_order == MSBFirst ? "MSBFirst" : "LSBFirst",
+            xi->bits_per_pixel );
+
+    if ( bench )
+        printf( " %8.1f Mpixel/s", 1.0e-6 * REPEATS * im->w * im->h / t );
+
+    printf( "  %s\n", bad ? "FAILED" : "ok" );
+    drop_ximage( im );
+    return bad;
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+    static FLIMAGE_SETUP setup;
+    XWindowAttributes root_xwa;
+    int w = 317,
+        h = 123,
+        bench = 0,
+        failures = 0,
+        n,
+        x,
+        y;
+
+    fl_initialize( &argc, argv, 0, 0, 0 );
+
+    if ( argc > 1 && strcmp( argv[ 1 ], "-bench" ) == 0 )
+    {
+        bench = 1;
+        w = 1920;
+        h = 1080;
+
+        if ( argc > 3 )
+        {
+            w = atoi( argv[ 2 ] );
+            h = atoi( argv[ 3 ] );
+        }
+    }
+    else if ( argc > 1 )
+        w = 0;
+
+    if ( w < 1 || h < 1 )
+    {
+        fprintf( stderr, "usage: %s [-bench [width height]]\n", argv[ 0 ] );
+        return 1;
+    }
+
+    setup.visual_cue = noop;
+    flimage_setup( &setup );
+
+    XGetWindowAttributes( fl_get_display( ), fl_root, &root_xwa );
+
+    if ( root_xwa.visual->class != TrueColor )
+        layouts[ 0 ].name = NULL;
+
+    srand( 1 );
+
+    for ( n = 0; n < NUM_LAYOUTS; n++ )
+    {
+        XWindowAttributes xwa = root_xwa;
+        Visual visual = *root_xwa.visual;
+        FL_IMAGE *im;
+        long bad;
+        int order;
+
+        if ( ! layouts[ n ].name )
+            continue;
+
+        if ( layouts[ n ].depth )
+        {
+            visual.class = TrueColor;
+            visual.red_mask = layouts[ n ].rmask;
+            visual.green_mask = layouts[ n ].gmask;
+            visual.blue_mask = layouts[ n ].bmask;
+            visual.bits_per_rgb = 8;
+            visual.map_entries = 256;
+            xwa.depth = layouts[ n ].depth;
+        }
+
+        xwa.visual = &visual;
+
+        printf( "%s (depth %d, masks 0x%lx 0x%lx 0x%lx)\n", layouts[ n ].name,
+                xwa.depth, visual.red_mask, visual.green_mask,
+                visual.blue_mask );
+
+        for ( order = LSBFirst; order <= MSBFirst; order++ )
+        {
+            /* Use a new image each time, so it gets adapted to the
+               visual again */
+
+            im = flimage_alloc( );
+            im->type = FL_IMAGE_RGB;
+            im->w = w;
+            im->h = h;
+            flimage_getmem( im );
+
+            for ( y = 0; y < h; y++ )
+                for ( x = 0; x < w; x++ )
+                {
+                    im->red[ y ][ x ]   = rand( );
+                    im->green[ y ][ x ] = rand( );
+                    im->blue[ y ][ x ]  = rand( );
+                }
+
+            if ( ( bad = check( im, &xwa, order, bench ) ) != 0 )
+            {
+                if ( bad < 0 )
+                    printf( "  conversion failed\n" );
+                failures++;
+            }
+
+            flimage_free( im );
+        }
+    }
+
+    printf( "%d failure(s)\n", failures );
+    fl_finish( );
+    return failures != 0;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,219 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Benchmark for streaming large amounts of data into an xyplot. 10
+ * million points (a noisy sine, like a telemetry trace) are pushed
+ *   - one at a time with fl_append_xyplot_data() while the form is
+ *     frozen, into a plot limited to the newest 1 million points,
+ *   - in blocks of 1000 points with fl_append_xyplot_data() into the
+ *     same plot, redrawing it after each block,
+ *   - one at a time with fl_insert_xyplot_data() (only a thousandth
+ *     of the points, as that redraws the plot for each point).
+ * Finally the plot is set to all 10 million points at once and redrawn
+ * a few times. Times and rates are printed.
+ *
+ *   usage: xyplotbench [points [window [block]]]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "include/forms.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define REDRAWS  10
+
+static FL_FORM *form;
+static FL_OBJECT *xyplot;
+
+
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ * Empties the plot and sets the number of points it keeps
+ ***************************************/
+
+static void
+reset( int window )
+{
+    float x = 0.0,
+          y = 0.0;
+
+    fl_set_xyplot_data( xyplot, &x, &y, 1, "", "", "" );
+    fl_set_xyplot_maxpoints( xyplot, 0, window );
+    XSync( fl_get_display( ), False );
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+report( const char * what,
+        long         points,
+        double       t )
+{
+    printf( "%-44s %8.3f s  %7.2f Mpoints/s  (%d in plot)\n", what, t,
+            1.0e-6 * points / t, fl_get_xyplot_numdata( xyplot, 0 ) );
+    fflush( stdout );
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+    long points = 10000000,
+         i;
+    int window = 1000000,
+        block = 1000;
+    float *x,
+          *y;
+    char what[ 64 ];
+    double t;
+
+    fl_initialize( &argc, argv, 0, 0, 0 );
+
+    if ( argc > 1 )
+        points = atol( argv[ 1 ] );
+    if ( argc > 2 )
+        window = atoi( argv[ 2 ] );
+    if ( argc > 3 )
+        block = atoi( argv[ 3 ] );
+
+    if ( points < 10 || window < 1 || block < 1 )
+    {
+        fprintf( stderr, "usage: %s [points [window [block]]]\n", argv[ 0 ] );
+        return 1;
+    }
+
+    if (    ! ( x = malloc( points * sizeof *x ) )
+         || ! ( y = malloc( points * sizeof *y ) ) )
+    {
+        fprintf( stderr, "out of memory\n" );
+        return 1;
+    }
+
+    srand( 1 );
+    for ( i = 0; i < points; i++ )
+    {
+        x[ i ] = i + 1;
+        y[ i ] = sin( i * 1.0e-4 ) + 0.1 * rand( ) / RAND_MAX;
+    }
+
+    form = fl_bgn_form( FL_UP_BOX, 840, 440 );
+    xyplot = fl_add_xyplot( FL_NORMAL_XYPLOT, 20, 20, 800, 400, "" );
+    fl_end_form( );
+
+    fl_show_form( form, FL_PLACE_CENTER, FL_FULLBORDER, "xyplot benchmark" );
+    fl_check_forms( );
+
+    /* Single points, without drawing */
+
+    reset( window );
+    fl_freeze_form( form );
+
+    t = now( );
+    for ( i = 0; i < points; i++ )
+        fl_append_xyplot_data( xyplot, 0, x + i, y + i, 1 );
+    t = now( ) - t;
+
+    fl_unfreeze_form( form );
+    XSync( fl_get_display( ), False );
+    sprintf( what, "append %ld single points, frozen", points );
+    report( what, points, t );
+
+    /* Blocks, redrawing after each */
+
+    reset( window );
+
+    t = now( );
+    for ( i = 0; i < points; i += block )
+        fl_append_xyplot_data( xyplot, 0, x + i, y + i,
+                               FL_min( block, points - i ) );
+    XSync( fl_get_display( ), False );
+    t = now( ) - t;
+
+    sprintf( what, "append %ld points in blocks of %d", points, block );
+    report( what, points, t );
+
+    /* The old way of adding points, each one redrawing the plot */
+
+    reset( window );
+
+    t = now( );
+    for ( i = 0; i < points / 1000; i++ )
+        fl_insert_xyplot_data( xyplot, 0, fl_get_xyplot_numdata( xyplot, 0 ),
+                               x[ i ], y[ i ] );
+    XSync( fl_get_display( ), False );
+    t = now( ) - t;
+
+    sprintf( what, "insert %ld single points", points / 1000 );
+    report( what, points / 1000, t );
+
+    /* Drawing all points */
+
+    fl_set_xyplot_maxpoints( xyplot, 0, 0 );
+    fl_set_xyplot_data( xyplot, x, y, points, "", "", "" );
+    XSync( fl_get_display( ), False );
+
+    t = now( );
+    for ( i = 0; i < REDRAWS; i++ )
+    {
+        fl_redraw_object( xyplot );
+        XSync( fl_get_display( ), False );
+    }
+    t = ( now( ) - t ) / REDRAWS;
+
+    sprintf( what, "redraw %ld points", points );
+    report( what, points, t );
+
+    free( x );
+    free( y );
+    fl_finish( );
+    return 0;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,216 @@
+/*
+ *  This file is part of XForms.
+ *
+ *  XForms is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 2.1, or
+ *  (at your option) any later version.
+ *
+ *  XForms is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with XForms; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 59 Temple Place - Suite 330, Boston,
+ *  MA 02111-1307, USA.
+ */
+
+
+/*
+ * Redraw latency of a streaming xyplot, i.e. the time from appending a
+ * block of points until the X server has drawn the updated plot. The
+ * plot has a title, axis labels, tics, a grid and a key. Three cases
+ * are measured:
+ *   - bounds fixed in advance, so only the data change: the cached
+ *     background just gets copied and the curve drawn on top,
+ *   - the same, but with the cache invalidated before each update, so
+ *     the background gets drawn completely each time, which is what
+ *     every redraw cost before there was a cache,
+ *   - autoscaling with a window of the newest points, so the bounds
+ *     change with each update and the background has to be redrawn
+ *     anyway.
+ * Mean, median, 99th percentile and maximum latency are printed.
+ *
+ *   usage: xyplotlatency [updates [points]]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "include/forms.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define WINDOW  20000
+
+static FL_FORM *form;
+static FL_OBJECT *xyplot;
+
+
+/***************************************
+ ***************************************/
+
+static double
+now( void )
+{
+    long sec,
+         usec;
+
+    fl_gettime( &sec, &usec );
+    return sec + 1.0e-6 * usec;
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+cmp_double( const void * a,
+            const void * b )
+{
+    double d = *( const double * ) a - *( const double * ) b;
+
+    return d < 0 ? -1 : d > 0;
+}
+
+
+/***************************************
+ * Streams the data into the plot in 'updates' blocks of 'n' points and
+ * prints the latencies
+ ***************************************/
+
+static void
+run( const char * what,
+     float      * x,
+     float      * y,
+     int          updates,
+     int          n,
+     int          fixed,
+     int          invalidate )
+{
+    double *lat = malloc( updates * sizeof *lat ),
+           sum = 0.0;
+    float x0 = 0.0,
+          y0 = 0.0;
+    int i;
+
+    fl_set_xyplot_data( xyplot, &x0, &y0, 1, "Telemetry", "sample", "value" );
+    fl_set_xyplot_key( xyplot, 0, "channel 1" );
+
+    if ( fixed )
+    {
+        fl_set_xyplot_maxpoints( xyplot, 0, 0 );
+        fl_set_xyplot_xbounds( xyplot, 0.0, ( double ) updates * n );
+        fl_set_xyplot_ybounds( xyplot, -1.5, 1.5 );
+    }
+    else
+    {
+        fl_set_xyplot_maxpoints( xyplot, 0, WINDOW );
+        fl_set_xyplot_xbounds( xyplot, 0.0, 0.0 );
+        fl_set_xyplot_ybounds( xyplot, 0.0, 0.0 );
+    }
+
+    XSync( fl_get_display( ), False );
+
+    for ( i = 0; i < updates; i++ )
+    {
+        double t = now( );
+
+        /* Resetting the margins to what they are throws away the
+           cached background without changing anything else */
+
+        if ( invalidate )
+            fl_set_xyplot_fixed_yaxis( xyplot, NULL, NULL );
+
+        fl_append_xyplot_data( xyplot, 0, x + i * n, y + i * n, n );
+        XSync( fl_get_display( ), False );
+        sum += lat[ i ] = now( ) - t;
+    }
+
+    qsort( lat, updates, sizeof *lat, cmp_double );
+
+    printf( "%-36s %8.3f %8.3f %8.3f %8.3f\n", what,
+            1.0e3 * sum / updates, 1.0e3 * lat[ updates / 2 ],
+            1.0e3 * lat[ ( int ) ( 0.99 * ( updates - 1 ) ) ],
+            1.0e3 * lat[ updates - 1 ] );
+    fflush( stdout );
+
+    free( lat );
+}
+
+
+/***************************************
+ ***************************************/
+
+int
+main( int    argc,
+      char * argv[ ] )
+{
+    int updates = 2000,
+        n = 100,
+        i;
+    float *x,
+          *y;
+    char what[ 64 ];
+
+    fl_initialize( &argc, argv, 0, 0, 0 );
+
+    if ( argc > 1 )
+        updates = atoi( argv[ 1 ] );
+    if ( argc > 2 )
+        n = atoi( argv[ 2 ] );
+
+    if ( updates < 1 || n < 1 )
+    {
+        fprintf( stderr, "usage: %s [updates [points]]\n", argv[ 0 ] );
+        return 1;
+    }
+
+    if (    ! ( x = malloc( ( size_t ) updates * n * sizeof *x ) )
+         || ! ( y = malloc( ( size_t ) updates * n * sizeof *y ) ) )
+    {
+        fprintf( stderr, "out of memory\n" );
+        return 1;
+    }
+
+    srand( 1 );
+    for ( i = 0; i < updates * n; i++ )
+    {
+        x[ i ] = i + 1;
+        y[ i ] = sin( i * 2.0e-3 ) + 0.2 * rand( ) / RAND_MAX;
+    }
+
+    form = fl_bgn_form( FL_UP_BOX, 840, 440 );
+    xyplot = fl_add_xyplot( FL_NORMAL_XYPLOT, 20, 20, 800, 400, "" );
+    fl_set_xyplot_xgrid( xyplot, FL_GRID_MINOR );
+    fl_set_xyplot_ygrid( xyplot, FL_GRID_MAJOR );
+    fl_end_form( );
+
+    fl_show_form( form, FL_PLACE_CENTER, FL_FULLBORDER, "xyplot latency" );
+    fl_check_forms( );
+
+    printf( "%d updates of %d points, latency in ms:\n", updates, n );
+    printf( "%-36s %8s %8s %8s %8s\n", "", "mean", "median", "99%", "max" );
+
+    run( "fixed bounds, cached background", x, y, updates, n, 1, 0 );
+    run( "fixed bounds, background redrawn", x, y, updates, n, 1, 1 );
+    sprintf( what, "autoscaling, last %d points", WINDOW );
+    run( what, x, y, updates, n, 0, 0 );
+
+    free( x );
+    free( y );
+    fl_finish( );
+    return 0;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -344,6 +344,15 @@ typedef struct flimage_ {
     int               isPixmap;
     FLIMAGESETUP      setup;
     char            * info;
+    void            * xshm;           /* shared memory XImage, if any */
+    FL_WINDOW         progressive_win; /* shows rows while reading */
+    int               rows_done;      /* rows already handed out   */
+
+    /* application handler, kept at the end for binary compatibility */
+
+    void              ( * rows_ready )( struct flimage_ *,
+                                        int,
+                                        int );
 } FL_IMAGE;
 
 /* some configuration stuff */
@@ -370,10 +379,18 @@ typedef struct flimage_setup_ {
 
     unsigned long   trailblazer;
     int             header_info;
+
+    /* kept at the end for binary compatibility */
+
+    void            ( * rows_ready )( FL_IMAGE *,
+                                      int,
+                                      int );
 } FLIMAGE_SETUP;
 
 FL_EXPORT void flimage_setup( FLIMAGE_SETUP * );
 
+FL_EXPORT int flimage_set_max_threads( int );
+
 /* Possible errors from the library. Not currently (v0.89) used */
 
 enum {
@@ -395,6 +412,9 @@ typedef int ( * FLIMAGE_Write_Image )( FL_IMAGE * );
 
 FL_EXPORT FL_IMAGE * flimage_load( const char * file );
 
+FL_EXPORT FL_IMAGE * flimage_load_progressive( const char * file,
+                                               FL_WINDOW    win );
+
 FL_EXPORT FL_IMAGE * flimage_read( FL_IMAGE * im );
 
 FL_EXPORT int flimage_dump( FL_IMAGE *,
@@ -536,6 +556,33 @@ FL_EXPORT void * fl_make_matrix( int,
 
 FL_EXPORT void fl_free_matrix( void * );
 
+/* Flags for fl_get_matrix_ex() */
+
+#define FL_MATRIX_ZERO        1     /* clear the elements */
+#define FL_MATRIX_ALIGN_ROWS  2     /* start each row 64 byte aligned */
+
+FL_EXPORT void * fl_get_matrix_ex( int,
+                                   int,
+                                   unsigned int,
+                                   int );
+
+/* Statistics of the memory used for image planes */
+
+typedef struct {
+    unsigned long allocated;        /* planes handed out so far          */
+    unsigned long recycled;         /* ... of which came from the pool   */
+    unsigned long released;         /* planes freed so far               */
+    unsigned long in_use;           /* planes currently in use           */
+    unsigned long in_use_bytes;
+    unsigned long pooled;           /* freed planes kept for reuse       */
+    unsigned long pooled_bytes;
+    unsigned long max_pool_bytes;   /* limit for pooled_bytes            */
+} FLIMAGE_PLANE_STATS;
+
+FL_EXPORT void flimage_get_plane_stats( FLIMAGE_PLANE_STATS * );
+
+FL_EXPORT unsigned long flimage_set_plane_pool_size( unsigned long );
+
 /* This function is retained for compatibility reasons only.
    It returns 1 always. */
 
@@ -562,6 +609,15 @@ FL_EXPORT int flimage_getcolormap( FL_IMAGE * );
 
 FL_EXPORT void fl_select_mediancut_quantizer( void );
 
+/* How the median cut quantizer maps pixels to the selected colors */
+
+enum {
+    FLIMAGE_FS_DITHER,          /* Floyd-Steinberg error diffusion */
+    FLIMAGE_ORDERED_DITHER      /* 8x8 ordered (Bayer) dither      */
+};
+
+FL_EXPORT int flimage_set_dither( int );
+
 /* Simple image processing routines */
 
 #define FLIMAGE_SHARPEN        ( ( int** )( -1 ) )
@@ -575,6 +631,9 @@ enum {
    FLIMAGE_CENTER     =  2,     /* center warped image. default  */
    FLIMAGE_RIGHT      =  8,     /* flush right the warped image  */
    FLIMAGE_ASPECT     = 32,     /* fit the size */
+   FLIMAGE_BILINEAR   = 64,     /* resample with a triangle filter */
+   FLIMAGE_BICUBIC    = 128,    /* resample with a cubic filter */
+   FLIMAGE_LANCZOS    = 256,    /* resample with a Lanczos3 filter */
    FLIMAGE_NOCENTER   = FL_ALIGN_LEFT_TOP
 };
 
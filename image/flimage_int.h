@@ -67,15 +67,31 @@ typedef struct {
 } SubImage;
 
 SubImage * flimage_get_subimage( FL_IMAGE * im,
-                                 int make );
+                                 int        make,
+                                 SubImage * sub );
+
+
+#define FLIMAGE_MAX_THREADS  32
+
+/* Works on the rows [first, last) of an image, 'index' is 0 only when
+   called from the thread that started the work, it's always less than
+   FLIMAGE_MAX_THREADS */
+
+typedef int ( * FLIMAGE_ROWS_FUNC )( int first,
+                                     int last,
+                                     int index,
+                                     void * data );
+
+int flimage_run_rows( int,
+                      int,
+                      FLIMAGE_ROWS_FUNC,
+                      void * );
 
 
 #define FL_IsGray( t )        ( t == FL_IMAGE_GRAY || t == FL_IMAGE_GRAY16 )
 #define FL_IsCI( t )          ( t == FL_IMAGE_CI   || t == FL_IMAGE_MONO )
 #define FLIMAGE_MAXLUT        ( 1 << FL_LUTBITS )
 
-extern FLIMAGE_IO *flimage_io;
-
 typedef int ( * FLIMAGE_QUANTIZE_RGB )( unsigned char **,
                                         unsigned char **,
                                         unsigned char **,
@@ -204,6 +220,8 @@ void flimage_free_linearlut( FL_IMAGE * );
 
 FLIMAGE_IO *flimage_find_imageIO( const char * );
 
+FLIMAGE_IO *flimage_formats( int * );
+
 void flimage_display_markers( FL_IMAGE * );
 
 unsigned long flimage_color_to_pixel( FL_IMAGE *,
@@ -225,6 +243,17 @@ int flimage_to_ximage( FL_IMAGE *,
                        FL_WINDOW,
                        XWindowAttributes * );
 
+void flimage_free_ximage( FL_IMAGE *,
+                          int );
+
+int flimage_display_rows( FL_IMAGE *,
+                          FL_WINDOW,
+                          int,
+                          int );
+
+void flimage_rows_done( FL_IMAGE *,
+                        int );
+
 #if ! defined( SEEK_SET )
 #define SEEK_SET 0
 #endif
@@ -35,24 +35,70 @@
 #include "private/flsnprintf.h"
 #include <stdlib.h>
 #include <stdarg.h>
+#include <unistd.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 static int visual_cue( FL_IMAGE *,
                        const char * );
 static void error_message( FL_IMAGE *,
                            const char * );
 
-static int nimage;
-static FLIMAGE_SETUP current_setup;
+static FLIMAGE_SETUP current_setup;   /* copied into each new image */
+
+#ifdef HAVE_PTHREAD_H
+static pthread_once_t setup_once = PTHREAD_ONCE_INIT;
+#endif
 
 #define MaxImageFileNameLen  260
 
-FLIMAGE_IO *flimage_io;
 FLIMAGE_QUANTIZE_RGB flimage_quantize_rgb;
 FLIMAGE_QUANTIZE_PACKED flimage_quantize_packed;
 
 static int ppm_added,
            gzip_added;
 
+/* The registered formats. Looking one up never takes a lock: the
+ * first 'n' entries of a table never change, a new format is put
+ * behind them and only then 'n' gets increased. Anything else (a
+ * format getting replaced, the table running full) makes a new table
+ * that then takes the place of the old one. Old tables are kept
+ * since images and other threads may still use them. Changes are
+ * serialized by a mutex. */
+
+typedef struct format_table_
+{
+    int                     n;       /* formats in use        */
+    int                     avail;   /* formats there's room for */
+    FLIMAGE_IO            * io;
+    FLIMAGE_FORMAT_INFO   * info;    /* for get_format_info() */
+    struct format_table_  * old;     /* table this one replaced */
+} FORMAT_TABLE;
+
+static FORMAT_TABLE *formats;
+
+#if    defined __clang__ \
+    || ( defined __GNUC__ && ( __GNUC__ > 4 || \
+                               ( __GNUC__ == 4 && __GNUC_MINOR__ >= 7 ) ) )
+#define PUBLISH( p, v )   __atomic_store_n( &( p ), v, __ATOMIC_RELEASE )
+#define FETCH( p )        __atomic_load_n( &( p ), __ATOMIC_ACQUIRE )
+#else
+#define PUBLISH( p, v )   ( ( p ) = ( v ) )
+#define FETCH( p )        ( p )
+#endif
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t format_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t setup_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK( m )     pthread_mutex_lock( &m )
+#define UNLOCK( m )   pthread_mutex_unlock( &m )
+#else
+#define LOCK( m )
+#define UNLOCK( m )
+#endif
+
 static void add_default_formats( void );
 
 
@@ -72,6 +118,8 @@ null_op( FL_IMAGE * im  FL_UNUSED_ARG )
 void
 flimage_setup( FLIMAGE_SETUP * setup )
 {
+    LOCK( setup_mutex );
+
     current_setup = *setup;
 
     if ( setup->max_frames == 0 )
@@ -79,6 +127,8 @@ flimage_setup( FLIMAGE_SETUP * setup )
     if ( setup->delay > 2000 )
         current_setup.delay = 2000;
 
+    UNLOCK( setup_mutex );
+
     add_default_formats( );
 }
 
@@ -89,40 +139,198 @@ flimage_setup( FLIMAGE_SETUP * setup )
 static void
 init_setup( void )
 {
-    if ( current_setup.max_frames || current_setup.delay )
-        return;
+    /* initialize the quantizer */
+
+    if ( ! flimage_quantize_rgb )
+    {
+        flimage_quantize_rgb = j2pass_quantize_rgb;
+        flimage_quantize_packed = j2pass_quantize_packed;
+    }
+
+    LOCK( setup_mutex );
+
+    if ( ! current_setup.max_frames && ! current_setup.delay )
+    {
+        current_setup.max_frames = 30;
+        current_setup.delay = 50;
+    }
+
+    UNLOCK( setup_mutex );
+}
+
+
+/*********************************************************************
+ * Splitting work on the rows of an image over several threads
+ *****************************************************************{**/
+
+static int max_threads;      /* 0 means one thread per processor */
+
+
+/***************************************
+ * Sets the maximum number of threads some of the image processing
+ * routines (e.g. convolution) may use, 0 picks one per processor.
+ * Returns the previous setting.
+ ***************************************/
+
+int
+flimage_set_max_threads( int n )
+{
+    int old = max_threads;
+
+    max_threads = FL_clamp( n, 0, FLIMAGE_MAX_THREADS );
+    return old;
+}
+
+
+/***************************************
+ * Returns the number of threads to use for 'rows' rows when no thread
+ * should get less than 'min_rows' of them
+ ***************************************/
+
+static int
+get_thread_count( int rows,
+                  int min_rows )
+{
+    int n = max_threads;
+
+#ifdef HAVE_PTHREAD_H
+#ifdef _SC_NPROCESSORS_ONLN
+    if ( n == 0 )
+        n = sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+#else
+    n = 1;
+#endif
+
+    if ( min_rows > 0 && n > rows / min_rows )
+        n = rows / min_rows;
+
+    return FL_clamp( n, 1, FLIMAGE_MAX_THREADS );
+}
+
+
+typedef struct {
+    FLIMAGE_ROWS_FUNC   func;
+    void              * data;
+    int                 first,
+                        last,
+                        index,
+                        status;
+} ROWS_JOB;
+
+
+/***************************************
+ ***************************************/
+
+static void *
+run_rows_job( void * arg )
+{
+    ROWS_JOB *job = arg;
+
+    job->status = job->func( job->first, job->last, job->index, job->data );
+    return NULL;
+}
+
+
+/***************************************
+ * Calls 'func' for the rows [0, rows) split into contiguous bands, one
+ * per thread. The band with index 0 is always done by the calling
+ * thread, so that's the only one that may report progress. Returns -1
+ * if any of the calls failed, 0 otherwise.
+ ***************************************/
+
+int
+flimage_run_rows( int                 rows,
+                  int                 min_rows,
+                  FLIMAGE_ROWS_FUNC   func,
+                  void              * data )
+{
+    ROWS_JOB job[ FLIMAGE_MAX_THREADS ];
+#ifdef HAVE_PTHREAD_H
+    pthread_t tid[ FLIMAGE_MAX_THREADS ];
+    int started[ FLIMAGE_MAX_THREADS ];
+#endif
+    int n = get_thread_count( rows, min_rows ),
+        status = 0,
+        i;
 
-    current_setup.max_frames = 30;
-    current_setup.delay = 50;
+    for ( i = 0; i < n; i++ )
+    {
+        job[ i ].func   = func;
+        job[ i ].data   = data;
+        job[ i ].first  = ( long ) rows * i / n;
+        job[ i ].last   = ( long ) rows * ( i + 1 ) / n;
+        job[ i ].index  = i;
+        job[ i ].status = 0;
+    }
+
+#ifdef HAVE_PTHREAD_H
+    /* If a thread can't be created its band gets done here instead */
+
+    for ( i = 1; i < n; i++ )
+        started[ i ] = ! pthread_create( tid + i, NULL, run_rows_job,
+                                         job + i );
+#endif
+
+    run_rows_job( job );
+
+    for ( i = 1; i < n; i++ )
+    {
+#ifdef HAVE_PTHREAD_H
+        if ( started[ i ] )
+            pthread_join( tid[ i ], NULL );
+        else
+#endif
+            run_rows_job( job + i );
+    }
+
+    for ( i = 0; i < n; i++ )
+        if ( job[ i ].status < 0 )
+            status = -1;
+
+    return status;
 }
 
 
 /***************************************
+ * Each image gets its own copy of the setup as it was at the time the
+ * image was created, so flimage_setup() may be called while other
+ * threads are working on images
  ***************************************/
 
 FL_IMAGE *
 flimage_alloc( void )
 {
     FL_IMAGE *image = fl_calloc( 1, sizeof *image );
+    FLIMAGE_SETUP *setup = fl_malloc( sizeof *setup );
 
+#ifdef HAVE_PTHREAD_H
+    pthread_once( &setup_once, init_setup );
+#else
     init_setup( );
+#endif
 
     add_default_formats( );
 
-    image->setup = &current_setup;
-    image->visual_cue = current_setup.visual_cue;
-    image->error_message = current_setup.error_message;
+    LOCK( setup_mutex );
+    *setup = current_setup;
+    UNLOCK( setup_mutex );
+
+    image->setup = setup;
+    image->visual_cue = setup->visual_cue;
+    image->error_message = setup->error_message;
+    image->rows_ready = setup->rows_ready;
     image->gray_maxval = 255;
     image->ci_maxval = 255;
     image->tran_index = -1;
     image->tran_rgb = -1;
     image->app_background = -1;
-    image->app_data = current_setup.app_data;
+    image->app_data = setup->app_data;
     image->total_frames = 1;
     image->xdist_scale = image->ydist_scale = 1.0;
     image->pscale = 1.0;
     image->display = flimage_display;
-    image->xdisplay = current_setup.xdisplay;
+    image->xdisplay = setup->xdisplay;
     image->infile = fl_malloc( MaxImageFileNameLen * sizeof *image->infile );
     image->outfile = fl_malloc( MaxImageFileNameLen * sizeof *image->outfile );
     image->infile[0] = image->outfile[ 0 ] = '\0';
@@ -130,14 +338,6 @@ flimage_alloc( void )
     if ( ! image->xdisplay )
         image->xdisplay = fl_display;
 
-    /* initialize the quantizer */
-
-    if ( ! flimage_quantize_rgb )
-    {
-        flimage_quantize_rgb = j2pass_quantize_rgb;
-        flimage_quantize_packed = j2pass_quantize_packed;
-    }
-
     /* make sure visual_cue and error_message are ok */
 
     if ( ! image->visual_cue )
@@ -169,6 +369,7 @@ identify_image( const char *file )
     FILE *fp;
     FLIMAGE_IO *io;
     FL_IMAGE *image = NULL;
+    int n;
 
     if ( ! file || ! *file )
         return NULL;
@@ -179,10 +380,7 @@ identify_image( const char *file )
         return NULL;
     }
 
-    if ( ! ppm_added )
-        add_default_formats( );
-
-    for ( io = flimage_io; io->formal_name; io++ )
+    for ( io = flimage_formats( &n ); n > 0; io++, n-- )
     {
         if ( io->identify( fp ) > 0 )
         {
@@ -212,20 +410,18 @@ flimage_is_supported( const char * file )
 {
     FILE *fp;
     FLIMAGE_IO *io;
-    int n;
+    int n,
+        i;
 
     if ( ! file || ! *file || ! ( fp = fopen( file, "rb" ) ) )
         return 0;
 
-    if ( ! ppm_added )
-        add_default_formats( );
-
-    for ( n = 0, io = flimage_io; io->formal_name; io++, n++ )
+    for ( i = 0, io = flimage_formats( &n ); i < n; io++, i++ )
     {
         if ( io->identify( fp ) > 0 )
         {
             fclose( fp );
-            return n + 1;
+            return i + 1;
         }
         else
             rewind( fp );
@@ -321,9 +517,16 @@ flimage_read( FL_IMAGE * im )
 
     image->completed = 0;
     image->total = im->h;
+    image->rows_done = 0;
     image->error_message( image, "" );
     error = error || ( io->read_pixels( image ) < 0 );
     image->completed = im->total;
+
+    /* Hand out whatever rows the reader didn't report itself */
+
+    if ( ! error )
+        flimage_rows_done( image, image->h );
+
     sprintf( buf, "Done Reading %s", image->fmt_name );
     image->visual_cue( image, error ? "Error Reading" : buf );
 
@@ -353,10 +556,42 @@ default_next_frame( FL_IMAGE * im )
 
 
 /***************************************
+ * Called by the readers whenever all rows up to (but not including)
+ * 'rows' have been decoded. Passes the new rows on to the rows_ready
+ * handler and, if the image is bound to a window, shows them there.
+ * Readers that can't produce their rows in order (interlaced or
+ * bottom-up files) don't call it, the rows then all get handed out
+ * at once when reading is done.
  ***************************************/
 
-FL_IMAGE *
-flimage_load( const char * file )
+void
+flimage_rows_done( FL_IMAGE * im,
+                   int        rows )
+{
+    int first = im->rows_done;
+
+    if ( rows > im->h )
+        rows = im->h;
+
+    if ( rows <= first )
+        return;
+
+    im->rows_done = rows;
+
+    if ( im->rows_ready )
+        im->rows_ready( im, first, rows - first );
+
+    if ( im->progressive_win )
+        flimage_display_rows( im, im->progressive_win, first, rows - first );
+}
+
+
+/***************************************
+ ***************************************/
+
+static FL_IMAGE *
+load_image( const char * file,
+            FL_WINDOW    win )
 {
     FL_IMAGE *image,
              *im;
@@ -369,13 +604,18 @@ flimage_load( const char * file )
 
     if ( ( image = flimage_open( file ) ) )
     {
+        image->progressive_win = win;
+
         if ( ! ( im = flimage_read( image ) ) )
         {
             flimage_free( image );
             image = NULL;
         }
         else
+        {
             image = im;
+            image->progressive_win = None;
+        }
     }
 
     if ( ! image )
@@ -414,8 +654,7 @@ flimage_load( const char * file )
 
     while (    ! err
             && im->more
-            && im->more > im->completed
-            && im->current_frame < current_setup.max_frames )
+            && im->current_frame < im->setup->max_frames )
     {
         if ( ! ( err = ! ( im->next = flimage_dup_( im, 0 ) ) ) )
         {
@@ -423,7 +662,7 @@ flimage_load( const char * file )
             im->current_frame++;
         }
         sprintf( buf, "Done image %d of %d",
-                 im->current_frame, current_setup.max_frames );
+                 im->current_frame, im->setup->max_frames );
         im->visual_cue( im, buf );
         err = err || ( im->next_frame( im ) < 0 );
         total_frames += ! err;
@@ -447,6 +686,29 @@ flimage_load( const char * file )
 }
 
 
+/***************************************
+ ***************************************/
+
+FL_IMAGE *
+flimage_load( const char * file )
+{
+    return load_image( file, None );
+}
+
+
+/***************************************
+ * Like flimage_load(), but rows are drawn into the window as soon as
+ * they have been read (for multi-frame images only the first frame)
+ ***************************************/
+
+FL_IMAGE *
+flimage_load_progressive( const char * file,
+                          FL_WINDOW    win )
+{
+    return load_image( file, win );
+}
+
+
 /**********************************************************************
  * Output routines
  *********************************************************************/
@@ -459,11 +721,12 @@ flimage_dump( FL_IMAGE   * image,
               const char * filename,
               const char * fmt )
 {
-    FLIMAGE_IO *io = flimage_io;
+    FLIMAGE_IO *io;
     char buf[ 256 ], *p;
     FILE *fp;
     int status = -1,
-        otype;
+        otype,
+        n;
     FL_IMAGE *tmpimage;
 
     if ( ! image || image->type == FL_IMAGE_NONE )
@@ -475,7 +738,7 @@ flimage_dump( FL_IMAGE   * image,
     if ( ! fmt || ! *fmt )
         fmt = image->fmt_name;
 
-    for ( ; io->formal_name; io++ )
+    for ( io = flimage_formats( &n ); n > 0; io++, n-- )
     {
         if (    (    strcasecmp( io->formal_name, fmt ) == 0
                   || strcasecmp( io->short_name,  fmt ) == 0
@@ -628,6 +891,7 @@ flimage_free( FL_IMAGE * image )
         imnext = im->next;
         fli_safe_free( im->infile );
         fli_safe_free( im->outfile );
+        fli_safe_free( im->setup );
         im->next = NULL;
         fl_free( im );
     }
@@ -966,11 +1230,7 @@ flimage_freemem( FL_IMAGE * image )
         image->pixmap_depth = 0;
     }
 
-    if ( image->ximage )
-    {
-        XDestroyImage( ( XImage * ) image->ximage );
-        image->ximage = NULL;
-    }
+    flimage_free_ximage( image, 0 );
 
     if ( image->gc )
     {
@@ -1008,6 +1268,85 @@ flimage_freemem( FL_IMAGE * image )
 }
 
 
+/***************************************
+ ***************************************/
+
+static void
+fill_info( FLIMAGE_FORMAT_INFO * info,
+           const FLIMAGE_IO    * io )
+{
+    info->formal_name = io->formal_name;
+    info->short_name = io->short_name;
+    info->extension = io->extension;
+    info->type = io->type;
+    info->annotation = io->annotation;
+    info->read_write =   ( io->write_image ? FLIMAGE_WRITABLE : 0 )
+                       | ( io->read_pixels ? FLIMAGE_READABLE : 0 );
+}
+
+
+/***************************************
+ * Makes a copy of the current table with room for at least 'avail'
+ * formats. Must be called with the format mutex held.
+ ***************************************/
+
+static FORMAT_TABLE *
+copy_formats( int avail )
+{
+    FORMAT_TABLE *t = fl_calloc( 1, sizeof *t );
+
+    if ( ! t )
+        return NULL;
+
+    if ( formats && formats->avail > avail )
+        avail = formats->avail;
+
+    t->avail = avail;
+    t->io = fl_calloc( avail + 1, sizeof *t->io );
+    t->info = fl_calloc( avail + 1, sizeof *t->info );
+
+    if ( ! t->io || ! t->info )
+    {
+        fli_safe_free( t->io );
+        fli_safe_free( t->info );
+        fl_free( t );
+        return NULL;
+    }
+
+    if ( ( t->old = formats ) )
+    {
+        t->n = formats->n;
+        memcpy( t->io, formats->io, t->n * sizeof *t->io );
+        memcpy( t->info, formats->info, t->n * sizeof *t->info );
+    }
+
+    return t;
+}
+
+
+/***************************************
+ * Returns the registered formats, their number in 'n'. The entries
+ * stay valid (and unchanged) for the lifetime of the program.
+ ***************************************/
+
+FLIMAGE_IO *
+flimage_formats( int * n )
+{
+    FORMAT_TABLE *t;
+
+    add_default_formats( );
+
+    if ( ! ( t = FETCH( formats ) ) )
+    {
+        *n = 0;
+        return NULL;
+    }
+
+    *n = FETCH( t->n );
+    return t->io;
+}
+
+
 /***************************************
  ***************************************/
 
@@ -1021,45 +1360,52 @@ flimage_add_format( const char          * formal_name,
                     FLIMAGE_Read_Pixels   read_pixels,
                     FLIMAGE_Write_Image   write_image )
 {
-    int i, k;
+    int i,
+        k,
+        n;
+    FORMAT_TABLE *t;
     FLIMAGE_IO *thisIO;
 
     if ( ! formal_name || ! *formal_name || ! short_name || ! *short_name )
         return -1;
 
-    ppm_added = ppm_added || ( extension && strcmp( "ppm", extension ) == 0 );
-    gzip_added = gzip_added || ( extension && strcmp("gz", extension ) == 0 );
-
     if ( type <= 0 || type > FL_IMAGE_FLEX )
         return -1;
 
     if ( ! description || ! read_pixels || ! identify )
         description = read_pixels = 0;
 
-    if ( flimage_io == 0 )
-    {
-        nimage = 1;     /* sentinel */
-        flimage_io = fl_calloc( 3, sizeof *flimage_io );
-    }
-    else
-        flimage_io = fl_realloc( flimage_io,
-                                 ( nimage + 2 ) * sizeof *flimage_io );
+    LOCK( format_mutex );
 
-    k = nimage;
+    ppm_added = ppm_added || ( extension && strcmp( "ppm", extension ) == 0 );
+    gzip_added = gzip_added || ( extension && strcmp("gz", extension ) == 0 );
 
     /* find out if the image format is already installed. Replace if yes */
 
-    for ( i = 0; flimage_io[ i ].formal_name; i++ )
+    n = k = formats ? formats->n : 0;
+
+    for ( i = 0; i < n; i++ )
     {
-        if (    strcmp( flimage_io[ i ].formal_name, formal_name ) == 0
-             && strcmp( flimage_io[ i ].short_name, short_name ) == 0 )
+        if (    strcmp( formats->io[ i ].formal_name, formal_name ) == 0
+             && strcmp( formats->io[ i ].short_name, short_name ) == 0 )
         {
             M_err( __func__, "%s already supported. Replaced", short_name );
-            k = i + 1;
+            k = i;
         }
     }
 
-    thisIO = flimage_io + k - 1;
+    /* A new format goes behind the others if there's room, everything
+       else needs a new table */
+
+    if ( k == n && formats && n < formats->avail )
+        t = formats;
+    else if ( ! ( t = copy_formats( k == n ? 2 * n + 8 : n ) ) )
+    {
+        UNLOCK( format_mutex );
+        return -1;
+    }
+
+    thisIO = t->io + k;
 
     thisIO->formal_name = formal_name;
     thisIO->short_name = short_name;
@@ -1069,18 +1415,20 @@ flimage_add_format( const char          * formal_name,
     thisIO->read_description = description;
     thisIO->read_pixels = read_pixels;
     thisIO->write_image = write_image;
-    thisIO->annotation = 0;
+    thisIO->annotation =    ! strcmp( short_name, "ppm" )
+                         || ! strcmp( short_name, "pgm" );
 
-    nimage += k == nimage;
+    fill_info( t->info + k, thisIO );
 
-    if ( ! strcmp( short_name, "ppm" ) || ! strcmp( short_name, "pgm" ) )
-        thisIO->annotation = 1;
+    if ( k == n )
+        PUBLISH( t->n, n + 1 );
 
-    /* sentinel */
+    if ( t != formats )
+        PUBLISH( formats, t );
 
-    ( ++thisIO )->formal_name = NULL;
+    UNLOCK( format_mutex );
 
-    return k;
+    return k + 1;
 }
 
 
@@ -1091,11 +1439,23 @@ void
 flimage_set_annotation_support( int in,
                                 int flag )
 {
-     --in;
+    FORMAT_TABLE *t;
 
-     if ( in < 0 || in >= nimage )
-         return;
-     flimage_io[ in ].annotation = flag != 0;
+    --in;
+
+    LOCK( format_mutex );
+
+    if (    formats
+         && in >= 0
+         && in < formats->n
+         && formats->io[ in ].annotation != ( flag != 0 )
+         && ( t = copy_formats( formats->n ) ) )
+    {
+        t->io[ in ].annotation = t->info[ in ].annotation = flag != 0;
+        PUBLISH( formats, t );
+    }
+
+    UNLOCK( format_mutex );
 }
 
 
@@ -1130,42 +1490,29 @@ flimage_type_name( int type )
 int
 flimage_get_number_of_formats( void )
 {
-    add_default_formats( );
-    return nimage - 1;
+    int n;
+
+    flimage_formats( &n );
+    return n;
 }
 
 
 /***************************************
+ * The information returned doesn't change anymore, a later call of
+ * flimage_add_format() for the same format returns new information
  ***************************************/
 
-#define MaxInfoBuffer 6
-
 const FLIMAGE_FORMAT_INFO *
 flimage_get_format_info( int n )
 {
-    static FLIMAGE_FORMAT_INFO fmt_return[ MaxInfoBuffer ];
-    static int k;
-    FLIMAGE_IO *io;
-    FLIMAGE_FORMAT_INFO *fmtinfo;
+    FORMAT_TABLE *t;
 
     add_default_formats( );
 
-    if ( n <= 0 || n > nimage )
+    if ( ! ( t = FETCH( formats ) ) || n <= 0 || n > FETCH( t->n ) )
         return 0;
 
-    fmtinfo = fmt_return + k++ % MaxInfoBuffer;
-    n--;
-    io = flimage_io + n;
-
-    fmtinfo->formal_name = io->formal_name;
-    fmtinfo->short_name = io->short_name;
-    fmtinfo->extension = io->extension;
-    fmtinfo->type = io->type;
-    fmtinfo->annotation = io->annotation;
-    fmtinfo->read_write =   ( io->write_image ? FLIMAGE_WRITABLE : 0 )
-                          | ( io->read_pixels ? FLIMAGE_READABLE : 0 );
-
-    return fmtinfo;
+    return t->info + n - 1;
 }
 
 
@@ -1368,6 +1715,7 @@ flimage_dup_( FL_IMAGE * sim,
     unsigned int mapsize = sim->map_len * sizeof *sim->red_lut;
     char *infile,
          *outfile;
+    FLIMAGE_SETUP *setup;
 
     if ( ! im )
     {
@@ -1377,9 +1725,14 @@ flimage_dup_( FL_IMAGE * sim,
 
     infile = im->infile;
     outfile = im->outfile;
+    setup = im->setup;
 
     memcpy( im, sim, sizeof *im );
 
+    if ( sim->setup )
+        *setup = *sim->setup;
+    im->setup = setup;
+
     /* reset all pointers */
 
     im->red = im->green = im->blue = im->alpha = NULL;
@@ -1436,6 +1789,10 @@ flimage_dup_( FL_IMAGE * sim,
     im->pixels = 0;
     im->pixmap = None;
     im->ximage = NULL;
+    im->xshm = NULL;
+    im->rows_ready = NULL;
+    im->progressive_win = None;
+    im->rows_done = 0;
     im->info = 0;
     im->win = None;
     im->gc = im->textgc = im->markergc = None;
@@ -1586,7 +1943,7 @@ pack_bits( unsigned char  * out,
  ***************************************/
 
 static void
-add_default_formats( void )
+register_default_formats( void )
 {
     if ( ! ppm_added )
     {
@@ -1599,6 +1956,24 @@ add_default_formats( void )
 }
 
 
+/***************************************
+ * Registers the default formats the first time through. With threads
+ * this is done by exactly one of them, the others wait for it.
+ ***************************************/
+
+static void
+add_default_formats( void )
+{
+#ifdef HAVE_PTHREAD_H
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+    pthread_once( &once, register_default_formats );
+#else
+    register_default_formats( );
+#endif
+}
+
+
 /***************************************
  * Given a format, find the corresponding io handler
  ***************************************/
@@ -1606,9 +1981,10 @@ add_default_formats( void )
 FLIMAGE_IO *
 flimage_find_imageIO( const char *fmt )
 {
-    FLIMAGE_IO *io = flimage_io;
+    int n;
+    FLIMAGE_IO *io = flimage_formats( &n );
 
-    for ( ; io && io->formal_name; io++ )
+    for ( ; n > 0; io++, n-- )
     {
         if (    ! strcmp( io->formal_name, fmt )
              || ! strcmp( io->short_name, fmt )
@@ -1648,10 +2024,10 @@ write_marker( FLIMAGE_MARKER * m,
 
 static int
 read_marker( FLIMAGE_MARKER * m,
+             char           * name,     /* at least 64 chars */
              FILE           * fp )
 {
     char buf[ 128 ];
-    static char name[ 64 ];
     int r,
         g,
         b,
@@ -1681,6 +2057,8 @@ read_marker( FLIMAGE_MARKER * m,
 #define LB '('
 #define RB ')'
 
+#define MaxTextLen  512
+
 static FLI_VN_PAIR fonts_vn[ ] =
 {
     { FL_NORMAL_STYLE,          "Helvetica"              },
@@ -1712,9 +2090,9 @@ static FLI_VN_PAIR fonts_vn[ ] =
  ***************************************/
 
 static const char *
-get_font_style( int fstyle )
+get_font_style( int    fstyle,
+                char * retbuf )     /* at least 128 chars */
 {
-    static char retbuf[ 128 ];
     const char *font_spstyle = "normal";
     int spstyle = fstyle / FL_SHADOW_STYLE;
     int style = fstyle % FL_SHADOW_STYLE;
@@ -1750,7 +2128,8 @@ write_text( FLIMAGE_TEXT * t,
     int r,
         g,
         b;
-    char *p;
+    char *p,
+         style[ 128 ];
 
     /* output string. */
 
@@ -1763,9 +2142,9 @@ write_text( FLIMAGE_TEXT * t,
     }
     putc( RB, fp );
 
-    fprintf( fp, " %s %d %d %d %s %d %d", get_font_style( t->style ), t->size,
-             t->x, t->y, fli_get_vn_name( align_vn, t->align ), t->angle,
-             t->nobk );
+    fprintf( fp, " %s %d %d %d %s %d %d", get_font_style( t->style, style ),
+             t->size, t->x, t->y, fli_get_vn_name( align_vn, t->align ),
+             t->angle, t->nobk );
     FL_UNPACK( t->color, r, g, b );
     fprintf( fp, " %d %d %d", r, g, b );
     FL_UNPACK( t->bcolor, r, g, b );
@@ -1778,13 +2157,13 @@ write_text( FLIMAGE_TEXT * t,
 
 static int
 read_text( FLIMAGE_TEXT * t,
-           FILE *         fp )
+           char         * name,
+           FILE         * fp )
 {
     char buf[ 1024 ],
          fnt[ 64 ],
          style[ 64 ],
          align[ 64 ];
-    static char name[ 512 ];
     int r,
         g,
         b,
@@ -1793,7 +2172,7 @@ read_text( FLIMAGE_TEXT * t,
         bb;
     char *p  = buf + 1,
          *s  = name,
-         *ss = name + sizeof name - 1;
+         *ss = name + MaxTextLen - 1;
 
     if ( fgets( buf, sizeof buf - 1, fp ) )
         buf[ sizeof buf - 1 ] = '\0';
@@ -1902,7 +2281,8 @@ flimage_read_annotation( FL_IMAGE * im )
         nmarkers,
         i,
         ntext;
-    char buf[ 1024 ];
+    char buf[ 1024 ],
+         name[ MaxTextLen ];     /* copied when added to the image */
 
     if ( ! im || im->type == FL_IMAGE_NONE )
         return -1;
@@ -1931,7 +2311,7 @@ flimage_read_annotation( FL_IMAGE * im )
             {
                 while ( skip_line( fp ) )
                     /* empty */ ;
-                if ( read_marker( &m, fp ) >= 0 )
+                if ( read_marker( &m, name, fp ) >= 0 )
                     flimage_add_marker_struct( im, &m );
             }
         }
@@ -1945,7 +2325,7 @@ flimage_read_annotation( FL_IMAGE * im )
             {
                 while ( skip_line( fp ) )
                     /* empty */ ;
-                if ( read_text( &t, fp) >= 0 )
+                if ( read_text( &t, name, fp ) >= 0 )
                     flimage_add_text_struct( im, &t );
             }
             done = 1;
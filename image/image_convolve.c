@@ -22,7 +22,9 @@
  *   All rights reserved.
  *
  *  General colvolution routines for RGB and gray (both 8bit and 16bit)
- *  images. 3x3 and 5x5 kernels are manually unrolled.
+ *  images. Kernels that are the product of a column and a row vector
+ *  are applied in two passes, and the rows of the image are split over
+ *  several threads.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -32,247 +34,384 @@
 #include "include/forms.h"
 #include "flimage.h"
 #include "flimage_int.h"
+#include <string.h>
 
 /***********************************************************************
  * Convolution
  *******************************************************************{***/
 
-#define VectorP3( k, b, i )     (   k[ 0 ] * b[ i - 1 ]     \
-                                  + k[ 1 ] * b[ i ]         \
-                                  + k[ 2 ] * b[ i + 1 ] )
+#define CONV_BAND      32      /* rows done in one go by a thread */
+#define CONV_MIN_ROWS  64      /* fewer rows aren't worth a thread */
+
+typedef struct {
+    int          ** kernel;
+    int             krow,
+                    kcol;
+    int           * vk,             /* column and row vector if the */
+                  * hk;             /* kernel is separable, or NULL */
+    int             weight;
+    int             maxval;
+    int             w,              /* size of area getting convolved */
+                    h;
+    int             comp;
+    int             is_gray;
+    void         ** src[ 3 ];       /* copies of the original pixels */
+    void         ** dst[ 3 ];
+    FL_IMAGE      * im;
+    const char    * what;
+} CONV_JOB;
+
+
+/* Normalize with weight and clamp */
 
-#define VectorP5( k, b, i )     (   k[ 0 ] * b[ i - 2 ]     \
-                                  + k[ 1 ] * b[ i - 1 ]     \
-                                  + k[ 2 ] * b[ i ]         \
-                                  + k[ 3 ] * b[ i + 1 ]     \
-                                  + k[ 4 ] * b[ i + 2 ]     )
-
-#define conv3x3( cm, m, r, c )  (   VectorP3( cm[ 0 ], m[ r - 1 ], c )    \
-                                  + VectorP3( cm[ 1 ], m[ r + 0 ], c )    \
-                                  + VectorP3( cm[ 2 ], m[ r + 1 ], c ) )
-
-#define conv5x5( kernel, pc, row, col )                        \
-                            (   VectorP5( kernel[ 0 ], pc[ row - 2 ], col )  \
-                              + VectorP5( kernel[ 1 ], pc[ row - 1 ], col )  \
-                              + VectorP5( kernel[ 2 ], pc[ row + 0 ], col )  \
-                              + VectorP5( kernel[ 3 ], pc[ row + 1 ], col )  \
-                              + VectorP5( kernel[ 4 ], pc[ row + 2 ], col ) )
+#define NormAndClamp( pc, w, max )                        \
+            do {                                          \
+                if ( pc < 0 )                             \
+                    pc = 0;                               \
+                else if ( ( pc /=w ) > ( max ) )          \
+                    pc = ( max );                         \
+             } while ( 0 )
 
 
 /***************************************
+ * The inner loops, all working on contiguous rows
  ***************************************/
 
-static int
-uc_conv5x5( int           ** kernel,
-            unsigned char ** pc,
-            int              r,
-            int              c )
+static void
+acc_uc( int                 * acc,
+        const unsigned char * s,
+        int                   k,
+        int                   n )
 {
-    return conv5x5( kernel, pc, r, c );
+    int i;
+
+    for ( i = 0; i < n; i++ )
+        acc[ i ] += k * s[ i ];
 }
 
 
 /***************************************
  ***************************************/
 
-static int
-us_conv5x5( int            ** kernel,
-            unsigned short ** s,
-            int               r,
-            int               c )
+static void
+acc_us( int                  * acc,
+        const unsigned short * s,
+        int                    k,
+        int                    n )
 {
-    return conv5x5( kernel, s, r, c );
-}
+    int i;
 
+    for ( i = 0; i < n; i++ )
+        acc[ i ] += k * s[ i ];
+}
 
-static void init_kernels(void);
 
-/* normalize with weight the clamp */
+/***************************************
+ ***************************************/
 
-#define NormAndClamp( pc, w, max )                        \
-            do {                                          \
-                if ( pc < 0 )                             \
-                    pc = 0;                               \
-                else if ( ( pc /=w ) > ( max ) )          \
-                    pc = ( max );                         \
-             } while ( 0 )
+static void
+acc_int( int       * acc,
+         const int * s,
+         int         k,
+         int         n )
+{
+    int i;
 
+    for ( i = 0; i < n; i++ )
+        acc[ i ] += k * s[ i ];
+}
 
 
 /***************************************
+ * Adds k times the pixels of the given row, starting at column col,
+ * to the accumulator
  ***************************************/
 
 static void
-rgb_convolve( unsigned char ** red,
-              unsigned char ** green,
-              unsigned char ** blue,
-              int              h,
-              int              w,
-              int           ** kernel,
-              int              krow,
-              int              kcol,
-              int              weight,
-              FL_IMAGE       * im,
-              const char     * what )
+acc_pixels( const CONV_JOB * job,
+            int            * acc,
+            int              c,
+            int              row,
+            int              col,
+            int              k,
+            int              n )
 {
-    int newr,
-        newg,
-        newb,
-        row,
-        col;
-    int k_halfh = krow / 2,
-        k_halfw = kcol / 2;
+    if ( job->is_gray )
+        acc_us( acc, ( ( unsigned short ** ) job->src[ c ] )[ row ] + col,
+                k, n );
+    else
+        acc_uc( acc, ( ( unsigned char ** ) job->src[ c ] )[ row ] + col,
+                k, n );
+}
 
-    for ( h -= k_halfw, w -= k_halfw, row = 1; row < h; row++ )
-    {
-        if ( krow == 3 && kcol == 3 )
-        {
-            for ( col = k_halfw; col < w; col++ )
-            {
-                newr = conv3x3( kernel, red, row, col );
-                newg = conv3x3( kernel, green, row, col );
-                newb = conv3x3( kernel, blue, row, col );
 
-                NormAndClamp( newr, weight, FL_PCMAX );
-                NormAndClamp( newg, weight, FL_PCMAX );
-                NormAndClamp( newb, weight, FL_PCMAX );
+/***************************************
+ ***************************************/
 
-                red[ row ][ col ] = newr;
-                green[ row ][ col ] = newg;
-                blue[ row ][ col ] = newb;
-            }
-        }
-        else if ( krow == 5 && kcol == 5 )
-        {
-            for ( col = k_halfw; col < w; col++ )
-            {
-                newr = uc_conv5x5( kernel, red, row, col );
-                newg = uc_conv5x5( kernel, green, row, col );
-                newb = uc_conv5x5( kernel, blue, row, col );
+static void
+store_row( const CONV_JOB * job,
+           int              c,
+           int              row,
+           const int      * acc,
+           int              n )
+{
+    int col = job->kcol / 2,
+        i,
+        v;
 
-                NormAndClamp( newr, weight, FL_PCMAX );
-                NormAndClamp( newg, weight, FL_PCMAX );
-                NormAndClamp( newb, weight, FL_PCMAX );
+    if ( job->is_gray )
+    {
+        unsigned short *d = ( ( unsigned short ** ) job->dst[ c ] )[ row ];
 
-                red[ row ][ col ] = newr;
-                green[ row ][ col ] = newg;
-                blue[ row ][ col ] = newb;
-            }
-        }
-        else
+        for ( i = 0; i < n; i++ )
         {
-            int i,
-                j,
-                ccol,
-                ii,
-                jj;
-
-            for ( col = k_halfw; col < w; col++ )
-            {
-                newr = newg = newb = 0;
-                ccol = col - k_halfw;
-
-                for ( i = 0; i < krow; i++ )
-                {
-                    ii = row - k_halfh + i;
-
-                    for ( jj = ccol, j = 0; j < kcol; jj++, j++ )
-                    {
-                        newr += kernel[ i ][ j ] * red[ ii ][ jj ];
-                        newg += kernel[ i ][ j ] * green[ ii ][ jj ];
-                        newb += kernel[ i ][ j ] * blue[ ii ][ jj ];
-                    }
-                }
-
-                NormAndClamp( newr, weight, FL_PCMAX );
-                NormAndClamp( newg, weight, FL_PCMAX );
-                NormAndClamp( newb, weight, FL_PCMAX );
-
-                red[ row ][ col ] = newr;
-                green[ row ][ col ] = newg;
-                blue[ row ][ col ] = newg;
-            }
+            v = acc[ i ];
+            NormAndClamp( v, job->weight, job->maxval );
+            d[ col + i ] = v;
         }
+    }
+    else
+    {
+        unsigned char *d = ( ( unsigned char ** ) job->dst[ c ] )[ row ];
 
-        if ( ! ( ++im->completed & FLIMAGE_REPFREQ ) )
-            im->visual_cue( im, what );
+        for ( i = 0; i < n; i++ )
+        {
+            v = acc[ i ];
+            NormAndClamp( v, job->weight, job->maxval );
+            d[ col + i ] = v;
+        }
     }
 }
 
 
 /***************************************
+ * Convolves the rows [first, last) of all components. 'acc' must hold
+ * a row, 'tmp' (only needed for separable kernels) CONV_BAND + krow - 1
+ * rows of the result of the horizontal pass.
  ***************************************/
 
 static void
-gray_convolve( unsigned short ** gray,
-               int               h,
-               int               w,
-               int            ** kernel,
-               int               krow,
-               int               kcol,
-               int               weight,
-               FL_IMAGE        * im,
-               const char      * what )
+convolve_band( const CONV_JOB * job,
+               int              first,
+               int              last,
+               int            * acc,
+               int            * tmp )
 {
-    int newr,
+    int kh = job->krow / 2,
+        n = job->w - 2 * ( job->kcol / 2 ),
+        c,
         row,
-        col;
-    int k_halfh = krow / 2,
-        k_halfw = kcol / 2;
+        i,
+        j;
 
-    for ( h -= k_halfw, w -= k_halfw, row = 1; row < h; row++ )
+    for ( c = 0; c < job->comp; c++ )
     {
-        if ( krow == 3 && kcol == 3 )
+        if ( job->hk )
         {
-            for  (col = k_halfw; col < w; col++ )
+            int nt = last - first + job->krow - 1;
+
+            memset( tmp, 0, nt * n * sizeof *tmp );
+            for ( i = 0; i < nt; i++ )
+                for ( j = 0; j < job->kcol; j++ )
+                    if ( job->hk[ j ] )
+                        acc_pixels( job, tmp + i * n, c, first - kh + i, j,
+                                    job->hk[ j ], n );
+
+            for ( row = first; row < last; row++ )
             {
-                newr = conv3x3( kernel, gray, row, col );
-                NormAndClamp( newr, weight, FL_PCMAX );
-                gray[ row ][ col ] = newr;
+                memset( acc, 0, n * sizeof *acc );
+                for ( i = 0; i < job->krow; i++ )
+                    if ( job->vk[ i ] )
+                        acc_int( acc, tmp + ( row - first + i ) * n,
+                                 job->vk[ i ], n );
+                store_row( job, c, row, acc, n );
             }
+
+            continue;
         }
-        else if ( krow == 5 && kcol == 5 )
+
+        for ( row = first; row < last; row++ )
         {
-            for ( col = k_halfw; col < w; col++ )
-            {
-                newr = us_conv5x5( kernel, gray, row, col );
-                NormAndClamp( newr, weight, im->gray_maxval );
-                gray[ row ] [col ] = newr;
-            }
+            memset( acc, 0, n * sizeof *acc );
+            for ( i = 0; i < job->krow; i++ )
+                for ( j = 0; j < job->kcol; j++ )
+                    if ( job->kernel[ i ][ j ] )
+                        acc_pixels( job, acc, c, row - kh + i, j,
+                                    job->kernel[ i ][ j ], n );
+            store_row( job, c, row, acc, n );
         }
-        else
+    }
+}
+
+
+/***************************************
+ * Called (possibly from another thread) for a range of the rows of the
+ * image that have a full kernel neighbourhood
+ ***************************************/
+
+static int
+convolve_rows( int    first,
+               int    last,
+               int    index,
+               void * data )
+{
+    CONV_JOB *job = data;
+    int kh = job->krow / 2,
+        n = job->w - 2 * ( job->kcol / 2 ),
+        *acc,
+        *tmp = NULL,
+        row;
+
+    if ( n <= 0 || first >= last )
+        return 0;
+
+    acc = fl_malloc( n * sizeof *acc );
+    if ( job->hk )
+        tmp = fl_malloc( ( CONV_BAND + job->krow - 1 ) * n * sizeof *tmp );
+
+    if ( ! acc || ( job->hk && ! tmp ) )
+    {
+        fli_safe_free( acc );
+        fli_safe_free( tmp );
+        return -1;
+    }
+
+    for ( row = first + kh; row < last + kh; row += CONV_BAND )
+    {
+        int end = FL_min( row + CONV_BAND, last + kh );
+
+        convolve_band( job, row, end, acc, tmp );
+
+        /* Only the calling thread may report, it estimates the progress
+           of the others by its own */
+
+        if ( index == 0 )
         {
-            int i,
-                j,
-                ccol,
-                ii,
-                jj;
+            job->im->completed = ( long ) ( end - kh ) * job->h
+                                 / FL_max( last, 1 );
+            job->im->visual_cue( job->im, job->what );
+        }
+    }
 
-            for ( col = k_halfw; col < w; col++ )
-            {
-                ccol = col - k_halfw;
+    fl_free( acc );
+    fli_safe_free( tmp );
+    return 0;
+}
+
+
+/***************************************
+ * Greatest common divisor of the absolute values
+ ***************************************/
+
+static int
+gcd( int a,
+     int b )
+{
+    int t;
+
+    a = FL_abs( a );
+    b = FL_abs( b );
+
+    while ( b )
+    {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
 
-                for ( newr = 0, i = 0; i < krow; i++ )
-                {
-                    ii = row - k_halfh + i;
 
-                    for ( jj = ccol, j = 0; j < kcol; jj++, j++ )
-                        newr += kernel[ i ][ j ] * gray[ ii ][ jj ];
-                }
+/***************************************
+ * Checks if the kernel is (exactly, in integers) the outer product of a
+ * column vector vk and a row vector hk. If it is, applying hk to each
+ * row and then vk to the columns gives the same result as using the
+ * kernel directly but takes only krow + kcol instead of krow * kcol
+ * multiplications per pixel.
+ ***************************************/
 
-                NormAndClamp( newr, weight, FL_PCMAX );
-                gray[ row ][ col ] = newr;
+static int
+split_kernel( int ** kernel,
+              int    krow,
+              int    kcol,
+              int  * vk,
+              int  * hk )
+{
+    int pr = -1,
+        pc = -1,
+        g = 0,
+        i,
+        j;
+
+    for ( i = 0; i < krow && pr < 0; i++ )
+        for ( j = 0; j < kcol; j++ )
+            if ( kernel[ i ][ j ] )
+            {
+                pr = i;
+                pc = j;
+                break;
             }
-        }
 
-        if ( ! ( ++im->completed & FLIMAGE_REPFREQ ) )
-            im->visual_cue( im, what );
+    if ( pr < 0 || krow == 1 || kcol == 1 )
+        return 0;
+
+    /* The row with the first non-zero element, divided by the greatest
+       common divisor of its elements, becomes the row vector */
+
+    for ( j = 0; j < kcol; j++ )
+        g = gcd( g, kernel[ pr ][ j ] );
+
+    if ( kernel[ pr ][ pc ] < 0 )
+        g = -g;
+
+    for ( j = 0; j < kcol; j++ )
+        hk[ j ] = kernel[ pr ][ j ] / g;
+
+    for ( i = 0; i < krow; i++ )
+    {
+        if ( kernel[ i ][ pc ] % hk[ pc ] )
+            return 0;
+
+        vk[ i ] = kernel[ i ][ pc ] / hk[ pc ];
+
+        for ( j = 0; j < kcol; j++ )
+            if ( kernel[ i ][ j ] != vk[ i ] * hk[ j ] )
+                return 0;
     }
+
+    return 1;
 }
 
 
-static int **sharpen_kernel;
-static int **smooth_kernel;
+/* The built-in kernels, set up at compile time so they can be used
+   from several threads at once */
+
+static int sharpen_rows[ 3 ][ 3 ] =
+{
+    { -1, -2, -1 },
+    { -2, 28, -2 },
+    { -1, -2, -1 }
+};
+
+/* smoothing a bit stronger than sharpening */
+
+static int smooth_rows[ 3 ][ 3 ] =
+{
+    { 1, 2, 1 },
+    { 2, 7, 2 },
+    { 1, 2, 1 }
+};
+
+static int *sharpen_kernel[ 3 ] =
+{
+    sharpen_rows[ 0 ], sharpen_rows[ 1 ], sharpen_rows[ 2 ]
+};
+
+static int *smooth_kernel[ 3 ] =
+{
+    smooth_rows[ 0 ], smooth_rows[ 1 ], smooth_rows[ 2 ]
+};
 
 
 /***************************************
@@ -285,10 +424,13 @@ flimage_convolve( FL_IMAGE  * im,
                   int         kcol )
 {
     int weight = 0,
+        status = 0,
         i;
     const char * what = "convolving";
     char buf[ 128 ];
-    SubImage *sub;
+    SubImage subimage,
+             *sub;
+    CONV_JOB job;
 
     if ( !im || im->w <= 0 || im->type == FL_IMAGE_NONE )
     {
@@ -304,9 +446,6 @@ flimage_convolve( FL_IMAGE  * im,
         return -1;
     }
 
-    if ( ! sharpen_kernel )
-        init_kernels( );
-
     if ( kernel == FL_SHARPEN )
     {
         kernel = sharpen_kernel;
@@ -338,30 +477,77 @@ flimage_convolve( FL_IMAGE  * im,
     if ( ! FL_IsGray( im->type ) )
         flimage_convert( im, FL_IMAGE_RGB, 0 );
 
-    if ( ! ( sub = flimage_get_subimage( im, 1 ) ) )
+    if ( ! ( sub = flimage_get_subimage( im, 1, &subimage ) ) )
         return -1;
 
+    job.kernel  = kernel;
+    job.krow    = krow;
+    job.kcol    = kcol;
+    job.weight  = weight;
+    job.w       = sub->w;
+    job.h       = sub->h;
+    job.comp    = sub->comp;
+    job.is_gray = FL_IsGray( im->type );
+    job.maxval  = job.is_gray ? im->gray_maxval : FL_PCMAX;
+    job.im      = im;
+    job.what    = what;
+    job.vk      = fl_malloc( ( krow + kcol ) * sizeof *job.vk );
+    job.hk      = job.vk ? job.vk + krow : NULL;
+
+    if ( job.vk && ! split_kernel( kernel, krow, kcol, job.vk, job.hk ) )
+    {
+        fl_free( job.vk );
+        job.vk = job.hk = NULL;
+    }
+
+    /* The result may only depend on the original pixels, so the kernel
+       gets applied to a copy of them and the results are written back */
+
+    for ( i = 0; i < job.comp; i++ )
+    {
+        int psize = job.is_gray ? sizeof( unsigned short ) : 1,
+            r;
+
+        job.dst[ i ] = sub->mat[ i ];
+        if ( ! ( job.src[ i ] = fl_get_matrix_ex( job.h, job.w, psize, 0 ) ) )
+        {
+            status = -1;
+            break;
+        }
+
+        for ( r = 0; r < job.h; r++ )
+            memcpy( job.src[ i ][ r ], job.dst[ i ][ r ], job.w * psize );
+    }
+
     im->completed = 0;
+    im->total = job.h;
     im->visual_cue( im, what );
 
-    if ( FL_IsGray( im->type ) )
-        gray_convolve( sub->mat[ 0 ], sub->h, sub->w,
-                       kernel, krow, kcol, weight, im, what );
-    else
-        rgb_convolve( sub->mat[ 0 ], sub->mat[ 1 ], sub->mat[ 2 ],
-                      sub->h, sub->w, kernel, krow, kcol, weight, im, what );
+    if ( status == 0 && job.h >= krow && job.w >= kcol )
+        status = flimage_run_rows( job.h - 2 * ( krow / 2 ), CONV_MIN_ROWS,
+                                   convolve_rows, &job );
 
-    im->completed = im->total;
-    sprintf( buf, "%s done", what );
-    im->visual_cue( im, buf );
+    while ( --i >= 0 )
+        fl_free_matrix( job.src[ i ] );
+    fli_safe_free( job.vk );
 
-    if (im->subw)
+    if ( im->subw )
     {
         fl_free_matrix( sub->mat[ 0 ] );
         fl_free_matrix( sub->mat[ 1 ] );
         fl_free_matrix( sub->mat[ 2 ] );
     }
 
+    if ( status < 0 )
+    {
+        im->error_message( im, "Convolve: running out of memory" );
+        return -1;
+    }
+
+    im->completed = im->total;
+    sprintf( buf, "%s done", what );
+    im->visual_cue( im, buf );
+
     im->modified = 1;
 
     return 0;
@@ -393,39 +579,6 @@ flimage_convolvea( FL_IMAGE * im,
 }
 
 
-/**********************************************************************
- * some built-in kernels
- **********************************************************************/
-
-static void
-init_kernels( void )
-{
-    sharpen_kernel = fl_get_matrix( 3, 3, sizeof( **sharpen_kernel ) );
-    smooth_kernel = fl_get_matrix( 3, 3, sizeof( **smooth_kernel ) );
-
-    sharpen_kernel[ 0 ][ 0 ] = -1;
-    sharpen_kernel[ 0 ][ 1 ] = -2;
-    sharpen_kernel[ 0 ][ 2 ] = -1;
-    sharpen_kernel[ 1 ][ 0 ] = -2;
-    sharpen_kernel[ 1 ][ 1 ] = 28;
-    sharpen_kernel[ 1 ][ 2 ] = -2;
-    sharpen_kernel[ 2 ][ 0 ] = -1;
-    sharpen_kernel[ 2 ][ 1 ] = -2;
-    sharpen_kernel[ 2 ][ 2 ] = -1;
-
-    /* smoothing a bit stronger than sharpening */
-
-    smooth_kernel[ 0 ][ 0 ] = 1;
-    smooth_kernel[ 0 ][ 1 ] = 2;
-    smooth_kernel[ 0 ][ 2 ] = 1;
-    smooth_kernel[ 1 ][ 0 ] = 2;
-    smooth_kernel[ 1 ][ 1 ] = 7;
-    smooth_kernel[ 1 ][ 2 ] = 2;
-    smooth_kernel[ 2 ][ 0 ] = 1;
-    smooth_kernel[ 2 ][ 1 ] = 2;
-    smooth_kernel[ 2 ][ 2 ] = 1;
-}
-
 
 /*}********************************************************************* */
 
@@ -255,7 +255,7 @@ flimage_crop( FL_IMAGE * im,
     {
         flimage_free_rgb( im );
 
-        err = ! ( us = fl_get_matrix( nh, nw, sizeof **us ) );
+        err = ! ( us = fl_get_matrix_ex( nh, nw, sizeof **us, 0 ) );
 
         if ( FL_IsGray(im->type ) )
         {
@@ -273,11 +273,14 @@ flimage_crop( FL_IMAGE * im,
     }
     else
     {
+        unsigned int esize = sizeof **red;
+
         flimage_free_gray( im );
         flimage_free_ci( im );
-        err =        ! ( red   = fl_get_matrix( nh, nw, sizeof **red   ) );
-        err = err || ! ( green = fl_get_matrix( nh, nw, sizeof **green ) );
-        err = err || ! ( blue  = fl_get_matrix( nh, nw, sizeof **blue  ) );
+
+        err =        ! ( red   = fl_get_matrix_ex( nh, nw, esize, 0 ) );
+        err = err || ! ( green = fl_get_matrix_ex( nh, nw, esize, 0 ) );
+        err = err || ! ( blue  = fl_get_matrix_ex( nh, nw, esize, 0 ) );
     }
 
     if ( err )
@@ -33,6 +33,16 @@
 #include "flimage.h"
 #include "flimage_int.h"
 
+#if    defined HAVE_XSHM && defined HAVE_SYS_SHM_H \
+    && defined HAVE_X11_EXTENSIONS_XSHM_H
+#define USE_XSHM  1
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#else
+#define USE_XSHM  0
+#endif
+
 #define IMAGEDEBUG  0
 #define TRACE       0
 
@@ -248,6 +258,284 @@ machine_endian( void )
     } while ( 0 )
 
 
+/***********************************************************************
+ * XImages for display. If the MIT-SHM extension can be used the pixels
+ * are put into a shared memory segment the X server reads directly,
+ * instead of sending them over the connection. The segment is kept
+ * with the image and reused as long as the size and visual stay the
+ * same, which saves re-allocating it for each frame of a movie.
+ ***********************************************************************/
+
+#if USE_XSHM
+
+typedef struct {
+    XImage          * ximage;
+    XShmSegmentInfo   info;
+    Visual          * visual;
+    int               pending;      /* XShmPutImage() may still run */
+} SHM_IMAGE;
+
+static Display *shm_display;        /* display shm_ok applies to */
+static int shm_ok;
+static int shm_error;
+
+
+/***************************************
+ ***************************************/
+
+static int
+shm_error_handler( Display     * d    FL_UNUSED_ARG,
+                   XErrorEvent * xev  FL_UNUSED_ARG )
+{
+    shm_error = 1;
+    return 0;
+}
+
+
+/***************************************
+ * Returns if the extension can be used. After attaching a segment
+ * failed once (as it does with remote servers) it's not tried again.
+ ***************************************/
+
+static int
+shm_usable( Display * d )
+{
+    if ( d != shm_display )
+    {
+        shm_display = d;
+        shm_ok = XShmQueryExtension( d );
+    }
+
+    return shm_ok;
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+free_shm_image( FL_IMAGE * im )
+{
+    SHM_IMAGE *sh = im->xshm;
+
+    if ( ! sh )
+        return;
+
+    if ( im->ximage == sh->ximage )
+        im->ximage = NULL;
+
+    XShmDetach( im->xdisplay, &sh->info );
+    XSync( im->xdisplay, False );
+    shmdt( sh->info.shmaddr );
+    sh->ximage->data = NULL;
+    XDestroyImage( sh->ximage );
+    fl_free( sh );
+    im->xshm = NULL;
+}
+
+
+/***************************************
+ * Returns a shared memory XImage of the size of the image, or NULL if
+ * that's not possible. Except in the 1 and 24 bit cases the conversion
+ * routines write the pixels without any padding at the end of lines,
+ * so the server's scanline padding must not require any.
+ ***************************************/
+
+static XImage *
+get_shm_ximage( FL_IMAGE * im )
+{
+    SHM_IMAGE *sh = im->xshm;
+    XImage *xi;
+    int ( * old_handler )( Display *, XErrorEvent * );
+
+    if ( ! shm_usable( im->xdisplay ) )
+        return NULL;
+
+    if ( sh )
+    {
+        xi = sh->ximage;
+
+        if (    xi->width == im->w
+             && xi->height == im->h
+             && xi->depth == im->sdepth
+             && sh->visual == im->visual )
+        {
+            /* Make sure the server is done with the previous contents */
+
+            if ( sh->pending )
+                XSync( im->xdisplay, False );
+            sh->pending = 0;
+            return xi;
+        }
+
+        free_shm_image( im );
+    }
+
+    if ( ! ( sh = fl_calloc( 1, sizeof *sh ) ) )
+        return NULL;
+
+    xi = XShmCreateImage( im->xdisplay, im->visual, im->sdepth, ZPixmap,
+                          NULL, &sh->info, im->w, im->h );
+
+    if (    ! xi
+         || (    xi->bits_per_pixel != 1
+              && xi->bits_per_pixel != 24
+              && xi->bytes_per_line != im->w * xi->bits_per_pixel / 8 ) )
+    {
+        if ( xi )
+            XDestroyImage( xi );
+        fl_free( sh );
+        return NULL;
+    }
+
+    sh->info.shmid = shmget( IPC_PRIVATE, xi->bytes_per_line * xi->height,
+                             IPC_CREAT | 0600 );
+
+    if ( sh->info.shmid < 0 )
+    {
+        XDestroyImage( xi );
+        fl_free( sh );
+        return NULL;
+    }
+
+    sh->info.shmaddr = xi->data = shmat( sh->info.shmid, NULL, 0 );
+    sh->info.readOnly = True;
+
+    if ( sh->info.shmaddr == ( char * ) -1 )
+    {
+        shmctl( sh->info.shmid, IPC_RMID, NULL );
+        xi->data = NULL;
+        XDestroyImage( xi );
+        fl_free( sh );
+        return NULL;
+    }
+
+    /* Attaching fails (asynchronously) if the server is on another
+       machine, so wait for the outcome */
+
+    shm_error = 0;
+    old_handler = XSetErrorHandler( shm_error_handler );
+    XShmAttach( im->xdisplay, &sh->info );
+    XSync( im->xdisplay, False );
+    XSetErrorHandler( old_handler );
+
+    /* The segment goes away once both sides have detached from it */
+
+    shmctl( sh->info.shmid, IPC_RMID, NULL );
+
+    if ( shm_error )
+    {
+        M_warn( __func__, "MIT-SHM not usable, falling back to XPutImage" );
+        shm_ok = 0;
+        shmdt( sh->info.shmaddr );
+        xi->data = NULL;
+        XDestroyImage( xi );
+        fl_free( sh );
+        return NULL;
+    }
+
+    sh->ximage = xi;
+    sh->visual = im->visual;
+    im->xshm = sh;
+
+    return xi;
+}
+
+#endif
+
+
+/***************************************
+ * Returns an XImage (with memory for the pixels) of the size of the
+ * image, using the given padding unless it's a shared memory one
+ ***************************************/
+
+static XImage *
+create_ximage( FL_IMAGE * im,
+               int        pad )
+{
+    XImage *xi;
+
+#if USE_XSHM
+    if ( ( xi = get_shm_ximage( im ) ) )
+        return xi;
+#endif
+
+    xi = XCreateImage( im->xdisplay, im->visual, im->sdepth,
+                       ZPixmap, 0, 0, im->w, im->h, pad, 0 );
+
+    if ( xi && ! ( xi->data = fl_malloc( im->h * xi->bytes_per_line ) ) )
+    {
+        XFree( xi );
+        xi = NULL;
+    }
+
+    return xi;
+}
+
+
+/***************************************
+ * Gets rid of an XImage created by create_ximage(). A shared memory
+ * one is kept for reuse.
+ ***************************************/
+
+static void
+destroy_ximage( FL_IMAGE * im,
+                XImage   * xi )
+{
+#if USE_XSHM
+    if ( im->xshm && ( ( SHM_IMAGE * ) im->xshm )->ximage == xi )
+        return;
+#endif
+
+    XDestroyImage( xi );
+}
+
+
+/***************************************
+ * Releases the image's XImage, 'keep_shm' tells if a shared memory
+ * segment may be kept for reuse or must be freed as well
+ ***************************************/
+
+void
+flimage_free_ximage( FL_IMAGE * im,
+                     int        keep_shm )
+{
+    if ( im->ximage )
+        destroy_ximage( im, im->ximage );
+    im->ximage = NULL;
+
+#if USE_XSHM
+    if ( ! keep_shm )
+        free_shm_image( im );
+#endif
+}
+
+
+/***************************************
+ * Sends (part of) the XImage to a drawable
+ ***************************************/
+
+static void
+put_ximage( FL_IMAGE * im,
+            Drawable   d )
+{
+#if USE_XSHM
+    SHM_IMAGE *sh = im->xshm;
+
+    if ( sh && sh->ximage == im->ximage )
+    {
+        XShmPutImage( im->xdisplay, d, im->gc, im->ximage, im->sxd, im->syd,
+                      im->wxd, im->wyd, im->swd, im->shd, False );
+        sh->pending = 1;
+        return;
+    }
+#endif
+
+    XPutImage( im->xdisplay, d, im->gc, im->ximage, im->sxd, im->syd,
+               im->wxd, im->wyd, im->swd, im->shd );
+}
+
+
 /***************************************
  * display colormapped image: always 8bit color LUT.
  * ASSUMPTIONS: sizeof(int) == 32bits
@@ -279,24 +567,13 @@ fl_display_ci( FL_IMAGE * im,
 
     pad = im->depth <= 8 ? 8 : ( im->depth <= 16 ? 16 : 32 );
 
-    ximage = XCreateImage( im->xdisplay, im->visual, im->sdepth,
-                           ZPixmap, 0, 0, im->w, im->h, pad, 0 );
-
-    if ( ximage )
-    {
-        xpixels = fl_malloc( im->h * ximage->bytes_per_line * sizeof *xpixels );
-
-        if ( ! xpixels )
-            XFree( ximage );
-    }
-
-    if ( ! ximage || ! xpixels )
+    if ( ! ( ximage = create_ximage( im, pad ) ) )
     {
         im->error_message( im, "fl_display_ci: Can't allocate memory" );
         return -1;
     }
 
-    ximage->data = ( char * ) xpixels;
+    xpixels = ( unsigned char * ) ximage->data;
 
 #if IMAGEDEBUG
     M_err( __func__, "w=%d bytes_per_line=%d bits_per_pixel=%d",
@@ -307,8 +584,7 @@ fl_display_ci( FL_IMAGE * im,
     {
         if ( ! ( xmapped = fl_malloc( im->map_len * sizeof *xmapped ) ) )
         {
-            XFree( ximage );
-            fl_free( xpixels );
+            destroy_ximage( im, ximage );
             M_err( __func__, "fl_malloc failed" );
             return -1;
         }
@@ -661,6 +937,191 @@ fl_display_gray( FL_IMAGE * im,
     } while ( 0 )
 
 
+/***************************************
+ * Fast conversion of RGB images for TrueColor visuals with no more
+ * than 8 bits per color component (i.e. the usual 8-8-8 and 5-6-5 or
+ * 5-5-5 layouts) and 16, 24 or 32 bits per pixel. The pixels are
+ * written in the byte order of the server directly, so no extra pass
+ * for swapping is needed, and each line goes to its proper offset in
+ * the XImage. The inner loops contain no calls or branches so that
+ * the compiler can vectorize them.
+ ***************************************/
+
+typedef struct {
+    unsigned int rdown,         /* how far to shift the 8 bit components */
+                 gdown,         /* down to get the number of bits of the */
+                 bdown;         /* visual */
+    unsigned int rshift,
+                 gshift,
+                 bshift;
+    unsigned int alpha;
+    int          swap;          /* server byte order differs from ours */
+} PIXEL_LAYOUT;
+
+#define BSWAP32( p )                       \
+    (   ( ( p ) >> 24 )                    \
+      | ( ( ( p ) >> 8 ) & 0xff00 )        \
+      | ( ( ( p ) & 0xff00 ) << 8 )        \
+      | ( ( p ) << 24 ) )
+
+#define LAYOUT_PIXEL( l, r, g, b )                                      \
+    (   ( ( ( unsigned int ) ( r ) >> ( l )->rdown ) << ( l )->rshift )  \
+      | ( ( ( unsigned int ) ( g ) >> ( l )->gdown ) << ( l )->gshift )  \
+      | ( ( ( unsigned int ) ( b ) >> ( l )->bdown ) << ( l )->bshift ) )
+
+
+/***************************************
+ ***************************************/
+
+static void
+rgb_to_pixel32( const unsigned char * r,
+                const unsigned char * g,
+                const unsigned char * b,
+                unsigned int        * out,
+                int                   n,
+                const PIXEL_LAYOUT  * l )
+{
+    int i;
+
+    if ( l->swap )
+        for ( i = 0; i < n; i++ )
+        {
+            unsigned int p = LAYOUT_PIXEL( l, r[ i ], g[ i ], b[ i ] )
+                             | l->alpha;
+
+            out[ i ] = BSWAP32( p );
+        }
+    else
+        for ( i = 0; i < n; i++ )
+            out[ i ] = LAYOUT_PIXEL( l, r[ i ], g[ i ], b[ i ] ) | l->alpha;
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+rgb_to_pixel16( const unsigned char * r,
+                const unsigned char * g,
+                const unsigned char * b,
+                unsigned short      * out,
+                int                   n,
+                const PIXEL_LAYOUT  * l )
+{
+    int i;
+
+    if ( l->swap )
+        for ( i = 0; i < n; i++ )
+        {
+            unsigned int p = LAYOUT_PIXEL( l, r[ i ], g[ i ], b[ i ] );
+
+            out[ i ] = ( unsigned short ) ( ( p >> 8 ) | ( p << 8 ) );
+        }
+    else
+        for ( i = 0; i < n; i++ )
+            out[ i ] = ( unsigned short ) LAYOUT_PIXEL( l, r[ i ], g[ i ],
+                                                        b[ i ] );
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+rgb_to_pixel24( const unsigned char * r,
+                const unsigned char * g,
+                const unsigned char * b,
+                unsigned char       * out,
+                int                   n,
+                const PIXEL_LAYOUT  * l,
+                int                   msb_first )
+{
+    int i;
+
+    if ( msb_first )
+        for ( i = 0; i < n; i++, out += 3 )
+        {
+            unsigned int p = LAYOUT_PIXEL( l, r[ i ], g[ i ], b[ i ] );
+
+            out[ 0 ] = p >> 16;
+            out[ 1 ] = p >> 8;
+            out[ 2 ] = p;
+        }
+    else
+        for ( i = 0; i < n; i++, out += 3 )
+        {
+            unsigned int p = LAYOUT_PIXEL( l, r[ i ], g[ i ], b[ i ] );
+
+            out[ 0 ] = p;
+            out[ 1 ] = p >> 8;
+            out[ 2 ] = p >> 16;
+        }
+}
+
+
+/***************************************
+ * Converts an RGB image into the XImage if one of the kernels above
+ * can be used, returns 0 if not
+ ***************************************/
+
+static int
+fast_rgb_to_ximage( FL_IMAGE * im,
+                    XImage   * ximage )
+{
+    FL_RGB2PIXEL *s = &im->rgb2p;
+    PIXEL_LAYOUT l;
+    char *row = ximage->data;
+    int bpp = ximage->bits_per_pixel;
+    int j;
+
+    if (    s->rbits > 8 || s->gbits > 8 || s->bbits > 8
+         || ( bpp != 16 && bpp != 24 && bpp != 32 ) )
+        return 0;
+
+    l.rdown  = 8 - s->rbits;
+    l.gdown  = 8 - s->gbits;
+    l.bdown  = 8 - s->bbits;
+    l.rshift = s->rshift;
+    l.gshift = s->gshift;
+    l.bshift = s->bshift;
+    l.alpha  =    bpp == 32 && im->sdepth == 32 && im->depth == 24
+               ? 0xff000000 : 0;
+    l.swap   = machine_endian( ) != ximage->byte_order;
+
+    for ( j = 0; j < im->h; j++, row += ximage->bytes_per_line )
+    {
+        if ( bpp == 32 )
+            rgb_to_pixel32( im->red[ j ], im->green[ j ], im->blue[ j ],
+                            ( unsigned int * ) row, im->w, &l );
+        else if ( bpp == 16 )
+            rgb_to_pixel16( im->red[ j ], im->green[ j ], im->blue[ j ],
+                            ( unsigned short * ) row, im->w, &l );
+        else
+            rgb_to_pixel24( im->red[ j ], im->green[ j ], im->blue[ j ],
+                            ( unsigned char * ) row, im->w, &l,
+                            ximage->byte_order == MSBFirst );
+    }
+
+    /* Keep the old (if strange) convention of making the pixel at the
+       position given by the transparent index transparent */
+
+    if (    l.alpha
+         && im->tran_index >= 0
+         && im->tran_index < im->w * im->h )
+    {
+        unsigned int *p =
+            ( unsigned int * ) ( ximage->data
+                                 +   ( im->tran_index / im->w )
+                                   * ximage->bytes_per_line )
+            + im->tran_index % im->w;
+
+        *p &= l.swap ? ~ 0xffU : ~ 0xff000000U;
+    }
+
+    return 1;
+}
+
+
 /***************************************
  ***************************************/
 
@@ -674,8 +1135,6 @@ fl_display_rgb( FL_IMAGE * im,
     unsigned char *red   = im->red[   0 ],
                   *green = im->green[ 0 ],
                   *blue  = im->blue[  0 ];
-    int w = im->w,
-        h = im->h;
 
     if ( im->vclass == DirectColor || im->vclass == TrueColor )
     {
@@ -684,11 +1143,16 @@ fl_display_rgb( FL_IMAGE * im,
         /* Use minimum possible padding */
 
         int pad = im->depth <= 8 ? 8 : ( im->depth <= 16 ? 16 : 32 );
-        ximage = XCreateImage( im->xdisplay, im->visual, im->sdepth,
-                               ZPixmap, 0, 0, w, h, pad, 0 );
+
+        if ( ! ( ximage = create_ximage( im, pad ) ) )
+        {
+            flimage_error( im, "fl_malloc() failed" );
+            return -1;
+        }
 
         if ( ximage->bits_per_pixel % 8 )
         {
+            destroy_ximage( im, ximage );
             im->error_message( im, "can't handle non-byte aligned pixel" );
             return -1;
         }
@@ -698,17 +1162,11 @@ fl_display_rgb( FL_IMAGE * im,
                  ximage->bytes_per_line, ximage->bits_per_pixel );
 #endif
 
-        xpixels = fl_malloc( h * ximage->bytes_per_line * sizeof *xpixels );
-
-        if ( ! xpixels )
-        {
-            flimage_error( im, "fl_malloc() failed" );
-            return -1;
-        }
+        xpixels = ( unsigned char * ) ximage->data;
 
-        ximage->data = ( char * ) xpixels;
-
-        if ( ximage->bits_per_pixel == 32 )
+        if ( fast_rgb_to_ximage( im, ximage ) )
+            /* empty */ ;
+        else if ( ximage->bits_per_pixel == 32 )
         {
             RGBTOPIXEL( unsigned int );
 
@@ -754,8 +1212,9 @@ fl_display_rgb( FL_IMAGE * im,
                 if ( ximage->byte_order == MSBFirst )
                     for ( i = 0, tmp3 = tt; i < im->w; i++ )
                     {
-                        xcol = rgb2pixel( im, red[ i ], green[ i ], blue[ i ],
-                                          &im->rgb2p );
+                        xcol = rgb2pixel( im, im->red[ j ][ i ],
+                                          im->green[ j ][ i ],
+                                          im->blue[ j ][ i ], &im->rgb2p );
                         *tmp3++ = ( xcol >> 16 ) & 0xff;
                         *tmp3++ = ( xcol >>  8 ) & 0xff;
                         *tmp3++ = ( xcol       ) & 0xff;
@@ -763,8 +1222,9 @@ fl_display_rgb( FL_IMAGE * im,
                 else
                     for ( i = 0, tmp3 = tt; i < im->w; i++ )
                     {
-                        xcol = rgb2pixel( im, red[ i ], green[ i ], blue[ i ],
-                                          &im->rgb2p );
+                        xcol = rgb2pixel( im, im->red[ j ][ i ],
+                                          im->green[ j ][ i ],
+                                          im->blue[ j ][ i ], &im->rgb2p );
                         *tmp3++ = ( xcol       ) & 0xff;
                         *tmp3++ = ( xcol >>  8 ) & 0xff;
                         *tmp3++ = ( xcol >> 16 ) & 0xff;
@@ -814,7 +1274,6 @@ fl_display_packed( FL_IMAGE * im,
 static void
 displayXImage( FL_IMAGE * im )
 {
-    XImage *ximage = im->ximage;
     Colormap xcolormap = im->xcolormap;
     unsigned long newpixels[ FLIMAGE_MAXLUT ];
     XColor xc[ FLIMAGE_MAXLUT ];
@@ -823,8 +1282,7 @@ displayXImage( FL_IMAGE * im )
     if ( im->vclass != TrueColor && im->vclass != DirectColor )
         get_all_colors( im, newpixels, &npix, xc );
 
-    XPutImage( im->xdisplay, im->win, im->gc, ximage, im->sxd, im->syd,
-               im->wxd, im->wyd, im->swd, im->shd );
+    put_ximage( im, im->win );
 
     if ( npix )
         XFreeColors( im->xdisplay, xcolormap, newpixels, npix, 0 );
@@ -1240,11 +1698,7 @@ flimage_sdisplay( FL_IMAGE * im,
 
     /* If we got here, we need to re-generate ximage */
 
-    if ( im->ximage )
-    {
-        XDestroyImage( ( XImage * ) im->ximage );
-        im->ximage = None;
-    }
+    flimage_free_ximage( im, 1 );
 
     if ( ! Compatible( xwa, im ) )
     {
@@ -1266,8 +1720,7 @@ flimage_sdisplay( FL_IMAGE * im,
     {
         im->win = im->double_buffer ? im->pixmap : win;
 
-        XPutImage( im->xdisplay, im->win, im->gc, im->ximage,
-                   im->sxd, im->syd, im->wxd, im->wyd, im->swd, im->shd );
+        put_ximage( im, im->win );
         im->display_markers( im );
         im->display_text( im );
         im->win = win;
@@ -1281,6 +1734,147 @@ flimage_sdisplay( FL_IMAGE * im,
 }
 
 
+/***************************************
+ * Returns a matrix that shares the rows starting at 'first' of
+ * the matrix 'mat'
+ ***************************************/
+
+static void *
+share_rows( void         * mat,
+            int            first,
+            int            nrows,
+            int            ncols,
+            unsigned int   esize )
+{
+    if ( ! mat )
+        return NULL;
+
+    return fl_make_matrix( nrows, ncols, esize, ( ( char ** ) mat )[ first ] );
+}
+
+
+/***************************************
+ * Shows the rows first to first + n - 1 of an image that may still be
+ * in the process of being read. Only these rows get converted, using a
+ * temporary image that shares the pixels but has its own colormap and
+ * display data, so nothing the reader (or a later full display) relies
+ * on gets changed. Since this must not allocate colors or quantize
+ * the image this is only done for TrueColor and DirectColor visuals,
+ * for all others the function simply returns 0.
+ ***************************************/
+
+int
+flimage_display_rows( FL_IMAGE * im,
+                      FL_WINDOW  win,
+                      int        first,
+                      int        n )
+{
+    FL_IMAGE band;
+    FLIMAGE_SETUP setup;
+    XWindowAttributes xwa;
+    int last = first + n,
+        top = 0,
+        ret;
+
+    if ( ! win || ! im || im->w <= 0 || n <= 0 )
+        return -1;
+
+    /* Only show the part that overlaps with the subimage, if one is set */
+
+    if ( im->sh > 0 && im->sy + im->sh <= im->h )
+    {
+        top = im->sy;
+        first = FL_max( first, top );
+        last = FL_min( last, top + im->sh );
+    }
+
+    if ( ( n = last - first ) <= 0 )
+        return 0;
+
+    XGetWindowAttributes( im->xdisplay, win, &xwa );
+
+    if (    xwa.depth == 1
+         || (    xwa.visual->class != TrueColor
+              && xwa.visual->class != DirectColor ) )
+        return 0;
+
+    band = *im;
+    setup = *im->setup;
+    setup.do_not_clear = 1;
+    band.setup = &setup;
+
+    band.h = n;
+    band.sy = band.sh = 0;
+    band.wy = im->wy + first - top;
+    band.double_buffer = 0;
+
+    band.red    = share_rows( im->red,    first, n, im->w, sizeof **im->red );
+    band.green  = share_rows( im->green,  first, n, im->w,
+                              sizeof **im->green );
+    band.blue   = share_rows( im->blue,   first, n, im->w,
+                              sizeof **im->blue );
+    band.gray   = share_rows( im->gray,   first, n, im->w,
+                              sizeof **im->gray );
+    band.ci     = share_rows( im->ci,     first, n, im->w, sizeof **im->ci );
+    band.packed = share_rows( im->packed, first, n, im->w,
+                              sizeof **im->packed );
+    band.alpha = NULL;
+    band.red16 = band.green16 = band.blue16 = band.alpha16 = NULL;
+
+    band.red_lut = band.green_lut = band.blue_lut = band.alpha_lut = NULL;
+    band.wlut = NULL;
+    band.wlut_len = 0;
+
+    if (    im->map_len > 0
+         && im->red_lut
+         && flimage_getcolormap( &band ) >= 0 )
+    {
+        size_t size = band.map_len * sizeof *band.red_lut;
+
+        memcpy( band.red_lut,   im->red_lut,   size );
+        memcpy( band.green_lut, im->green_lut, size );
+        memcpy( band.blue_lut,  im->blue_lut,  size );
+        memcpy( band.alpha_lut, im->alpha_lut, size );
+    }
+
+    band.pixels = NULL;
+    band.display_type = FL_IMAGE_NONE;
+    band.modified = 1;
+    band.ximage = NULL;
+    band.xshm = NULL;
+    band.gc = band.textgc = band.markergc = None;
+    band.pixmap = None;
+    band.ntext = band.nmarkers = 0;
+    band.dont_display_text = band.dont_display_marker = 1;
+
+    ret = flimage_sdisplay( &band, win );
+    XFlush( im->xdisplay );
+
+    flimage_free_ximage( &band, 0 );
+
+    if ( band.gc )
+        XFreeGC( band.xdisplay, band.gc );
+    if ( band.textgc )
+        XFreeGC( band.xdisplay, band.textgc );
+
+    fl_free_matrix( band.pixels );
+    fl_free_matrix( band.red );
+    fl_free_matrix( band.green );
+    fl_free_matrix( band.blue );
+    fl_free_matrix( band.gray );
+    fl_free_matrix( band.ci );
+    fl_free_matrix( band.packed );
+
+    fli_safe_free( band.red_lut );
+    fli_safe_free( band.green_lut );
+    fli_safe_free( band.blue_lut );
+    fli_safe_free( band.alpha_lut );
+    fli_safe_free( band.wlut );
+
+    return ret;
+}
+
+
 /***************************************
  * quantize a full color image
  ***************************************/
@@ -1657,9 +2251,7 @@ flimage_from_pixmap_( FL_IMAGE * im,
 
     /* The old Ximage is now out of date */
 
-    if ( im->ximage )
-        XDestroyImage((XImage *) im->ximage);
-
+    flimage_free_ximage( im, 1 );
     im->ximage = ximage;
 
     return status;
@@ -36,6 +36,14 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined HAVE_MMAP && defined HAVE_SYS_MMAN_H
+#define USE_MMAP 1
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 
 #define FITS_DEBUG         0
 
@@ -65,7 +73,6 @@ flimage_set_fits_bits( int bits )
 static int dogray = 1;              /* how to do fits        */
 static float nan_replace = 0.0;     /* what to do about NaNs  */
 static float blank_replace = 0.0;   /* what to do about NaNs  */
-static int little_endian = -1;
 
 #define RECORD_LEN    2880
 
@@ -118,6 +125,8 @@ typedef struct
     int    blank;
     int    has_blank;
     int    nframe;
+    int    little_endian;               /* byte order of this machine      */
+    long   data_start;                  /* file offset of the data array   */
     int    dim[ MAXDIM ];               /* dimensions                      */
     char   label[ MAXDIM ][ MAXLEN ];   /* name of each dimension          */
     char   bunit[ MAXLEN ];             /* unit name of the quantities     */
@@ -133,13 +142,13 @@ typedef struct
 /***************************************
  ***************************************/
 
-static void
+static int
 detect_endian( void )
 {
     FLOAT_UNION U;
 
     U.val = 1.0;
-    little_endian = ( U.uc[ 3 ] == 0x3f );
+    return U.uc[ 3 ] == 0x3f;
 }
 
 
@@ -149,8 +158,7 @@ detect_endian( void )
 static void
 init_fits( SPEC * sp )
 {
-    if ( little_endian < 0 )
-    detect_endian( );
+    sp->little_endian = detect_endian( );
 
     sp->bpp = sp->ndim = -1;
     sp->bscale = 1.0;
@@ -160,19 +168,23 @@ init_fits( SPEC * sp )
 
 
 
+#define HINFO_LINES  15
+
 /***************************************
+ * Formats the header into the lines of 'hbuf', returns 'buf' with a
+ * pointer to each line, terminated by NULL
  ***************************************/
 
 static char **
-FITS_header_info( const void * p )
+FITS_header_info( const void * p,
+                  char         hbuf[ ][ 80 ],
+                  char      ** buf )
 {
     const SPEC *h = p;
-    static char hbuf[ 15 ][ 80 ];
-    static char *buf[ 15 ];
     int i,
         j;
 
-    for ( i = 0; i < 15; i++ )
+    for ( i = 0; i < HINFO_LINES; i++ )
         buf[ i ] = hbuf[ i ];
 
     i = 0;
@@ -204,12 +216,15 @@ static void
 generate_fits_header_info( FL_IMAGE * im )
 {
     SPEC *h = im->io_spec;
-    char **q;
+    char hbuf[ HINFO_LINES ][ 80 ],
+         *buf[ HINFO_LINES ],
+         **q;
 
     if ( ! ( im->info = fl_malloc( 1024 ) ) )
         return;
 
-    for ( im->info[ 0 ] = '\0', q = FITS_header_info( h ); *q; q++ )
+    for ( im->info[ 0 ] = '\0', q = FITS_header_info( h, hbuf, buf );
+          *q; q++ )
         strcat( strcat( im->info, *q ),"\n" );
 }
 
@@ -225,12 +240,14 @@ static int verbose = 4;
 static void
 echo_FITS_header( SPEC * h )
 {
-    char **q;
+    char hbuf[ HINFO_LINES ][ 80 ],
+         *buf[ HINFO_LINES ],
+         **q;
 
     if ( verbose <= ML_INFO1 )
         return;
 
-    for ( q = FITS_header_info( h ); *q; q++ )
+    for ( q = FITS_header_info( h, hbuf, buf ); *q; q++ )
         fprintf( stderr, "%s\n", *q );
 }
 
@@ -246,6 +263,8 @@ static int parse_fits_header( FILE *,
 #define LBCOL      0        /* black           */
 
 static int FITS_next( FL_IMAGE * );
+static int FITS_random_frame( FL_IMAGE *,
+                              int );
 
 
 /***************************************
@@ -323,6 +342,8 @@ FITS_description( FL_IMAGE * im )
 
     im->more = sp->ndim > 2 && sp->dim[ 2 ] > 1;
     im->next_frame = FITS_next;
+    im->random_frame = FITS_random_frame;
+    im->total_frames = sp->ndim > 2 && sp->dim[ 2 ] > 1 ? sp->dim[ 2 ] : 1;
 
     /* label the axis if available */
 
@@ -452,7 +473,13 @@ parse_fits_header( FILE     * fp,
         else if (strcmp( key, "EXTEND" ) == 0 )
             h->xtension = val[ 0 ] == 'T';
         else if ( strncmp( buf, "END ", 4 ) == 0 )
+        {
+            /* the data start with the next record */
+
+            h->data_start = ( ftell( fp ) + RECORD_LEN - 1 ) / RECORD_LEN
+                            * RECORD_LEN;
             done = 1;
+        }
         else if ( is_comments( key ) )
             flimage_add_comments( im, buf, 80 );
 
@@ -545,178 +572,244 @@ parse_fits_header( FILE     * fp,
 
 
 /***************************************
- * Assuming IEEE-745 floating point native
+ * Gets hold of the raw data of the current frame. If possible the
+ * file gets mapped into memory so only the pages of the frame actually
+ * needed are ever read (which makes stepping through a large data cube
+ * cheap), otherwise the frame is read into a buffer. Returns the number
+ * of rows available
  ***************************************/
 
+typedef struct
+{
+    unsigned char * data;       /* start of the frame's raw data  */
+    void          * mem;        /* what has to be released        */
+    size_t          mem_len;    /* mapped length, 0 if allocated  */
+} FRAME_DATA;
+
 static int
-FITS_load( FL_IMAGE * im )
+get_frame_data( FL_IMAGE   * im,
+                FRAME_DATA * fd )
 {
-    unsigned short *ci = FL_IsGray( im->type ) ? im->gray[ 0 ] : im->ci[ 0 ];
     SPEC *sp = im->io_spec;
-    FLOAT64  offset,
-             scale,
-             dmin,
-             dmax,
-            *dval,
-             tmp64;
-    FILE *fp = im->fpin;
-    int  i,
-         j,
-         n,
-         k,
-         byte_per_pix,
-         has_minmax,
-        *ival,
-         err;
-    unsigned char *c,
-                   uc[ 8 ];
-    short *sval;
-    FLOAT32 *fval,
-             tmp32;
-    void **vals;
-
-    dmin = 1.0e30;
-    dmax = -1.0e30;
-    has_minmax = sp->dmax != sp->dmin;
+    size_t row_bytes = ( size_t ) im->w * ( FL_abs( sp->bpp ) / 8 ),
+           bytes = row_bytes * im->h,
+           got;
+#ifdef USE_MMAP
+    off_t offset = sp->data_start + ( off_t ) ( sp->nframe - 1 ) * bytes,
+          start;
+    struct stat st;
+
+    /* Only map what really is in the file, touching pages beyond
+       its end would get us killed */
+
+    if (    fstat( fileno( im->fpin ), &st ) == 0
+         && offset + ( off_t ) bytes <= st.st_size )
+    {
+        start = offset - offset % sysconf( _SC_PAGESIZE );
+        fd->mem_len = bytes + ( offset - start );
+        fd->mem = mmap( NULL, fd->mem_len, PROT_READ, MAP_PRIVATE,
+                        fileno( im->fpin ), start );
 
-#if FITS_DEBUG
-    M_err( __func__, "sp->dmax=%g sp->dmin=%g", sp->dmax, sp->dmin );
+        if ( fd->mem != MAP_FAILED )
+        {
+#ifdef MADV_SEQUENTIAL
+            madvise( fd->mem, fd->mem_len, MADV_SEQUENTIAL );
+#endif
+            fd->data = ( unsigned char * ) fd->mem + ( offset - start );
+            return im->h;
+        }
+    }
+#else
+    long offset = sp->data_start + ( long ) ( sp->nframe - 1 ) * bytes;
 #endif
 
-    /* read the data */
+    fd->mem_len = 0;
 
-    byte_per_pix = FL_abs( sp->bpp ) / 8;
-    if ( ! ( vals = fl_get_matrix( im->h, im->w, byte_per_pix ) ) )
+    if ( ! ( fd->data = fd->mem = fl_malloc( bytes ) ) )
     {
         im->error_message( im, "Can't get memory for FITS" );
         return -1;
     }
 
-    for ( err = 0, i = im->h - 1; !err && i >= 0; i--, im->completed++ )
-    {
-        if ( ! ( im->completed & FLIMAGE_REPFREQ ) )
-            im->visual_cue( im, "Reading FITS" );
+    if ( fseek( im->fpin, offset, SEEK_SET ) != 0 )
+        got = 0;
+    else
+        got = fread( fd->data, 1, bytes, im->fpin );
 
-        k = im->h - 1 - i;
+    /* keep what we've got */
 
-        if ( ( err = ( fread( c = vals[ k ], byte_per_pix, im->w, fp ) !=
-                                                          ( size_t ) im->w ) ) )
-            im->error_message( im, "Error reading FITS" );
+    if ( got < bytes )
+        im->error_message( im, "Error reading FITS" );
 
-        /* now do data conversion to MSBF order */
+    return got / row_bytes;
+}
 
-        switch ( sp->bpp )
-        {
-            case 32 :
-                for ( ival = vals[k], j = 0; j < im->w; j++, c += 4 )
-                {
-                    ival[ j ] =   ( c[ 0 ] << 24 )
-                                | ( c[ 1 ] << 16 )
-                                | ( c[ 2 ] <<  8 )
-                                | c[ 3 ];
 
-                    if ( sp->has_blank && ival[ j ] == sp->blank )
-                        ival[ j ] = blank_replace;
-                }
+/***************************************
+ ***************************************/
 
-                if ( ! has_minmax )
-                {
-                    for ( j = 0; j < im->w; j++ )
-                        if ( ival[ j ] < dmin )
-                            dmin = ival[ j ];
-                        else if ( ival[ j ] > dmax )
-                            dmax = ival[ j ];
-                }
-                break;
+static void
+release_frame_data( FRAME_DATA * fd )
+{
+#ifdef USE_MMAP
+    if ( fd->mem_len )
+    {
+        munmap( fd->mem, fd->mem_len );
+        return;
+    }
+#endif
 
-            case 16 :
-                for ( sval = vals[ k ], j = 0; j < im->w; j++, c += 2 )
-                {
-                    sval[ j ] = ( c[ 0 ] << 8 ) | c[ 1 ];
-                    if ( sp->has_blank && sval[ j ] == sp->blank )
-                        sval[ j ] = blank_replace;
-                }
+    fl_free( fd->mem );
+}
 
-                if ( ! has_minmax )
-                {
-                    for ( j = 0; j < im->w; j++ )
-                        if ( sval[ j ] < dmin )
-                            dmin = sval[ j ];
-                        else if ( sval[ j ] > dmax )
-                            dmax = sval[ j ];
-                }
-                break;
 
-            case 8 :
-                if ( ! has_minmax )
-                {
-                    for ( j = 0; j < im->w; j++ )
-                        if ( c[ j ] < dmin )
-                            dmin = c[ j ];
-                        else if ( c[ j ] > dmax )
-                            dmax = c[ j ];
-                }
-                break;
+/***************************************
+ * Converts a row of raw (MSBF) data to doubles, replacing blanks and
+ * NaNs on the way. Assumes IEEE-754 floating point native
+ ***************************************/
 
-            case -32 :
-                for ( fval = vals[ k ], j = 0; j < im->w; j++, c += 4 )
+static void
+convert_row( const unsigned char * c,
+             int                   n,
+             const SPEC          * sp,
+             FLOAT64             * out )
+{
+    FLOAT64 tmp64;
+    FLOAT32 fval,
+            tmp32;
+    unsigned char uc[ 8 ];
+    int j,
+        ival;
+
+    switch ( sp->bpp )
+    {
+        case 8 :
+            for ( j = 0; j < n; j++, c++ )
+                out[ j ] = ( sp->has_blank && *c == sp->blank ) ?
+                           blank_replace : *c;
+            break;
+
+        case 16 :
+            for ( j = 0; j < n; j++, c += 2 )
+            {
+                ival = ( short ) ( ( c[ 0 ] << 8 ) | c[ 1 ] );
+                out[ j ] = ( sp->has_blank && ival == sp->blank ) ?
+                           blank_replace : ival;
+            }
+            break;
+
+        case 32 :
+            for ( j = 0; j < n; j++, c += 4 )
+            {
+                ival = ( int ) (   ( ( unsigned int ) c[ 0 ] << 24 )
+                                 | ( c[ 1 ] << 16 )
+                                 | ( c[ 2 ] <<  8 )
+                                 | c[ 3 ] );
+                out[ j ] = ( sp->has_blank && ival == sp->blank ) ?
+                           blank_replace : ival;
+            }
+            break;
+
+        case -32 :
+            for ( j = 0; j < n; j++, c += 4 )
+            {
+                /* Using
+                    fval = * ( FLOAT32 * ) uc;
+                   results in type-punning warning, so instead: */
+
+                if ( sp->little_endian )
                 {
-                    if ( little_endian )
-                    {
-                        /* Using
-                            fval[ j ] = * ( FLOAT32 * ) uc;
-                           results in type-punning warning, so instead: */
-                        memcpy( fval + j, uc, 4 );
-                    }
-
-                    if ( ISNAN( fval[ j ], tmp32 ) )
-                        fval[ j ] = nan_replace;
+                    SWAP4( c, uc );
+                    memcpy( &fval, uc, 4 );
                 }
+                else
+                    memcpy( &fval, c, 4 );
 
-                if ( ! has_minmax )
-                {
-                    for ( j = 0; j < im->w; j++ )
-                        if ( fval[ j ] < dmin )
-                            dmin = fval[ j ];
-                        else if ( fval[ j ] > dmax )
-                            dmax = fval[ j ];
-                }
-                break;
+                out[ j ] = ISNAN( fval, tmp32 ) ? nan_replace : fval;
+            }
+            break;
 
-            case -64 :
-                for ( dval = vals[ k ], j = 0; j < im->w; j++, c += 8 )
+        case -64 :
+            for ( j = 0; j < n; j++, c += 8 )
+            {
+                if ( sp->little_endian )
                 {
-                    if ( little_endian )
-                    {
-                        SWAP8( c, uc );
-                        /* Using
-                            dval[ j ] = * ( FLOAT64 * ) uc;
-                           results in type-punning warning, so instead: */
-                        memcpy( dval + j, uc, 8 );
-                    }
-
-                    if ( ISNAN( dval[ j ], tmp64 ) )
-                        dval[ j ] = nan_replace;
+                    SWAP8( c, uc );
+                    memcpy( out + j, uc, 8 );
                 }
+                else
+                    memcpy( out + j, c, 8 );
 
-                if ( ! has_minmax )
-                {
-                    for ( j = 0; j < im->w; j++ )
-                        if ( dval[ j ] < dmin )
-                            dmin = dval[ j ];
-                        else if ( dval[ j ] > dmax )
-                            dmax = dval[ j ];
-                }
-                break;
-        }
+                if ( ISNAN( out[ j ], tmp64 ) )
+                    out[ j ] = nan_replace;
+            }
+            break;
     }
+}
+
+
+/***************************************
+ * Converts the current frame into gray pixels, directly from the file
+ * data and one row at a time, so apart from the image itself no memory
+ * proportional to the size of the frame is needed.
+ ***************************************/
+
+static int
+FITS_load( FL_IMAGE * im )
+{
+    unsigned short **ci = FL_IsGray( im->type ) ? im->gray : im->ci;
+    SPEC *sp = im->io_spec;
+    FRAME_DATA fd;
+    FLOAT64 offset,
+            scale,
+            dmin,
+            dmax,
+           *row;
+    size_t row_bytes = ( size_t ) im->w * ( FL_abs( sp->bpp ) / 8 );
+    int i,
+        j,
+        nrows;
+
+    im->completed = 0;
+
+    if ( ( nrows = get_frame_data( im, &fd ) ) < 0 )
+        return -1;
 
-    if ( ! has_minmax )
+    if ( ! ( row = fl_malloc( im->w * sizeof *row ) ) )
     {
+        release_frame_data( &fd );
+        im->error_message( im, "Can't get memory for FITS" );
+        return -1;
+    }
+
+    /* Find the data range if the header didn't tell */
+
+    if ( sp->dmax == sp->dmin )
+    {
+        dmin = 1.0e30;
+        dmax = -1.0e30;
+
+        for ( i = 0; i < nrows; i++ )
+        {
+            convert_row( fd.data + i * row_bytes, im->w, sp, row );
+
+            for ( j = 0; j < im->w; j++ )
+            {
+                if ( row[ j ] < dmin )
+                    dmin = row[ j ];
+                if ( row[ j ] > dmax )
+                    dmax = row[ j ];
+            }
+        }
+
         sp->dmin = sp->bzero + dmin * sp->bscale;
         sp->dmax = sp->bzero + dmax * sp->bscale;
     }
 
+#if FITS_DEBUG
+    M_err( __func__, "sp->dmax=%g sp->dmin=%g", sp->dmax, sp->dmin );
+#endif
+
     /* now the overall offset and scale for physical data */
 
     scale = im->gray_maxval / ( sp->dmax - sp->dmin );
@@ -738,23 +831,22 @@ FITS_load( FL_IMAGE * im )
 
     /* remap data into pixels */
 
-    if ( sp->bpp == 8 )
-        for ( c = vals[ 0 ], n = im->w * im->h; --n > 0; )
-            ci[ n ] = offset + c[ n ] * scale;
-    else if ( sp->bpp == 16 )
-        for ( sval = vals[ 0 ], n = im->w * im->h; --n > 0; )
-            ci[ n ] = offset + sval[ n ] * scale;
-    else if ( sp->bpp == 32 )
-        for ( ival = vals[ 0 ], n = im->w * im->h; --n > 0; )
-            ci[ n ] = offset + ival[ n ] * scale;
-    else if ( sp->bpp == -32 )
-        for ( fval = vals[ 0 ], n = im->w * im->h; --n > 0; )
-            ci[ n ] = offset + fval[ n ] * scale;
-    else if ( sp->bpp == -64 )
-        for ( dval = vals[ 0 ], n = im->w * im->h; --n > 0; )
-            ci[ n ] = offset + dval[ n ] * scale;
-
-    fl_free_matrix( vals );
+    for ( i = 0; i < nrows; i++ )
+    {
+        convert_row( fd.data + i * row_bytes, im->w, sp, row );
+
+        for ( j = 0; j < im->w; j++ )
+            ci[ i ][ j ] = offset + row[ j ] * scale;
+
+        if ( ! ( ++im->completed & FLIMAGE_REPFREQ ) )
+        {
+            im->visual_cue( im, "Reading FITS" );
+            flimage_rows_done( im, im->completed );
+        }
+    }
+
+    fl_free( row );
+    release_frame_data( &fd );
 
     return im->completed >= im->h / 2 ? 1 : -1;
 }
@@ -823,8 +915,33 @@ FITS_next( FL_IMAGE * im )
 #endif
 
     status = FITS_load( im );
-    im->more = status >= 0 && ! ( feof( im->fpin ) || ferror( im->fpin ) );
-    im->more = im->more && sp->nframe < sp->dim[ 2 ];
+    im->more = status >= 0 && sp->nframe < sp->dim[ 2 ];
+    return status;
+}
+
+
+/***************************************
+ * Loads frame n (starting from 1) of a data cube. Since the position
+ * of each frame in the file is known, this doesn't require reading
+ * any of the other frames
+ ***************************************/
+
+static int
+FITS_random_frame( FL_IMAGE * im,
+                   int        n )
+{
+    int status;
+    SPEC *sp = im->io_spec;
+
+    if ( n < 1 || n > ( sp->ndim > 2 ? sp->dim[ 2 ] : 1 ) )
+    {
+        flimage_error( im, "FITS: %s has no frame %d", im->infile, n );
+        return -1;
+    }
+
+    sp->nframe = n;
+    status = FITS_load( im );
+    im->more = status >= 0 && sp->nframe < sp->dim[ 2 ];
     return status;
 }
 
@@ -59,7 +59,7 @@ GIF_identify( FILE * fp )
     if ( fread( buf, 1, 6, fp ) != 6 )
         return 0;
     rewind( fp );
-    return ! strncmp( buf, "GIFa", 4 );
+    return ! strncmp( buf, "GIF", 3 );
 }
 
 
@@ -346,14 +346,47 @@ convert_gif_text( FL_IMAGE * im )
 
 /******************* local functions ******************/
 
+/* Where the rows of a (possibly interlaced) image are */
+
+typedef struct
+{
+    int pass,
+        current;
+} LINESEQ;
+
+#define MC_SIZE        4097
+
+/* State of the decompressor, one per image being read */
+
+typedef struct
+{
+    int              bpp,
+                     ClearCode,
+                     EOFCode,
+                     CodeSize;
+    int              avail,
+                     oldcode;
+    unsigned char    firstchar;
+    int              lines;         /* rows output so far  */
+    LINESEQ          seq;
+    unsigned char  * lhead,         /* line buffer         */
+                   * lbuf;
+    unsigned char    suffix[ MC_SIZE ];
+    unsigned short   prefix[ MC_SIZE ];
+    unsigned short   length[ MC_SIZE ];
+} LZWDEC;
+
 static int readextension( FILE *,
                           FL_IMAGE * );
-static int next_lineno( int,
+static int next_lineno( LINESEQ *,
+                        int,
                         int,
                         int );
 static int process_lzw_code( FL_IMAGE *,
+                             LZWDEC *,
                              int );
 static void outputline( FL_IMAGE *,
+                        LZWDEC *,
                         unsigned char * );
 
 
@@ -374,20 +407,17 @@ static const unsigned int gif_codemask[ ] =
 
 static void
 outputline( FL_IMAGE      * im,
+            LZWDEC        * d,
             unsigned char * line )
 {
     unsigned short *po;
     unsigned char *pi = line;
     SPEC *sp = im->io_spec;
-    static int lines;
     int k;
 
-    if ( sp->cur_total == 0 )   /* first entry */
-        lines = 0;
-
     /* figure out the real row  number if interlace */
 
-    k = next_lineno( lines, im->h, sp->interlace );
+    k = next_lineno( &d->seq, d->lines, im->h, sp->interlace );
 
     sp->cur_total += im->w;
 
@@ -399,9 +429,16 @@ outputline( FL_IMAGE      * im,
     for ( po = im->ci[ k ], line += im->w; pi < line; )
         *po++ = *pi++;
 
-    im->completed = ++lines;
+    im->completed = ++d->lines;
     if ( ! ( im->completed & FLIMAGE_REPFREQ ) )
+    {
         im->visual_cue( im, "Reading GIF" );
+
+        /* Interlaced images only get complete at the very end */
+
+        if ( ! sp->interlace )
+            flimage_rows_done( im, d->lines );
+    }
 }
 
 
@@ -493,9 +530,10 @@ readextension( FILE     * fp,
             {
                 sp->gc.tran = buf[ 0 ] & 1;
                 sp->gc.input = buf[ 0 ] & 2;
-                sp->gc.delay = 10 * ( buf[ 0 ] + ( buf[ 1 ] << 8 ) );
+                sp->gc.delay = 10 * (   ( unsigned char ) buf[ 1 ]
+                                      + ( ( unsigned char ) buf[ 2 ] << 8 ) );
                 if ( sp->gc.tran )
-                    sp->gc.tran_col = buf[ 3 ];
+                    sp->gc.tran_col = ( unsigned char ) buf[ 3 ];
             }
             break;
 
@@ -561,18 +599,6 @@ skip_extension( FILE     * fp,
 #define LZW_INIT          9000
 
 
-static int bpp,
-           ClearCode,
-           EOFCode,
-           CodeSize;
-
-#include <ctype.h>
-
-static unsigned char * lhead,
-                     *lbuf,
-                     *stackp;   /* local buffers */
-
-
 /***************************************
  ***************************************/
 
@@ -588,20 +614,30 @@ GIF_load( FL_IMAGE * im )
                   buf[ 257 ];
     SPEC *sp = im->io_spec;
     FILE *fp = im->fpin;
+    LZWDEC *d;
 
     sp->ctext = 0;
 
-    CodeSize = getc( fp );
-    if ( CodeSize > 8 || CodeSize < 2 )
+    if ( ! ( d = fl_calloc( 1, sizeof *d ) ) )
+    {
+        flimage_error( im, "GIF load: can't allocate decoder" );
+        return -1;
+    }
+
+    d->CodeSize = getc( fp );
+    if ( d->CodeSize > 8 || d->CodeSize < 2 )
     {
-        flimage_error( im, "Load: Bad CodeSize %d(%s)", CodeSize, im->infile );
+        flimage_error( im, "Load: Bad CodeSize %d(%s)", d->CodeSize,
+                       im->infile );
+        fl_free( d );
         return -1;
     }
 
     /* initialize the decompressor */
 
-    err = sp->cur_total = 0;
-    process_lzw_code( im, LZW_INIT );
+    sp->cur_total = 0;
+    if ( ( err = process_lzw_code( im, d, LZW_INIT ) ) )
+        flimage_error( im, "GIF load: can't allocate line buffer" );
 
     while ( ! err && ( count = getc( fp ) ) != EOF && count > 0 )
     {
@@ -610,21 +646,22 @@ GIF_load( FL_IMAGE * im )
         {
             datum += *ch << bits;
             bits += 8;
-            while ( bits >= CodeSize && ! err )
+            while ( bits >= d->CodeSize && ! err )
             {
-                code = datum & gif_codemask[ CodeSize ];
-                datum >>= CodeSize;
-                bits -= CodeSize;
-                err = code == EOFCode || process_lzw_code( im, code );
+                code = datum & gif_codemask[ d->CodeSize ];
+                datum >>= d->CodeSize;
+                bits -= d->CodeSize;
+                err = code == d->EOFCode || process_lzw_code( im, d, code );
             }
         }
 
         /* EOFcode is not exactly an errr */
 
-        if ( err && code == EOFCode )
+        if ( err && code == d->EOFCode )
             err = 0;
 
-        if ( code != EOFCode && sp->cur_total > (long) im->w * im->h )
+        if (    code != d->EOFCode
+             && sp->cur_total > ( long ) im->w * im->h )
         {
             flimage_error( im, "%s: Raster full before EOI", im->infile );
             err = 1;
@@ -661,15 +698,18 @@ GIF_load( FL_IMAGE * im )
     if ( count < im->h )
     {
         int leftover;
-        leftover = lbuf - lhead;
+        leftover = d->lbuf - d->lhead;
 
         M_warn( __func__, "total %ld should be %d", sp->cur_total + leftover,
                 im->w * im->h );
 
         if ( leftover )
-            outputline( im, lhead );
+            outputline( im, d, d->lhead );
     }
 
+    fli_safe_free( d->lhead );
+    fl_free( d );
+
     /* if more than 1/4 image is read, return positive value so that driver
        will try to display it.  */
 
@@ -685,41 +725,41 @@ GIF_load( FL_IMAGE * im )
  * bytes associated with the code.
  *
  * Based on gifpaste by Kipp Hickman @ Silicon Graphics
+ *
+ * Besides prefix and suffix the table also keeps the length of the
+ * string each code stands for. That way a string can be unpacked
+ * back to front directly into the line buffer, without going through
+ * a stack first and without testing for the root code at each step.
  ***************************************/
 
-#define OUTPIX( c )    ( *lbuf++ = ( c ) )
-#define MC_SIZE        4097
-
 
 /***************************************
  * if we've got more than one scanline, output
  ***************************************/
 
 static void
-flush_buffer( FL_IMAGE * im )
+flush_buffer( FL_IMAGE * im,
+              LZWDEC   * d )
 {
     int incode;
 
-    incode = lbuf - lhead;
+    incode = d->lbuf - d->lhead;
 
     if ( incode >= im->w )
     {
-        int i;
-
-        lbuf = lhead;
+        d->lbuf = d->lhead;
 
         while ( incode >= im->w )
         {
-            outputline( im, lbuf );
+            outputline( im, d, d->lbuf );
             incode -= im->w;
-            lbuf += im->w;
+            d->lbuf += im->w;
         }
 
         /* copy the left over */
 
-        for ( i = 0; i < incode; i++ )
-            lhead[ i ] = *lbuf++;
-        lbuf = lhead + incode;
+        memmove( d->lhead, d->lbuf, incode );
+        d->lbuf = d->lhead + incode;
     }
 }
 
@@ -729,57 +769,64 @@ flush_buffer( FL_IMAGE * im )
 
 static int
 process_lzw_code( FL_IMAGE * im,
+                  LZWDEC   * d,
                   int        code )
 {
-    int incode;
-    static unsigned char firstchar;
-    static unsigned char stack[ MC_SIZE ];
-    static int avail,
-               oldcode;
-    static unsigned char suffix[ MC_SIZE ];
-    static unsigned short prefix[ MC_SIZE ];
+    int incode,
+        len;
+    unsigned char *p,
+                  *suffix = d->suffix;
+    unsigned short *prefix = d->prefix,
+                   *length = d->length;
 
     if ( code == LZW_INIT )
     {
-        lbuf = lhead = fl_realloc( lhead, im->w + 1 + 4096 );
+        d->lbuf = d->lhead = fl_malloc( im->w + 1 + 4096 );
 
-        bpp = CodeSize;
-        ClearCode = 1 << bpp;
-        EOFCode = ClearCode + 1;
-        CodeSize = bpp + 1;
+        d->bpp = d->CodeSize;
+        d->ClearCode = 1 << d->bpp;
+        d->EOFCode = d->ClearCode + 1;
+        d->CodeSize = d->bpp + 1;
 
-        for ( incode = ClearCode; --incode >= 0; )
+        /* Codes not yet defined (only to be found in broken files)
+           stand for a single character */
+
+        for ( incode = 0; incode < MC_SIZE; incode++ )
         {
-            *( suffix + incode ) = incode;
-            *( prefix + incode ) = 0;
+            suffix[ incode ] = incode < d->ClearCode ? incode : 0;
+            prefix[ incode ] = 0;
+            length[ incode ] = 1;
         }
 
-        avail = ClearCode + 2;
-        oldcode = -1;
-        stackp = stack;
-        return lbuf ? 0 : -1;
+        d->avail = d->ClearCode + 2;
+        d->oldcode = -1;
+        return d->lbuf ? 0 : -1;
     }
 
-    if ( code == ClearCode )
+    if ( code == d->ClearCode )
     {
-        CodeSize = bpp + 1;
-        avail = ClearCode + 2;
-        oldcode = -1;
+        d->CodeSize = d->bpp + 1;
+        d->avail = d->ClearCode + 2;
+        d->oldcode = -1;
         return 0;
     }
 
     /* this is possible only if the image file is corrupt */
 
-    if ( code > avail || code < 0 )
+    if ( code > d->avail || code < 0 )
     {
         flimage_error( im, "GIFLZW(%s): Bad code 0x%04x", im->infile, code );
         return -1;
     }
 
-    if ( oldcode == -1 )
+    if ( d->oldcode == -1 )
     {
-        OUTPIX( suffix[ code ] );
-        firstchar = oldcode = code;
+        /* The first code after a clear must be a root code. Treat
+           anything else as the single character it was once set to,
+           strings thus can't grow beyond the size of the table */
+
+        *d->lbuf++ = d->firstchar = suffix[ code ];
+        d->oldcode = d->firstchar;
 
         /* Clive Stubbings.
          * There is the posibility of an image with just alternate
@@ -788,48 +835,67 @@ process_lzw_code( FL_IMAGE * im,
          * it crashed...
          * So flush the buffer before it overuns. */
 
-        flush_buffer( im );
+        flush_buffer( im, d );
         return 0;
     }
 
-    incode = code;
-    if ( code == avail )
-    {               /* the first code is always < avail */
-        *stackp++ = firstchar;
-        code = oldcode;
+    if ( d->avail >= 4096 )
+    {
+        flimage_error( im, "GIFLZW(%s): BadBlock--TableFull", im->infile );
+        return -1;
     }
 
-    while ( code > ClearCode )
+    /* Strings are unpacked from their last character backwards, the
+       length table tells where that one goes. The code not yet in the
+       table (the first code is always < avail) stands for the previous
+       string plus that string's first character */
+
+    incode = code;
+    if ( code < d->ClearCode )
     {
-        *stackp++ = suffix[ code ];
-        code = prefix[ code ];
+        *d->lbuf = code;
+        len = 1;
     }
-
-    if ( avail >= 4096 )
+    else
     {
-        flimage_error( im, "GIFLZW(%s): BadBlock--TableFull", im->infile );
-        return -1;
+        if ( code == d->avail )
+        {
+            len = length[ d->oldcode ] + 1;
+            d->lbuf[ len - 1 ] = d->firstchar;
+            code = d->oldcode;
+            p = d->lbuf + len - 1;
+        }
+        else
+        {
+            len = length[ code ];
+            p = d->lbuf + len;
+        }
+
+        while ( p > d->lbuf )
+        {
+            *--p = suffix[ code ];
+            code = prefix[ code ];
+        }
     }
 
-    *stackp++ = firstchar = suffix[ code ];
-    prefix[ avail ] = oldcode;
-    suffix[ avail ] = firstchar;
+    d->firstchar = *d->lbuf;
+    d->lbuf += len;
 
-    avail++;
-    if ( ( avail & gif_codemask[ CodeSize ] ) == 0 && avail < 4096 )
-        CodeSize++;
+    prefix[ d->avail ] = d->oldcode;
+    suffix[ d->avail ] = d->firstchar;
+    length[ d->avail ] = length[ d->oldcode ] + 1;
 
-    oldcode = incode;
+    d->avail++;
+    if (    ( d->avail & gif_codemask[ d->CodeSize ] ) == 0
+         && d->avail < 4096 )
+        d->CodeSize++;
 
-    do
-    {
-        OUTPIX( *--stackp );
-    }
-    while ( stackp > stack );
+    d->oldcode = incode;
 
     /* if we've got more than one scanline, output */
 
-    flush_buffer( im );
+    if ( d->lbuf - d->lhead >= im->w )
+        flush_buffer( im, d );
 
     return 0;
 }
@@ -875,32 +941,32 @@ GIF_next( FL_IMAGE * im )
  ***************************************/
 
 static int
-next_lineno( int i,
-             int h,
-             int interlace )
+next_lineno( LINESEQ * seq,
+             int       i,
+             int       h,
+             int       interlace )
 {
     static const int steps[ 5 ] = { 8, 8, 4, 2, 0 };
     static const int start[ 5 ] = { 0, 4, 2, 1, 0 };
-    static int pass,
-               sofar,
-               current;
     int line;
 
     /* init for each image */
 
     if ( i == 0 )
-        pass = sofar = current = 0;
+        seq->pass = seq->current = 0;
 
     line = i;           /* unless interlace */
 
     if ( interlace )
     {
-        line = current;
-        if ( ( current += steps[pass] ) >= h )
-            current = start[ ++pass ];
-    }
+        line = seq->current;
+        seq->current += steps[ seq->pass ];
 
-    sofar++;
+        /* skip passes without any rows (in images less than 5 rows high) */
+
+        while ( seq->current >= h && seq->pass < 4 )
+            seq->current = start[ ++seq->pass ];
+    }
 
     return line;
 }
@@ -915,92 +981,43 @@ next_lineno( int i,
  * Write image to a disk file in GIF format.
  ************************************************************/
 
-/* current char, cchar, must be of signed type, and code and prefix must be
- * at least 12 bits long. */
-
-typedef struct strspace_
-{
-    struct strspace_ * next;            /* link          */
-    int                code;            /* emit code     */
-    int                cchar;           /* current char */
-} Strtab;
-
-typedef struct
-{
-    int prefix,
-        cchar,
-        code;
-} WorkStr;
-
-#define  MAXTABL  4097
-
-static Strtab *strtab[ MAXTABL ],
-               strspace[ MAXTABL ];
-
-
-/**************************************************************
- * Check if current string is already in the string table
- **************************************************************/
-
-static int
-in_table( WorkStr * cstr )
-{
-    Strtab *p = strtab[ cstr->prefix ];
-
-    for ( ; p && p->cchar != cstr->cchar; p = p->next )
-        /* empty */ ;
-
-    return p ? p->code : -1;
-}
-
-#define USE_TAB_FUNC
-
-
-/*
- * A macro and function are supplied to insert a string into the
- * string table.
+/* The string table of the encoder is an open addressing hash table,
+ * the scheme used by compress(1). A string is looked up by its prefix
+ * code and the character appended to it, the entry found holds the
+ * code assigned to the string. HSIZE is a prime about 20% larger than
+ * the 4096 codes the table can ever hold, keeping probe sequences short.
  */
 
-#ifdef USE_TAB_FUNC
+#define HSIZE     5003
+#define HSHIFT    4     /* ( cchar << HSHIFT ) ^ prefix is below HSIZE */
 
-/***************************************
- ***************************************/
+/* State of the compressor, one per frame being written */
 
-static void
-addto_table( WorkStr * cstr,
-             int       code )
+typedef struct
 {
-    Strtab *p = &strspace[ code ];
-
-    p->code = code;
-    p->cchar = cstr->cchar;
-    p->next = strtab[ cstr->prefix ];
-    strtab[ cstr->prefix ] = p;
-}
-
-#else
-
-#define  addto_table(cstr, ccode )                         \
-    do {                                                   \
-        Strtab *p = &strspace[ ccode ];                    \
-        p->code = ccode;                                   \
-        p->cchar = cstr->cchar;                            \
-        p->next = strtab[ cstr->prefix ];                  \
-        strtab[ cstr->prefix ] = p;                        \
-   } while( 0 )
-#endif
-
-
-static void output_lzw_code( unsigned int,
-                             FILE * );
-static void init_table( int,
-                        FILE * );
+    FILE           * fp;
+    int              bpp,
+                     ClearCode,
+                     EOFCode,
+                     CodeSize;
+    unsigned int     bytes,         /* packed into bbuf so far */
+                     bits;          /* bits pending in accum   */
+    unsigned long    accum;
+    unsigned char    bbuf[ 255 + 3 ];
+    int              hash_key[ HSIZE ];
+    unsigned short   hash_code[ HSIZE ];
+} LZWENC;
+
+
+static void output_lzw_code( LZWENC *,
+                             unsigned int );
+static void init_table( LZWENC * );
 #if 0
 static unsigned short * get_scan_line( FL_IMAGE *,
                                        int );
 #endif
 
-static int interlace;
+static int interlace;     /* only read when a write starts */
 
 
 /***************************************
@@ -1041,24 +1058,123 @@ write_gif_comments( FILE       * fp,
 
 
 /***************************************
+ * Number of bits needed for the indices into the colormap of an image
+ ***************************************/
+
+static int
+map_bits( FL_IMAGE * im )
+{
+    int bits = 0;
+
+    while ( im->map_len > 1 << bits )
+        bits++;
+
+    if ( bits < 1 || bits > 8 )
+    {
+        M_err( __func__, "%s: Bad bpp=%d", im->outfile, bits );
+        bits = 1;
+    }
+
+    return bits;
+}
+
+
+/***************************************
+ * Sets up the table used to translate the pixels of a frame into
+ * indices into the global colormap of the first one. Returns 0 if
+ * some color used by the frame isn't in the global map, in which case
+ * the frame has to come with a local colormap of its own and the
+ * table is set up to leave the pixels alone.
+ ***************************************/
+
+static int
+map_to_global( FL_IMAGE      * im,
+               FL_IMAGE      * gim,
+               unsigned char * xlate )
+{
+    unsigned char used[ 256 ];
+    unsigned short *p,
+                   *ps;
+    int i,
+        k,
+        colors = 1 << map_bits( im );
+
+    for ( i = 0; i < 256; i++ )
+        xlate[ i ] = i & ( colors - 1 );
+
+    if ( im == gim )
+        return 1;
+
+    if (    im->map_len == gim->map_len
+         && ! memcmp( im->red_lut, gim->red_lut,
+                      im->map_len * sizeof *im->red_lut )
+         && ! memcmp( im->green_lut, gim->green_lut,
+                      im->map_len * sizeof *im->green_lut )
+         && ! memcmp( im->blue_lut, gim->blue_lut,
+                      im->map_len * sizeof *im->blue_lut ) )
+        return 1;
+
+    memset( used, 0, sizeof used );
+    for ( p = im->ci[ 0 ], ps = p + im->w * im->h; p < ps; p++ )
+        used[ *p & ( colors - 1 ) ] = 1;
+
+    for ( i = 0; i < colors; i++ )
+    {
+        if ( ! used[ i ] )
+            continue;
+
+        if ( i >= im->map_len )
+            break;
+
+        for ( k = 0;
+                 k < gim->map_len
+              && (    im->red_lut[   i ] != gim->red_lut[   k ]
+                   || im->green_lut[ i ] != gim->green_lut[ k ]
+                   || im->blue_lut[  i ] != gim->blue_lut[  k ] );
+              k++ )
+            /* empty */ ;
+
+        if ( k == gim->map_len )
+            break;
+
+        xlate[ i ] = k;
+    }
+
+    if ( i == colors )
+        return 1;
+
+    for ( i = 0; i < 256; i++ )
+        xlate[ i ] = i & ( colors - 1 );
+
+    return 0;
+}
+
+
+/***************************************
+ * Writes the graphics control extension (if needed) and the image
+ * descriptor of a frame. 'tran' is the transparent index (or -1),
+ * 'delay' the time to wait after the frame in 1/100 s and 'local_bits'
+ * the size of the local colormap that follows (0 if there's none).
  ***************************************/
 
 static int
-write_descriptor( FL_IMAGE * im )
+write_descriptor( FL_IMAGE * im,
+                  int        tran,
+                  int        delay,
+                  int        local_bits,
+                  int        interlaced )
 {
     unsigned char buf[ 10 ];
     FILE *ffp = im->fpout;
 
-    if ( im->app_background >= 0 )
+    if ( tran >= 0 || delay > 0 )
     {
-        int tran = flimage_get_closest_color_from_map( im, im->app_background );
-
         buf[ 0 ] = GIFEXT_GC;
         buf[ 1 ] = 4;       /* count */
-        buf[ 2 ] = 0x1;
-        buf[ 3 ] = 0;
-        buf[ 4 ] = 0;
-        buf[ 5 ] = tran;
+        buf[ 2 ] = tran >= 0;
+        buf[ 3 ] = delay & 0xff;
+        buf[ 4 ] = ( delay >> 8 ) & 0xff;
+        buf[ 5 ] = tran >= 0 ? tran : 0;
         buf[ 6 ] = 0;       /* end of block */
         putc( EXTENSION, ffp );
         fwrite( buf, 1, 7, ffp );
@@ -1078,32 +1194,37 @@ write_descriptor( FL_IMAGE * im )
 
     /* local_gifmap, interlace, etc. only set interlace if requested */
 
-    putc( interlace ? 0x40 : 0, ffp );
+    putc(   ( interlaced ? 0x40 : 0 )
+          | ( local_bits ? 0x80 | ( local_bits - 1 ) : 0 ), ffp );
+
+    if ( local_bits )
+        write_map( im, 1 << local_bits );
+
     return 0;
 }
 
 
 /***************************************
- * write the image description
+ * write the image description, returns the number of bits of the
+ * global map or -1 on failure
  ***************************************/
 
 static int
 write_desc( FL_IMAGE * im,
             FILE     * ffp )
 {
-    int packed;
+    static const unsigned char loop[ ] = { 0xff, 11, 'N', 'E', 'T', 'S', 'C',
+                                           'A', 'P', 'E', '2', '.', '0',
+                                           3, 1, 0, 0, 0 };
+    FL_IMAGE *tim;
+    int packed,
+        bpp,
+        w = im->w,
+        h = im->h;
 
     /* get bits per pixel first */
 
-    bpp = 0;
-    while ( im->map_len > 1 << bpp )
-        bpp++;
-
-    if ( bpp < 1 || bpp > 8 )
-    {
-        M_err( __func__, "%s: Bad bpp=%d", im->outfile, bpp );
-        bpp = 1;
-    }
+    bpp = map_bits( im );
 
     if ( Badfwrite("GIF89a", 1, 6, ffp ) )
     {
@@ -1111,10 +1232,16 @@ write_desc( FL_IMAGE * im,
         return -1;
     }
 
-    /* always write the same logical screen/image size  */
+    /* the logical screen must be large enough for all frames */
 
-    fli_fput2LSBF( im->w, ffp );
-    fli_fput2LSBF( im->h, ffp );
+    for ( tim = im->next; tim; tim = tim->next )
+    {
+        w = FL_max( w, tim->w );
+        h = FL_max( h, tim->h );
+    }
+
+    fli_fput2LSBF( w, ffp );
+    fli_fput2LSBF( h, ffp );
 
     packed =   0x80                  /* always output global map */
              + ( ( bpp - 1 ) << 4 )  /* cr. does not mean much   */
@@ -1127,10 +1254,18 @@ write_desc( FL_IMAGE * im,
 
     write_map( im, 1 << bpp );
 
+    /* animations get played in an endless loop */
+
+    if ( im->next )
+    {
+        putc( EXTENSION, ffp );
+        fwrite( loop, 1, sizeof loop, ffp );
+    }
+
     if ( im->comments )
         write_gif_comments( ffp, im->comments );
 
-    return 0;
+    return bpp;
 }
 
 
@@ -1139,104 +1274,174 @@ write_desc( FL_IMAGE * im,
  *******************************************************************/
 
 /***************************************
+ * Compresses the pixels of an image, using the translation table
+ * 'xlate' for the colormap indices and codes for 'nbits' bits wide
+ * characters, with the rows in interlaced order if 'interlaced' is set.
  ***************************************/
 
 static int
-write_pixels( FL_IMAGE * im )
+write_pixels( FL_IMAGE            * im,
+              const unsigned char * xlate,
+              int                   nbits,
+              int                   interlaced )
 {
-    int j, code,
-        ccode;
+    int j,
+        h,
+        disp,
+        key,
+        cchar,
+        prefix,
+        ccode,
+        err;
     unsigned short *scan,
                    *ss;
-    WorkStr *cstr;
-    int colors;
-    WorkStr workstring;
-    FILE *fp = im->fpout;
+    LINESEQ seq;
+    LZWENC *e;
+    int *hash_key;
+    unsigned short *hash_code;
 
-    /* IMPORTANT: number of colors handed to this routine might not be 2^n,
-       need to make it so to fool the encoder (colors-1 need to be full bits) */
+    if ( ! ( e = fl_calloc( 1, sizeof *e ) ) )
+    {
+        flimage_error( im, "GIF write: can't allocate encoder" );
+        return -1;
+    }
 
-    colors = 1 << bpp;
+    e->fp = im->fpout;
+    hash_key = e->hash_key;
+    hash_code = e->hash_code;
 
     /* min bpp by definition is no smaller than 2 */
 
-    if ( bpp < 2 )
-        bpp = 2;        /* initial codesize */
-    putc( bpp, fp );
+    e->bpp = nbits < 2 ? 2 : nbits;     /* initial codesize */
+    putc( e->bpp, e->fp );
 
-    ClearCode = 1 << bpp;   /* set clear and end codes */
-    EOFCode = ClearCode + 1;
-    CodeSize = bpp + 1;     /* start encoding */
+    e->ClearCode = 1 << e->bpp;         /* set clear and end codes */
+    e->EOFCode = e->ClearCode + 1;
+    e->CodeSize = e->bpp + 1;           /* start encoding */
 
-    init_table( colors, fp );   /* initialize the LZW tables */
-    cstr = &workstring;
-    ccode = EOFCode + 1;
-    cstr->prefix = -1;
+    init_table( e );                    /* initialize the LZW tables */
+    ccode = e->EOFCode + 1;
+    prefix = -1;
 
     /* start raster stream. Old way of doing things, that is as soon as we
        get 4095, a clearcode is emitted. */
 
     for ( j = 0; j < im->h; j++ )
     {
-        scan = im->ci[ next_lineno( j, im->h, interlace ) ];
+        scan = im->ci[ next_lineno( &seq, j, im->h, interlaced ) ];
 
         for ( ss = scan + im->w; scan < ss; scan++ )
         {
-            cstr->cchar = *scan & ( colors - 1 );
-            if ( cstr->prefix >= 0 )
+            cchar = xlate[ *scan & 0xff ];
+
+            if ( prefix < 0 )       /* root entry */
+            {
+                prefix = cchar;
+                continue;
+            }
+
+            key = ( cchar << 12 ) + prefix;
+            h = ( cchar << HSHIFT ) ^ prefix;
+
+            if ( hash_key[ h ] != key && hash_key[ h ] >= 0 )
             {
-                if ( ( code = in_table( cstr ) ) >= 0 )
-                    cstr->prefix = code;
-                else
+                disp = h ? HSIZE - h : 1;
+
+                do
                 {
-                    addto_table( cstr, ccode );
-                    output_lzw_code( cstr->prefix, fp );
-                    cstr->prefix = cstr->cchar;
-
-                    if ( ccode >= 1 << CodeSize )
-                        CodeSize++;
-                    ccode++;
-
-                    if ( ccode >= 4096 )
-                    {
-                        output_lzw_code( cstr->prefix, fp );
-                        init_table( colors, fp );
-                        ccode = EOFCode + 1;
-                        cstr->prefix = -1;
-                    }
-                }
+                    if ( ( h -= disp ) < 0 )
+                        h += HSIZE;
+                } while ( hash_key[ h ] != key && hash_key[ h ] >= 0 );
             }
-            else
-            {           /* root entry */
-                cstr->prefix = cstr->code = cstr->cchar;
+
+            if ( hash_key[ h ] == key )
+            {
+                prefix = hash_code[ h ];
+                continue;
+            }
+
+            /* a new string, output the code for what we had so far and
+               add the string at the free slot the search ended at */
+
+            hash_key[ h ] = key;
+            hash_code[ h ] = ccode;
+            output_lzw_code( e, prefix );
+            prefix = cchar;
+
+            if ( ccode >= 1 << e->CodeSize )
+                e->CodeSize++;
+            ccode++;
+
+            if ( ccode >= 4096 )
+            {
+                output_lzw_code( e, prefix );
+                init_table( e );
+                ccode = e->EOFCode + 1;
+                prefix = -1;
             }
         }
     }
 
-    output_lzw_code( cstr->prefix, fp );
-    output_lzw_code( EOFCode, fp );
-    putc( 0, fp );      /* end block  */
+    output_lzw_code( e, prefix );
+
+    /* The decoder adds a string for the code just written, so the end
+       code must already have the code size that new string may require */
 
-    return fflush( fp );
+    if ( ccode >= 1 << e->CodeSize && e->CodeSize < 12 )
+        e->CodeSize++;
+    output_lzw_code( e, e->EOFCode );
+    putc( 0, e->fp );   /* end block  */
+
+    err = fflush( e->fp );
+    fl_free( e );
+    return err;
 }
 
 
 /***************************************
+ * All frames of a multi-frame image go into the same file. The
+ * colormap of the first one is written only once as the global map,
+ * the pixels of the following frames get translated to it where
+ * possible. Only frames using colors not in it need a local map.
  ***************************************/
 
 static int
 GIF_write( FL_IMAGE * sim )
 {
-    int err = 0;
+    int err = 0,
+        gbits,
+        local,
+        tran,
+        delay = 0,
+        interlaced = interlace;
+    unsigned char xlate[ 256 ];
     FL_IMAGE *im;
-    
-    if ( write_desc( sim, sim->fpout ) < 0 )
+
+    if ( ( gbits = write_desc( sim, sim->fpout ) ) < 0 )
         return -1;
 
+    /* setup delay is in ms, GIF wants 1/100 s */
+
+    if ( sim->next && sim->setup )
+        delay = ( sim->setup->delay + 5 ) / 10;
+
     for ( err = 0, im = sim; !err && im; im = im->next )
     {
         im->fpout = sim->fpout;
-        err = write_descriptor( im ) < 0 || write_pixels( im ) < 0;
+
+        local = ! map_to_global( im, sim, xlate );
+
+        tran = -1;
+        if ( im->app_background >= 0 )
+            tran = xlate[ flimage_get_closest_color_from_map( im,
+                                                  im->app_background ) ];
+
+        err =    write_descriptor( im, tran, delay,
+                                   local ? map_bits( im ) : 0,
+                                   interlaced ) < 0
+              || write_pixels( im, xlate,
+                               local ? map_bits( im ) : gbits,
+                               interlaced ) < 0;
         if ( im != sim )
             im->fpout = 0;
     }
@@ -1249,29 +1454,17 @@ GIF_write( FL_IMAGE * sim )
 
 
 /***************************************
+ * Emits a clear code and empties the string table
  ***************************************/
 
 static void
-init_table( int    rootlen,
-            FILE * fp )
+init_table( LZWENC * e )
 {
-    int i;
-    Strtab *sp = strspace;
-
-    output_lzw_code( ClearCode, fp );
-
-    CodeSize = bpp + 1;
+    output_lzw_code( e, e->ClearCode );
 
-    for ( i = 0; i < rootlen; i++, sp++ )
-    {
-        sp->next = 0;
-        sp->code = i;
-        sp->cchar = -1;
-        strtab[ i ] = sp;
-    }
+    e->CodeSize = e->bpp + 1;
 
-    for ( ; i < MAXTABL; i++, sp++ )
-        strtab[ i ] = sp->next = 0;
+    memset( e->hash_key, -1, sizeof e->hash_key );
 }
 
 
@@ -1283,41 +1476,37 @@ init_table( int    rootlen,
  *******************************************************************/
 
 static void
-output_lzw_code( unsigned int   code,
-                 FILE         * fp )
+output_lzw_code( LZWENC       * e,
+                 unsigned int   code )
 {
-    static unsigned int bytes,
-                        bits;
-    static unsigned char bbuf[ 255 + 3 ];
-    static unsigned long accum;
     unsigned char *ch;
 
-    accum &= gif_codemask[ bits ];
-    accum |= code << bits;
-    bits += CodeSize;
+    e->accum &= gif_codemask[ e->bits ];
+    e->accum |= code << e->bits;
+    e->bits += e->CodeSize;
 
-    ch = bbuf + bytes;
-    bytes += bits >> 3;
+    ch = e->bbuf + e->bytes;
+    e->bytes += e->bits >> 3;
 
-    while ( bits >= 8 )
+    while ( e->bits >= 8 )
     {
-        bits -= 8;
-        *ch++ = ( unsigned char ) ( accum & 255 );
-        accum >>= 8;
+        e->bits -= 8;
+        *ch++ = ( unsigned char ) ( e->accum & 255 );
+        e->accum >>= 8;
     }
 
-    if ( bytes >= 254 || ( int ) code == EOFCode )
+    if ( e->bytes >= 254 || ( int ) code == e->EOFCode )
     {
-        if ( ( int ) code == EOFCode && bits )
+        if ( ( int ) code == e->EOFCode && e->bits )
         {
-            *ch = ( unsigned char ) ( accum & 255 );
-            bytes++;
-            bits = accum = 0;
+            *ch = ( unsigned char ) ( e->accum & 255 );
+            e->bytes++;
+            e->bits = e->accum = 0;
         }
 
-        putc(bytes, fp);
-        fwrite( bbuf, 1, bytes, fp );
-        bytes = 0;
+        putc( e->bytes, e->fp );
+        fwrite( e->bbuf, 1, e->bytes, e->fp );
+        e->bytes = 0;
     }
 }
 
@@ -47,47 +47,30 @@
 
 
 /***************************************
+ * Creates a new temporary file, its name goes into 'name' which must
+ * have room for at least TMPF_LEN chars. mkstemp() makes sure the
+ * name is unique, even if several threads are asking at once.
  ***************************************/
 
+#define TMPF_LEN  64
+
 static char *
-get_tmpf( char * obuf )
+get_tmpf( char * name )
 {
-    static int k,
-               seq;
-    static char buf[ 15 ][ 256 ];
-    int fd = -1,
+    int fd,
         tries = 0;
-    char *name;
-
-    k = ( k + 1 ) % 15;
-    name = obuf ? obuf : buf[ k ];
 
     do
     {
-        if ( ( fd = mkstemp( name ) ) >= 0 )
-            /* empty */ ;
-        else
-        {
-            fli_snprintf( buf[ k ], sizeof buf[ k ],
-                          "%s/.FL%03d_%d.tmp", "/tmp", seq++,
-                          ( int ) getpid( ) );
-            name = buf[ k ];
+        fli_snprintf( name, TMPF_LEN, "%s/.FL_XXXXXX", "/tmp" );
+        fd = mkstemp( name );
+    } while ( fd < 0 && ++tries < 30 );
 
-            /* create the file now in exclusive mode (for security) */
+    if ( fd < 0 )
+        return 0;
 
-            fd = open( name, O_RDWR | O_CREAT | O_EXCL, S_IREAD | S_IWRITE );
-        }
-
-        tries++;
-    } while ( fd < 0 && tries < 30 );
-
-    if ( fd >= 0 )
-    {
-        close( fd );
-        return name;
-    }
-
-    return 0;
+    close( fd );
+    return name;
 }
 
 
@@ -101,12 +84,14 @@ flimage_description_via_filter( FL_IMAGE     * im,
                                 int verbose )
 {
     char cmd[ 1024 ],
-         *tmpf;
+         tmpf[ TMPF_LEN ];
     char * const *q = cmds;
+    FLIMAGE_IO *io;
     int status = 0,
-        n;
+        n,
+        nformats;
 
-    if ( ! ( tmpf = get_tmpf( 0 ) ) )
+    if ( ! get_tmpf( tmpf ) )
     {
         im->error_message( im, "can't get tmpfile!" );
         return -1;
@@ -148,20 +133,20 @@ flimage_description_via_filter( FL_IMAGE     * im,
 
     /* if verbose, delay the file deletion in case we want to look at it */
 
-    --n;
+    io = flimage_formats( &nformats ) + n - 1;
     if ( verbose )
         fprintf( stderr, " reading %s via %s\n",
                  ( ( FLIMAGE_IO * ) im->image_io )->short_name,
-                 flimage_io[ n ].short_name );
+                 io->short_name );
 
     if ( strcmp( im->fmt_name, "gzip" ) == 0 )
-        im->fmt_name = flimage_io[ n ].short_name;
+        im->fmt_name = io->short_name;
 
-    im->image_io = flimage_io + n;
-    im->type = flimage_io[ n ].type;
+    im->image_io = io;
+    im->type = io->type;
 
-    flimage_io[ n ].identify( im->fpin );   /* advance file position */
-    status = flimage_io[ n ].read_description( im );
+    io->identify( im->fpin );   /* advance file position */
+    status = io->read_description( im );
 
     remove( tmpf );
 
@@ -186,15 +171,20 @@ static FLIMAGE_IO *
 best_format( FL_IMAGE     * im,
              char * const   formats[ ] )
 {
-    FLIMAGE_IO *io = flimage_io;
+    FLIMAGE_IO *io,
+               *all;
     char *const *fmts = formats;
     FLIMAGE_IO *first = 0,
                *best_sofar = 0;
-    int found;
+    int found,
+        n,
+        i;
+
+    all = flimage_formats( &n );
 
     for ( ; *fmts; fmts++ )
     {
-        for ( io = flimage_io, found = 0; ! found && io->formal_name; io++ )
+        for ( io = all, i = found = 0; ! found && i < n; io++, i++ )
             found =    strcasecmp( io->formal_name, *fmts ) == 0
                     || strcasecmp( io->short_name,  *fmts ) == 0;
 
@@ -222,11 +212,12 @@ flimage_write_via_filter( FL_IMAGE     * im,
                           char *const    formats[ ],      /* formats */
                           int            verbose )
 {
-    char *tmpf;
-    char ofile[ 256 ],
+    char tmpf[ TMPF_LEN ],
+         ofile[ 256 ],
          cmd[ 1024 ];
     char * const *shellcmd;
     FLIMAGE_IO *io;
+    FILE *fp = im->fpout;
     int err,
         status;
 
@@ -241,14 +232,25 @@ flimage_write_via_filter( FL_IMAGE     * im,
     if ( ! ( io->type & im->type ) )
         flimage_convert( im, io->type, 256 );
 
-    tmpf = get_tmpf( 0 );
+    if ( ! get_tmpf( tmpf ) )
+    {
+        fprintf( stderr, "can't get tmpfile\n" );
+        return -1;
+    }
+
     strcpy( ofile, im->outfile );
     strcpy( im->outfile, tmpf );
 
+    /* The intermediate image goes to the temporary file, the output
+       file the caller opened gets written by the filter and is closed
+       by the caller */
+
     if ( ! ( im->fpout = fopen( im->outfile, "wb" ) ) )
     {
         fprintf( stderr, "can't open %s\n", tmpf );
         remove( tmpf );
+        strcpy( im->outfile, ofile );
+        im->fpout = fp;
         return -1;
     }
 
@@ -256,6 +258,7 @@ flimage_write_via_filter( FL_IMAGE     * im,
 
     err = io->write_image( im ) < 0;
     fclose( im->fpout );
+    im->fpout = fp;
     if ( verbose )
         fprintf( stderr, "Done writing %s (%s) \n",
                  im->outfile, io->short_name );
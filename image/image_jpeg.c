@@ -129,7 +129,7 @@ static void
 error_exit( j_common_ptr cinfo )
 {
     SPEC *spec = ( SPEC * ) cinfo->err;
-    static char buf[ 1024 ];
+    char buf[ JMSG_LENGTH_MAX ];
 
     cinfo->err->format_message( cinfo, buf );
     spec->image->error_message( spec->image, buf );
@@ -290,12 +290,6 @@ JPEG_read_pixels( FL_IMAGE * im )
     {
         jpeg_read_scanlines( cinfo, buf, 1 /* cinfo->rec_out_height  */ );
 
-        if ( ! ( cinfo->output_scanline & FLIMAGE_REPFREQ ) )
-        {
-            im->completed = cinfo->output_scanline;
-            im->visual_cue( im, "Reading JPEG" );
-        }
-
         if ( im->type == FL_IMAGE_RGB )
         {
             for ( i = j = 0; i < ( int ) cinfo->output_width; i++, j += 3 )
@@ -333,6 +327,13 @@ JPEG_read_pixels( FL_IMAGE * im )
             flimage_error( im, "%s: unknown color space", im->infile );
             err = 1;
         }
+
+        if ( ! err && ! ( cinfo->output_scanline & FLIMAGE_REPFREQ ) )
+        {
+            im->completed = cinfo->output_scanline;
+            im->visual_cue( im, "Reading JPEG" );
+            flimage_rows_done( im, cinfo->output_scanline );
+        }
     }
 
     jpeg_finish_decompress( cinfo );
@@ -46,6 +46,28 @@ fl_select_mediancut_quantizer( void )
 }
 
 
+static int dither_method = FLIMAGE_FS_DITHER;
+
+
+/***************************************
+ * Selects between Floyd-Steinberg (the default) and ordered dithering.
+ * The first gives the better looking results but has to go through
+ * the image pixel by pixel, ordered dithering works on all rows of the
+ * image in parallel. Returns the previous setting.
+ ***************************************/
+
+int
+flimage_set_dither( int method )
+{
+    int old = dither_method;
+
+    if ( method == FLIMAGE_FS_DITHER || method == FLIMAGE_ORDERED_DITHER )
+        dither_method = method;
+
+    return old;
+}
+
+
 #define R_SCALE 2       /* scale R distances by this much */
 #define G_SCALE 3       /* scale G distances by this much */
 #define B_SCALE 1       /* and B by this much */
@@ -140,13 +162,13 @@ static void prescan_quantize( SPEC *,
 static void select_colors( SPEC *,
                            int );
 
-static void pass2_fs_dither( SPEC *,
-                             unsigned char **,
-                             unsigned char **,
-                             unsigned char **,
-                             unsigned short **,
-                             int,
-                             int );
+static void map_pixels( SPEC *,
+                        unsigned char **,
+                        unsigned char **,
+                        unsigned char **,
+                        unsigned short **,
+                        int,
+                        int );
 
 
 /***************************************
@@ -242,7 +264,6 @@ j2pass_quantize_rgb( unsigned char  ** red,
                      FL_IMAGE        * im )
 {
     SPEC *sp = alloc_spec( w, h, red_lut, green_lut, blue_lut );
-    int i;
 
     if ( ! sp )
     {
@@ -262,15 +283,7 @@ j2pass_quantize_rgb( unsigned char  ** red,
     prescan_quantize( sp, red, green, blue, w, h );
 
     select_colors( sp, max_color );
-
-    /* re-init histogram for inverse lookup */
-
-    for ( i = 0; i < HIST_C0_ELEMS; i++ )
-        memset( sp->histogram[ i ], 0,
-                HIST_C1_ELEMS * HIST_C2_ELEMS * sizeof( histcell ) );
-
-    sp->on_odd_row = 0;
-    pass2_fs_dither( sp, red, green, blue, ci, w, h );
+    map_pixels( sp, red, green, blue, ci, w, h );
     *actual_color = sp->actual_number_of_colors;
     cleanup_spec( sp );
 
@@ -348,15 +361,7 @@ j2pass_quantize_packed( unsigned int   ** packed,
     prescan_quantize( sp, red, green, blue, w, h );
 
     select_colors( sp, max_color );
-
-    /* re-init histogram for inverse lookup */
-
-    for ( i = 0; i < HIST_C0_ELEMS; i++ )
-        memset( sp->histogram[ i ], 0,
-                HIST_C1_ELEMS * HIST_C2_ELEMS * sizeof( histcell ) );
-
-    sp->on_odd_row = 0;
-    pass2_fs_dither( sp, red, green, blue, ci, w, h );
+    map_pixels( sp, red, green, blue, ci, w, h );
     *actual_color = sp->actual_number_of_colors;
 
     fl_free_matrix( red );
@@ -961,6 +966,212 @@ pass2_fs_dither( SPEC            * sp,
 }
 
 
+/***************************************
+ * Fills the inverse-colormap entries of all update boxes. Each box is
+ * independent of all the others, so this can be split over threads.
+ * Ordered dithering can't work without it, and for large images it's
+ * worth it also for Floyd-Steinberg dithering, which otherwise fills
+ * them one by one as it goes along.
+ ***************************************/
+
+#define BOX_C0_COUNT   ( HIST_C0_ELEMS >> BOX_C0_LOG )
+#define BOX_C1_COUNT   ( HIST_C1_ELEMS >> BOX_C1_LOG )
+#define BOX_C2_COUNT   ( HIST_C2_ELEMS >> BOX_C2_LOG )
+#define BOX_COUNT      ( BOX_C0_COUNT * BOX_C1_COUNT * BOX_C2_COUNT )
+
+#define CMAP_MIN_BOXES  64      /* update boxes per thread at least  */
+#define CMAP_MIN_PIXELS ( HIST_C0_ELEMS * HIST_C1_ELEMS * HIST_C2_ELEMS * 4 )
+
+static int
+fill_boxes( int    first,
+            int    last,
+            int    index  FL_UNUSED_ARG,
+            void * data )
+{
+    SPEC *sp = data;
+    int i;
+
+    for ( i = first; i < last; i++ )
+        fill_inverse_cmap( sp,
+                           ( i / ( BOX_C1_COUNT * BOX_C2_COUNT ) )
+                                                              << BOX_C0_LOG,
+                           ( ( i / BOX_C2_COUNT ) % BOX_C1_COUNT )
+                                                              << BOX_C1_LOG,
+                           ( i % BOX_C2_COUNT ) << BOX_C2_LOG );
+
+    return 0;
+}
+
+
+/***************************************
+ * Ordered dithering: a threshold from an 8x8 Bayer matrix, scaled to
+ * about the distance between neighbouring colors of the colormap, is
+ * added to each pixel before looking up its color. Each pixel only
+ * depends on its own value and position, so all rows can be done in
+ * parallel.
+ ***************************************/
+
+static const unsigned char bayer[ 8 ][ 8 ] =
+{
+    {  0, 32,  8, 40,  2, 34, 10, 42 },
+    { 48, 16, 56, 24, 50, 18, 58, 26 },
+    { 12, 44,  4, 36, 14, 46,  6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 },
+    {  3, 35, 11, 43,  1, 33,  9, 41 },
+    { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47,  7, 39, 13, 45,  5, 37 },
+    { 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+#define ORDERED_MIN_ROWS  32    /* rows per thread at least */
+
+typedef struct {
+    SPEC            * sp;
+    unsigned char  ** red,
+                   ** green,
+                   ** blue;
+    unsigned short ** out;
+    int               w;
+    int               h;
+    int               dith[ 8 ][ 8 ];
+} ORDERED_JOB;
+
+static int
+ordered_rows( int    first,
+              int    last,
+              int    index,
+              void * data )
+{
+    ORDERED_JOB *job = data;
+    hist3d histogram = job->sp->histogram;
+    FL_IMAGE *im = job->sp->im;
+    unsigned char *r,
+                  *g,
+                  *b;
+    unsigned short *out;
+    const int *d;
+    int row,
+        col,
+        c0,
+        c1,
+        c2;
+
+    for ( row = first; row < last; row++ )
+    {
+        r = job->red[   row ];
+        g = job->green[ row ];
+        b = job->blue[  row ];
+        out = job->out[ row ];
+        d = job->dith[ row & 7 ];
+
+        for ( col = 0; col < job->w; col++ )
+        {
+            c0 = FL_PCCLAMP( r[ col ] + d[ col & 7 ] );
+            c1 = FL_PCCLAMP( g[ col ] + d[ col & 7 ] );
+            c2 = FL_PCCLAMP( b[ col ] + d[ col & 7 ] );
+
+            out[ col ] = histogram[ c0 >> C0_SHIFT ]
+                                  [ c1 >> C1_SHIFT ]
+                                  [ c2 >> C2_SHIFT ] - 1;
+        }
+
+        if ( index == 0 && im && ! ( ( row - first ) & FLIMAGE_REPFREQ ) )
+        {
+            im->completed = ( long ) ( row - first ) * job->h
+                            / ( last - first );
+            im->visual_cue( im, "Dithering ..." );
+        }
+    }
+
+    return 0;
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+ordered_dither( SPEC            * sp,
+                unsigned char  ** red,
+                unsigned char  ** green,
+                unsigned char  ** blue,
+                unsigned short ** output_buf,
+                int               width,
+                int               num_rows )
+{
+    ORDERED_JOB job;
+    double spread;
+    int i,
+        j;
+
+    /* For n colors evenly spread over the color cube neighbouring colors
+       would be MAXJSAMPLE / (n^(1/3) - 1) apart. The colors picked by
+       median cut are closer where most of the pixels are, so half of
+       that is a good amplitude */
+
+    spread = pow( FL_max( sp->actual_number_of_colors, 8 ), 1.0 / 3.0 );
+    spread = 0.5 * ( MAXJSAMPLE + 1 ) / ( spread - 1.0 );
+
+    for ( i = 0; i < 8; i++ )
+        for ( j = 0; j < 8; j++ )
+            job.dith[ i ][ j ] =
+                       FL_nint( ( ( 2 * bayer[ i ][ j ] + 1 ) / 128.0 - 0.5 )
+                                * spread );
+
+    job.sp = sp;
+    job.red = red;
+    job.green = green;
+    job.blue = blue;
+    job.out = output_buf;
+    job.w = width;
+    job.h = num_rows;
+
+    flimage_run_rows( num_rows, ORDERED_MIN_ROWS, ordered_rows, &job );
+
+    if ( sp->im )
+    {
+        sp->im->completed = sp->im->total = sp->im->h;
+        sp->im->visual_cue( sp->im, "Dithering done" );
+    }
+}
+
+
+/***************************************
+ * Second pass: maps the pixels to the colors selected, using the
+ * histogram as a cache for the inverse colormap
+ ***************************************/
+
+static void
+map_pixels( SPEC            * sp,
+            unsigned char  ** red,
+            unsigned char  ** green,
+            unsigned char  ** blue,
+            unsigned short ** output_buf,
+            int               width,
+            int               num_rows )
+{
+    int i;
+
+    /* re-init histogram for inverse lookup */
+
+    for ( i = 0; i < HIST_C0_ELEMS; i++ )
+        memset( sp->histogram[ i ], 0,
+                HIST_C1_ELEMS * HIST_C2_ELEMS * sizeof( histcell ) );
+
+    if (    dither_method == FLIMAGE_ORDERED_DITHER
+         || ( long ) width * num_rows >= CMAP_MIN_PIXELS )
+        flimage_run_rows( BOX_COUNT, CMAP_MIN_BOXES, fill_boxes, sp );
+
+    if ( dither_method == FLIMAGE_ORDERED_DITHER )
+        ordered_dither( sp, red, green, blue, output_buf, width, num_rows );
+    else
+    {
+        sp->on_odd_row = 0;
+        pass2_fs_dither( sp, red, green, blue, output_buf, width, num_rows );
+    }
+}
+
+
 /***************************************
  * Shrink the min/max bounds of a box to enclose only nonzero elements,
  * and recompute its volume and population
@@ -1398,7 +1609,59 @@ select_colors( SPEC * sp,
 
 
 /***************************************
- * get histogram
+ * get histogram. Each thread counts the pixels of its rows in its own
+ * histogram (with cells large enough to never overflow), which then
+ * all get added up, saturating at the largest count a cell of the
+ * shared histogram can hold.
+ ***************************************/
+
+#define HIST_CELLS     ( HIST_C0_ELEMS * HIST_C1_ELEMS * HIST_C2_ELEMS )
+#define HIST_MIN_ROWS  64       /* rows per thread at least */
+
+typedef struct {
+    unsigned char ** r,
+                  ** g,
+                  ** b;
+    int              width;
+    unsigned int   * hist[ FLIMAGE_MAX_THREADS ];
+} HIST_JOB;
+
+static int
+hist_rows( int    first,
+           int    last,
+           int    index,
+           void * data )
+{
+    HIST_JOB *job = data;
+    unsigned int *hist;
+    unsigned char *r,
+                  *g,
+                  *b;
+    int row,
+        col;
+
+    if ( ! ( hist = job->hist[ index ] = fl_calloc( HIST_CELLS,
+                                                    sizeof *hist ) ) )
+        return -1;
+
+    for ( row = first; row < last; row++ )
+    {
+        r = job->r[ row ];
+        g = job->g[ row ];
+        b = job->b[ row ];
+
+        for ( col = 0; col < job->width; col++ )
+            hist[   ( ( r[ col ] >> C0_SHIFT )
+                      << ( HIST_C1_BITS + HIST_C2_BITS ) )
+                  | ( ( g[ col ] >> C1_SHIFT ) << HIST_C2_BITS )
+                  | ( b[ col ] >> C2_SHIFT ) ]++;
+    }
+
+    return 0;
+}
+
+
+/***************************************
  ***************************************/
 
 static void
@@ -1411,7 +1674,12 @@ prescan_quantize( SPEC           * sp,
 {
     histptr histp;
     hist3d histogram = sp->histogram;
-    int row, col;
+    HIST_JOB job;
+    unsigned long count;
+    int row,
+        col,
+        i,
+        n;
 
     if ( sp->im )
     {
@@ -1419,22 +1687,50 @@ prescan_quantize( SPEC           * sp,
         sp->im->visual_cue( sp->im, "Getting Histogram ..." );
     }
 
-    for ( row = 0; row < num_rows; row++ )
+    job.r = r;
+    job.g = g;
+    job.b = b;
+    job.width = width;
+    memset( job.hist, 0, sizeof job.hist );
+
+    if ( flimage_run_rows( num_rows, HIST_MIN_ROWS, hist_rows, &job ) == 0 )
     {
-        for ( col = width; --col >= 0; )
+        for ( n = 0; n < FLIMAGE_MAX_THREADS && job.hist[ n ]; n++ )
+            /* empty */ ;
+
+        for ( histp = NULL, i = 0; i < HIST_CELLS; i++ )
         {
-            /* get pixel value and index into the histogram */
+            if ( ! ( i & ( HIST_C1_ELEMS * HIST_C2_ELEMS - 1 ) ) )
+                histp = histogram[ i >> ( HIST_C1_BITS + HIST_C2_BITS ) ][ 0 ];
 
-            histp = &histogram[ r[ row ][ col ] >> C0_SHIFT ]
-                              [ g[ row ][ col ] >> C1_SHIFT ]
-                              [ b[ row ][ col ] >> C2_SHIFT ];
+            for ( count = 0, col = 0; col < n; col++ )
+                count += job.hist[ col ][ i ];
 
-            /* increment, check for overflow and undo increment if so. */
+            *histp++ = ( histcell ) FL_min( count, 0xffffUL );
+        }
+    }
+    else     /* out of memory, do it the slow way */
+    {
+        for ( row = 0; row < num_rows; row++ )
+        {
+            for ( col = width; --col >= 0; )
+            {
+                /* get pixel value and index into the histogram */
 
-            if ( ++( *histp ) <= 0 )
-                ( *histp )--;
+                histp = &histogram[ r[ row ][ col ] >> C0_SHIFT ]
+                                  [ g[ row ][ col ] >> C1_SHIFT ]
+                                  [ b[ row ][ col ] >> C2_SHIFT ];
+
+                /* increment, check for overflow and undo increment if so */
+
+                if ( ++( *histp ) <= 0 )
+                    ( *histp )--;
+            }
         }
     }
+
+    for ( i = 0; i < FLIMAGE_MAX_THREADS; i++ )
+        fli_safe_free( job.hist[ i ] );
 }
 
 
@@ -21,7 +21,9 @@
  *  Copyright (c) 1993, 1998-2002  By T.C. Zhao
  *  All rights reserved.
  *
- *  TODO: png should be implemented in real code
+ *  If zlib is available PNG files are read and written directly, one
+ *  scanline at a time. Otherwise the netpbm programs pngtopnm and
+ *  pnmtopng are used as filters.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -32,6 +34,13 @@
 #include "flimage.h"
 #include "flimage_int.h"
 
+#if defined HAVE_ZLIB_H && defined HAVE_LIBZ
+#define PNG_NATIVE  1
+#include <zlib.h>
+#else
+#define PNG_NATIVE  0
+#endif
+
 
 /***************************************
  ***************************************/
@@ -48,6 +57,888 @@ PNG_identify( FILE * fp )
 }
 
 
+#if PNG_NATIVE
+
+#define PNG_BUFSIZE  32768      /* size of (de)compression buffers */
+
+enum {
+    PNG_GRAY       = 0,
+    PNG_RGB        = 2,
+    PNG_PALETTE    = 3,
+    PNG_GRAY_ALPHA = 4,
+    PNG_RGB_ALPHA  = 6
+};
+
+typedef struct {
+    int             w,
+                    h;
+    int             depth;          /* bits per sample                */
+    int             color_type;
+    int             interlace;
+    int             channels;       /* samples per pixel              */
+    int             bpp;            /* bytes per pixel, at least 1    */
+    long            idat_left;      /* bytes left in current IDAT     */
+    z_stream        z;
+    unsigned char   buf[ PNG_BUFSIZE ];
+} SPEC;
+
+
+/***************************************
+ ***************************************/
+
+static void
+generate_header_info( FL_IMAGE * im )
+{
+    SPEC *sp = im->io_spec;
+    static const char *ctype[ ] = { "Gray", "?", "RGB", "Palette",
+                                    "GrayAlpha", "?", "RGBA" };
+
+    if ( ! ( im->info = fl_malloc( 128 ) ) )
+        return;
+
+    sprintf( im->info, "Size=(%d x %d)\nBitDepth=%d\nColorType=%s\n"
+             "Interlace=%s", sp->w, sp->h, sp->depth,
+             ctype[ sp->color_type ], sp->interlace ? "Adam7" : "None" );
+}
+
+
+/***************************************
+ * Reads the length and type of the next chunk
+ ***************************************/
+
+static long
+read_chunk_header( FILE * fp,
+                   char * type )
+{
+    long len = fli_fget4MSBF( fp );
+
+    if ( fread( type, 1, 4, fp ) != 4 || len < 0 )
+        return -1;
+
+    return len;
+}
+
+
+/***************************************
+ * Checks that a combination of color type and bit depth is allowed
+ ***************************************/
+
+static int
+check_depth( int color_type,
+             int depth )
+{
+    switch ( color_type )
+    {
+        case PNG_GRAY :
+            return    depth == 1 || depth == 2 || depth == 4
+                   || depth == 8 || depth == 16;
+
+        case PNG_PALETTE :
+            return depth == 1 || depth == 2 || depth == 4 || depth == 8;
+
+        case PNG_RGB :
+        case PNG_GRAY_ALPHA :
+        case PNG_RGB_ALPHA :
+            return depth == 8 || depth == 16;
+    }
+
+    return 0;
+}
+
+
+/***************************************
+ * Reads all chunks up to the start of the image data
+ ***************************************/
+
+static int
+PNG_description( FL_IMAGE * im )
+{
+    FILE *fp = im->fpin;
+    SPEC *sp;
+    char buf[ 8 ],
+         type[ 4 ];
+    long len;
+    int got_header = 0,
+        i;
+
+    if ( fread( buf, 1, 8, fp ) != 8 )
+    {
+        im->error_message( im, "error while reading png file" );
+        return -1;
+    }
+
+    if ( ! ( sp = fl_calloc( 1, sizeof *sp ) ) )
+    {
+        im->error_message( im, "PNG: running out of memory" );
+        return -1;
+    }
+
+    im->io_spec = sp;
+
+    while ( ( len = read_chunk_header( fp, type ) ) >= 0 )
+    {
+        if ( ! strncmp( type, "IHDR", 4 ) )
+        {
+            sp->w = fli_fget4MSBF( fp );
+            sp->h = fli_fget4MSBF( fp );
+            sp->depth = getc( fp );
+            sp->color_type = getc( fp );
+
+            if (    getc( fp ) != 0             /* compression method */
+                 || getc( fp ) != 0             /* filter method      */
+                 || ( sp->interlace = getc( fp ) ) < 0
+                 || sp->interlace > 1
+                 || sp->w <= 0
+                 || sp->h <= 0
+                 || ! check_depth( sp->color_type, sp->depth ) )
+                break;
+
+            got_header = 1;
+            len -= 13;
+        }
+        else if ( ! got_header )
+            break;
+        else if ( ! strncmp( type, "PLTE", 4 ) && len % 3 == 0 )
+        {
+            if ( ( im->map_len = len / 3 ) > 256 || im->map_len == 0 )
+                break;
+
+            flimage_getcolormap( im );
+
+            for ( i = 0; i < im->map_len; i++ )
+            {
+                im->red_lut[ i ]   = getc( fp );
+                im->green_lut[ i ] = getc( fp );
+                im->blue_lut[ i ]  = getc( fp );
+            }
+
+            len = 0;
+        }
+        else if ( ! strncmp( type, "tRNS", 4 ) )
+        {
+            /* Only a single fully transparent palette entry or RGB value
+               can be represented */
+
+            if ( sp->color_type == PNG_PALETTE )
+            {
+                for ( i = 0; i < len; i++ )
+                    if ( getc( fp ) == 0 && im->tran_index < 0 )
+                        im->tran_index = i;
+                len = 0;
+            }
+            else if ( sp->color_type == PNG_RGB && len == 6 )
+            {
+                int r = fli_fget2MSBF( fp ),
+                    g = fli_fget2MSBF( fp ),
+                    b = fli_fget2MSBF( fp );
+
+                if ( sp->depth == 16 )
+                {
+                    r >>= 8;
+                    g >>= 8;
+                    b >>= 8;
+                }
+
+                im->tran_rgb = FL_PACK3( r, g, b );
+                len = 0;
+            }
+        }
+        else if ( ! strncmp( type, "IDAT", 4 ) )
+        {
+            sp->idat_left = len;
+            break;
+        }
+        else if ( ! strncmp( type, "IEND", 4 ) )
+            break;
+
+        /* Skip the rest of the chunk and its CRC */
+
+        if ( fseek( fp, len + 4, SEEK_CUR ) < 0 )
+            break;
+    }
+
+    if ( len < 0 || strncmp( type, "IDAT", 4 ) )
+    {
+        flimage_error( im, "%s: bad or unsupported png file", im->infile );
+        fl_free( im->io_spec );
+        im->io_spec = NULL;
+        return -1;
+    }
+
+    if ( sp->color_type == PNG_PALETTE && im->map_len == 0 )
+    {
+        flimage_error( im, "%s: palette missing", im->infile );
+        fl_free( im->io_spec );
+        im->io_spec = NULL;
+        return -1;
+    }
+
+    sp->channels = ( sp->color_type == PNG_RGB ) ? 3
+                   : ( sp->color_type == PNG_GRAY_ALPHA ) ? 2
+                   : ( sp->color_type == PNG_RGB_ALPHA ) ? 4 : 1;
+    sp->bpp = FL_max( sp->channels * sp->depth / 8, 1 );
+
+    im->w = sp->w;
+    im->h = sp->h;
+
+    if ( sp->color_type == PNG_PALETTE )
+        im->type = FL_IMAGE_CI;
+    else if ( sp->color_type == PNG_RGB || sp->color_type == PNG_RGB_ALPHA )
+        im->type = FL_IMAGE_RGB;
+    else if ( sp->depth == 16 )
+    {
+        im->type = FL_IMAGE_GRAY16;
+        im->gray_maxval = 65535;
+    }
+    else
+    {
+        im->type = FL_IMAGE_GRAY;
+        im->gray_maxval = 255;
+    }
+
+    if ( im->setup->header_info )
+        generate_header_info( im );
+
+    return 1;
+}
+
+
+/***************************************
+ * Fills 'out' with 'len' bytes of decompressed image data, pulling
+ * in the following IDAT chunks as needed
+ ***************************************/
+
+static int
+inflate_bytes( FL_IMAGE      * im,
+               unsigned char * out,
+               size_t          len )
+{
+    SPEC *sp = im->io_spec;
+    char type[ 4 ];
+    int status;
+
+    sp->z.next_out = out;
+    sp->z.avail_out = len;
+
+    while ( sp->z.avail_out > 0 )
+    {
+        if ( sp->z.avail_in == 0 )
+        {
+            size_t n;
+
+            while ( sp->idat_left == 0 )
+            {
+                fli_fget4MSBF( im->fpin );          /* CRC */
+                if (    ( sp->idat_left = read_chunk_header( im->fpin,
+                                                             type ) ) < 0
+                     || strncmp( type, "IDAT", 4 ) )
+                    return -1;
+            }
+
+            n = FL_min( sp->idat_left, PNG_BUFSIZE );
+            if ( fread( sp->buf, 1, n, im->fpin ) != n )
+                return -1;
+
+            sp->idat_left -= n;
+            sp->z.next_in = sp->buf;
+            sp->z.avail_in = n;
+        }
+
+        status = inflate( &sp->z, Z_NO_FLUSH );
+
+        if ( status == Z_STREAM_END && sp->z.avail_out > 0 )
+            return -1;
+        if ( status != Z_OK && status != Z_STREAM_END )
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/***************************************
+ * Paeth predictor
+ ***************************************/
+
+static int
+paeth( int a,
+       int b,
+       int c )
+{
+    int p = a + b - c,
+        pa = FL_abs( p - a ),
+        pb = FL_abs( p - b ),
+        pc = FL_abs( p - c );
+
+    if ( pa <= pb && pa <= pc )
+        return a;
+    return pb <= pc ? b : c;
+}
+
+
+/***************************************
+ * Undoes the filter of a scanline, 'prev' is the (already unfiltered)
+ * previous scanline or all zeros for the first one
+ ***************************************/
+
+static int
+unfilter_row( int                   filter,
+              unsigned char       * row,
+              const unsigned char * prev,
+              int                   len,
+              int                   bpp )
+{
+    int i;
+
+    switch ( filter )
+    {
+        case 0 :
+            break;
+
+        case 1 :
+            for ( i = bpp; i < len; i++ )
+                row[ i ] += row[ i - bpp ];
+            break;
+
+        case 2 :
+            for ( i = 0; i < len; i++ )
+                row[ i ] += prev[ i ];
+            break;
+
+        case 3 :
+            for ( i = 0; i < bpp; i++ )
+                row[ i ] += prev[ i ] >> 1;
+            for ( ; i < len; i++ )
+                row[ i ] += ( row[ i - bpp ] + prev[ i ] ) >> 1;
+            break;
+
+        case 4 :
+            for ( i = 0; i < bpp; i++ )
+                row[ i ] += prev[ i ];
+            for ( ; i < len; i++ )
+                row[ i ] += paeth( row[ i - bpp ], prev[ i ],
+                                   prev[ i - bpp ] );
+            break;
+
+        default :
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/***************************************
+ * Returns sample 'i' of an unfiltered scanline
+ ***************************************/
+
+static int
+get_sample( const unsigned char * row,
+            int                   i,
+            int                   depth )
+{
+    int bit;
+
+    if ( depth == 8 )
+        return row[ i ];
+    if ( depth == 16 )
+        return ( row[ 2 * i ] << 8 ) | row[ 2 * i + 1 ];
+
+    bit = i * depth;
+    return ( row[ bit >> 3 ] >> ( 8 - depth - ( bit & 7 ) ) )
+           & ( ( 1 << depth ) - 1 );
+}
+
+
+/***************************************
+ * Stores 'n' pixels of an unfiltered scanline in the image row 'y',
+ * starting at column 'x' and going in steps of 'dx' (the last two are
+ * only different from 0 and 1 for interlaced images)
+ ***************************************/
+
+static void
+store_row( FL_IMAGE            * im,
+           const unsigned char * row,
+           int                   y,
+           int                   x,
+           int                   dx,
+           int                   n )
+{
+    SPEC *sp = im->io_spec;
+    int depth = sp->depth,
+        i;
+
+    if ( sp->color_type == PNG_RGB || sp->color_type == PNG_RGB_ALPHA )
+    {
+        unsigned char *r = im->red[ y ] + x,
+                      *g = im->green[ y ] + x,
+                      *b = im->blue[ y ] + x,
+                      *a = im->alpha[ y ] + x;
+        int step = sp->channels * ( depth / 8 );
+
+        /* 16 bit samples only keep their most significant byte */
+
+        for ( i = 0; i < n; i++, row += step )
+        {
+            r[ i * dx ] = row[ 0 ];
+            g[ i * dx ] = row[ depth / 8 ];
+            b[ i * dx ] = row[ 2 * depth / 8 ];
+            if ( sp->channels == 4 )
+                a[ i * dx ] = row[ 3 * depth / 8 ];
+        }
+    }
+    else if ( sp->color_type == PNG_PALETTE )
+    {
+        unsigned short *ci = im->ci[ y ] + x;
+
+        /* Indices not in the palette (invalid anyway) become 0 */
+
+        for ( i = 0; i < n; i++ )
+        {
+            int v = get_sample( row, i, depth );
+
+            ci[ i * dx ] = v < im->map_len ? v : 0;
+        }
+    }
+    else
+    {
+        unsigned short *gray = im->gray[ y ] + x;
+        int maxs = ( 1 << depth ) - 1;
+
+        /* Grays with less than 8 bits get scaled to 0 to 255, any alpha
+           channel is dropped */
+
+        for ( i = 0; i < n; i++ )
+        {
+            int v = get_sample( row, i * sp->channels, depth );
+
+            gray[ i * dx ] = depth < 8 ? v * 255 / maxs : v;
+        }
+    }
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+PNG_read_pixels( FL_IMAGE * im )
+{
+    static const int xoff[ ] = { 0, 4, 0, 2, 0, 1, 0 },
+                     yoff[ ] = { 0, 0, 4, 0, 2, 0, 1 },
+                     xstep[ ] = { 8, 8, 4, 4, 2, 2, 1 },
+                     ystep[ ] = { 8, 8, 8, 4, 4, 2, 2 };
+    SPEC *sp = im->io_spec;
+    unsigned char *cur,
+                  *prev;
+    size_t rowbytes = ( ( size_t ) sp->w * sp->channels * sp->depth + 7 ) / 8;
+    int npass = sp->interlace ? 7 : 1,
+        status = 0,
+        pass,
+        y;
+
+    cur = fl_malloc( rowbytes + 1 );
+    prev = fl_malloc( rowbytes + 1 );
+
+    if ( ! cur || ! prev || inflateInit( &sp->z ) != Z_OK )
+    {
+        fli_safe_free( cur );
+        fli_safe_free( prev );
+        im->error_message( im, "PNG: running out of memory" );
+        return -1;
+    }
+
+    for ( pass = 0; pass < npass && status == 0; pass++ )
+    {
+        int x0 = sp->interlace ? xoff[ pass ] : 0,
+            y0 = sp->interlace ? yoff[ pass ] : 0,
+            dx = sp->interlace ? xstep[ pass ] : 1,
+            dy = sp->interlace ? ystep[ pass ] : 1,
+            pw = ( sp->w - x0 + dx - 1 ) / dx,
+            len;
+
+        if ( pw <= 0 || y0 >= sp->h )
+            continue;
+
+        len = ( pw * sp->channels * sp->depth + 7 ) / 8;
+        memset( prev, 0, len + 1 );
+
+        /* Each scanline starts with a byte for the filter type */
+
+        for ( y = y0; y < sp->h; y += dy )
+        {
+            unsigned char *t;
+
+            if (    inflate_bytes( im, cur, len + 1 ) < 0
+                 || unfilter_row( cur[ 0 ], cur + 1, prev + 1, len,
+                                  sp->bpp ) < 0 )
+            {
+                status = -1;
+                break;
+            }
+
+            store_row( im, cur + 1, y, x0, dx, pw );
+
+            t = prev;
+            prev = cur;
+            cur = t;
+
+            if ( pass == npass - 1 && ! ( ++im->completed & FLIMAGE_REPFREQ ) )
+            {
+                im->visual_cue( im, "Reading PNG" );
+                if ( ! sp->interlace )
+                    flimage_rows_done( im, y + 1 );
+            }
+        }
+    }
+
+    inflateEnd( &sp->z );
+    fl_free( cur );
+    fl_free( prev );
+
+    if ( status < 0 )
+        flimage_error( im, "%s: corrupt png image data", im->infile );
+
+    /* With a partially read image at least the upper half should be ok */
+
+    return ( status == 0 || im->completed > im->h / 2 ) ? 1 : -1;
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+write_chunk( FILE                * fp,
+             const char          * type,
+             const unsigned char * data,
+             size_t                len )
+{
+    uLong crc = crc32( 0, ( const Bytef * ) type, 4 );
+
+    if ( len )
+        crc = crc32( crc, data, len );
+
+    fli_fput4MSBF( len, fp );
+    fwrite( type, 1, 4, fp );
+    if ( len )
+        fwrite( data, 1, len, fp );
+    fli_fput4MSBF( crc, fp );
+}
+
+
+/***************************************
+ * Compresses 'len' bytes, writing IDAT chunks whenever the output
+ * buffer is full. With 'finish' set also everything still pending
+ * gets written out.
+ ***************************************/
+
+static int
+deflate_bytes( FILE          * fp,
+               z_stream      * z,
+               unsigned char * buf,
+               unsigned char * data,
+               size_t          len,
+               int             finish )
+{
+    int status;
+
+    z->next_in = data;
+    z->avail_in = len;
+
+    do
+    {
+        if ( ( status = deflate( z, finish ? Z_FINISH : Z_NO_FLUSH ) )
+             == Z_STREAM_ERROR )
+            return -1;
+
+        if ( z->avail_out == 0 || ( finish && status == Z_STREAM_END ) )
+        {
+            if ( z->avail_out < PNG_BUFSIZE )
+                write_chunk( fp, "IDAT", buf, PNG_BUFSIZE - z->avail_out );
+            z->next_out = buf;
+            z->avail_out = PNG_BUFSIZE;
+        }
+    } while ( z->avail_in > 0 || ( finish && status != Z_STREAM_END ) );
+
+    return 0;
+}
+
+
+/***************************************
+ * Picks the filter for which the sum of absolute values of the result
+ * is smallest (the heuristic recommended by the PNG specification) and
+ * stores the filtered scanline, led by the filter type, in 'out'
+ ***************************************/
+
+static void
+filter_row( const unsigned char * row,
+            const unsigned char * prev,
+            int                   len,
+            int                   bpp,
+            unsigned char       * out,
+            unsigned char       * tmp )
+{
+    long best_sum = -1;
+    int f,
+        i;
+
+    for ( f = 0; f < 5; f++ )
+    {
+        long sum = 0;
+
+        for ( i = 0; i < len; i++ )
+        {
+            int a = i >= bpp ? row[ i - bpp ] : 0,
+                b = prev[ i ],
+                c = i >= bpp ? prev[ i - bpp ] : 0,
+                v = row[ i ];
+
+            switch ( f )
+            {
+                case 1 : v -= a; break;
+                case 2 : v -= b; break;
+                case 3 : v -= ( a + b ) >> 1; break;
+                case 4 : v -= paeth( a, b, c ); break;
+            }
+
+            tmp[ i + 1 ] = v;
+            sum += FL_abs( ( signed char ) v );
+        }
+
+        if ( best_sum < 0 || sum < best_sum )
+        {
+            best_sum = sum;
+            tmp[ 0 ] = f;
+            memcpy( out, tmp, len + 1 );
+        }
+    }
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+PNG_write( FL_IMAGE * im )
+{
+    FILE *fp = im->fpout;
+    unsigned char hdr[ 13 ],
+                  plte[ 3 * 256 ],
+                  *row,
+                  *prev,
+                  *out,
+                  *tmp,
+                  *buf,
+                  *mem;
+    int color_type,
+        depth,
+        channels,
+        bpp,
+        len,
+        i,
+        x,
+        y,
+        status = 0;
+    z_stream z;
+
+    /* Colormapped images with too many colors get written as RGB */
+
+    if ( FL_IsCI( im->type ) && im->map_len <= 256 )
+    {
+        color_type = PNG_PALETTE;
+        depth = im->map_len <= 2 ? 1 : im->map_len <= 4 ? 2
+                : im->map_len <= 16 ? 4 : 8;
+    }
+    else if ( FL_IsGray( im->type ) )
+    {
+        color_type = PNG_GRAY;
+        depth = im->type == FL_IMAGE_GRAY16 ? 16 : 8;
+    }
+    else
+    {
+        color_type = PNG_RGB;
+        depth = 8;
+    }
+
+    channels = color_type == PNG_RGB ? 3 : 1;
+    bpp = FL_max( channels * depth / 8, 1 );
+    len = ( im->w * channels * depth + 7 ) / 8;
+
+    if ( ! ( mem = fl_calloc( 4 * ( len + 1 ) + PNG_BUFSIZE, 1 ) ) )
+    {
+        im->error_message( im, "PNG: running out of memory" );
+        return -1;
+    }
+
+    row = mem;
+    prev = row + len + 1;
+    out = prev + len + 1;
+    tmp = out + len + 1;
+    buf = tmp + len + 1;
+
+    memset( &z, 0, sizeof z );
+    if ( deflateInit( &z, Z_DEFAULT_COMPRESSION ) != Z_OK )
+    {
+        fl_free( mem );
+        im->error_message( im, "PNG: can't initialize compression" );
+        return -1;
+    }
+
+    z.next_out = buf;
+    z.avail_out = PNG_BUFSIZE;
+
+    fwrite( "\x89PNG\x0d\x0a\x1a\x0a", 1, 8, fp );
+
+    hdr[ 0 ] = im->w >> 24;
+    hdr[ 1 ] = im->w >> 16;
+    hdr[ 2 ] = im->w >> 8;
+    hdr[ 3 ] = im->w;
+    hdr[ 4 ] = im->h >> 24;
+    hdr[ 5 ] = im->h >> 16;
+    hdr[ 6 ] = im->h >> 8;
+    hdr[ 7 ] = im->h;
+    hdr[ 8 ] = depth;
+    hdr[ 9 ] = color_type;
+    hdr[ 10 ] = hdr[ 11 ] = hdr[ 12 ] = 0;
+    write_chunk( fp, "IHDR", hdr, 13 );
+
+    if ( color_type == PNG_PALETTE )
+    {
+        for ( i = 0; i < im->map_len; i++ )
+        {
+            plte[ 3 * i     ] = im->red_lut[ i ];
+            plte[ 3 * i + 1 ] = im->green_lut[ i ];
+            plte[ 3 * i + 2 ] = im->blue_lut[ i ];
+        }
+
+        write_chunk( fp, "PLTE", plte, 3 * im->map_len );
+
+        if ( im->tran_index >= 0 && im->tran_index < im->map_len )
+        {
+            memset( plte, 255, im->tran_index );
+            plte[ im->tran_index ] = 0;
+            write_chunk( fp, "tRNS", plte, im->tran_index + 1 );
+        }
+    }
+    else if ( color_type == PNG_RGB && im->tran_rgb >= 0 )
+    {
+        memset( plte, 0, 6 );
+        plte[ 1 ] = FL_GETR( im->tran_rgb );
+        plte[ 3 ] = FL_GETG( im->tran_rgb );
+        plte[ 5 ] = FL_GETB( im->tran_rgb );
+        write_chunk( fp, "tRNS", plte, 6 );
+    }
+
+    for ( y = 0; y < im->h && status == 0; y++ )
+    {
+        unsigned char *t;
+
+        if ( color_type == PNG_PALETTE )
+        {
+            int ppb = 8 / depth;
+
+            memset( row, 0, len );
+            for ( x = 0; x < im->w; x++ )
+                row[ x / ppb ] |= im->ci[ y ][ x ]
+                                  << ( 8 - depth * ( x % ppb + 1 ) );
+        }
+        else if ( color_type == PNG_GRAY && depth == 16 )
+        {
+            /* Samples get scaled to the full 16 bit range */
+
+            for ( x = 0; x < im->w; x++ )
+            {
+                unsigned int v = im->gray[ y ][ x ] * 65535UL
+                                 / FL_max( im->gray_maxval, 1 );
+
+                v = FL_min( v, 65535 );
+                row[ 2 * x ] = v >> 8;
+                row[ 2 * x + 1 ] = v;
+            }
+        }
+        else if ( color_type == PNG_GRAY )
+        {
+            for ( x = 0; x < im->w; x++ )
+                row[ x ] = im->gray[ y ][ x ];
+        }
+        else if ( FL_IsCI( im->type ) )
+        {
+            for ( x = 0; x < im->w; x++ )
+            {
+                int ci = im->ci[ y ][ x ];
+
+                row[ 3 * x     ] = im->red_lut[ ci ];
+                row[ 3 * x + 1 ] = im->green_lut[ ci ];
+                row[ 3 * x + 2 ] = im->blue_lut[ ci ];
+            }
+        }
+        else
+        {
+            for ( x = 0; x < im->w; x++ )
+            {
+                row[ 3 * x     ] = im->red[ y ][ x ];
+                row[ 3 * x + 1 ] = im->green[ y ][ x ];
+                row[ 3 * x + 2 ] = im->blue[ y ][ x ];
+            }
+        }
+
+        /* Filtering rarely helps with palette images */
+
+        if ( color_type == PNG_PALETTE )
+        {
+            out[ 0 ] = 0;
+            memcpy( out + 1, row, len );
+        }
+        else
+            filter_row( row, prev, len, bpp, out, tmp );
+
+        status = deflate_bytes( fp, &z, buf, out, len + 1, 0 );
+
+        t = prev;
+        prev = row;
+        row = t;
+
+        if ( ! ( ++im->completed & FLIMAGE_REPFREQ ) )
+            im->visual_cue( im, "Writing PNG" );
+    }
+
+    if ( status == 0 )
+        status = deflate_bytes( fp, &z, buf, NULL, 0, 1 );
+
+    deflateEnd( &z );
+    fl_free( mem );
+
+    if ( status < 0 )
+    {
+        im->error_message( im, "PNG: compression failed" );
+        return -1;
+    }
+
+    write_chunk( fp, "IEND", NULL, 0 );
+
+    return ferror( fp ) ? -1 : 0;
+}
+
+
+/***************************************
+ ***************************************/
+
+void
+flimage_enable_png( void )
+{
+    flimage_add_format( "Portable Network Graphics", "png", "png",
+                        FL_IMAGE_RGB | FL_IMAGE_GRAY | FL_IMAGE_GRAY16
+                        | FL_IMAGE_CI | FL_IMAGE_MONO,
+                        PNG_identify,
+                        PNG_description,
+                        PNG_read_pixels,
+                        PNG_write );
+}
+
+#else    /* ! PNG_NATIVE */
+
+
 /***************************************
  ***************************************/
 
@@ -101,6 +992,8 @@ flimage_enable_png( void )
                         PNG_dump);
 }
 
+#endif   /* PNG_NATIVE */
+
 
 /*
  * Local variables:
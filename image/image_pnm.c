@@ -174,6 +174,22 @@ PNM_description( FL_IMAGE * im )
 }
 
 
+/***************************************
+ * Called after each row that got read
+ ***************************************/
+
+static void
+row_read( FL_IMAGE * im,
+          int        rows )
+{
+    if ( ( im->completed = rows ) & FLIMAGE_REPFREQ )
+        return;
+
+    im->visual_cue( im, "Reading PNM" );
+    flimage_rows_done( im, rows );
+}
+
+
 /***************************************
  ***************************************/
 
@@ -181,6 +197,7 @@ static int
 PNM_read_pixels( FL_IMAGE * im )
 {
     int i,
+        j,
         npix = im->w * im->h;
     SPEC *sp = im->io_spec;
 
@@ -192,24 +209,26 @@ PNM_read_pixels( FL_IMAGE * im )
 
         if ( sp->raw )
         {
-            for ( i = 0; i < npix; i++ )
-            {
-                *r++ = getc( im->fpin );
-                *g++ = getc( im->fpin );
-                *b++ = getc( im->fpin );
-            }
+            for ( j = 0; j < im->h; row_read( im, ++j ) )
+                for ( i = 0; i < im->w; i++ )
+                {
+                    *r++ = getc( im->fpin );
+                    *g++ = getc( im->fpin );
+                    *b++ = getc( im->fpin );
+                }
         }
         else
         {
-            for ( i = 0; i < npix; i++ )
-            {
-                *r++ =
-                     ( unsigned char ) ( fli_readpint( im->fpin ) * sp->fnorm );
-                *g++ =
-                     ( unsigned char ) ( fli_readpint( im->fpin ) * sp->fnorm );
-                *b++ =
-                     ( unsigned char ) ( fli_readpint( im->fpin ) * sp->fnorm );
-            }
+            for ( j = 0; j < im->h; row_read( im, ++j ) )
+                for ( i = 0; i < im->w; i++ )
+                {
+                    *r++ = ( unsigned char )
+                               ( fli_readpint( im->fpin ) * sp->fnorm );
+                    *g++ = ( unsigned char )
+                               ( fli_readpint( im->fpin ) * sp->fnorm );
+                    *b++ = ( unsigned char )
+                               ( fli_readpint( im->fpin ) * sp->fnorm );
+                }
 
             if ( sp->maxval != FL_PCMAX )
             {
@@ -231,11 +250,13 @@ PNM_read_pixels( FL_IMAGE * im )
         unsigned short *gray = im->gray[0];
 
         if ( sp->raw )
-            for ( i = 0; i < npix; i++ )
-                gray[ i ] = getc( im->fpin );
+            for ( j = 0; j < im->h; row_read( im, ++j ) )
+                for ( i = 0; i < im->w; i++ )
+                    *gray++ = getc( im->fpin );
         else
-            for ( i = 0; i < npix; i++ )
-                gray[ i ] = fli_readpint( im->fpin );
+            for ( j = 0; j < im->h; row_read( im, ++j ) )
+                for ( i = 0; i < im->w; i++ )
+                    *gray++ = fli_readpint( im->fpin );
     }
     else if ( im->type == FL_IMAGE_MONO )
     {
@@ -259,12 +280,15 @@ PNM_read_pixels( FL_IMAGE * im )
                     *ci = ( k & 0x80 ) ? 1 : 0;
                     k <<= 1;
                 }
+
+                row_read( im, i + 1 );
             }
         }
         else
         {
-            for ( ; ci < cend; ci++ )
-                *ci = fli_readpint( im->fpin ) > 0;
+            for ( j = 0; j < im->h; row_read( im, ++j ) )
+                for ( cend = ci + im->w; ci < cend; ci++ )
+                    *ci = fli_readpint( im->fpin ) > 0;
         }
     }
     else
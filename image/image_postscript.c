@@ -143,7 +143,9 @@ load_page( FL_IMAGE * im,
          tmpf[ 1024 ];
     SPEC *sp = im->extra_io_info;
     FLIMAGE_IO *fileIO;
-    int status, n;
+    int status,
+        n,
+        nformats;
 
     fli_snprintf( name, sizeof name, "%s/%s_%d",
                   sp->tmpdir, sp->prefix, pageNo );
@@ -167,7 +169,7 @@ load_page( FL_IMAGE * im,
 
     /* re-direct the io handling */
 
-    im->image_io = fileIO = &flimage_io[ n - 1 ];
+    im->image_io = fileIO = flimage_formats( &nformats ) + n - 1;
     im->type = fileIO->type;
 
     fileIO->identify( im->fpin );
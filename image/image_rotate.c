@@ -243,43 +243,78 @@ flip_matrix( void * matrix,
  *       rotated. caller must take care of the rotated dimensions
  **************************************************************/
 
-/*  Rotate 90 degrees */
-
-#define DO_M90( type, out, in )                      \
-    do {                                             \
-        type  *p= ( ( type ** ) out )[ 0 ],          \
-             **o= in;                                \
-        int i,                                       \
-            j;                                       \
-        for ( j = 0; j < col; j++ )                  \
-        {                                            \
-            for ( i = row - 1; i >= 0; i-- )         \
-                *p++ = o[ i ][ j ];                  \
-        }                                            \
+/* For +/-90 degrees the input is read column-wise. To keep that from
+   thrashing the cache the output is done in blocks of ROT_BLOCK x
+   ROT_BLOCK pixels, and bands of output rows are done in parallel. */
+
+#define ROT_BLOCK  32
+
+typedef struct {
+    void   * in;
+    void   * out;
+    int      row,                /* size of the input */
+             col,
+             deg;
+    size_t   e;
+} ROT_JOB;
+
+/* Rotate 90 degrees: out[ k ][ i ] = in[ i ][ col - 1 - k ],
+   rotate -90 degrees: out[ k ][ i ] = in[ row - 1 - i ][ k ] */
+
+#define ROTATE_BLOCKS( type, job, first, last )                       \
+    do {                                                              \
+        type **o = ( job )->out,                                      \
+             **m = ( job )->in;                                       \
+        int kb, ib, k, i, ke, ie;                                     \
+        for ( kb = first; kb < last; kb += ROT_BLOCK )                \
+        {                                                             \
+            ke = FL_min( kb + ROT_BLOCK, last );                      \
+            for ( ib = 0; ib < ( job )->row; ib += ROT_BLOCK )        \
+            {                                                         \
+                ie = FL_min( ib + ROT_BLOCK, ( job )->row );          \
+                for ( k = kb; k < ke; k++ )                           \
+                {                                                     \
+                    type *p = o[ k ];                                 \
+                    if ( ( job )->deg == 90 )                         \
+                        for ( i = ib; i < ie; i++ )                   \
+                            p[ i ] = m[ i ][ ( job )->col - 1 - k ];  \
+                    else                                              \
+                        for ( i = ib; i < ie; i++ )                   \
+                            p[ i ] = m[ ( job )->row - 1 - i ][ k ];  \
+                }                                                     \
+            }                                                         \
+        }                                                             \
     } while ( 0 )
 
-/*  Rotate -90 degrees */
-
-#define DO_90( type, out, in )                       \
-    do {                                             \
-        type  *p= ( ( type ** ) out )[ 0 ],          \
-             **o= in;                                \
-        int i,                                       \
-            j;                                       \
-        for ( j = col - 1; j >= 0; j-- )             \
-        {                                            \
-            for ( i = 0; i < row; i++ )              \
-                *p++ = o[ i ][ j ];                  \
-        }                                            \
-    } while ( 0 )
+
+/***************************************
+ * Does the output rows [first, last) of a +/-90 degree rotation
+ ***************************************/
+
+static int
+rotate_rows( int    first,
+             int    last,
+             int    index  FL_UNUSED_ARG,
+             void * data )
+{
+    ROT_JOB *job = data;
+
+    if ( job->e == 2 )
+        ROTATE_BLOCKS( unsigned short, job, first, last );
+    else
+        ROTATE_BLOCKS( unsigned char, job, first, last );
+
+    return 0;
+}
+
 
 #define DO_180( ty, out, in )                               \
     do {                                                    \
         ty *p= ( ( ty ** ) out )[ 0 ],                      \
            *o= ( ( ty ** ) in  )[ 0 ];                      \
         ty *os;                                             \
-        for ( os= o + col * row-1 ; os > o; *p++ = *os-- )  \
-            /* empty */ ;                                   \
+        for ( os = o + col * row; os > o; )                 \
+            *p++ = *--os;                                   \
     } while( 0 )
 
 
@@ -318,22 +353,21 @@ rotate_matrix( void * m,
         ncol = row;
     }
 
-    if ( ! ( mm = fl_get_matrix( nrow, ncol, e ) ) )
+    if ( ! ( mm = fl_get_matrix_ex( nrow, ncol, e, 0 ) ) )
         return 0;
 
-    if ( deg == 90 )
-    {
-        if ( e == 2 )
-            DO_90( unsigned short, mm, m );
-        else
-            DO_90( unsigned char, mm, m );
-    }
-    else if ( deg == -90 )
+    if ( deg == 90 || deg == -90 )
     {
-        if ( e == 2 )
-            DO_M90( unsigned short, mm, m );
-        else
-            DO_M90( unsigned char, mm, m );
+        ROT_JOB job;
+
+        job.in  = m;
+        job.out = mm;
+        job.row = row;
+        job.col = col;
+        job.deg = deg;
+        job.e   = e;
+
+        flimage_run_rows( nrow, ROT_BLOCK, rotate_rows, &job );
     }
     else if ( deg == 180 || deg == -180 )
     {
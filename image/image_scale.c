@@ -31,6 +31,8 @@
 #include "include/forms.h"
 #include "flimage.h"
 #include "flimage_int.h"
+#include <math.h>
+#include <string.h>
 
 
 /***************************************
@@ -198,6 +200,396 @@ image_scale( void     * om[ ],
 }
 
 
+/***********************************************************************
+ * Resampling with a (separable) filter kernel. For each output column
+ * and row a table holds the first source pixel and the weights of the
+ * source pixels contributing to it. Each output row is computed by
+ * applying the column weights to the source rows it depends on and
+ * then adding up these intermediate rows with the row weights.
+ ***********************************************************************/
+
+#ifndef M_PI
+#define M_PI  3.14159265358979323846
+#endif
+
+#define SCALE_BAND      16      /* output rows done in one go */
+#define SCALE_MIN_ROWS  32      /* fewer rows aren't worth a thread */
+
+typedef struct {
+    int     taps;               /* number of weights per output pixel */
+    int   * start;              /* first source pixel of output pixel */
+    float * weight;             /* taps weights for each output pixel */
+} SCALE_TABLE;
+
+typedef struct {
+    double        ( * func )( double );
+    double          support;
+} SCALE_FILTER;
+
+typedef struct {
+    void        ** om[ 4 ],
+                ** nm[ 4 ];
+    int            comp;
+    int            is_gray;
+    int            maxval;
+    int            w,
+                   h,
+                   nw,
+                   nh;
+    SCALE_TABLE    xt,
+                   yt;
+    FL_IMAGE     * im;
+} SCALE_JOB;
+
+
+/***************************************
+ ***************************************/
+
+static double
+bilinear_filter( double x )
+{
+    x = fabs( x );
+    return x < 1.0 ? 1.0 - x : 0.0;
+}
+
+
+/***************************************
+ * Cubic convolution with a = -0.5 (Keys)
+ ***************************************/
+
+static double
+bicubic_filter( double x )
+{
+    x = fabs( x );
+
+    if ( x < 1.0 )
+        return ( 1.5 * x - 2.5 ) * x * x + 1.0;
+    if ( x < 2.0 )
+        return ( ( -0.5 * x + 2.5 ) * x - 4.0 ) * x + 2.0;
+    return 0.0;
+}
+
+
+/***************************************
+ ***************************************/
+
+static double
+lanczos3_filter( double x )
+{
+    x = fabs( x );
+
+    if ( x < 1.0e-6 )
+        return 1.0;
+    if ( x >= 3.0 )
+        return 0.0;
+
+    x *= M_PI;
+    return 3.0 * sin( x ) * sin( x / 3.0 ) / ( x * x );
+}
+
+
+/***************************************
+ * Sets up the weights for scaling n source pixels to nn pixels. When
+ * shrinking the filter gets widened to avoid aliasing.
+ ***************************************/
+
+static int
+make_scale_table( SCALE_TABLE        * t,
+                  int                  n,
+                  int                  nn,
+                  const SCALE_FILTER * f )
+{
+    double scale = ( double ) nn / n,
+           fscale = FL_min( scale, 1.0 ),
+           support = f->support / fscale,
+           center,
+           sum;
+    float *w;
+    int i,
+        j,
+        first;
+
+    t->taps = FL_min( ( int ) ceil( 2 * support ) + 1, n );
+    t->start = fl_malloc( nn * sizeof *t->start );
+    t->weight = fl_calloc( nn * t->taps, sizeof *t->weight );
+
+    if ( ! t->start || ! t->weight )
+        return -1;
+
+    for ( i = 0; i < nn; i++ )
+    {
+        w = t->weight + i * t->taps;
+
+        /* Pixel centers are at half-integer positions */
+
+        center = ( i + 0.5 ) / scale;
+        first = floor( center - support - 0.5 );
+        t->start[ i ] = FL_clamp( first, 0, n - t->taps );
+
+        /* Source pixels beyond the border are replaced by the border
+           pixel, so their weights get added to that one */
+
+        for ( sum = 0.0, j = first; j + 0.5 - center <= support; j++ )
+        {
+            double v = f->func( ( j + 0.5 - center ) * fscale );
+            int k = FL_clamp( j, 0, n - 1 ) - t->start[ i ];
+
+            if ( k >= 0 && k < t->taps )
+            {
+                w[ k ] += v;
+                sum += v;
+            }
+        }
+
+        if ( sum != 0.0 )
+            for ( j = 0; j < t->taps; j++ )
+                w[ j ] /= sum;
+    }
+
+    return 0;
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+free_scale_table( SCALE_TABLE * t )
+{
+    fli_safe_free( t->start );
+    fli_safe_free( t->weight );
+}
+
+
+/***************************************
+ * Applies the column weights to a source row
+ ***************************************/
+
+static void
+scale_row( const SCALE_JOB * job,
+           int               c,
+           int               row,
+           float           * out )
+{
+    const float *w = job->xt.weight;
+    int taps = job->xt.taps,
+        i,
+        k;
+
+    if ( job->is_gray )
+    {
+        const unsigned short *s = ( ( unsigned short ** ) job->om[ c ] )[ row ];
+
+        for ( i = 0; i < job->nw; i++, w += taps )
+        {
+            const unsigned short *p = s + job->xt.start[ i ];
+            float v = 0.0f;
+
+            for ( k = 0; k < taps; k++ )
+                v += w[ k ] * p[ k ];
+            out[ i ] = v;
+        }
+    }
+    else
+    {
+        const unsigned char *s = ( ( unsigned char ** ) job->om[ c ] )[ row ];
+
+        for ( i = 0; i < job->nw; i++, w += taps )
+        {
+            const unsigned char *p = s + job->xt.start[ i ];
+            float v = 0.0f;
+
+            for ( k = 0; k < taps; k++ )
+                v += w[ k ] * p[ k ];
+            out[ i ] = v;
+        }
+    }
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+store_scaled_row( const SCALE_JOB * job,
+                  int               c,
+                  int               row,
+                  const float     * acc )
+{
+    int i,
+        v;
+
+    if ( job->is_gray )
+    {
+        unsigned short *d = ( ( unsigned short ** ) job->nm[ c ] )[ row ];
+
+        for ( i = 0; i < job->nw; i++ )
+        {
+            v = acc[ i ] + 0.5f;
+            d[ i ] = FL_clamp( v, 0, job->maxval );
+        }
+    }
+    else
+    {
+        unsigned char *d = ( ( unsigned char ** ) job->nm[ c ] )[ row ];
+
+        for ( i = 0; i < job->nw; i++ )
+        {
+            v = acc[ i ] + 0.5f;
+            d[ i ] = FL_clamp( v, 0, job->maxval );
+        }
+    }
+}
+
+
+/***************************************
+ * Computes the output rows [first, last), possibly in another thread
+ ***************************************/
+
+static int
+scale_rows( int    first,
+            int    last,
+            int    index,
+            void * data )
+{
+    SCALE_JOB *job = data;
+    const SCALE_TABLE *yt = &job->yt;
+    float *tmp,
+          *acc;
+    int row,
+        end,
+        r0,
+        nr,
+        c,
+        i,
+        k;
+
+    if ( first >= last )
+        return 0;
+
+    /* Number of source rows a band of output rows may depend on */
+
+    for ( nr = 0, row = first; row < last; row += SCALE_BAND )
+    {
+        end = FL_min( row + SCALE_BAND, last );
+        nr = FL_max( nr, yt->start[ end - 1 ] + yt->taps - yt->start[ row ] );
+    }
+
+    acc = fl_malloc( job->nw * sizeof *acc );
+    tmp = fl_malloc( nr * job->nw * sizeof *tmp );
+
+    if ( ! acc || ! tmp )
+    {
+        fli_safe_free( acc );
+        fli_safe_free( tmp );
+        return -1;
+    }
+
+    for ( row = first; row < last; row = end )
+    {
+        end = FL_min( row + SCALE_BAND, last );
+        r0 = yt->start[ row ];
+        nr = yt->start[ end - 1 ] + yt->taps - r0;
+
+        for ( c = 0; c < job->comp; c++ )
+        {
+            for ( i = 0; i < nr; i++ )
+                scale_row( job, c, r0 + i, tmp + i * job->nw );
+
+            for ( i = row; i < end; i++ )
+            {
+                const float *w = yt->weight + i * yt->taps;
+                const float *t = tmp + ( yt->start[ i ] - r0 ) * job->nw;
+
+                memset( acc, 0, job->nw * sizeof *acc );
+
+                for ( k = 0; k < yt->taps; k++, t += job->nw )
+                {
+                    float wk = w[ k ];
+                    int j;
+
+                    if ( wk == 0.0f )
+                        continue;
+
+                    for ( j = 0; j < job->nw; j++ )
+                        acc[ j ] += wk * t[ j ];
+                }
+
+                store_scaled_row( job, c, i, acc );
+            }
+        }
+
+        if ( index == 0 )
+        {
+            job->im->completed = ( long ) end * job->nh / last;
+            job->im->visual_cue( job->im, "Scaling" );
+        }
+    }
+
+    fl_free( acc );
+    fl_free( tmp );
+    return 0;
+}
+
+
+/***************************************
+ * Parameter im is also used for reporting
+ ***************************************/
+
+static int
+image_resample( void     * om[ ],
+                void     * nm[ ],
+                int        h,
+                int        w,
+                int        nh,
+                int        nw,
+                int        comp,
+                int        option,
+                FL_IMAGE * im )
+{
+    static const SCALE_FILTER bilinear = { bilinear_filter, 1.0 },
+                              bicubic  = { bicubic_filter,  2.0 },
+                              lanczos3 = { lanczos3_filter, 3.0 };
+    const SCALE_FILTER *f;
+    SCALE_JOB job;
+    int i,
+        status = -1;
+
+    if ( option & FLIMAGE_LANCZOS )
+        f = &lanczos3;
+    else if ( option & FLIMAGE_BICUBIC )
+        f = &bicubic;
+    else
+        f = &bilinear;
+
+    memset( &job, 0, sizeof job );
+
+    for ( i = 0; i < comp; i++ )
+    {
+        job.om[ i ] = om[ i ];
+        job.nm[ i ] = nm[ i ];
+    }
+
+    job.comp    = comp;
+    job.is_gray = FL_IsGray( im->type );
+    job.maxval  = job.is_gray ? im->gray_maxval : FL_PCMAX;
+    job.w       = w;
+    job.h       = h;
+    job.nw      = nw;
+    job.nh      = nh;
+    job.im      = im;
+
+    if (    make_scale_table( &job.xt, w, nw, f ) == 0
+         && make_scale_table( &job.yt, h, nh, f ) == 0 )
+        status = flimage_run_rows( nh, SCALE_MIN_ROWS, scale_rows, &job );
+
+    free_scale_table( &job.xt );
+    free_scale_table( &job.yt );
+
+    return status;
+}
+
+
 /***************************************
  ***************************************/
 
@@ -207,9 +599,11 @@ flimage_scale( FL_IMAGE * im,
                int        nh,
                int        option )
 {
-    void *om[ 3 ],
-         *nm[ 3 ] = { 0, 0, 0 };
-    int err = 0,
+    void *om[ 4 ],
+         *nm[ 4 ] = { 0, 0, 0, 0 };
+    int filter = option & ( FLIMAGE_BILINEAR | FLIMAGE_BICUBIC
+                            | FLIMAGE_LANCZOS ),
+        err = 0,
         comp;
 
     if ( ! im || im->w <= 0 || im->type == FL_IMAGE_NONE )
@@ -220,6 +614,11 @@ flimage_scale( FL_IMAGE * im,
     if ( im->w == nw && im->h == nh )
         return 0;
 
+    /* The filters all do subpixel sampling */
+
+    if ( filter )
+        option |= FLIMAGE_SUBPIXEL;
+
     /* Convert to RGB only if subpixel and not gray */
 
     if ( option & FLIMAGE_SUBPIXEL )
@@ -248,20 +647,36 @@ flimage_scale( FL_IMAGE * im,
 
         /* For size fitting, we don't need allocate pixels here */
 
+        /* All pixels get written, so the planes needn't be cleared */
+
         if ( ! ( option & FLIMAGE_ASPECT ) )
         {
+            unsigned int esize = sizeof **im->red;
+
             err =    err
-                  || ! ( nm[ 0 ] = fl_get_matrix( nh, nw, sizeof **im->red ) )
-                  || ! ( nm[ 1 ] = fl_get_matrix( nh, nw, sizeof **im->red ) )
-                  || ! ( nm[ 2 ] = fl_get_matrix( nh, nw, sizeof **im->red ) );
+                  || ! ( nm[ 0 ] = fl_get_matrix_ex( nh, nw, esize, 0 ) )
+                  || ! ( nm[ 1 ] = fl_get_matrix_ex( nh, nw, esize, 0 ) )
+                  || ! ( nm[ 2 ] = fl_get_matrix_ex( nh, nw, esize, 0 ) );
         }
 
         comp = 3;
+
+        /* Only the resampler keeps the alpha channel */
+
+        if ( filter && im->alpha && ! ( option & FLIMAGE_ASPECT ) )
+        {
+            om[ 3 ] = im->alpha;
+            err = err || ! ( nm[ 3 ] = fl_get_matrix_ex( nh, nw,
+                                                         sizeof **im->alpha,
+                                                         0 ) );
+            comp = 4;
+        }
     }
     else
     {
         om[ 0 ] = FL_IsGray( im->type ) ? im->gray : im->ci;
-        err = err || ! ( nm[ 0 ] = fl_get_matrix( nh, nw, sizeof **im->gray ) );
+        err = err || ! ( nm[ 0 ] = fl_get_matrix_ex( nh, nw,
+                                                     sizeof **im->gray, 0 ) );
         om[ 1 ] = nm[ 1 ] = om[ 2 ] = nm[ 2 ] = 0;
         comp = 1;
     }
@@ -272,6 +687,7 @@ flimage_scale( FL_IMAGE * im,
         fl_free_matrix( nm[ 0 ]);
         fl_free_matrix( nm[ 1 ]);
         fl_free_matrix( nm[ 2 ]);
+        fl_free_matrix( nm[ 3 ]);
         im->modified = 1;
         return -1;
     }
@@ -281,8 +697,9 @@ flimage_scale( FL_IMAGE * im,
 
     if ( option & FLIMAGE_ASPECT )
     {
-        static float m[ 2 ][ 2 ];
+        float m[ 2 ][ 2 ];
 
+        m[ 0 ][ 1 ] = m[ 1 ][ 0 ] = 0.0;
         m[ 0 ][ 0 ] = ( float ) nw / im->w;
         m[ 1 ][ 1 ] = ( float ) nh / im->h;
 
@@ -293,6 +710,9 @@ flimage_scale( FL_IMAGE * im,
         im->visual_cue( im, "Scaling Done" );
         return err;
     }
+    else if ( filter )
+        err = image_resample( om, nm, im->h, im->w, nh, nw, comp, option,
+                              im ) < 0;
     else if ( option & FLIMAGE_SUBPIXEL )
         err = image_scale( om, nm, im->h, im->w, nh, nw, comp, im ) < 0;
     else
@@ -301,11 +721,23 @@ flimage_scale( FL_IMAGE * im,
     if ( ! err )
     {
         flimage_replace_image( im, nw, nh, nm[ 0 ], nm[ 1 ], nm[ 2 ] );
+
+        if ( nm[ 3 ] )
+        {
+            memcpy( im->alpha[ 0 ], ( ( unsigned char ** ) nm[ 3 ] )[ 0 ],
+                    nw * nh * sizeof **im->alpha );
+            fl_free_matrix( nm[ 3 ] );
+        }
+
         im->completed = im->h;
         im->visual_cue( im, "Scaling Done" );
     }
     else
     {
+        fl_free_matrix( nm[ 0 ] );
+        fl_free_matrix( nm[ 1 ] );
+        fl_free_matrix( nm[ 2 ] );
+        fl_free_matrix( nm[ 3 ] );
         im->visual_cue( im, "Scaling failed" );
         im->error_message( im, "Scaling failed" );
     }
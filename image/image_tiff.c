@@ -60,7 +60,7 @@ typedef struct
 } TIFFTag;
 
 
-static TIFFTag *find_tag( int );
+#define NUM_TAGS    19  /* interesting tags, including the sentinel */
 
 typedef struct
 {
@@ -85,8 +85,14 @@ typedef struct
     int offset_offset;
     int bytecount_offset;
     int max_tags;
+    TIFFTag tags[ NUM_TAGS ];   /* values of the tags of the current IFD */
 } SPEC;
 
+static TIFFTag *find_tag( SPEC *,
+                          int );
+static void init_tags( SPEC * );
+static void free_tags( SPEC * );
+
 static void initialize_tiff_io( SPEC *,
                                 int );
 
@@ -122,6 +128,7 @@ TIFF_description( FL_IMAGE * im )
     im->io_spec = sp;
     im->spec_size = sizeof *sp;
     sp->image = im;
+    init_tags( sp );
 
     if ( fread( buf, 1, 4, fp ) != 4 )
     {
@@ -151,6 +158,7 @@ TIFF_description( FL_IMAGE * im )
 
     if ( get_image_info_from_ifd( im ) < 0 )
     {
+        free_tags( sp );
         fl_free( sp );
         im->io_spec = NULL;
         im->spec_size = 0;
@@ -173,6 +181,7 @@ static int
 TIFF_readpixels( FL_IMAGE * im )
 {
     SPEC *sp = im->io_spec;
+    int status;
 
     load_tiff_colormap( im );
 
@@ -183,7 +192,13 @@ TIFF_readpixels( FL_IMAGE * im )
 
     im->more = sp->ifd_offset != 0;
 
-    return read_pixels(im);
+    status = read_pixels( im );
+
+    /* the tags get read again with the next IFD */
+
+    free_tags( sp );
+
+    return status;
 }
 
 
@@ -261,6 +276,7 @@ TIFF_write( FL_IMAGE * image )
     sp->endian = machine_endian( );
 
     initialize_tiff_io( sp, sp->endian );
+    init_tags( sp );
 
     fwrite( sp->endian == LSBFirst ? "II" : "MM", 1, 2, fp );
     sp->write2bytes( 42, fp );
@@ -370,9 +386,11 @@ enum
     kDouble   = 12
 };
 
-/* type is used for writing only */
+/* Template for the tag tables in the SPEC structures, type is used for
+   writing only. junkBuffer gets never written to, it's just a value of
+   0 for tags not found in a file */
 
-TIFFTag interestedTags[ ] =
+static const TIFFTag interestedTags[ NUM_TAGS ] =
 {
     NV( ImageWidth,      kUShort ),
     NV( ImageHeight,     kUShort ),
@@ -397,24 +415,53 @@ TIFFTag interestedTags[ ] =
     NV( 0,               kShort  )
 };
 
-static TIFFTag *
-
 /***************************************
  ***************************************/
 
-find_tag( int val )
+static TIFFTag *
+find_tag( SPEC * sp,
+          int    val )
 {
     TIFFTag *tag;
 
     /* if tags are more than about 20, binary search may be better */
 
-    for ( tag = interestedTags; tag->tag_value && tag->tag_value != val; tag++ )
+    for ( tag = sp->tags; tag->tag_value && tag->tag_value != val; tag++ )
         /* empty */ ;
 
     return tag->tag_value ? tag : 0;    /* &stag; */
 }
 
 
+/***************************************
+ * Sets up the table of tags of a SPEC structure. Each image (and each
+ * output stream) has one of its own, so several files can be read and
+ * written at the same time.
+ ***************************************/
+
+static void
+init_tags( SPEC * sp )
+{
+    memcpy( sp->tags, interestedTags, sizeof sp->tags );
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+free_tags( SPEC * sp )
+{
+    TIFFTag *tag;
+
+    for ( tag = sp->tags; tag->tag_value; tag++ )
+        if ( tag->value != &junkBuffer )
+            fl_free( tag->value );
+
+    init_tags( sp );
+}
+
+
 /***************************************
  * convert tag value to image value
  ***************************************/
@@ -426,14 +473,14 @@ get_image_info_from_ifd( FL_IMAGE * im )
     SPEC *sp = im->io_spec;
     int i;
 
-    if ( ! ( tag = find_tag( ImageWidth ) ) )
+    if ( ! ( tag = find_tag( sp, ImageWidth ) ) )
     {
         flimage_error( im, "Bad ImageWidth tag" );
         return -1;
     }
     im->w = tag->value[ 0 ];
 
-    if ( ! ( tag = find_tag( ImageHeight ) ) )
+    if ( ! ( tag = find_tag( sp, ImageHeight ) ) )
     {
         flimage_error( im, "Bad ImageLength tag" );
         return -1; 
@@ -446,10 +493,10 @@ get_image_info_from_ifd( FL_IMAGE * im )
         return -1;
     }
 
-    if ( ! ( sp->spp = find_tag( SamplesPerPixel )->value[ 0 ] ) )
+    if ( ! ( sp->spp = find_tag( sp, SamplesPerPixel )->value[ 0 ] ) )
         sp->spp = 1;
 
-    tag = find_tag( BitsPerSample );
+    tag = find_tag( sp, BitsPerSample );
 
     for ( i = 0; i < sp->spp; i++ )
     {
@@ -460,7 +507,7 @@ get_image_info_from_ifd( FL_IMAGE * im )
         }
     }
 
-    tag = find_tag( PhotometricI );
+    tag = find_tag( sp, PhotometricI );
 
     switch ( tag->value[ 0 ] )
     {
@@ -476,7 +523,7 @@ get_image_info_from_ifd( FL_IMAGE * im )
 
         case PhotoPalette :
             im->type = FL_IMAGE_CI;
-            if ( ( im->map_len = find_tag( ColorMap )->count / 3 ) <= 0 )
+            if ( ( im->map_len = find_tag( sp, ColorMap )->count / 3 ) <= 0 )
             {
                 flimage_error( im, "Colormap is missing for PhotoPalette" );
                 return -1;
@@ -488,7 +535,8 @@ get_image_info_from_ifd( FL_IMAGE * im )
             break;
     }
 
-    if ( im->type == FL_IMAGE_GRAY16 && ( tag = find_tag( MaxSampleValue ) ) )
+    if (    im->type == FL_IMAGE_GRAY16
+         && ( tag = find_tag( sp, MaxSampleValue ) ) )
         im->gray_maxval = tag->value[ 0 ];
     else
         im->gray_maxval = ( 1 << sp->bps[ 0 ] ) - 1;
@@ -496,7 +544,10 @@ get_image_info_from_ifd( FL_IMAGE * im )
     return 0;
 }
 
-static int typeSize[ 13 ];
+static const int typeSize[ 13 ] =
+{
+    0, 1, 1, 2, 4, 8, 1, 0, 2, 4, 8, 4, 8
+};
 
 
 /***************************************
@@ -507,19 +558,6 @@ static void
 initialize_tiff_io( SPEC * sp,
                     int    endian )
 {
-    if ( ! typeSize[ kUByte ] )
-    {
-        /* initialize the typeSize                       */
-
-        typeSize[ kUByte ] = typeSize[ SBYTE ] = 1;
-        typeSize[ ASCII ] = 1;
-        typeSize[ kShort ] = typeSize[ kUShort ] = 2;
-        typeSize[ kLong ] = typeSize[ kULong ] = 4;
-        typeSize[ RATIONAL ] = typeSize[ SRATIONAL ] = 8;
-        typeSize[ kFloat ] = 4;
-        typeSize[ kDouble ] = 8;
-    }
-
     /* initialize the functions that reads various types */
 
     sp->readit[ kUByte ] = sp->readit[SBYTE] = fgetc;
@@ -561,7 +599,7 @@ read_tag( FILE * fp,
     fseek( fp, offset, SEEK_SET );
 
     tag_val = sp->read2bytes( fp );
-    if ( ! ( tag = find_tag( tag_val ) ) )
+    if ( ! ( tag = find_tag( sp, tag_val ) ) )
     {
 #if TIFF_DEBUG
         fprintf( stderr, "Unsupported tag 0x%x(%d)\n", tag_val, tag_val );
@@ -622,6 +660,8 @@ read_tiff_ifd( FILE * fp,
         i;
     TIFFTag *tag;
 
+    free_tags( sp );
+
     fseek( fp, sp->ifd_offset, SEEK_SET );
 
     num_tags = sp->read2bytes( fp );
@@ -637,7 +677,7 @@ read_tiff_ifd( FILE * fp,
 
     /* validate the tags (sort of) */
 
-    if ( ! ( tag = find_tag( BitsPerSample ) )->count )
+    if ( ! ( tag = find_tag( sp, BitsPerSample ) )->count )
         return -1;
 
     if (    tag->value[ 0 ] != 1
@@ -651,7 +691,7 @@ read_tiff_ifd( FILE * fp,
     }
 
 #if TIFF_DEBUG
-    for ( tag = interestedTags; tag->tag_value; tag++ )
+    for ( tag = sp->tags; tag->tag_value; tag++ )
     {
         if ( tag->count )
             fprintf( stderr, "%s\t count=%2d\t val=%d\n",
@@ -730,7 +770,7 @@ read_pixels( FL_IMAGE * im )
     unsigned short *sbuf;
     FILE *fp = im->fpin;
 
-    rowsPerStripTag = find_tag( RowsPerStrip );
+    rowsPerStripTag = find_tag( sp, RowsPerStrip );
 
     if ( ( val = rowsPerStripTag->value[ 0 ] ) <= 0 )
     {
@@ -738,7 +778,7 @@ read_pixels( FL_IMAGE * im )
         return -1;
     }
 
-    if (    ( compress = find_tag( Compression )->value[ 0 ] )
+    if (    ( compress = find_tag( sp, Compression )->value[ 0 ] )
          && compress != Uncompressed )
     {
         flimage_error( im, "can't handled compressed TIF" );
@@ -746,7 +786,7 @@ read_pixels( FL_IMAGE * im )
     }
 
     nstrips = ( im->h + val - 1 ) / val;
-    bytecountTag = find_tag( StripByteCount );
+    bytecountTag = find_tag( sp, StripByteCount );
 
     if ( nstrips != bytecountTag->count )
     {
@@ -754,9 +794,10 @@ read_pixels( FL_IMAGE * im )
         return -1;
     }
 
-    bpl = ( im->w * sp->spp * find_tag( BitsPerSample )->value[ 0 ] + 7 ) / 8;
+    bpl =   ( im->w * sp->spp * find_tag( sp, BitsPerSample )->value[ 0 ] + 7 )
+          / 8;
     rps = rowsPerStripTag->value[ 0 ];
-    tag = find_tag( StripOffsets );
+    tag = find_tag( sp, StripOffsets );
 
     if ( ! ( tmpbuffer = fl_malloc( bytecountTag->value[ 0 ] + 4 ) ) )
     {
@@ -838,7 +879,7 @@ read_pixels( FL_IMAGE * im )
         }
         else if ( sp->spp == 3 || sp->spp == 4 )
         {
-            int config = find_tag( PlannarConfig )->value[ 0 ];
+            int config = find_tag( sp, PlannarConfig )->value[ 0 ];
 
             if ( sp->bps[ 0 ] == 8 )
             {
@@ -889,9 +930,9 @@ read_pixels( FL_IMAGE * im )
 
     fl_free( tmpbuffer );
 
-    if ( find_tag(BitsPerSample)->value[ 0 ] == 1 )
+    if ( find_tag( sp, BitsPerSample )->value[ 0 ] == 1 )
     {
-        int b = find_tag( PhotometricI )->value[0] != PhotoBW0Black;
+        int b = find_tag( sp, PhotometricI )->value[0] != PhotoBW0Black;
         im->red_lut[ b ] = im->green_lut[ b ] = im->blue_lut[ b ] = 0;
         im->red_lut[ ! b ] = im->green_lut[ ! b ] = im->blue_lut[ ! b ] =
                                                                       FL_PCMAX;
@@ -913,8 +954,8 @@ static int
 load_tiff_colormap( FL_IMAGE * im )
 {
     FILE *fp = im->fpin;
-    TIFFTag *tag = find_tag( ColorMap );
     SPEC *sp = im->io_spec;
+    TIFFTag *tag = find_tag( sp, ColorMap );
 
     if ( ! tag->count )
         return 0;
@@ -1003,7 +1044,7 @@ write_tag( FILE * fp,
     TIFFTag *tag;
     int i;
 
-    tag = find_tag( tag_val );
+    tag = find_tag( sp, tag_val );
     sp->write2bytes( tag_val, fp );
     sp->write2bytes( tag->type, fp );
     sp->write4bytes( count, fp );
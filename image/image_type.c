@@ -57,9 +57,8 @@ spline_int_interpolate( const int * wx,
            a,
            b,
            x;
-    static int nwork = 0;
-    static double *y2 = NULL,
-                  *u = NULL;
+    double *y2,
+           *u;
 
     if ( nin <= 3 )
     {
@@ -67,12 +66,9 @@ spline_int_interpolate( const int * wx,
         return -1;
     }
 
-    if ( nwork < nin )
-    {
-        y2 = fl_realloc( y2, nin * sizeof *y2 );
-        u = fl_realloc( u, nin * sizeof *u );
-        nwork = nin;
-    }
+    if ( ! ( y2 = fl_malloc( 2 * nin * sizeof *y2 ) ) )
+        return -1;
+    u = y2 + nin;
 
     y2[ 0 ] = u[ 0 ] = 0.0;
 
@@ -141,6 +137,8 @@ spline_int_interpolate( const int * wx,
     }
 
     y[ nout - 1 ] = wy[ nin - 1 ];
+
+    fl_free( y2 );
     return nout;
 }
 
@@ -507,8 +505,8 @@ enum
     DITHER_THRESHOLD
 };
 
-static int dither_method = FS_DITHER;
-static int dither_threshold = ( 1 << FL_PCBITS ) / 2;
+static const int dither_method = FS_DITHER;
+static const int dither_threshold = ( 1 << FL_PCBITS ) / 2;
 
 
 /***************************************
@@ -539,7 +537,11 @@ fs_dither( unsigned short ** mat,
 
     tmp = fl_get_matrix( h + 1, w, sizeof **tmp );
 
-    spline_int_interpolate( x, y, 4, 1, lut );
+    if ( ! tmp || spline_int_interpolate( x, y, 4, 1, lut ) < 0 )
+    {
+        fl_free_matrix( tmp );
+        return -1;
+    }
 
     for ( ras = mat[ 0 ], curr = tmp[ 0 ], n = h * w; --n >= 0; ras++, curr++ )
         *curr = lut[ *ras ];
@@ -590,9 +592,6 @@ gray_to_mono( FL_IMAGE * im )
                    *end;
     int status = 0;
 
-    if ( dither_threshold <= 0 )
-        dither_threshold = ( 1 << FL_PCBITS ) / 2;
-
     if ( dither_method == FS_DITHER )
         status = fs_dither( im->gray, im->h, im->w, outm );
     else if ( dither_method == DITHER_THRESHOLD )
@@ -612,6 +611,8 @@ gray_to_mono( FL_IMAGE * im )
         im->red_lut[ 0 ] = im->green_lut[ 0 ] = im->blue_lut[ 0 ] = FL_PCMAX;
         im->red_lut[ 1 ] = im->green_lut[ 1 ] = im->blue_lut[ 1 ] = 0;
     }
+    else
+        fl_free_matrix( outm );
 
     return status;
 }
@@ -628,7 +629,7 @@ gray16_to_mono( FL_IMAGE * im )
     unsigned short **gray,
                    **save = im->gray;
 
-    if ( ! ( gray = fl_get_matrix( im->h, im->w, sizeof **gray ) ) )
+    if ( ! ( gray = fl_get_matrix_ex( im->h, im->w, sizeof **gray, 0 ) ) )
         return -1;
 
     scale_gray16( save[ 0 ], gray[ 0 ], im->gray_maxval, im->w * im->h );
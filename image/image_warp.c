@@ -32,378 +32,358 @@
 #include "flimage.h"
 #include "flimage_int.h"
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+
+
+/***********************************************************************
+ * The output image is done in tiles of WARP_TILE x WARP_TILE pixels,
+ * so that the source pixels needed for a tile (which, e.g. for a
+ * rotation, lie along a slanted band) still are in the cache when the
+ * next line of the tile is done. Within a line of a tile the source
+ * coordinates are stepped incrementally in fixed point, starting from
+ * the exact position at the start of each line. As many fractional
+ * bits as possible (up to 16) are used, only for really large images
+ * fewer are needed to keep the coordinates from overflowing a long.
+ * Bands of tile rows are done in parallel.
+ ***********************************************************************/
+
+#define WARP_TILE   64
+#define FIX_WBITS   8            /* bits of the interpolation weights */
+
+typedef struct {
+    void     * in[ 3 ];          /* unsigned short ** for 1 component, */
+    void     * out[ 3 ];         /* unsigned char ** for 3 (RGB)       */
+    int        comp;
+    int        w,
+               h,
+               nw,
+               nh;
+    float      m[ 2 ][ 2 ];      /* maps output to input coordinates */
+    int        shift[ 2 ];
+    int        fill[ 3 ];
+    int        subp;
+    int        fbits;            /* fractional bits of the coordinates */
+    FL_IMAGE * im;
+} WARP_JOB;
 
 
 /***************************************
- * linear interpolation
+ * Returns the (truncated) position of a pixel for nearest neighbour
+ * sampling or -1 if it's outside of the image of size 'n'
  ***************************************/
 
-static void
-interpol2d_short( unsigned short  * out,
-                  float             y,
-                  float             x,
-                  unsigned short ** mat,
-                  int               nrow,
-                  int               ncol,
-                  unsigned int      fill )
+static int
+fix_to_index( long fx,
+              int  n,
+              int  fbits )
 {
-    float wx,
-          wy,
-          wx1;
-    int s00,
-        s01,
-        s10,
-        s11,
-        ix,
-        iy;
-
-    if ( x <= -1.0 || y <= -1.0 || x >= ncol || y >= nrow )
-    {
-        *out = fill;
-        return;
-    }
-
-    /* we need to fake one row/column of samples outside of the image to
-       make the boundary look nice */
-
-    ix = x < 0 ? -1 : x;
-    iy = y < 0 ? -1 : y;
-
-    /* here we use extra samples outside of the image */
-
-    s00 = ( ix >= 0 && iy >= 0) ? mat[ iy ][ ix ] : fill;
-    s10 = ( ix < ncol - 1 && iy >= 0 ) ? mat[ iy ][ ix + 1 ] : fill;
-    s01 = ( ix >= 0 && iy < nrow - 1 ) ? mat[ iy + 1 ][ ix ] : fill;
-    s11 = ( ix < ncol - 1 && iy < nrow - 1 ) ? mat[ iy + 1 ][ ix + 1 ] : fill;
+    long one = 1L << fbits;
+    int i;
 
-    /* weights */
+    fx += one / 10;
 
-    wx = x - ix;
-    wy = y - iy;
-    wx1 = 1.0 - wx;
+    if ( fx <= -one )
+        return -1;
 
-    *out =   ( s00 * wx1 + s10 * wx ) * ( 1.0 - wy )
-           + ( s01 * wx1 + s11 * wx ) * wy + 0.1;
+    i = fx < 0 ? 0 : fx >> fbits;
 
-    return;
+    return i < n ? i : -1;
 }
 
 
 /***************************************
- * linear interpolation
+ * Bilinear interpolation between the four samples. The weights have
+ * FIX_WBITS bits, so even with 16 bit samples everything fits into an
+ * unsigned int. The result is rounded to the nearest value (versions
+ * before the tiled code truncated it, so most interpolated pixels now
+ * come out one or two units higher than they used to).
  ***************************************/
 
-static void
-interpol2d_uc( int              out[ 3 ],
-               float            y,
-               float            x,
-               unsigned char ** r,
-               unsigned char ** g,
-               unsigned char ** b,
-               int              nrow,
-               int              ncol,
-               int              fill[ ] )
-{
-    int ix,
-        iy;
-    float wx,
-          wy,
-          wx1,
-          wy1;
-    int s00[ 3 ],
-        s01[ 3 ],
-        s10[ 3 ],
-        s11[ 3 ];
-
-    if ( x <= -1.0f || y <= -1.0f || x >= ncol || y >= nrow )
-    {
-        out[ 0 ] = fill[ 0 ];
-        out[ 1 ] = fill[ 1 ];
-        out[ 2 ] = fill[ 2 ];
-        return;
-    }
-
-    ix = x < 0.0 ? -1 : ( int ) x;
-    iy = y < 0.0 ? -1 : ( int ) y;
+#define BILINEAR( s00, s10, s01, s11, wx, wy )                          \
+    ( (   ( ( s00 ) * ( ( 1 << FIX_WBITS ) - ( wx ) ) + ( s10 ) * ( wx ) ) \
+          * ( ( 1 << FIX_WBITS ) - ( wy ) )                             \
+        + ( ( s01 ) * ( ( 1 << FIX_WBITS ) - ( wx ) ) + ( s11 ) * ( wx ) ) \
+          * ( wy )                                                      \
+        + ( 1U << ( 2 * FIX_WBITS - 1 ) ) ) >> ( 2 * FIX_WBITS ) )
 
-    /* we need to fake one row/column of samples outside of the image to
-       make the boundary look nice */
 
-    if ( ix >= 0 && iy >= 0 )
-    {
-        s00[ 0 ] = r[ iy ][ ix ];
-        s00[ 1 ] = g[ iy ][ ix ];
-        s00[ 2 ] = b[ iy ][ ix ];
-    }
-    else
-    {
-        s00[ 0 ] = fill[ 0 ];
-        s00[ 1 ] = fill[ 1 ];
-        s00[ 2 ] = fill[ 2 ];
-    }
-
-    if ( ix < ncol - 1 && iy >= 0 )
-    {
-        s10[ 0 ] = r[ iy ][ ix + 1 ];
-        s10[ 1 ] = g[ iy ][ ix + 1 ];
-        s10[ 2 ] = b[ iy ][ ix + 1 ];
-    }
-    else
-    {
-        s10[ 0 ] = fill[ 0 ];
-        s10[ 1 ] = fill[ 1 ];
-        s10[ 2 ] = fill[ 2 ];
-    }
-
-    if ( ix >= 0 && iy < nrow - 1 )
-    {
-        s01[ 0 ] = r[ iy + 1 ][ ix ];
-        s01[ 1 ] = g[ iy + 1 ][ ix ];
-        s01[ 2 ] = b[ iy + 1 ][ ix ];
-    }
-    else
-    {
-        s01[ 0 ] = fill[ 0 ];
-        s01[ 1 ] = fill[ 1 ];
-        s01[ 2 ] = fill[ 2 ];
-    }
-
-    if ( ix < ncol - 1 && iy < nrow - 1 )
-    {
-        s11[ 0 ] = r[ iy + 1 ][ ix + 1 ];
-        s11[ 1 ] = g[ iy + 1 ][ ix + 1 ];
-        s11[ 2 ] = b[ iy + 1 ][ ix + 1 ];
-    }
-    else
-    {
-        s11[ 0 ] = fill[ 0 ];
-        s11[ 1 ] = fill[ 1 ];
-        s11[ 2 ] = fill[ 2 ];
-    }
-
-    /* weights */
+/***************************************
+ * Gets the four samples around a (fixed point) position and the
+ * weights for them. Samples outside of the image are replaced by
+ * the fill value, that makes the boundary look nice. Returns 0 if
+ * the position is so far outside that only the fill value is to be
+ * used.
+ ***************************************/
 
-    wx = x - ix;
-    wy = y - iy;
-    wx1 = 1.0 - wx;
-    wy1 = 1.0 - wy;
+static int
+get_corners( const WARP_JOB * job,
+             long             fx,
+             long             fy,
+             int            * ix,
+             int            * iy,
+             unsigned int   * wx,
+             unsigned int   * wy )
+{
+    long one = 1L << job->fbits;
 
-    out[ 0 ] =   ( s00[ 0 ] * wx1 + s10[ 0 ] * wx ) * wy1
-               + ( s01[ 0 ] * wx1 + s11[ 0 ] * wx ) * wy;
-    out[ 1 ] =   ( s00[ 1 ] * wx1 + s10[ 1 ] * wx ) * wy1
-               + ( s01[ 1 ] * wx1 + s11[ 1 ] * wx ) * wy;
-    out[ 2 ] =   ( s00[ 2 ] * wx1 + s10[ 2 ] * wx ) * wy1
-               + ( s01[ 2 ] * wx1 + s11[ 2 ] * wx ) * wy;
+    if (    fx <= -one || fy <= -one
+         || fx >= job->w * one || fy >= job->h * one )
+        return 0;
 
-    if (    out[ 0 ] < 0 || out[ 0 ] > FL_PCMAX
-         || out[ 1 ] < 0 || out[ 1 ] > FL_PCMAX
-         || out[ 2 ] < 0 || out[ 2 ] > FL_PCMAX)
-    {
-        M_err( __func__, "out of range" );
-        exit( 1 );
-    }
+    *ix = fx < 0 ? -1 : fx >> job->fbits;
+    *iy = fy < 0 ? -1 : fy >> job->fbits;
+    *wx = ( fx - *ix * one ) >> ( job->fbits - FIX_WBITS );
+    *wy = ( fy - *iy * one ) >> ( job->fbits - FIX_WBITS );
 
-    return;
+    return 1;
 }
 
 
-#define Free( a )  if( a ) fl_free( a )
+#define SAMPLE( m, x, y, w, h, fill )                                   \
+    ( ( x ) >= 0 && ( y ) >= 0 && ( x ) < ( w ) && ( y ) < ( h )       \
+      ? ( unsigned int ) ( m )[ y ][ x ] : ( unsigned int ) ( fill ) )
 
 
 /***************************************
+ * Does the pixels [c0, c1) of output line 'r' of a gray or colormapped
+ * image, (fx, fy) being the source position of the first of them.
+ * Positions for which all four samples are within the image are by
+ * far the most common ones and get handled first.
  ***************************************/
 
-static int
-get_luts( float ** lutx0,
-          float ** lutx1,
-          float ** luty0,
-          float ** luty1,
-          float    m[ ][ 2 ],
-          int      shift[ ],
-          int      w,
-          int      h )
+static void
+warp_span_short( const WARP_JOB * job,
+                 int              r,
+                 int              c0,
+                 int              c1,
+                 long             fx,
+                 long             fy,
+                 long             dx,
+                 long             dy )
 {
-    int i,
-        err = 0;
-
-    *lutx0 = *luty0 = *lutx1 = *luty1 = NULL;
-    err =    ! ( *lutx0 = fl_malloc( sizeof **lutx0 * ( w + 1 ) ) )
-          || ! ( *luty0 = fl_malloc( sizeof **luty0 * ( w + 1 ) ) )
-          || ! ( *lutx1 = fl_malloc( sizeof **lutx1 * ( h + 1 ) ) )
-          || ! ( *luty1 = fl_malloc( sizeof **luty1 * ( h + 1 ) ) );
-
-    if ( err )
+    unsigned short **in = job->in[ 0 ],
+                   *out = ( ( unsigned short ** ) job->out[ 0 ] )[ r ];
+    unsigned int fill = job->fill[ 0 ];
+    int fbits = job->fbits,
+        wshift = fbits - FIX_WBITS,
+        w = job->w,
+        h = job->h,
+        c;
+    unsigned long xlim = ( unsigned long ) ( w - 1 ) << fbits,
+                  ylim = ( unsigned long ) ( h - 1 ) << fbits;
+
+    for ( c = c0; c < c1; c++, fx += dx, fy += dy )
     {
-        Free( *lutx0 );
-        Free( *luty0 );
-        Free( *lutx1 );
-        Free( *luty1 );
-        return -1;
-    }
+        int ix,
+            iy;
+        unsigned int wx,
+                     wy;
 
-    for ( i = 0; i <= w; i++ )
-    {
-        ( *lutx0 )[ i ] = m[ 0 ][ 0 ] * ( i - shift[ 0 ] );
-        ( *luty0 )[ i ] = m[ 1 ][ 0 ] * ( i - shift[ 0 ] );
-    }
-
-    for ( i = 0; i <= h; i++ )
-    {
-        ( *lutx1 )[ i ] = m[ 0 ][ 1 ] * ( i - shift[ 1 ] );
-        ( *luty1 )[ i ] = m[ 1 ][ 1 ] * ( i - shift[ 1 ] );
+        if ( ! job->subp )
+        {
+            ix = fix_to_index( fx, w, fbits );
+            iy = fix_to_index( fy, h, fbits );
+            out[ c ] = ix < 0 || iy < 0 ? fill : in[ iy ][ ix ];
+        }
+        else if ( ( unsigned long ) fx < xlim && ( unsigned long ) fy < ylim )
+        {
+            const unsigned short *p0,
+                                 *p1;
+
+            ix = fx >> fbits;
+            iy = fy >> fbits;
+            wx = ( fx >> wshift ) & ( ( 1 << FIX_WBITS ) - 1 );
+            wy = ( fy >> wshift ) & ( ( 1 << FIX_WBITS ) - 1 );
+            p0 = in[ iy ] + ix;
+            p1 = in[ iy + 1 ] + ix;
+            out[ c ] = BILINEAR( p0[ 0 ], p0[ 1 ], p1[ 0 ], p1[ 1 ], wx, wy );
+        }
+        else if ( ! get_corners( job, fx, fy, &ix, &iy, &wx, &wy ) )
+            out[ c ] = fill;
+        else
+            out[ c ] = BILINEAR( SAMPLE( in, ix,     iy,     w, h, fill ),
+                                 SAMPLE( in, ix + 1, iy,     w, h, fill ),
+                                 SAMPLE( in, ix,     iy + 1, w, h, fill ),
+                                 SAMPLE( in, ix + 1, iy + 1, w, h, fill ),
+                                 wx, wy );
     }
-
-    return 0;
 }
 
 
-#define Outside( ic, ir, w, h )    \
-( ic < 0 || ic > ( w ) - 1 || ir < 0 || ir > ( h ) - 1 )
-
-
 /***************************************
- * the short array passed in could be grayscale or color index
+ * Same for RGB images
  ***************************************/
 
-static int
-transform_short( unsigned short ** in,
-                 unsigned short ** out,
-                 int               w,
-                 int               h,
-                 int               nw,
-                 int               nh,
-                 float             m[ ][ 2 ],
-                 int               shift[ ],
-                 unsigned int      fill,
-                 int               subp,
-                 FL_IMAGE        * im)
+static void
+warp_span_rgb( const WARP_JOB * job,
+               int              r,
+               int              c0,
+               int              c1,
+               long             fx,
+               long             fy,
+               long             dx,
+               long             dy )
 {
-    float *lutx[ 2 ],
-          *luty[ 2 ];
-    int r,
+    unsigned char **in[ 3 ],
+                  *out[ 3 ];
+    int fbits = job->fbits,
+        wshift = fbits - FIX_WBITS,
+        w = job->w,
+        h = job->h,
         c,
-        ir,
-        ic;
-    float fir,
-        fic;
+        k;
+    unsigned long xlim = ( unsigned long ) ( w - 1 ) << fbits,
+                  ylim = ( unsigned long ) ( h - 1 ) << fbits;
 
-    if ( get_luts( lutx, lutx + 1, luty, luty + 1, m, shift, nw, nh ) < 0 )
-        return -1;
+    for ( k = 0; k < 3; k++ )
+    {
+        in[ k ]  = job->in[ k ];
+        out[ k ] = ( ( unsigned char ** ) job->out[ k ] )[ r ];
+    }
 
-    for ( r = 0; r < nh; r++, im->completed++ )
+    for ( c = c0; c < c1; c++, fx += dx, fy += dy )
     {
-        if ( ! ( im->completed & FLIMAGE_REPFREQ ) )
-            im->visual_cue( im, subp ? "GraySubP" : "Gray" );
+        int ix,
+            iy;
+        unsigned int wx,
+                     wy;
+
+        if ( ! job->subp )
+        {
+            ix = fix_to_index( fx, w, fbits );
+            iy = fix_to_index( fy, h, fbits );
 
-        if ( ! subp )
+            for ( k = 0; k < 3; k++ )
+                out[ k ][ c ] = ix < 0 || iy < 0 ?
+                                job->fill[ k ] : in[ k ][ iy ][ ix ];
+        }
+        else if ( ( unsigned long ) fx < xlim && ( unsigned long ) fy < ylim )
         {
-            for ( c = 0; c < nw; c++ )
+            ix = fx >> fbits;
+            iy = fy >> fbits;
+            wx = ( fx >> wshift ) & ( ( 1 << FIX_WBITS ) - 1 );
+            wy = ( fy >> wshift ) & ( ( 1 << FIX_WBITS ) - 1 );
+
+            for ( k = 0; k < 3; k++ )
             {
-                ic = lutx[ 0 ][ c ] + lutx[ 1 ][ r ] + 0.1;
-                ir = luty[ 0 ][ c ] + luty[ 1 ][ r ] + 0.1;
-                out[ r ][ c ] = Outside( ic, ir, w, h ) ? fill : in[ ir ][ ic ];
+                const unsigned char *p0 = in[ k ][ iy ] + ix,
+                                    *p1 = in[ k ][ iy + 1 ] + ix;
+
+                out[ k ][ c ] = BILINEAR( p0[ 0 ], p0[ 1 ], p1[ 0 ], p1[ 1 ],
+                                          wx, wy );
             }
         }
+        else if ( ! get_corners( job, fx, fy, &ix, &iy, &wx, &wy ) )
+        {
+            for ( k = 0; k < 3; k++ )
+                out[ k ][ c ] = job->fill[ k ];
+        }
         else
         {
-            for ( c = 0; c < nw; c++ )
+            for ( k = 0; k < 3; k++ )
             {
-                fic = lutx[ 0 ][ c ] + lutx[ 1 ][ r ];
-                fir = luty[ 0 ][ c ] + luty[ 1 ][ r ];
-                interpol2d_short( &out[ r ][ c ], fir, fic, in, h, w, fill );
+                int f = job->fill[ k ];
+
+                out[ k ][ c ] =
+                    BILINEAR( SAMPLE( in[ k ], ix,     iy,     w, h, f ),
+                              SAMPLE( in[ k ], ix + 1, iy,     w, h, f ),
+                              SAMPLE( in[ k ], ix,     iy + 1, w, h, f ),
+                              SAMPLE( in[ k ], ix + 1, iy + 1, w, h, f ),
+                              wx, wy );
             }
         }
     }
-
-    fl_free( lutx[ 0 ] );
-    fl_free( lutx[ 1 ] );
-    fl_free( luty[ 0 ] );
-    fl_free( luty[ 1 ] );
-
-    return 1;
 }
 
 
 /***************************************
+ * Returns the number of fractional bits for the source coordinates.
+ * They're largest for one of the corners of the output image.
  ***************************************/
 
 static int
-transform_rgb( unsigned char ** or,
-               unsigned char ** og,
-               unsigned char ** ob,
-               unsigned char ** nr,
-               unsigned char ** ng,
-               unsigned char ** nb,
-               int              w,
-               int              h,
-               int              nw,
-               int              nh,
-               float            m[ ][ 2 ],
-               int              shift[ ],
-               unsigned int     fill,
-               int              subp,
-               FL_IMAGE       * im )
+fix_bits( const WARP_JOB * job )
 {
-    float *lutx[ 2 ],
-          *luty[ 2 ];
-    int r,
-        c,
-        ir,
-        ic,
-        out[ 3 ];
-    float fir,
-          fic;
-    unsigned char fr = FL_GETR( fill ),
-                  fg = FL_GETG( fill ),
-                  fb = FL_GETB( fill );
-    int fillc[ 3 ];
-
-    if ( get_luts( lutx, lutx + 1, luty, luty + 1, m, shift, nw, nh ) < 0 )
-        return -1;
+    double max = 0.0;
+    int bits = 16,
+        i;
+
+    for ( i = 0; i < 4; i++ )
+    {
+        double c = ( i & 1 ? job->nw : 0 ) - job->shift[ 0 ],
+               r = ( i & 2 ? job->nh : 0 ) - job->shift[ 1 ];
 
-    fillc[ 0] = FL_GETR( fill );
-    fillc[ 1] = FL_GETG( fill );
-    fillc[ 2] = FL_GETB( fill );
+        max = FL_max( max, fabs( job->m[ 0 ][ 0 ] * c
+                                 + job->m[ 0 ][ 1 ] * r ) );
+        max = FL_max( max, fabs( job->m[ 1 ][ 0 ] * c
+                                 + job->m[ 1 ][ 1 ] * r ) );
+    }
+
+    max += 2;       /* some room for rounding */
+
+    while ( bits > FIX_WBITS && ldexp( max, bits ) >= LONG_MAX / 2 )
+        bits--;
+
+    return bits;
+}
+
+
+/***************************************
+ * Does the output lines [first, last), possibly in another thread
+ ***************************************/
 
-    for ( r = 0; r < nh; r++, im->completed++ )
+static int
+warp_rows( int    first,
+           int    last,
+           int    index,
+           void * data )
+{
+    WARP_JOB *job = data;
+    double one = 1L << job->fbits;
+    long dx = floor( job->m[ 0 ][ 0 ] * one + 0.5 ),
+         dy = floor( job->m[ 1 ][ 0 ] * one + 0.5 );
+    int r0,
+        r1,
+        c0,
+        c1,
+        r;
+
+    for ( r0 = first; r0 < last; r0 = r1 )
     {
-        if ( ! ( im->completed & FLIMAGE_REPFREQ ) )
-            im->visual_cue( im, subp ? "RGBSubP" : "RGB" );
+        r1 = FL_min( r0 + WARP_TILE, last );
 
-        if ( ! subp )
+        for ( c0 = 0; c0 < job->nw; c0 = c1 )
         {
-            for ( c = 0; c < nw; c++ )
-            {
-                ic = lutx[ 0 ][ c ] + lutx[ 1 ][ r ] + 0.1;
-                ir = luty[ 0 ][ c ] + luty[ 1 ][ r ] + 0.1;
+            c1 = FL_min( c0 + WARP_TILE, job->nw );
 
-                nr[ r ][ c ] = Outside( ic, ir, w, h ) ? fr : or[ ir ][ ic ];
-                ng[ r ][ c ] = Outside( ic, ir, w, h ) ? fg : og[ ir ][ ic ];
-                nb[ r ][ c ] = Outside( ic, ir, w, h ) ? fb : ob[ ir ][ ic ];
+            for ( r = r0; r < r1; r++ )
+            {
+                double x =   job->m[ 0 ][ 0 ] * ( c0 - job->shift[ 0 ] )
+                           + job->m[ 0 ][ 1 ] * ( r  - job->shift[ 1 ] ),
+                       y =   job->m[ 1 ][ 0 ] * ( c0 - job->shift[ 0 ] )
+                           + job->m[ 1 ][ 1 ] * ( r  - job->shift[ 1 ] );
+                long fx = floor( x * one + 0.5 ),
+                     fy = floor( y * one + 0.5 );
+
+                if ( job->comp == 1 )
+                    warp_span_short( job, r, c0, c1, fx, fy, dx, dy );
+                else
+                    warp_span_rgb( job, r, c0, c1, fx, fy, dx, dy );
             }
         }
-        else
-        {
-            for ( c = 0; c < nw; c++ )
-            {
-                fic = lutx[ 0][ c ] + lutx[ 1 ][ r ];
-                fir = luty[ 0][ c ] + luty[ 1 ][ r ];
 
-                interpol2d_uc( out, fir, fic, or, og, ob, h, w, fillc );
-
-                nr[ r ][ c ] = out[ 0 ];
-                ng[ r ][ c ] = out[ 1 ];
-                nb[ r ][ c ] = out[ 2 ];
-            }
+        if ( index == 0 )
+        {
+            job->im->completed = ( long ) r1 * job->nh / last;
+            job->im->visual_cue( job->im, job->comp == 1 ?
+                                 ( job->subp ? "GraySubP" : "Gray" ) :
+                                 ( job->subp ? "RGBSubP" : "RGB" ) );
         }
     }
 
-    fl_free(lutx[ 0 ] );
-    fl_free(lutx[ 1 ] );
-    fl_free(luty[ 0 ] );
-    fl_free(luty[ 1 ] );
-
-    return 1;
+    return 0;
 }
 
 
@@ -437,6 +417,7 @@ flimage_warp( FL_IMAGE * im,
           ymax,
           inv[ 2 ][ 2 ];
     double det;
+    WARP_JOB job;
 
     if ( ! im || im->w <= 0 )
         return -1;
@@ -515,16 +496,16 @@ flimage_warp( FL_IMAGE * im,
 
     if ( FL_IsCI( im->type ) || FL_IsGray( im->type ) )
     {
-        err = ! ( us = fl_get_matrix( nh, nw, sizeof **us ) );
+        err = ! ( us = fl_get_matrix_ex( nh, nw, sizeof **us, 0 ) );
     }
     else
     {
         flimage_free_ci( im );
         flimage_free_gray( im );
 
-        err =        ! ( r = fl_get_matrix( nh, nw, sizeof **r ) );
-        err = err || ! ( g = fl_get_matrix( nh, nw, sizeof **g ) );
-        err = err || ! ( b = fl_get_matrix( nh, nw, sizeof **b ) );
+        err =        ! ( r = fl_get_matrix_ex( nh, nw, sizeof **r, 0 ) );
+        err = err || ! ( g = fl_get_matrix_ex( nh, nw, sizeof **g, 0 ) );
+        err = err || ! ( b = fl_get_matrix_ex( nh, nw, sizeof **b, 0 ) );
     }
 
     if ( err )
@@ -539,29 +520,49 @@ flimage_warp( FL_IMAGE * im,
 
     /* now do the transform */
 
-    im->completed = 1;
-    im->visual_cue( im, "Transforming" );
+    memset( &job, 0, sizeof job );
+    job.w = im->w;
+    job.h = im->h;
+    job.nw = nw;
+    job.nh = nh;
+    job.m[ 0 ][ 0 ] = inv[ 0 ][ 0 ];
+    job.m[ 0 ][ 1 ] = inv[ 0 ][ 1 ];
+    job.m[ 1 ][ 0 ] = inv[ 1 ][ 0 ];
+    job.m[ 1 ][ 1 ] = inv[ 1 ][ 1 ];
+    job.shift[ 0 ] = shift[ 0 ];
+    job.shift[ 1 ] = shift[ 1 ];
+    job.subp = subp;
+    job.fbits = fix_bits( &job );
+    job.im = im;
 
     if ( FL_IsGray( im->type ) )
     {
-        fill = FL_RGB2GRAY( FL_GETR( fill ), FL_GETG( fill ), FL_GETB( fill ) );
-        if ( ! ( err = ( transform_short( im->gray, us, im->w, im->h, nw, nh,
-                                          inv, shift, fill, subp, im) < 0 ) ) )
-            flimage_replace_image( im, nw, nh, us, 0, 0 );
+        job.comp = 1;
+        job.in[ 0 ] = im->gray;
+        job.out[ 0 ] = us;
+        job.fill[ 0 ] = FL_RGB2GRAY( FL_GETR( fill ), FL_GETG( fill ),
+                                     FL_GETB( fill ) );
     }
     else if ( FL_IsCI( im->type ) )
     {
-        fill = flimage_get_closest_color_from_map( im, fill );
-        if ( ! ( err = ( transform_short( im->ci, us, im->w, im->h, nw, nh,
-                                          inv, shift, fill, 0, im ) < 0 ) ) )
-            flimage_replace_image( im, nw, nh, us, 0, 0 );
+        job.comp = 1;
+        job.in[ 0 ] = im->ci;
+        job.out[ 0 ] = us;
+        job.fill[ 0 ] = flimage_get_closest_color_from_map( im, fill );
+        job.subp = 0;
     }
     else if ( im->type == FL_IMAGE_RGB )
     {
-        if ( ! ( err = ( transform_rgb( im->red, im->green, im->blue,
-                                        r, g, b, im->w, im->h, nw, nh, inv,
-                                        shift, fill, subp, im ) < 0 ) ) )
-            flimage_replace_image( im, nw, nh, r, g, b );
+        job.comp = 3;
+        job.in[ 0 ] = im->red;
+        job.in[ 1 ] = im->green;
+        job.in[ 2 ] = im->blue;
+        job.out[ 0 ] = r;
+        job.out[ 1 ] = g;
+        job.out[ 2 ] = b;
+        job.fill[ 0 ] = FL_GETR( fill );
+        job.fill[ 1 ] = FL_GETG( fill );
+        job.fill[ 2 ] = FL_GETB( fill );
     }
     else
     {
@@ -569,6 +570,13 @@ flimage_warp( FL_IMAGE * im,
         return -1;
     }
 
+    im->completed = 1;
+    im->visual_cue( im, "Transforming" );
+
+    if ( ! ( err = flimage_run_rows( nh, WARP_TILE, warp_rows, &job ) < 0 ) )
+        flimage_replace_image( im, nw, nh, job.out[ 0 ], job.out[ 1 ],
+                               job.out[ 2 ] );
+
     if ( err )
     {
         im->error_message( im, "Transform failed" );
@@ -134,9 +134,6 @@ swap_header( XWDFileHeader * h )
 }
 
 
-static int need_swap;
-
-
 /***************************************
  * XWD does not have a signature, we'll have to guess
  ***************************************/
@@ -150,9 +147,7 @@ XWD_identify( FILE * fp )
         return 0;
     rewind( fp );
 
-    need_swap = ( h.file_version != XWD_FILE_VERSION );
-
-    if ( need_swap )
+    if ( h.file_version != XWD_FILE_VERSION )
         swap_header( &h );
 
     if ( h.file_version != XWD_FILE_VERSION )
@@ -215,7 +210,9 @@ XWD_description( FL_IMAGE * im )
     if ( fread( header, 1, sizeof *header, fp ) != sizeof *header )
         M_err( __func__, "failure to read from file" );
 
-    if ( ( sp->swap = need_swap ) )
+    /* identify made sure the version is right one way or the other */
+
+    if ( ( sp->swap = header->file_version != XWD_FILE_VERSION ) )
         swap_header( header );
 
     fli_rgbmask_to_shifts( header->red_mask,   &sp->rshifts, &sp->rbits );
@@ -532,10 +529,7 @@ XWD_write_image( FL_IMAGE * im )
     int ( * write32 )( int, FILE * ),
         ( * write16 )( int, FILE * );
     unsigned char *uc;
-    static int machine_endian = -1;
-
-    if ( machine_endian < 0 )
-        machine_endian = detect_endian( );
+    int machine_endian = detect_endian( );
 
     /* some programs expect MSBF always. Force it */
 
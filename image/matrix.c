@@ -32,35 +32,235 @@
 #include "flimage_int.h"
 
 
+#include <string.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define POOL_LOCK    pthread_mutex_lock( &pool_mutex )
+#define POOL_UNLOCK  pthread_mutex_unlock( &pool_mutex )
+#else
+#define POOL_LOCK
+#define POOL_UNLOCK
+#endif
+
+
+/***********************************************************************
+ * The memory for the pixels of a matrix (a "plane") comes from a pool.
+ * Freed planes are kept there and handed out again when a plane of
+ * (nearly) the same size is requested, so that operations that drop
+ * and re-allocate planes all the time (type conversions, cropping,
+ * scaling etc.) don't need to go back to the system for memory each
+ * time, which for large planes also means page faults. Planes are
+ * aligned to PLANE_ALIGN bytes and start with a PLANE header directly
+ * in front of the pixels.
+ ***********************************************************************/
+
+#define PLANE_ALIGN      64
+#define DEFAULT_POOL     ( 64UL * 1024 * 1024 )
+
+typedef struct plane_ {
+    struct plane_ * next;
+    void          * mem;          /* what fl_malloc() returned */
+    size_t          size;         /* usable bytes behind the header */
+} PLANE;
+
+static PLANE *pool;
+static FLIMAGE_PLANE_STATS stats = { 0, 0, 0, 0, 0, 0, 0, DEFAULT_POOL };
+
+
+/***************************************
+ * Returns a plane of at least 'size' bytes, from the pool if possible
+ ***************************************/
+
+static PLANE *
+get_plane( size_t size )
+{
+    PLANE *p,
+          **pp;
+    char *mem;
+
+    POOL_LOCK;
+
+    /* Don't waste more than an eighth of a pooled plane */
+
+    for ( pp = &pool; *pp; pp = &( *pp )->next )
+        if ( ( *pp )->size >= size && ( *pp )->size - size <= size / 8 )
+            break;
+
+    if ( ( p = *pp ) )
+    {
+        *pp = p->next;
+        stats.pooled--;
+        stats.pooled_bytes -= p->size;
+        stats.recycled++;
+    }
+
+    POOL_UNLOCK;
+
+    if ( ! p )
+    {
+        if ( ! ( mem = fl_malloc( sizeof *p + PLANE_ALIGN - 1 + size ) ) )
+            return NULL;
+
+        p = ( PLANE * ) (   ( ( size_t ) mem + sizeof *p + PLANE_ALIGN - 1 )
+                          & ~ ( size_t ) ( PLANE_ALIGN - 1 ) ) - 1;
+        p->mem = mem;
+        p->size = size;
+    }
+
+    POOL_LOCK;
+    stats.allocated++;
+    stats.in_use++;
+    stats.in_use_bytes += p->size;
+    POOL_UNLOCK;
+
+    return p;
+}
+
+
+/***************************************
+ * Takes the least recently used planes (which are at the end of the
+ * list) out of the pool until it's not larger than allowed anymore
+ * and returns them. Must be called with the pool locked.
+ ***************************************/
+
+static PLANE *
+trim_pool( void )
+{
+    PLANE *drop = NULL,
+          *p,
+          **pp;
+
+    while ( stats.pooled_bytes > stats.max_pool_bytes )
+    {
+        for ( pp = &pool; ( *pp )->next; pp = &( *pp )->next )
+            /* empty */ ;
+
+        p = *pp;
+        *pp = NULL;
+        stats.pooled--;
+        stats.pooled_bytes -= p->size;
+        p->next = drop;
+        drop = p;
+    }
+
+    return drop;
+}
+
+
 /***************************************
  ***************************************/
 
+static void
+free_planes( PLANE * p )
+{
+    PLANE *next;
+
+    for ( ; p; p = next )
+    {
+        next = p->next;
+        fl_free( p->mem );
+    }
+}
+
+
+/***************************************
+ * Puts a plane back into the pool (unless it's larger than the whole
+ * pool may be)
+ ***************************************/
+
+static void
+release_plane( PLANE * p )
+{
+    PLANE *drop = NULL;
+
+    POOL_LOCK;
+
+    stats.released++;
+    stats.in_use--;
+    stats.in_use_bytes -= p->size;
+
+    if ( p->size <= stats.max_pool_bytes )
+    {
+        p->next = pool;
+        pool = p;
+        stats.pooled++;
+        stats.pooled_bytes += p->size;
+        drop = trim_pool( );
+    }
+    else
+    {
+        p->next = NULL;
+        drop = p;
+    }
+
+    POOL_UNLOCK;
+
+    free_planes( drop );
+}
+
+
+/***************************************
+ * Returns a matrix with 'nrows' rows of 'ncols' elements of 'esize'
+ * bytes. With FL_MATRIX_ZERO in 'flags' the elements are all set to
+ * 0, otherwise they are undefined. With FL_MATRIX_ALIGN_ROWS each row
+ * starts at a PLANE_ALIGN byte boundary, but then the rows usually are
+ * not contiguous anymore.
+ ***************************************/
+
 void *
-fl_get_matrix( int          nrows,
-               int          ncols,
-               unsigned int esize )
+fl_get_matrix_ex( int          nrows,
+                  int          ncols,
+                  unsigned int esize,
+                  int          flags )
 {
     char **mat;
+    PLANE *p;
+    size_t stride = ( size_t ) ncols * esize;
     int i;
 
-    if ( ! ( mat = fl_malloc( ( nrows + 1 ) * sizeof *mat ) ) )
+    if ( nrows <= 0 || ncols <= 0 || ! esize )
         return NULL;
 
-    mat[ 0 ] = ( void * ) FL_GET_MATRIX;
+    if ( flags & FL_MATRIX_ALIGN_ROWS )
+        stride =   ( stride + PLANE_ALIGN - 1 )
+                 & ~ ( size_t ) ( PLANE_ALIGN - 1 );
 
-    if ( ! ( mat[ 1 ] = fl_calloc( nrows * ncols, esize ) ) )
+    if ( ! ( mat = fl_malloc( ( nrows + 1 ) * sizeof *mat ) ) )
+        return NULL;
+
+    if ( ! ( p = get_plane( nrows * stride ) ) )
     {
         fl_free( mat );
         return NULL;
     }
 
+    mat[ 0 ] = ( void * ) FL_GET_MATRIX;
+    mat[ 1 ] = ( char * ) ( p + 1 );
+
+    if ( flags & FL_MATRIX_ZERO )
+        memset( mat[ 1 ], 0, nrows * stride );
+
     for ( i = 2; i <= nrows; i++ )
-        mat[ i ] = mat[ i - 1 ] + ncols * esize;
+        mat[ i ] = mat[ i - 1 ] + stride;
 
     return mat + 1;
 }
 
 
+/***************************************
+ ***************************************/
+
+void *
+fl_get_matrix( int          nrows,
+               int          ncols,
+               unsigned int esize )
+{
+    return fl_get_matrix_ex( nrows, ncols, esize, FL_MATRIX_ZERO );
+}
+
+
 /***************************************
  * Given a piece of memory, make a matrix out of it
  ***************************************/
@@ -100,12 +300,50 @@ fl_free_matrix( void *p )
     if ( matrix[ -1 ] && matrix[ 0 ] )
     {
         if ( matrix[ -1 ] == ( char * ) FL_GET_MATRIX )
-            fl_free( matrix[ 0 ] );
+            release_plane( ( PLANE * ) matrix[ 0 ] - 1 );
         fl_free( matrix - 1 );
     }
 }
 
 
+/***************************************
+ * Sets the maximum number of bytes kept in the pool of freed planes
+ * (0 switches pooling off) and returns the previous setting
+ ***************************************/
+
+unsigned long
+flimage_set_plane_pool_size( unsigned long max_bytes )
+{
+    unsigned long old;
+    PLANE *drop;
+
+    POOL_LOCK;
+    old = stats.max_pool_bytes;
+    stats.max_pool_bytes = max_bytes;
+    drop = trim_pool( );
+    POOL_UNLOCK;
+
+    free_planes( drop );
+
+    return old;
+}
+
+
+/***************************************
+ ***************************************/
+
+void
+flimage_get_plane_stats( FLIMAGE_PLANE_STATS * s )
+{
+    if ( ! s )
+        return;
+
+    POOL_LOCK;
+    *s = stats;
+    POOL_UNLOCK;
+}
+
+
 /*
  * Local variables:
  * tab-width: 4
@@ -35,15 +35,25 @@
 #include "include/forms.h"
 #include "flinternal.h"
 #include <sys/types.h>
+#include <string.h>
 
 #ifndef FL_WIN32
 #include <sys/time.h>
+#include <unistd.h>
 #endif
 
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
 #ifdef __sgi
 #include <bstring.h>
 #endif
@@ -53,52 +63,595 @@
 #endif
 
 
-static fd_set st_rfds,
-              st_wfds,
-              st_efds;
+/* The file descriptors to be watched get handed to one of several
+   backends: epoll(7) where available, poll(2) as the portable fallback
+   and select(2) for systems that have neither. The backends get told
+   about each change of the set of watched fds when it happens, so
+   nothing has to be rebuilt before waiting, and they only dispatch the
+   callbacks for fds that became ready instead of looping over all of
+   them. Neither epoll nor poll restricts fds to be below FD_SETSIZE.
+
+   To find the callbacks for a ready fd quickly there's a table, indexed
+   by the fd, with the list of the IO records for that fd (linked via
+   their 'fd_next' fields) and the union of their masks.
+
+   Additionally there can be a single "wakeup" fd without callbacks
+   (the connection to the X server when the main loop is event-driven)
+   that's only watched for making fli_watch_io() return as soon as
+   there's something to read on it. */
+
+typedef struct {
+    FLI_IO_REC   * recs;         /* records for this fd */
+    unsigned int   mask;         /* what the backend is watching for */
+    int            index;        /* position in poll array (if used) */
+} FD_ENTRY;
+
+typedef struct {
+    const char * name;
+    int  ( * init    )( void );
+    void ( * update  )( int, unsigned int, unsigned int );
+    int  ( * wait    )( long );
+    void ( * cleanup )( void );
+} IO_BACKEND;
 
+static FD_ENTRY *fd_tab = NULL;
+static int fd_tab_size = 0;
+
+static IO_BACKEND *backend = NULL;
+
+static int wakeup_fd = -1;
+
+static void dispatch( int,
+                      unsigned int );
+static void fallback_backend( void );
 static void add_to_freelist( FLI_IO_REC * io );
 static void clear_freelist( void );
 
 
 /***************************************
- * Collect all the fd_sets so we don't do it inside the
- * critical select inner loop
+ * Report failure of the system call used for waiting (unless it got
+ * just interrupted by a signal)
  ***************************************/
 
 static void
-collect_fds( void )
+wait_failed( const char * func )
 {
-    FLI_IO_REC *p;
-    int nf = 0;
+    if ( errno == EINTR )
+        M_warn( func, "%s interrupted by signal", backend->name );
+
+    /* select() on some platforms returns -1 with errno == 0 */
+
+    else if ( errno != 0 )
+        M_err( func, fli_get_syserror_msg( ) );
+}
+
+
+#ifdef HAVE_SYS_EPOLL_H
+
+/*
+ * epoll backend
+ */
+
+#define MAX_EPOLL_EVENTS  64
+
+static int epoll_fd = -1;
+
+
+/***************************************
+ ***************************************/
+
+static int
+epoll_init( void )
+{
+#ifdef EPOLL_CLOEXEC
+    epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+#else
+    epoll_fd = epoll_create( MAX_EPOLL_EVENTS );
+#endif
+
+    return epoll_fd < 0 ? -1 : 0;
+}
+
+
+/***************************************
+ ***************************************/
 
-    /* Initialize the sets */
+static void
+epoll_update( int          fd,
+              unsigned int old_mask,
+              unsigned int new_mask )
+{
+    struct epoll_event ev;
+
+    ev.events  =   ( new_mask & FL_READ   ? EPOLLIN  : 0 )
+                 | ( new_mask & FL_WRITE  ? EPOLLOUT : 0 )
+                 | ( new_mask & FL_EXCEPT ? EPOLLPRI : 0 );
+    ev.data.fd = fd;
+
+    /* On removal the fd may already have been closed, so don't complain */
+
+    if ( ! new_mask )
+    {
+        epoll_ctl( epoll_fd, EPOLL_CTL_DEL, fd, &ev );
+        return;
+    }
+
+    if ( old_mask && epoll_ctl( epoll_fd, EPOLL_CTL_MOD, fd, &ev ) == 0 )
+        return;
+
+    /* Not registered yet (or the fd got closed and reopened meanwhile) */
+
+    if ( epoll_ctl( epoll_fd, EPOLL_CTL_ADD, fd, &ev ) == 0 )
+        return;
+
+    /* epoll can't deal with regular files (which select() and poll()
+       report as always being ready), so switch to the next backend */
+
+    if ( errno == EPERM )
+        fallback_backend( );
+    else
+        M_err( __func__, "Can't watch fd %d: %s", fd,
+               fli_get_syserror_msg( ) );
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+epoll_wait_io( long msec )
+{
+    struct epoll_event ev[ MAX_EPOLL_EVENTS ];
+    int nf,
+        i;
+
+    if ( ( nf = epoll_wait( epoll_fd, ev, MAX_EPOLL_EVENTS, msec ) ) < 0 )
+    {
+        wait_failed( __func__ );
+        return -1;
+    }
+
+    for ( i = 0; i < nf; i++ )
+    {
+        unsigned int ready = 0;
+
+        /* Like select() treat hangups and errors as readability */
+
+        if ( ev[ i ].events & ( EPOLLIN | EPOLLHUP | EPOLLERR ) )
+            ready |= FL_READ;
+        if ( ev[ i ].events & ( EPOLLOUT | EPOLLERR ) )
+            ready |= FL_WRITE;
+        if ( ev[ i ].events & EPOLLPRI )
+            ready |= FL_EXCEPT;
+
+        dispatch( ev[ i ].data.fd, ready );
+    }
+
+    return nf;
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+epoll_cleanup( void )
+{
+    if ( epoll_fd >= 0 )
+        close( epoll_fd );
+    epoll_fd = -1;
+}
+
+
+static IO_BACKEND epoll_backend = {
+    "epoll", epoll_init, epoll_update, epoll_wait_io, epoll_cleanup
+};
+
+#endif /* HAVE_SYS_EPOLL_H */
+
+
+#ifdef HAVE_POLL_H
+
+/*
+ * poll backend. The fds are kept in a dense array, an fd entry's
+ * 'index' field is its position within the array.
+ */
 
+static struct pollfd *poll_fds = NULL;
+static int num_poll_fds = 0,
+           poll_fds_size = 0;
+
+
+/***************************************
+ ***************************************/
+
+static int
+poll_init( void )
+{
+    return 0;
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+poll_update( int          fd,
+             unsigned int old_mask,
+             unsigned int new_mask )
+{
+    int i = fd_tab[ fd ].index;
+
+    if ( ! new_mask )
+    {
+        /* Fill the hole with the last element of the array */
+
+        if ( i != --num_poll_fds )
+        {
+            poll_fds[ i ] = poll_fds[ num_poll_fds ];
+            fd_tab[ poll_fds[ i ].fd ].index = i;
+        }
+
+        return;
+    }
+
+    if ( ! old_mask )
+    {
+        if ( num_poll_fds == poll_fds_size )
+        {
+            poll_fds_size = poll_fds_size ? 2 * poll_fds_size : 16;
+            poll_fds = fl_realloc( poll_fds, poll_fds_size * sizeof *poll_fds );
+        }
+
+        i = fd_tab[ fd ].index = num_poll_fds++;
+        poll_fds[ i ].fd = fd;
+    }
+
+    poll_fds[ i ].events =   ( new_mask & FL_READ   ? POLLIN  : 0 )
+                           | ( new_mask & FL_WRITE  ? POLLOUT : 0 )
+                           | ( new_mask & FL_EXCEPT ? POLLPRI : 0 );
+    poll_fds[ i ].revents = 0;
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+poll_wait_io( long msec )
+{
+    int nf,
+        n,
+        i;
+
+    if ( ( nf = poll( poll_fds, num_poll_fds, msec ) ) < 0 )
+    {
+        wait_failed( __func__ );
+        return -1;
+    }
+
+    /* Callbacks may add or remove fds, which changes the array, so
+       first collect the results and clear them from the array. Going
+       backwards makes sure no fd with results gets moved to a position
+       not yet visited when an fd gets removed. */
+
+    for ( n = nf, i = num_poll_fds - 1; n > 0 && i >= 0; i-- )
+    {
+        short revents = poll_fds[ i ].revents;
+        unsigned int ready = 0;
+
+        if ( ! revents )
+            continue;
+
+        n--;
+        poll_fds[ i ].revents = 0;
+
+        if ( revents & POLLNVAL )
+        {
+            M_err( __func__, "fd %d isn't open", poll_fds[ i ].fd );
+            continue;
+        }
+
+        if ( revents & ( POLLIN | POLLHUP | POLLERR ) )
+            ready |= FL_READ;
+        if ( revents & ( POLLOUT | POLLERR ) )
+            ready |= FL_WRITE;
+        if ( revents & POLLPRI )
+            ready |= FL_EXCEPT;
+
+        dispatch( poll_fds[ i ].fd, ready );
+
+        /* Removal of fds from within the callback may have moved fds from
+           the end of the array to lower positions, all of them were already
+           dealt with, so continue with the entries below */
+
+        i = FL_min( i, num_poll_fds );
+    }
+
+    return nf;
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+poll_cleanup( void )
+{
+    fli_safe_free( poll_fds );
+    num_poll_fds = poll_fds_size = 0;
+}
+
+
+static IO_BACKEND poll_backend = {
+    "poll", poll_init, poll_update, poll_wait_io, poll_cleanup
+};
+
+#endif /* HAVE_POLL_H */
+
+
+/*
+ * select backend, only used if there's neither epoll() nor poll().
+ * fli_context->num_io is the highest watched fd plus 1.
+ */
+
+static fd_set st_rfds,
+              st_wfds,
+              st_efds;
+
+
+/***************************************
+ ***************************************/
+
+static int
+select_init( void )
+{
     FD_ZERO( &st_rfds );
     FD_ZERO( &st_wfds );
     FD_ZERO( &st_efds );
+    fli_context->num_io = 0;
+
+    return 0;
+}
+
 
-    /* Loop through all requested IOs */
+/***************************************
+ ***************************************/
+
+static void
+select_update( int          fd,
+               unsigned int old_mask  FL_UNUSED_ARG,
+               unsigned int new_mask )
+{
+    if ( fd >= FD_SETSIZE )
+    {
+        M_err( __func__, "Can't watch fd %d, must be below %d",
+               fd, FD_SETSIZE );
+        return;
+    }
+
+    FD_CLR( fd, &st_rfds );
+    FD_CLR( fd, &st_wfds );
+    FD_CLR( fd, &st_efds );
+
+    if ( new_mask & FL_READ )
+        FD_SET( fd, &st_rfds );
+    if ( new_mask & FL_WRITE )
+        FD_SET( fd, &st_wfds );
+    if ( new_mask & FL_EXCEPT )
+        FD_SET( fd, &st_efds );
+
+    if ( new_mask && fli_context->num_io <= fd )
+        fli_context->num_io = fd + 1;
+    else if ( ! new_mask && fli_context->num_io == fd + 1 )
+        while ( fli_context->num_io > 0
+                && ! fd_tab[ fli_context->num_io - 1 ].mask )
+            fli_context->num_io--;
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+select_wait_io( long msec )
+{
+    fd_set rfds = st_rfds,
+           wfds = st_wfds,
+           efds = st_efds;
+    struct timeval timeout;
+    int nf,
+        n,
+        fd;
+
+    timeout.tv_usec = 1000 * ( msec % 1000 );
+    timeout.tv_sec  = msec / 1000;
+
+    /* Now watch it. HP defines rfds to be ints. Althought compiler will
+       bark, it is harmless. */
+
+    if ( ( nf = select( fli_context->num_io, &rfds, &wfds, &efds,
+                        &timeout ) ) < 0 )
+    {
+        wait_failed( __func__ );
+        return -1;
+    }
 
-    for ( p = fli_context->io_rec; p; p = p->next )
+    for ( n = nf, fd = 0; n > 0 && fd < fli_context->num_io; fd++ )
     {
-        if ( p->source < 0 )
+        unsigned int ready = 0;
+
+        if ( FD_ISSET( fd, &rfds ) )
+            ready |= FL_READ;
+        if ( FD_ISSET( fd, &wfds ) )
+            ready |= FL_WRITE;
+        if ( FD_ISSET( fd, &efds ) )
+            ready |= FL_EXCEPT;
+
+        if ( ready )
         {
-            M_err( __func__, "source < 0\n" );
-            continue;
+            n--;
+            dispatch( fd, ready );
         }
+    }
+
+    return nf;
+}
+
 
-        if ( p->mask & FL_READ )
-            FD_SET( p->source, &st_rfds );
-        if ( p->mask & FL_WRITE )
-            FD_SET( p->source, &st_wfds );
-        if ( p->mask & FL_EXCEPT )
-            FD_SET( p->source, &st_efds );
-        if ( nf < p->source + 1 )
-            nf = p->source + 1;
+/***************************************
+ ***************************************/
+
+static void
+select_cleanup( void )
+{
+    fli_context->num_io = 0;
+}
+
+
+static IO_BACKEND select_backend = {
+    "select", select_init, select_update, select_wait_io, select_cleanup
+};
+
+
+static IO_BACKEND *backends[ ] = {
+#ifdef HAVE_SYS_EPOLL_H
+    &epoll_backend,
+#endif
+#ifdef HAVE_POLL_H
+    &poll_backend,
+#endif
+    &select_backend
+};
+
+#define NUM_BACKENDS  ( int ) ( sizeof backends / sizeof *backends )
+
+
+/***************************************
+ * Picks the best backend, starting at the one with index 'first',
+ * that can be initialized
+ ***************************************/
+
+static void
+init_backend( int first )
+{
+    int i;
+
+    for ( i = first; i < NUM_BACKENDS; i++ )
+        if ( backends[ i ]->init( ) == 0 )
+        {
+            backend = backends[ i ];
+            M_info( __func__, "Using %s for IO callbacks", backend->name );
+            return;
+        }
+}
+
+
+/***************************************
+ * Replaces the current backend by the next one in the list of
+ * backends, telling it about all fds to be watched
+ ***************************************/
+
+static void
+fallback_backend( void )
+{
+    int i;
+
+    for ( i = 0; backends[ i ] != backend; i++ )
+        /* empty */ ;
+
+    backend->cleanup( );
+    init_backend( i + 1 );
+
+    for ( i = 0; i < fd_tab_size; i++ )
+        if ( fd_tab[ i ].mask )
+            backend->update( i, 0, fd_tab[ i ].mask );
+}
+
+
+/***************************************
+ * Recalculates what to watch an fd for from the records for it
+ * and tells the backend if that changed
+ ***************************************/
+
+static void
+update_fd( int fd )
+{
+    FLI_IO_REC *p;
+    unsigned int old_mask = fd_tab[ fd ].mask,
+                 new_mask = 0;
+
+    for ( p = fd_tab[ fd ].recs; p; p = p->fd_next )
+        new_mask |= p->mask;
+
+    if ( fd == wakeup_fd )
+        new_mask |= FL_READ;
+
+    new_mask &= FL_READ | FL_WRITE | FL_EXCEPT;
+
+    if ( new_mask == old_mask )
+        return;
+
+    fd_tab[ fd ].mask = new_mask;
+    backend->update( fd, old_mask, new_mask );
+}
+
+
+/***************************************
+ * Invokes the callbacks for an fd that's ready for what's
+ * indicated by 'ready'
+ ***************************************/
+
+static void
+dispatch( int          fd,
+          unsigned int ready )
+{
+    FLI_IO_REC *p;
+
+    if ( fd < 0 || fd >= fd_tab_size )
+        return;
+
+    /* Records removed from within a callback aren't deallocated before
+       we return to fli_watch_io(), and they still point to the record
+       that followed them, so it's safe to continue with the next one */
+
+    for ( p = fd_tab[ fd ].recs; p; p = p->fd_next )
+    {
+        if ( ! p->callback || p->mask == 0 )
+            continue;
+
+        if ( p->mask & FL_READ && ready & FL_READ )
+            p->callback( p->source, p->data );
+
+        if ( p->mask & FL_WRITE && ready & FL_WRITE )
+            p->callback( p->source, p->data );
+
+        if ( p->mask & FL_EXCEPT && ready & FL_EXCEPT )
+            p->callback( p->source, p->data );
     }
+}
 
-    fli_context->num_io = nf;
+
+/***************************************
+ * Makes sure the backend is set up and the fd table is large
+ * enough for 'fd'
+ ***************************************/
+
+static void
+prepare_fd( int fd )
+{
+    if ( ! backend )
+        init_backend( 0 );
+
+    if ( fd >= fd_tab_size )
+    {
+        int new_size = FL_max( 2 * fd_tab_size, fd + 1 );
+
+        fd_tab = fl_realloc( fd_tab, new_size * sizeof *fd_tab );
+        memset( fd_tab + fd_tab_size, 0,
+                ( new_size - fd_tab_size ) * sizeof *fd_tab );
+        fd_tab_size = new_size;
+    }
 }
 
 
@@ -114,19 +667,29 @@ fl_add_io_callback( int              fd,
 {
     FLI_IO_REC *io_rec;
 
+    if ( fd < 0 )
+    {
+        M_err( __func__, "Invalid fd %d", fd );
+        return;
+    }
+
+    prepare_fd( fd );
+
     /* Create new record and make it the start of the list */
 
     io_rec = fl_malloc( sizeof *io_rec );
 
     io_rec->next     = fli_context->io_rec;
+    io_rec->fd_next  = fd_tab[ fd ].recs;
     io_rec->callback = callback;
     io_rec->data     = data;
     io_rec->source   = fd;
     io_rec->mask     = mask;
 
     fli_context->io_rec = io_rec;
+    fd_tab[ fd ].recs = io_rec;
 
-    collect_fds( );
+    update_fd( fd );
 }
 
 
@@ -139,12 +702,19 @@ fl_remove_io_callback( int            fd,
                        FL_IO_CALLBACK cb )
 {
     FLI_IO_REC *io,
-               *previous_io = NULL;
+               *previous_io = NULL,
+               **fd_link;
 
-    for ( io = fli_context->io_rec;
-          io && ! ( io->source == fd && io->callback == cb && io->mask & mask );
-          io = io->next )
-        previous_io = io;
+    if ( fd < 0 || fd >= fd_tab_size )
+    {
+        M_err( __func__, "Non-existent handler for %d", fd );
+        return;
+    }
+
+    for ( fd_link = &fd_tab[ fd ].recs;
+          ( io = *fd_link ) && ! ( io->callback == cb && io->mask & mask );
+          fd_link = &io->fd_next )
+        /* empty */ ;
 
     if ( ! io )
     {
@@ -157,104 +727,109 @@ fl_remove_io_callback( int            fd,
 
     if ( ! ( io->mask &= ~ mask ) )
     {
+        FLI_IO_REC *p;
+
+        for ( p = fli_context->io_rec; p != io; p = p->next )
+            previous_io = p;
+
         if ( previous_io )
             previous_io->next = io->next;
         else
             fli_context->io_rec = io->next;
 
+        *fd_link = io->fd_next;
+
         /* Caution: the following may look idiotic at first: simply getting
            rid of the structure for the callback would seem to be appropriate.
            But things get interesting if the callback gets removed from within
            the callback - then just removing it gets us into trouble since
-           then fli_watch_io(), iterating over all IO callbacks still tries to
-           to access the 'next' field and if the structure has been
-           deallocated completely (instead of having been temporarily moved
-           to somewhere else where it still can be accessed) it stumbles
-           badly. That's also why fli_watch_io() calls clear_freelist() -
-           it's the only place where it's known when the structure isn't
-           needed anymore. */
+           then fli_watch_io(), iterating over the IO callbacks for a ready
+           fd still tries to to access the 'fd_next' field and if the
+           structure has been deallocated completely (instead of having been
+           temporarily moved to somewhere else where it still can be
+           accessed) it stumbles badly. That's also why fli_watch_io() calls
+           clear_freelist() - it's the only place where it's known when the
+           structure isn't needed anymore. */
 
         add_to_freelist( io );
     }
 
-    collect_fds( );
+    update_fd( fd );
 }
 
 
 /***************************************
- * Watch for activities using select or poll. Timeout is in milli-seconds.
+ * Sets the fd that ends waiting in fli_watch_io() when it becomes
+ * readable (without any callback getting invoked), -1 for none
  ***************************************/
 
 void
-fli_watch_io( FLI_IO_REC * io_rec,
-              long         msec )
+fli_set_io_wakeup_fd( int fd )
 {
-    fd_set rfds,
-           wfds,
-           efds;
-    struct timeval timeout;
-    FLI_IO_REC *p;
-    int nf;
-
-    clear_freelist( );
-
-    if ( ! io_rec )
-    {
-        if ( msec > 0 )
-            fl_msleep( msec );
+    int old_fd = wakeup_fd;
 
+    if ( fd == old_fd )
         return;
-    }
 
-    timeout.tv_usec = 1000 * ( msec % 1000 );
-    timeout.tv_sec  = msec / 1000;
+    wakeup_fd = fd;
 
-    /* Initialize the sets */
+    if ( old_fd >= 0 )
+        update_fd( old_fd );
 
-    rfds = st_rfds;
-    wfds = st_wfds;
-    efds = st_efds;
+    if ( fd >= 0 )
+    {
+        prepare_fd( fd );
+        update_fd( fd );
+    }
+}
 
-    /* Now watch it. HP defines rfds to be ints. Althought compiler will
-       bark, it is harmless. */
 
-    nf = select( fli_context->num_io, &rfds, &wfds, &efds, &timeout );
+/***************************************
+ * Removes all IO callbacks and releases the resources of the backend
+ ***************************************/
 
-    if ( nf < 0 )     /* something is wrong. */
-    {
-        if ( errno == EINTR )
-            M_warn( __func__, "select interrupted by signal" );
+void
+fli_remove_all_io_callbacks( void )
+{
+    while ( fli_context->io_rec )
+        fl_remove_io_callback( fli_context->io_rec->source,
+                               fli_context->io_rec->mask,
+                               fli_context->io_rec->callback );
 
-        /* select() on some platforms returns -1 with errno == 0 */
+    clear_freelist( );
+    wakeup_fd = -1;
 
-        else if ( errno != 0 )
-            M_err( __func__, fli_get_syserror_msg( ) );
+    if ( backend )
+        backend->cleanup( );
+    backend = NULL;
 
-        return;
-    }
+    fli_safe_free( fd_tab );
+    fd_tab_size = 0;
+}
 
-    /* Timeout expired */
 
-    if ( nf == 0 )
-        return;
+/***************************************
+ * Watch for activities using epoll, poll or select, invoking the
+ * callbacks for fds that became ready. Timeout is in milli-seconds.
+ * Returns early if the wakeup fd (if set) becomes readable.
+ ***************************************/
 
-    /* Handle it */
+void
+fli_watch_io( FLI_IO_REC * io_rec,
+              long         msec )
+{
+    clear_freelist( );
 
-    for ( p = io_rec; p; p = p->next )
+    if ( ! io_rec && wakeup_fd < 0 )
     {
-        if ( ! p->callback || p->source < 0 || p->mask == 0 )
-            continue;
-
-        if ( p->mask & FL_READ && FD_ISSET( p->source, &rfds ) )
-            p->callback( p->source, p->data );
-
-        if ( p->mask & FL_WRITE && FD_ISSET( p->source, &wfds ) )
-            p->callback( p->source, p->data );
+        if ( msec > 0 )
+            fl_msleep( msec );
 
-        if ( p->mask & FL_EXCEPT && FD_ISSET( p->source, &efds ) )
-            p->callback( p->source, p->data );
+        return;
     }
 
+    backend->wait( FL_max( msec, 0 ) );
+
     clear_freelist( );
 }
 
@@ -267,8 +842,11 @@ fli_is_watched_io( int fd )
 {
     FLI_IO_REC *p;
 
-    for ( p = fli_context->io_rec; p; p = p->next )
-        if ( p->source == fd && p->mask )
+    if ( fd < 0 || fd >= fd_tab_size )
+        return 0;
+
+    for ( p = fd_tab[ fd ].recs; p; p = p->fd_next )
+        if ( p->mask )
             return 1;
 
     return 0;
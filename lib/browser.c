@@ -1185,6 +1185,31 @@ fl_load_browser( FL_OBJECT  * obj,
 }
 
 
+/***************************************
+ * Makes the browser a virtual one with 'num_lines' lines, where
+ * the text of the lines gets requested from the application via
+ * the 'fetch' function only when they're needed
+ ***************************************/
+
+void
+fl_set_browser_virtual( FL_OBJECT        * obj,
+                        int                num_lines,
+                        FL_BROWSER_FETCH   fetch,
+                        void             * data )
+{
+    FLI_BROWSER_SPEC *sp = obj->spec;
+
+    if ( ! fetch )
+    {
+        fl_clear_browser( obj );
+        return;
+    }
+
+    fli_tbox_set_virtual( sp->tb, num_lines, fetch, data );
+    redraw_scrollbar( obj );
+}
+
+
 /***************************************
  * Adds a line to the (end of the) browser (does not make the line
  * visible)
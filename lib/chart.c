@@ -53,7 +53,7 @@ typedef struct
     float    val;                          /* Value of the entry       */
     FL_COLOR col;                          /* Color of the entry       */
     FL_COLOR lcol;                         /* Label color of the entry */
-    char     str[ MAX_CHART_LABEL_LEN ];   /* Label of the entry       */
+    char   * str;                          /* Label of the entry (or 0) */
 } ENTRY;
 
 typedef struct
@@ -70,20 +70,84 @@ typedef struct
                w,
                h;
     FL_COLOR   lcol;            /* default label color */
-    ENTRY    * entries;         /* the entries */
+    ENTRY    * entries;         /* the entries (a ring buffer) */
+    int        first;           /* index of the oldest entry */
+    int        nalloc;          /* number of allocated entries */
+    int        nlabels;         /* number of entries with a label */
     int        no_baseline;
+    int        scroll;          /* scroll instead of redrawing on adds */
+    Pixmap     pixmap;          /* what got drawn last (in scroll mode) */
+    int        pm_valid;
+    int        pm_x,            /* object geometry and bounds the */
+               pm_y,            /* pixmap was drawn for */
+               pm_w,
+               pm_h,
+               pm_depth,
+               pm_type,
+               pm_maxnumb;
+    float      pm_min,
+               pm_max;
 } FLI_CHART_SPEC;
 
 
+/* Returns a pointer to the i-th entry, counting from the oldest one */
+
+#define CHART_ENTRY( sp, i )  \
+    ( ( sp )->entries + ( ( sp )->first + ( i ) ) % ( sp )->nalloc )
+
+
+/* Box types for which the drawing area is filled with the objects color */
+
+#define IS_RECT_BOX( t )  (    ( t ) == FL_UP_BOX       \
+                            || ( t ) == FL_DOWN_BOX     \
+                            || ( t ) == FL_BORDER_BOX   \
+                            || ( t ) == FL_FRAME_BOX    \
+                            || ( t ) == FL_EMBOSSED_BOX \
+                            || ( t ) == FL_FLAT_BOX )
+
+
+/***************************************
+ * Sets the label of an entry, throwing away the old one. Labels are
+ * stored outside of the entries since most entries don't have one.
+ ***************************************/
+
+static void
+set_entry_label( FLI_CHART_SPEC * sp,
+                 ENTRY          * e,
+                 const char     * str )
+{
+    size_t len;
+
+    if ( e->str )
+    {
+        fl_free( e->str );
+        e->str = NULL;
+        sp->nlabels--;
+    }
+
+    if ( ! str || ! *str )
+        return;
+
+    len = FL_min( strlen( str ), MAX_CHART_LABEL_LEN - 1 );
+    e->str = fl_malloc( len + 1 );
+    memcpy( e->str, str, len );
+    e->str[ len ] = '\0';
+    sp->nlabels++;
+}
+
+
 /***************************************
  * Draws a bar chart. x,y,w,h is the bounding box, entries the array of
- * numb entries and min and max the boundaries.
+ * numb entries and min and max the boundaries. Only the bars from
+ * 'start' up to (but not including) 'end' are drawn.
  ***************************************/
 
 static void
 draw_barchart( FL_OBJECT * ob,
                float       min,
-               float       max )
+               float       max,
+               int         start,
+               int         end )
 {
     FLI_CHART_SPEC *sp = ob->spec;
     int x = sp->x,
@@ -102,11 +166,8 @@ draw_barchart( FL_OBJECT * ob,
     float incr,         /* Increment per unit value */
           xfuzzy;
     float lh = fl_get_char_height( sp->lstyle, sp->lsize, &i, &j );
-    ENTRY *e,
-          *es,
-          *entries = sp->entries;
+    ENTRY *e;
     int lbox;
-    float fx;
 
     incr = h / ( max - min );
     zeroh = y + h + min * incr;
@@ -133,10 +194,11 @@ draw_barchart( FL_OBJECT * ob,
     if ( ( xfuzzy = bwidth - ( FL_Coord ) bwidth ) != 0.0 )
         n = 1.0 / xfuzzy + 2;
 
-    for ( e = entries, xx = x, i = 0, es = e + numb; e < es; e++, i++ )
+    for ( xx = x, i = 0; i < end; i++ )
     {
         dx = bwidth + ( i % n ) * xfuzzy;
-        if ( e->val != 0.0 )
+        e = CHART_ENTRY( sp, i );
+        if ( i >= start && e->val != 0.0 )
         {
             val = e->val * incr;
             fl_rectbound( xx, zeroh - val, dx, val, e->col );
@@ -146,12 +208,19 @@ draw_barchart( FL_OBJECT * ob,
 
     /* Draw the labels */
 
+    if ( ! sp->nlabels )
+        return;
+
     lbox = 0.8 * bwidth;
 
-    for ( e = entries, es = e + numb, fx = x; e < es; fx += bwidth, e++ )
-        fl_draw_text_beside( FL_ALIGN_BOTTOM, fx + 0.5 * ( bwidth - lbox ),
+    for ( i = start; i < end; i++ )
+    {
+        e = CHART_ENTRY( sp, i );
+        fl_draw_text_beside( FL_ALIGN_BOTTOM,
+                             x + i * bwidth + 0.5 * ( bwidth - lbox ),
                              zeroh - lbox, lbox, lbox, e->lcol,
                              sp->lstyle, sp->lsize, e->str );
+    }
 }
 
 
@@ -182,15 +251,15 @@ draw_horbarchart( FL_OBJECT * ob,
         n;
     float yfuzzy;
     char *s;
-    ENTRY *e,
-          *entries = sp->entries;
+    ENTRY *e;
     int lbox;
 
     /* Compute maximal label width */
 
-    for ( lw = 0, i = 0; i < numb; i++ )
+    for ( lw = 0, i = 0; sp->nlabels && i < numb; i++ )
     {
-        s = entries[ i ].str;
+        if ( ! ( s = CHART_ENTRY( sp, i )->str ) )
+            continue;
         l = fl_get_string_width( sp->lstyle, sp->lsize, s, strlen( s ) );
         if ( l > lw )
             lw = l;
@@ -226,8 +295,9 @@ draw_horbarchart( FL_OBJECT * ob,
     if ( ( yfuzzy = bwidth - dy ) != 0 )
         n = 1.0 / yfuzzy + 2;
 
-    for ( e = entries + numb - 1, i = 0; i < numb; i++, e-- )
+    for ( i = 0; i < numb; i++ )
     {
+        e = CHART_ENTRY( sp, numb - 1 - i );
         dy = bwidth + ( i % n ) * yfuzzy;
         if ( e->val != 0.0 )
             fl_rectbound( zeroh, yy, e->val * incr, dy, e->col );
@@ -236,23 +306,32 @@ draw_horbarchart( FL_OBJECT * ob,
 
     /* Draw the labels */
 
+    if ( ! sp->nlabels )
+        return;
+
     lbox = 0.8 * bwidth;
-    for ( e = entries + numb - 1, i = 0; i < numb; i++, e-- )
+    for ( i = 0; i < numb; i++ )
+    {
+        e = CHART_ENTRY( sp, numb - 1 - i );
         fl_draw_text_beside( FL_ALIGN_LEFT, zeroh,
                              y + i * bwidth + 0.5 * ( bwidth - lbox ),
                              lbox, lbox, e->lcol, sp->lstyle,
                              sp->lsize, e->str );
+    }
 }
 
 
 /***************************************
- * Draws a line chart
+ * Draws a line chart, only the values from 'start' up to (but not
+ * including) 'end'
  ***************************************/
 
 static void
 draw_linechart( FL_OBJECT * ob,
                 float       min,
-                float       max )
+                float       max,
+                int         start,
+                int         end )
 {
     FLI_CHART_SPEC *sp = ob->spec;
     int type = ob->type;
@@ -268,8 +347,7 @@ draw_linechart( FL_OBJECT * ob,
     float incr;         /* Increment per unit value */
     float lh = fl_get_char_height( sp->lstyle, sp->lsize, 0, 0 );
     ENTRY *e,
-          *es,
-          *entries = sp->entries;
+          *cur;
     float xx,           /* tmp vars */
           val1,
           val2,
@@ -283,21 +361,22 @@ draw_linechart( FL_OBJECT * ob,
 
     /* Draw the values */
 
-    for ( i = 0; i < numb; i++ )
+    for ( i = start; i < end; i++ )
     {
-        val3 = entries[ i ].val * incr;
+        cur = CHART_ENTRY( sp, i );
+        val3 = cur->val * incr;
         if ( type == FL_SPIKE_CHART )
         {
             val1 = ( i + 0.5 ) * bwidth;
             fli_reset_vertex( );
-            fl_color( entries[ i ].col );
+            fl_color( cur->col );
             fli_add_float_vertex( x + val1, zeroh );
             fli_add_float_vertex( x + val1, zeroh - val3 );
             fli_endline( );
         }
         else if ( type == FL_LINE_CHART && i != 0 )
         {
-            e = entries + i - 1;
+            e = CHART_ENTRY( sp, i - 1 );
             fli_reset_vertex( );
             fl_color( e->col );
             fli_add_float_vertex( x + ( i - 0.5 ) * bwidth,
@@ -307,7 +386,7 @@ draw_linechart( FL_OBJECT * ob,
         }
         else if ( type == FL_FILLED_CHART && i != 0 )
         {
-            e = entries + i - 1;
+            e = CHART_ENTRY( sp, i - 1 );
             val1 = ( i - 0.5 ) * bwidth;
             val2 = ( i + 0.5 ) * bwidth;
 
@@ -315,10 +394,10 @@ draw_linechart( FL_OBJECT * ob,
             fl_color( e->col );
             fli_add_float_vertex( x + val1, zeroh );
             fli_add_float_vertex( x + val1, zeroh - e->val * incr );
-            if (    ( e->val > 0.0 && entries[ i ].val < 0.0 )
-                 || ( e->val < 0.0 && entries[ i ].val > 0.0 ) )
+            if (    ( e->val > 0.0 && cur->val < 0.0 )
+                 || ( e->val < 0.0 && cur->val > 0.0 ) )
             {
-                ttt = e->val / ( e->val - entries[ i ].val );
+                ttt = e->val / ( e->val - cur->val );
                 fli_add_float_vertex( x + ( i - 0.5 + ttt ) * bwidth, zeroh );
                 fli_add_float_vertex( x + ( i - 0.5 + ttt ) * bwidth, zeroh );
             }
@@ -342,10 +421,14 @@ draw_linechart( FL_OBJECT * ob,
 
     /* Draw the labels */
 
+    if ( ! sp->nlabels )
+        return;
+
     lbox = 0.8 * bwidth;
-    xx = x + 0.5 * ( bwidth - lbox );
-    for ( e = entries, es = e + numb; e < es; e++, xx += bwidth )
+    for ( i = start; i < end; i++ )
     {
+        e = CHART_ENTRY( sp, i );
+        xx = x + i * bwidth + 0.5 * ( bwidth - lbox );
         if ( e->val < 0.0 )
             fl_draw_text_beside( FL_ALIGN_TOP, xx, zeroh - e->val * incr + 12,
                                  lbox, lbox, e->lcol, sp->lstyle,
@@ -386,8 +469,7 @@ draw_piechart( FL_OBJECT * ob,
           tyc;
     float lh = fl_get_char_height( sp->lstyle, sp->lsize, 0, 0 );
     int lbox;
-    ENTRY *e,
-          *entries = sp->entries;
+    ENTRY *e;
 
     /* compute center and radius */
 
@@ -404,8 +486,8 @@ draw_piechart( FL_OBJECT * ob,
     /* compute sum of values */
 
     for ( tot = 0.0f, i = 0; i < numb; i++ )
-        if ( entries[ i ].val > 0.0 )
-            tot += entries[ i ].val;
+        if ( ( e = CHART_ENTRY( sp, i ) )->val > 0.0 )
+            tot += e->val;
 
     if ( tot == 0.0 )
         return;
@@ -415,8 +497,8 @@ draw_piechart( FL_OBJECT * ob,
     /* Draw the pie */
 
     curang = 0.0;
-    for ( e = entries, i = 0; i < numb; i++, e++ )
-        if ( e->val > 0.0 )
+    for ( i = 0; i < numb; i++ )
+        if ( ( e = CHART_ENTRY( sp, i ) )->val > 0.0 )
         {
             float tt = incr * e->val;
 
@@ -468,6 +550,65 @@ draw_piechart( FL_OBJECT * ob,
 }
 
 
+/***************************************
+ * Calculates the drawing area from the position and size of the object
+ ***************************************/
+
+static void
+get_area( FL_OBJECT * ob )
+{
+    FLI_CHART_SPEC *sp = ob->spec;
+    FL_Coord absbw = FL_abs( ob->bw );
+
+    sp->x = ob->x + 3 + 2 * absbw;
+    sp->y = ob->y + 3 + 2 * absbw;
+    sp->w = ob->w - 6 - 4 * absbw;
+    sp->h = ob->h - 6 - 4 * absbw;
+}
+
+
+/***************************************
+ * Draws the values (for bar and line charts only those from 'start'
+ * up to, but not including, 'end')
+ ***************************************/
+
+static void
+draw_values( FL_OBJECT * ob,
+             float       min,
+             float       max,
+             int         start,
+             int         end )
+{
+    FLI_CHART_SPEC *sp = ob->spec;
+
+    start = FL_max( start, 0 );
+    end = FL_min( end, sp->numb );
+
+    switch ( ob->type )
+    {
+        case FL_BAR_CHART:
+            draw_barchart( ob, min, max, start, end );
+            break;
+
+        case FL_HORBAR_CHART:
+            draw_horbarchart( ob, min, max );
+            break;
+
+        case FL_PIE_CHART:
+            draw_piechart( ob, 0 );
+            break;
+
+        case FL_SPECIALPIE_CHART:
+            draw_piechart( ob, 1 );
+            break;
+
+        default:
+            draw_linechart( ob, min, max, start, end );
+            break;
+    }
+}
+
+
 /***************************************
  * Draws a chart object
  ***************************************/
@@ -476,29 +617,27 @@ static void
 draw_chart( FL_OBJECT * ob )
 {
     FLI_CHART_SPEC *sp = ob->spec;
-    FL_Coord absbw = FL_abs( ob->bw );
     float min = sp->min,
           max = sp->max;
+    ENTRY *e;
     int i;
 
     /* Find bounding box */
 
-    sp->x = ob->x + 3 + 2 * absbw;
-    sp->y = ob->y + 3 + 2 * absbw;
-    sp->w = ob->w - 6 - 4 * absbw;
-    sp->h = ob->h - 6 - 4 * absbw;
+    get_area( ob );
 
     /* Find bounds */
 
     if ( min == max )
     {
-        min = max = sp->numb ? sp->entries[ 0 ].val : 0.0;
+        min = max = sp->numb ? CHART_ENTRY( sp, 0 )->val : 0.0;
         for ( i = 0; i < sp->numb; i++ )
         {
-            if ( sp->entries[ i ].val < min )
-                min = sp->entries[ i ].val;
-            if ( sp->entries[ i ].val > max )
-                max = sp->entries[ i ].val;
+            e = CHART_ENTRY( sp, i );
+            if ( e->val < min )
+                min = e->val;
+            if ( e->val > max )
+                max = e->val;
         }
     }
 
@@ -522,34 +661,225 @@ draw_chart( FL_OBJECT * ob )
     }
 
     fl_set_clipping( sp->x - 1, sp->y - 1, sp->w + 2, sp->h + 2 );
+    draw_values( ob, min, max, 0, sp->numb );
+    fl_unset_clipping( );
+}
 
-    switch ( ob->type )
+
+/***************************************
+ * In scroll mode draws the chart into a pixmap and copies it from there
+ * to the window. The pixmap is what fl_add_chart_value() later shifts
+ * to make room for a new value. Returns 0 if no pixmap can be used.
+ ***************************************/
+
+static int
+draw_chart_via_pixmap( FL_OBJECT * ob )
+{
+    FLI_CHART_SPEC *sp = ob->spec;
+    Window win = fl_winget( );
+    int depth = fli_depth( fl_vmode );
+    FL_Coord x = ob->x,
+             y = ob->y;
+    FL_Coord cx,
+             cy,
+             cw,
+             ch;
+    int clipped;
+
+    sp->pm_valid = 0;
+
+    if (    ! sp->scroll
+         || win == None
+         || ! IS_RECT_BOX( ob->boxtype )
+         || ob->w <= 0
+         || ob->h <= 0 )
+        return 0;
+
+    if (    sp->pixmap
+         && (    sp->pm_w != ob->w
+              || sp->pm_h != ob->h
+              || sp->pm_depth != depth ) )
     {
-        case FL_BAR_CHART:
-            draw_barchart( ob, min, max );
-            break;
+        XFreePixmap( flx->display, sp->pixmap );
+        sp->pixmap = None;
+    }
 
-        case FL_HORBAR_CHART:
-            draw_horbarchart( ob, min, max );
-            break;
+    if ( ! sp->pixmap )
+        sp->pixmap = XCreatePixmap( flx->display, win, ob->w, ob->h, depth );
 
-        case FL_PIE_CHART:
-            draw_piechart( ob, 0 );
-            break;
+    /* Clipping to an exposed region is in window coordinates and would
+       leave parts of the pixmap undrawn, so switch it off meanwhile */
 
-        case FL_SPECIALPIE_CHART:
-            draw_piechart( ob, 1 );
-            break;
+    clipped = fl_get_global_clipping( &cx, &cy, &cw, &ch );
+    if ( clipped )
+        fli_unset_global_clipping( );
+
+    ob->x = ob->y = 0;
+    fl_winset( sp->pixmap );
+    draw_chart( ob );
+    fl_winset( win );
+    ob->x = x;
+    ob->y = y;
+
+    if ( clipped )
+        fli_set_global_clipping( cx, cy, cw, ch );
+
+    fli_flush_draw_batch( );
+    XCopyArea( flx->display, sp->pixmap, win, flx->gc,
+               0, 0, ob->w, ob->h, ob->x, ob->y );
+
+    get_area( ob );
+
+    sp->pm_x       = ob->x;
+    sp->pm_y       = ob->y;
+    sp->pm_w       = ob->w;
+    sp->pm_h       = ob->h;
+    sp->pm_depth   = depth;
+    sp->pm_type    = ob->type;
+    sp->pm_maxnumb = sp->maxnumb;
+    sp->pm_min     = sp->min;
+    sp->pm_max     = sp->max;
+    sp->pm_valid   = 1;
+
+    return 1;
+}
 
-        default:
-            draw_linechart( ob, min, max );
-            break;
-    }
 
+/***************************************
+ * Redraws the columns from 'from' up to (but not including) 'to' in
+ * the pixmap. Values in the neighbouring columns may reach into them
+ * and have to be drawn as well.
+ ***************************************/
+
+static void
+redraw_columns( FL_OBJECT * ob,
+                int         from,
+                int         to )
+{
+    FLI_CHART_SPEC *sp = ob->spec;
+    int dx = sp->w / sp->maxnumb;
+    int x0 = sp->x + FL_max( from, 0 ) * dx,
+        x1 = FL_min( sp->x + to * dx, sp->x + sp->w + 1 );
+
+    fl_rectf( x0, sp->y - 1, x1 - x0, sp->h + 2, ob->col1 );
+    fl_set_clipping( x0, sp->y - 1, x1 - x0, sp->h + 2 );
+    draw_values( ob, sp->min, sp->max, from - 1, to + 1 );
     fl_unset_clipping( );
 }
 
 
+/***************************************
+ * Shows a value just appended to a full chart by shifting what's in
+ * the pixmap one column to the left and then only drawing the newest
+ * values. This requires that nothing else changed since the chart was
+ * drawn, the bounds are fixed, there are no labels and the columns are
+ * a whole number of pixels wide. Returns 0 if the chart has to be
+ * redrawn completely instead.
+ ***************************************/
+
+static int
+scroll_chart( FL_OBJECT * ob )
+{
+    FLI_CHART_SPEC *sp = ob->spec;
+    FL_FORM *form = ob->form;
+    Window win = FL_ObjWin( ob ),
+           oldwin;
+    FL_Coord x = ob->x,
+             y = ob->y;
+    FL_Coord cx,
+             cy,
+             cw,
+             ch;
+    int clipped;
+    int dx;
+
+    if (    ! sp->pm_valid
+         || ! sp->pixmap
+         || win == None
+         || ! form
+         || form->visible != FL_VISIBLE
+         || form->frozen
+         || form->in_redraw
+         || ! ob->visible
+         || ( ob->parent && ! ob->parent->visible )
+         || ob->is_under
+         || ob->redraw
+         || (    ob->type != FL_BAR_CHART
+              && ob->type != FL_LINE_CHART
+              && ob->type != FL_FILLED_CHART
+              && ob->type != FL_SPIKE_CHART )
+         || ! IS_RECT_BOX( ob->boxtype )
+         || sp->numb != sp->maxnumb
+         || sp->nlabels
+         || sp->min == sp->max
+         || sp->pm_min != sp->min
+         || sp->pm_max != sp->max
+         || sp->pm_type != ob->type
+         || sp->pm_maxnumb != sp->maxnumb
+         || sp->pm_x != ob->x
+         || sp->pm_y != ob->y
+         || sp->pm_w != ob->w
+         || sp->pm_h != ob->h )
+        return 0;
+
+    /* Everything in the pixmap is relative to the objects origin */
+
+    ob->x = ob->y = 0;
+    get_area( ob );
+
+    dx = sp->w / sp->maxnumb;
+    if ( dx <= 0 || dx * sp->maxnumb != sp->w )
+    {
+        ob->x = x;
+        ob->y = y;
+        get_area( ob );
+        return 0;
+    }
+
+    oldwin = fl_winget( );
+    clipped = fl_get_global_clipping( &cx, &cy, &cw, &ch );
+    if ( clipped )
+        fli_unset_global_clipping( );
+
+    fl_winset( sp->pixmap );
+
+    fli_flush_draw_batch( );
+    XCopyArea( flx->display, sp->pixmap, sp->pixmap, flx->gc,
+               sp->x + dx, sp->y - 1, sp->w + 1 - dx, sp->h + 2,
+               sp->x, sp->y - 1 );
+
+    /* The first columns may still show parts of the value just dropped
+       (with rounding the line to it can reach into the second one). At
+       the end the line to the new value starts in the middle of the
+       column before the last one. */
+
+    redraw_columns( ob, 0, 2 );
+    redraw_columns( ob, sp->maxnumb - 2, sp->maxnumb + 1 );
+
+    ob->x = x;
+    ob->y = y;
+
+    if ( clipped )
+        fli_set_global_clipping( cx, cy, cw, ch );
+
+    fli_flush_draw_batch( );
+    XCopyArea( flx->display, sp->pixmap, win, flx->gc,
+               sp->x - 1, sp->y - 1, sp->w + 2, sp->h + 2,
+               ob->x + sp->x - 1, ob->y + sp->y - 1 );
+
+    get_area( ob );
+
+    /* A label inside of the chart isn't part of the pixmap */
+
+    fl_winset( win );
+    if ( fl_is_inside_lalign( ob->align ) )
+        fl_draw_object_label( ob );
+    fl_winset( oldwin );
+
+    return 1;
+}
+
+
 /***************************************
  * Handles an event, returns whether value has changed
  ***************************************/
@@ -562,6 +892,9 @@ handle_chart( FL_OBJECT * ob,
               int         key  FL_UNUSED_ARG,
               void      * ev   FL_UNUSED_ARG )
 {
+    FLI_CHART_SPEC *sp = ob->spec;
+    int i;
+
 #if FL_DEBUG >= ML_DEBUG
     M_info( __func__, fli_event_name( event ) );
 #endif
@@ -569,7 +902,8 @@ handle_chart( FL_OBJECT * ob,
     switch ( event )
     {
         case FL_DRAW:
-            draw_chart( ob );
+            if ( ! draw_chart_via_pixmap( ob ) )
+                draw_chart( ob );
             /* fall through */
 
         case FL_DRAWLABEL:
@@ -577,8 +911,14 @@ handle_chart( FL_OBJECT * ob,
             break;
 
         case FL_FREEMEM:
-            if ( ( ( FLI_CHART_SPEC * ) ob->spec )->entries )
-                fl_free( ( ( FLI_CHART_SPEC * ) ob->spec )->entries );
+            if ( sp->entries )
+            {
+                for ( i = 0; i < sp->numb; i++ )
+                    set_entry_label( sp, CHART_ENTRY( sp, i ), NULL );
+                fl_free( sp->entries );
+            }
+            if ( sp->pixmap )
+                XFreePixmap( flx->display, sp->pixmap );
             fl_free( ob->spec );
             break;
     }
@@ -601,7 +941,6 @@ fl_create_chart( int          type,
 {
     FL_OBJECT *obj;
     FLI_CHART_SPEC *sp;
-    int i;
 
     obj = fl_make_object( FL_CHART, type, x, y, w, h, label, handle_chart );
 
@@ -615,9 +954,9 @@ fl_create_chart( int          type,
     sp = obj->spec = fl_calloc( 1, sizeof *sp );
 
     sp->maxnumb = 512;
-    sp->entries = fl_calloc( sp->maxnumb + 1, sizeof *sp->entries );
-    for ( i = 0; i <= sp->maxnumb; i++ )
-        sp->entries[ i ].val = 0.0;
+    sp->nalloc  = sp->maxnumb + 1;
+    sp->entries = fl_calloc( sp->nalloc, sizeof *sp->entries );
+    sp->pixmap  = None;
 
     sp->autosize = 1;
     sp->min      = sp->max = 0.0;
@@ -661,6 +1000,7 @@ fl_set_chart_lsize( FL_OBJECT * ob,
     if ( sp->lsize != lsize )
     {
         sp->lsize = lsize;
+        sp->pm_valid = 0;
         fl_redraw_object( ob );
     }
 }
@@ -678,6 +1018,7 @@ fl_set_chart_lstyle( FL_OBJECT * ob,
     if ( sp->lstyle != lstyle )
     {
         sp->lstyle = lstyle;
+        sp->pm_valid = 0;
         fl_redraw_object( ob );
     }
 }
@@ -704,7 +1045,15 @@ fl_set_chart_lcolor( FL_OBJECT * ob,
 void
 fl_clear_chart( FL_OBJECT * ob )
 {
-    ( ( FLI_CHART_SPEC * ) ob->spec )->numb = 0;
+    FLI_CHART_SPEC *sp = ob->spec;
+    int i;
+
+    for ( i = 0; i < sp->numb; i++ )
+        set_entry_label( sp, CHART_ENTRY( sp, i ), NULL );
+
+    sp->numb = 0;
+    sp->first = 0;
+    sp->pm_valid = 0;
     fl_redraw_object( ob );
 }
 
@@ -720,6 +1069,8 @@ fl_add_chart_value( FL_OBJECT  * ob,
                     FL_COLOR     col )
 {
     FLI_CHART_SPEC *sp = ob->spec;
+    ENTRY *e;
+    int was_full;
 
 #if FL_DEBUG >= ML_ERR
     if ( ! IsValidClass( ob, FL_CHART ) )
@@ -729,30 +1080,31 @@ fl_add_chart_value( FL_OBJECT  * ob,
     }
 #endif
 
-    /* Shift entries if required */
+    if ( sp->maxnumb == 0 )
+        return;
 
-    if ( sp->numb == sp->maxnumb )
-    {
-        int i;
+    /* If the chart is full drop the oldest entry by advancing the start
+       of the ring buffer */
 
-        for ( i = 0; i < sp->numb - 1; i++ )
-            sp->entries[ i ] = sp->entries[ i + 1 ];
+    if ( ( was_full = sp->numb == sp->maxnumb ) )
+    {
+        set_entry_label( sp, CHART_ENTRY( sp, 0 ), NULL );
+        sp->first = ( sp->first + 1 ) % sp->nalloc;
         sp->numb--;
     }
 
     /* Fill in the new entry */
 
-    sp->entries[ sp->numb ].val = val;
-    sp->entries[ sp->numb ].col = col;
-    sp->entries[ sp->numb ].lcol = sp->lcol;
-
-    if ( str )
-        fli_sstrcpy( sp->entries[sp->numb ].str, str, MAX_CHART_LABEL_LEN );
-    else
-        *sp->entries[sp->numb ].str = '\0';
+    e = CHART_ENTRY( sp, sp->numb );
+    e->val = val;
+    e->col = col;
+    e->lcol = sp->lcol;
+    e->str = NULL;
+    set_entry_label( sp, e, str );
     sp->numb++;
 
-    fl_redraw_object( ob );
+    if ( ! was_full || ! sp->scroll || ! scroll_chart( ob ) )
+        fl_redraw_object( ob );
 }
 
 
@@ -768,6 +1120,7 @@ fl_insert_chart_value( FL_OBJECT  * ob,
                        FL_COLOR     col )
 {
     FLI_CHART_SPEC *sp = ob->spec;
+    ENTRY *e;
     int i;
 
 #if FL_DEBUG >= ML_ERR
@@ -781,24 +1134,42 @@ fl_insert_chart_value( FL_OBJECT  * ob,
     if ( indx < 1 || indx > sp->numb + 1 )
         return;
 
-    /* Shift entries */
+    /* If the chart is full the last entry gets dropped - and if that's
+       where the new one was to go there's nothing left to do */
 
-    for ( i = sp->numb; i >= indx; i-- )
-        sp->entries[ i ] = sp->entries[ i - 1 ];
+    if ( sp->numb == sp->maxnumb )
+    {
+        if ( indx > sp->numb )
+            return;
+        set_entry_label( sp, CHART_ENTRY( sp, sp->numb - 1 ), NULL );
+        sp->numb--;
+    }
 
-    if ( sp->numb < sp->maxnumb )
-        sp->numb++;
+    /* Shift the shorter part of the ring buffer, the entries before the
+       new one towards the front or those after it towards the end */
 
-    /* Fill in the new entry */
+    if ( indx - 1 < sp->numb / 2 )
+    {
+        sp->first = ( sp->first + sp->nalloc - 1 ) % sp->nalloc;
+        for ( i = 0; i < indx - 1; i++ )
+            *CHART_ENTRY( sp, i ) = *CHART_ENTRY( sp, i + 1 );
+    }
+    else
+        for ( i = sp->numb; i >= indx; i-- )
+            *CHART_ENTRY( sp, i ) = *CHART_ENTRY( sp, i - 1 );
 
-    sp->entries[ indx - 1 ].val = val;
-    sp->entries[ indx - 1 ].col = col;
+    sp->numb++;
 
-    if ( str != NULL )
-        fli_sstrcpy( sp->entries[ indx - 1 ].str, str, MAX_CHART_LABEL_LEN );
-    else
-        *sp->entries[ indx - 1 ].str = '\0';
+    /* Fill in the new entry */
+
+    e = CHART_ENTRY( sp, indx - 1 );
+    e->val = val;
+    e->col = col;
+    e->lcol = sp->lcol;
+    e->str = NULL;
+    set_entry_label( sp, e, str );
 
+    sp->pm_valid = 0;
     fl_redraw_object( ob );
 }
 
@@ -815,18 +1186,17 @@ fl_replace_chart_value( FL_OBJECT  * ob,
                         FL_COLOR     col )
 {
     FLI_CHART_SPEC *sp = ob->spec;
+    ENTRY *e;
 
     if ( indx < 1 || indx > sp->numb )
         return;
 
-    sp->entries[ indx - 1 ].val = val;
-    sp->entries[ indx - 1 ].col = col;
-
-    if ( str )
-        fli_sstrcpy( sp->entries[ indx - 1 ].str, str, MAX_CHART_LABEL_LEN );
-    else
-        *sp->entries[ indx - 1 ].str = '\0';
+    e = CHART_ENTRY( sp, indx - 1 );
+    e->val = val;
+    e->col = col;
+    set_entry_label( sp, e, str );
 
+    sp->pm_valid = 0;
     fl_redraw_object( ob );
 }
 
@@ -855,6 +1225,7 @@ fl_set_chart_bounds( FL_OBJECT * ob,
     {
         sp->min = min;
         sp->max = max;
+        sp->pm_valid = 0;
         fl_redraw_object( ob );
     }
 }
@@ -884,7 +1255,10 @@ fl_set_chart_maxnumb( FL_OBJECT * ob,
                       int         maxnumb )
 {
     FLI_CHART_SPEC *sp = ob->spec;
-    int i, curmax;
+    ENTRY *entries;
+    int i,
+        numb,
+        drop;
 
     /* Fill in the new number */
 
@@ -894,42 +1268,40 @@ fl_set_chart_maxnumb( FL_OBJECT * ob,
         return;
     }
 
+    if ( maxnumb > FL_CHART_MAX )
+        maxnumb = FL_CHART_MAX;
+
     if ( maxnumb == sp->maxnumb )
         return;
 
-    curmax = sp->maxnumb;
-
-    if ( maxnumb > FL_CHART_MAX )
-        sp->maxnumb = FL_CHART_MAX;
-    else
-        sp->maxnumb = maxnumb;
-
-    if ( sp->maxnumb > curmax )
+    if ( ! ( entries = fl_calloc( maxnumb + 1, sizeof *entries ) ) )
     {
-        sp->entries = fl_realloc( sp->entries,
-                                  ( sp->maxnumb + 1 ) * sizeof *sp->entries );
-        for ( i = curmax; i <= sp->maxnumb; i++ )
-            sp->entries[ i ].val = 0.0;
+        M_err( __func__, "Running out of memory" );
+        return;
     }
 
-   if ( ! sp->entries )
-   {
-       sp->maxnumb = curmax;
-       sp->entries = fl_calloc( curmax + 1, sizeof *sp->entries );
-       for ( i = 0; i <= curmax; i++ )
-           sp->entries[ i ].val = 0.0;
-       return;
-   }
+    /* Copy the newest entries over in order, getting rid of the labels of
+       those that don't fit anymore */
 
-    /* Shift entries if required */
+    numb = FL_min( sp->numb, maxnumb );
+    drop = sp->numb - numb;
 
-   if ( sp->numb > sp->maxnumb )
-   {
-       for ( i = 0; i < maxnumb; i++ )
-           sp->entries[ i ] = sp->entries[ i + sp->numb - maxnumb ];
-       sp->numb = sp->maxnumb;
-       fl_redraw_object( ob );
-    }
+    for ( i = 0; i < drop; i++ )
+        set_entry_label( sp, CHART_ENTRY( sp, i ), NULL );
+
+    for ( i = 0; i < numb; i++ )
+        entries[ i ] = *CHART_ENTRY( sp, drop + i );
+
+    fl_free( sp->entries );
+    sp->entries  = entries;
+    sp->nalloc   = maxnumb + 1;
+    sp->first    = 0;
+    sp->numb     = numb;
+    sp->maxnumb  = maxnumb;
+    sp->pm_valid = 0;
+
+    if ( drop )
+        fl_redraw_object( ob );
 }
 
 
@@ -944,6 +1316,7 @@ fl_set_chart_autosize( FL_OBJECT * ob,
     if ( ( ( FLI_CHART_SPEC * ) ob->spec )->autosize != autosize )
     {
         ( ( FLI_CHART_SPEC * ) ob->spec )->autosize = autosize;
+        ( ( FLI_CHART_SPEC * ) ob->spec )->pm_valid = 0;
         fl_redraw_object( ob );
     }
 }
@@ -959,11 +1332,41 @@ fl_set_chart_baseline( FL_OBJECT * ob,
     if ( ( ( FLI_CHART_SPEC * ) ob->spec )->no_baseline != !iYesNo )
     {
         ( ( FLI_CHART_SPEC * ) ob->spec )->no_baseline = !iYesNo;
+        ( ( FLI_CHART_SPEC * ) ob->spec )->pm_valid = 0;
         fl_redraw_object( ob );
     }
 }
 
 
+/***************************************
+ * Switches scroll mode on or off: values added to a full bar or line
+ * chart then shift what's already shown instead of having the whole
+ * chart redrawn
+ ***************************************/
+
+void
+fl_set_chart_scroll( FL_OBJECT * ob,
+                     int         yes_no )
+{
+    FLI_CHART_SPEC *sp = ob->spec;
+
+    yes_no = yes_no != 0;
+    if ( sp->scroll == yes_no )
+        return;
+
+    sp->scroll = yes_no;
+    sp->pm_valid = 0;
+
+    if ( ! yes_no && sp->pixmap )
+    {
+        XFreePixmap( flx->display, sp->pixmap );
+        sp->pixmap = None;
+    }
+
+    fl_redraw_object( ob );
+}
+
+
 /***************************************
  ***************************************/
 
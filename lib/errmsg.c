@@ -68,12 +68,12 @@ extern char *sys_errlist[ ];
 
 static FILE *errlog;           /* where the msg is going       */
 static int threshold;          /* current threshold            */
-static int level;              /* requested message level      */
-static const char *file;       /* source file name             */
-static int lineno = 0;         /* line no. in that file        */
+static FLI_THREAD_LOCAL int level;              /* requested message level */
+static FLI_THREAD_LOCAL const char *file;       /* source file name        */
+static FLI_THREAD_LOCAL int lineno = 0;         /* line no. in that file   */
 
 
-FL_ERROR_FUNC efp_;                  /* global pointer to shut up lint */
+FLI_THREAD_LOCAL FL_ERROR_FUNC efp_;   /* global pointer to shut up lint */
 FL_ERROR_FUNC user_error_function_;  /* hook for application error handler */
 
 
@@ -139,15 +139,13 @@ P_errmsg( const char * func,
 {
     char line[ ( int ) log10( INT_MAX ) + 3 ],
          *why;
+    FILE *fp = errlog ? errlog : stderr;
 
     /* Return if there is nothing to do */
 
     if ( level >= threshold )
         return;
 
-    if ( ! errlog )
-        errlog = stderr;
-
     EXPAND_FORMAT_STRING( why, fmt );
 
     if ( lineno > 0 )
@@ -156,10 +154,10 @@ P_errmsg( const char * func,
         strcpy( line, "?" );
 
     if ( func && *func )
-        fprintf( errlog, "In %s() [%s:%s]: %s\n", func, file, line,
+        fprintf( fp, "In %s() [%s:%s]: %s\n", func, file, line,
                  why ? why : "" );
     else
-        fprintf( errlog, "In [%s:%s]: %s\n", file, line, why ? why : "" );
+        fprintf( fp, "In [%s:%s]: %s\n", file, line, why ? why : "" );
 
     fli_safe_free( why );
 }
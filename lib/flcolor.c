@@ -735,6 +735,8 @@ fli_create_gc( Window win )
        *flgce;
     FL_State *fs = fl_state + fl_vmode;
 
+    fli_flush_draw_batch( );
+
     /* If gc for this visual exists, do switch */
 
     if ( fl_state[ fl_vmode ].gc[ 0 ] )
@@ -1006,6 +1008,11 @@ fl_color( FL_COLOR col )
 {
     static int vmode = -1;
 
+    /* Setting the color means something is going to be drawn directly,
+       so recorded requests have to be drawn first */
+
+    fli_flush_draw_batch( );
+
     if ( flx->color != col || vmode != fl_vmode )
     {
         unsigned long p = fl_get_pixel( col );
@@ -1199,7 +1206,10 @@ fl_mapcolor( FL_COLOR col,
     if ( col < FL_BUILT_IN_COLS )
         M_warn( __func__, "Changing reserved color" );
 
-    /* Must invalidate color cache */
+    /* Requests recorded for the color must be drawn with its old value
+       and the color cache must be invalidated */
+
+    fli_flush_draw_batch( );
 
     if ( col == flx->color )
         flx->color = BadPixel;
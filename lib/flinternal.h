@@ -224,6 +224,8 @@ void fli_show_object( FL_OBJECT * );
 
 void fli_recalc_intersections( FL_FORM * );
 
+void fli_free_object_grid( FL_FORM * );
+
 FL_OBJECT * fli_find_last( FL_FORM *,
                            int,
                            FL_Coord,
@@ -445,6 +447,21 @@ void fli_set_additional_clipping( FL_Coord,
 
 FL_RECT * fli_get_global_clip_rect( void );
 
+void fli_begin_draw_batch( void );
+
+void fli_end_draw_batch( void );
+
+int fli_suspend_draw_batch( void );
+
+void fli_resume_draw_batch( int );
+
+void fli_flush_draw_batch( void );
+
+void fli_flush_draw_batch_area( FL_Coord,
+                                FL_Coord,
+                                FL_Coord,
+                                FL_Coord );
+
 
 /* Application windows */
 
@@ -487,6 +504,7 @@ typedef struct fli_idle_cb_ {
 
 typedef struct fli_io_event_ {
     struct fli_io_event_ * next;
+    struct fli_io_event_ * fd_next;     /* next record for the same fd */
     FL_IO_CALLBACK         callback;
     void                 * data;
     unsigned int           mask;
@@ -515,21 +533,26 @@ typedef struct fli_signallist_ {
 
 void fli_remove_all_signal_callbacks( void );
 
+int fli_signals_wake_up( void );
+
 /* timeouts */
 
 typedef struct fli_timeout_ {
     int                    id;
-    struct fli_timeout_  * next;
-    struct fli_timeout_  * prev;
-    long                   start_sec,
-                           start_usec;
-    long                   ms_to_wait;
+    int                    heap_index;    /* position in the timeout heap */
+    struct fli_timeout_  * hash_next;     /* next entry in same id bucket */
+    unsigned long          serial;        /* order of creation */
+    long                   expire_sec,    /* (monotonic) time of expiry */
+                           expire_usec;
     FL_TIMEOUT_CALLBACK    callback;
     void                 * data;
 } FLI_TIMEOUT_REC;
 
 void fli_remove_all_timeouts( void );
 
+void fli_get_monotonic_time( long *,
+                             long * );
+
 /*
  *  Intenal controls.
  */
@@ -540,7 +563,11 @@ typedef struct fli_context_ {
     FLI_IDLE_REC       * idle_rec;          /* idle callback record   */
     FLI_IO_REC         * io_rec;            /* async IO record        */
     FLI_SIGNAL_REC     * signal_rec;        /* list of app signals    */
-    FLI_TIMEOUT_REC    * timeout_rec;       /* timeout callbacks      */
+    FLI_TIMEOUT_REC   ** timeout_heap;      /* timeouts, min-heap     */
+    int                  num_timeouts;
+    int                  timeout_heap_size;
+    FLI_TIMEOUT_REC   ** timeout_hash;      /* id to timeout lookup   */
+    int                  timeout_hash_size;
     int                  idle_delta;        /* timer resolution       */
     int                  last_event;        /* last event received    */
     long                 mouse_button;      /* push/release record    */
@@ -885,6 +912,10 @@ void fli_insert_composite( FL_OBJECT *,
 
 int fli_is_watched_io( int );
 
+void fli_remove_all_io_callbacks( void );
+
+void fli_set_io_wakeup_fd( int );
+
 const char * fli_object_class_name( FL_OBJECT * );
 
 char * fli_read_line( FILE * fp );
@@ -1101,6 +1132,10 @@ int fli_get_string_widthTABfs( XFontStruct *,
                                const char *,
                                int );
 
+int fli_get_string_widthfs( XFontStruct *,
+                            const char *,
+                            int );
+
 
 #endif /* ! defined FL_INTERNAL_H */
 
@@ -1350,10 +1350,7 @@ fl_finish( void )
 #endif
 
     if ( fli_context )
-        while ( fli_context->io_rec )
-            fl_remove_io_callback( fli_context->io_rec->source,
-                                   fli_context->io_rec->mask,
-                                   fli_context->io_rec->callback );
+        fli_remove_all_io_callbacks( );
 
     fli_safe_free( fli_context );
 
@@ -40,6 +40,8 @@
 
 static XFontStruct * defaultfs;
 
+static void forget_advance_table( XFontStruct * );
+
 static XFontStruct * try_get_font_struct( int,
                                           int,
                                           int );
@@ -228,7 +230,10 @@ fl_set_font_name( int          n,
 
         for ( i = 0; i < flf->nsize; i++ )
             if ( flf->size[ i ] > 0 )
+            {
+                forget_advance_table( flf->fs[ i ] );
                 XFreeFont( flx->display, flf->fs[ i ] );
+            }
         *flf->fname = '\0';
     }
 
@@ -403,7 +408,10 @@ try_get_font_struct( int numb,
     if ( flf->nsize == FL_MAX_FONTSIZES )
     {
         if ( flf->size[ FL_MAX_FONTSIZES - 1 ] > 0 )
+        {
+            forget_advance_table( flf->fs[ FL_MAX_FONTSIZES - 1 ] );
             XFreeFont( flx->display, flf->fs[ FL_MAX_FONTSIZES - 1 ] );
+        }
         flf->nsize--;
     }
 
@@ -428,6 +436,124 @@ fl_get_font_struct( int style,
 }
 
 
+/* To avoid having to look up the metrics of each character of a string
+   for each string measured (as XTextWidth() does) a table with the widths
+   of all characters is set up once for each font (with only a single row
+   of characters, i.e. 8-bit fonts) that gets used. The tables are kept in
+   a small cache, indexed by the address of the font structure. */
+
+#define ADVANCE_CACHE_SIZE  64
+
+typedef struct {
+    XFontStruct * fs;
+    short         width[ 256 ];
+} ADVANCE_TABLE;
+
+static ADVANCE_TABLE advance_cache[ ADVANCE_CACHE_SIZE ];
+
+#define advance_slot( fs )  \
+    ( advance_cache + ( ( unsigned long ) ( fs ) >> 4 ) % ADVANCE_CACHE_SIZE )
+
+
+/***************************************
+ * Returns the metrics XTextWidth() uses for a character of a single-row
+ * font or NULL if the font has no such character
+ ***************************************/
+
+static XCharStruct *
+char_metrics( XFontStruct  * fs,
+              unsigned int   c )
+{
+    XCharStruct *cs;
+
+    if ( c < fs->min_char_or_byte2 || c > fs->max_char_or_byte2 )
+        return NULL;
+
+    if ( ! fs->per_char )
+        return &fs->min_bounds;
+
+    cs = fs->per_char + ( c - fs->min_char_or_byte2 );
+
+    /* Characters with all metrics being 0 don't exist */
+
+    if (    ! cs->width && ! cs->lbearing && ! cs->rbearing
+         && ! cs->ascent && ! cs->descent )
+        return NULL;
+
+    return cs;
+}
+
+
+/***************************************
+ * Returns the table of character widths for a font, setting it up
+ * if necessary, or NULL for fonts with more than one row of characters
+ ***************************************/
+
+static ADVANCE_TABLE *
+get_advance_table( XFontStruct * fs )
+{
+    ADVANCE_TABLE *t = advance_slot( fs );
+    XCharStruct *def,
+                *cs;
+    unsigned int c;
+
+    if ( t->fs == fs )
+        return t;
+
+    if ( fs->min_byte1 || fs->max_byte1 )
+        return NULL;
+
+    /* Characters that don't exist are drawn using the default character */
+
+    def = char_metrics( fs, fs->default_char );
+
+    for ( c = 0; c < 256; c++ )
+        t->width[ c ] = ( cs = char_metrics( fs, c ) ) ?
+                        cs->width : ( def ? def->width : 0 );
+
+    t->fs = fs;
+    return t;
+}
+
+
+/***************************************
+ * Must be called before a font gets freed
+ ***************************************/
+
+static void
+forget_advance_table( XFontStruct * fs )
+{
+    ADVANCE_TABLE *t = advance_slot( fs );
+
+    if ( t->fs == fs )
+        t->fs = NULL;
+}
+
+
+/***************************************
+ * Returns the width of a string in the font, a faster
+ * replacement for XTextWidth()
+ ***************************************/
+
+int
+fli_get_string_widthfs( XFontStruct * fs,
+                        const char  * s,
+                        int           len )
+{
+    ADVANCE_TABLE *t = get_advance_table( fs );
+    const unsigned char *p = ( const unsigned char * ) s;
+    int w = 0;
+
+    if ( ! t )
+        return XTextWidth( fs, s, len );
+
+    while ( len-- > 0 )
+        w += t->width[ *p++ ];
+
+    return w;
+}
+
+
 /***************************************
  * Similar to fl_get_string_xxxGC except that there is no side effects.
  * Must not free the fontstruct as structure FL_FONT caches the
@@ -442,7 +568,8 @@ fl_get_string_width( int          style,
 {
     XFontStruct *fs = fl_get_font_struct( style, size );
 
-    return fli_no_connection ? ( len * size ) : XTextWidth( fs, s, len );
+    return fli_no_connection ?
+           ( len * size ) : fli_get_string_widthfs( fs, s, len );
 }
 
 
@@ -467,11 +594,11 @@ fli_get_string_widthTABfs( XFontStruct * fs,
     for ( w = 0, q = s; *q && ( p = strchr( q, '\t' ) ) && ( p - s ) < len;
           q = p + 1 )
     {
-        w += XTextWidth( fs, q, p - q );
+        w += fli_get_string_widthfs( fs, q, p - q );
         w = ( ( w / tab ) + 1 ) * tab;
     }
 
-    return w += XTextWidth( fs, q, len - ( q - s ) );
+    return w += fli_get_string_widthfs( fs, q, len - ( q - s ) );
 }
 
 
@@ -643,8 +770,8 @@ fl_set_tabstop( const char *s )
 int
 fli_get_tabpixels( XFontStruct * fs )
 {
-    return   XTextWidth( fs, *tabstop, *tabstopNchar )
-           + XTextWidth( fs, " ", 1 );
+    return   fli_get_string_widthfs( fs, *tabstop, *tabstopNchar )
+           + fli_get_string_widthfs( fs, " ", 1 );
 }
 
 
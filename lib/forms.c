@@ -1690,6 +1690,8 @@ fl_free_form( FL_FORM * form )
 
     fli_fast_free_object = NULL;
 
+    fli_free_object_grid( form );
+
     if ( form->flpixmap )
     {
         fli_free_flpixmap( form->flpixmap );
@@ -57,6 +57,18 @@ static int form_event_queued( XEvent *,
 static int delta_msec = FLI_TIMER_RES;
 static XEvent st_xev;
 
+/* If set the main loop, while there's nothing to be done periodically,
+   blocks until there's an X event, IO on one of the watched fds or a
+   timeout expires instead of waking up every few hundred milliseconds.
+   Also X events then aren't delayed in favour of IO callbacks. */
+
+static int event_driven = 1;
+
+/* How long to wait (in ms) when the main loop is event-driven and
+   there's nothing else to limit the waiting time */
+
+#define BLOCK_PAUSE   3600000L
+
 extern void ( * fli_handle_signal )( void );       /* defined in signal.c */
 extern int ( * fli_handle_clipboard )( void * );   /* defined in clipboard.c */
 
@@ -884,17 +896,31 @@ get_next_event_or_idle( int        wait_io,
               || fli_int.pushobj
               || fli_context->idle_rec )
         msec = delta_msec;
+    else if ( event_driven && fli_signals_wake_up( ) )
+        msec = BLOCK_PAUSE;
     else
         msec = FL_min( delta_msec * 3, 300 );
 
-    if ( fli_context->timeout_rec )
+    if ( fli_context->num_timeouts )
         fli_handle_timeouts( &msec );
 
+    /* In event-driven mode waiting (for IO or the next timeout) also ends
+       when data from the X server arrive */
+
+    fli_set_io_wakeup_fd( event_driven ?
+                          ConnectionNumber( flx->display ) : -1 );
+
     /* Skip checking for an X event after 10 events, thus giving X events
        a 10:1 priority over async IO, UPDATE events, automatic handlers and
-       idle callbacks etc. */
+       idle callbacks etc. In event-driven mode X events are never skipped,
+       but every 11th time round pending IO is dealt with (without waiting)
+       so it can't get starved by a flood of X events. */
+
+    if ( event_driven && ++cnt % 11 == 0 && fli_context->io_rec )
+        fli_watch_io( fli_context->io_rec, 0 );
 
-    if ( ++cnt % 11 && XEventsQueued( flx->display, QueuedAfterFlush ) )
+    if (    ( event_driven || ++cnt % 11 )
+         && XEventsQueued( flx->display, QueuedAfterFlush ) )
     {
         XNextEvent( flx->display, xev );
 
@@ -1646,6 +1672,23 @@ fl_set_idle_callback( FL_APPEVENT_CB   callback,
 }
 
 
+/***************************************
+ * Switches between the event-driven main loop (the default), which
+ * sleeps until there's something to do, and the traditional one that
+ * polls for X events and IO at regular intervals. Returns the previous
+ * setting.
+ ***************************************/
+
+int
+fl_set_event_driven_loop( int yes )
+{
+    int old = event_driven;
+
+    event_driven = yes != 0;
+    return old;
+}
+
+
 /***************************************
  ***************************************/
 
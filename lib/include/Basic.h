@@ -771,6 +771,8 @@ struct FL_OBJECT_ {
     int              group_id;
     int              want_motion;
     int              want_update;
+    XRectangle       grid_area;      /* area registered in the forms grid */
+    long             grid_order;     /* position in the forms object list */
 };
 
 
@@ -892,6 +894,7 @@ struct FL_FORM_ {
     void                   ( * pre_attach )( FL_FORM * );
     void                 * attach_data;
     int                    in_redraw;
+    void                 * obj_grid;         /* internal use */
 };
 
 
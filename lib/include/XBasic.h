@@ -618,6 +618,8 @@ FL_EXPORT long fl_remove_selected_xevent( Window win,
 
 FL_EXPORT void fl_set_idle_delta( long delta );
 
+FL_EXPORT int fl_set_event_driven_loop( int yes );
+
 FL_EXPORT FL_APPEVENT_CB fl_add_event_callback( Window           win,
                                                 int              ev,
                                                 FL_APPEVENT_CB   wincb,
@@ -226,6 +226,15 @@ FL_EXPORT void
                                      FL_BROWSER_SCROLL_CALLBACK,
                                      void * );
 
+typedef const char * ( * FL_BROWSER_FETCH )( FL_OBJECT *,
+                                             int,
+                                             void * );
+
+FL_EXPORT void fl_set_browser_virtual( FL_OBJECT *,
+                                       int,
+                                       FL_BROWSER_FETCH,
+                                       void * );
+
 FL_EXPORT int fl_get_browser_line_yoffset( FL_OBJECT *,
 										   int  );
 
@@ -111,6 +111,9 @@ FL_EXPORT void fl_set_chart_lcolor( FL_OBJECT * ob,
 FL_EXPORT void fl_set_chart_baseline( FL_OBJECT * ob,
                                       int         iYesNo );
 
+FL_EXPORT void fl_set_chart_scroll( FL_OBJECT * ob,
+                                    int         yes_no );
+
 #define fl_set_chart_lcol   fl_set_chart_lcolor
 
 #endif /* ! defined FL_CHART_H */
@@ -105,6 +105,16 @@ FL_EXPORT void fl_insert_xyplot_data( FL_OBJECT * ob,
                                       double      x,
                                       double      y );
 
+FL_EXPORT void fl_append_xyplot_data( FL_OBJECT * ob,
+                                      int         id,
+                                      float     * x,
+                                      float     * y,
+                                      int         n );
+
+FL_EXPORT int fl_set_xyplot_maxpoints( FL_OBJECT * ob,
+                                       int         id,
+                                       int         maxpoints );
+
 #define fl_set_xyplot_datafile   fl_set_xyplot_file
 
 FL_EXPORT void fl_add_xyplot_text( FL_OBJECT  * ob,
@@ -59,6 +59,13 @@ static int prep_recalc( FL_FORM   * form,
                         FL_OBJECT * start_obj );
 static void finish_recalc( FL_FORM   * form,
                            FL_OBJECT * start_obj );
+static void fli_combine_rectangles( FL_RECT       * r1,
+                                    const FL_RECT * r2 );
+static void draw_form_object( FL_FORM   * form,
+                              FL_OBJECT * obj );
+static void add_to_grid( FL_OBJECT * obj );
+static void remove_from_grid( FL_OBJECT * obj );
+static void update_grid_area( FL_OBJECT * obj );
 
 static FL_OBJECT *refocus;
 
@@ -100,6 +107,29 @@ static FL_RECT *tmp_rects = NULL;
 #define IN_REDRAW         1
 #define HIDE_WHILE_FROZEN 2
 
+#define GRID_MIN_CELL_SIZE   16
+#define GRID_MAX_CELL_SIZE  256
+
+typedef struct {
+    FL_OBJECT ** objs;
+    int          cnt,
+                 nalloc;
+} FLI_GRID_CELL;
+
+typedef struct {
+    FLI_GRID_CELL * cells;
+    int             cols,
+                    rows,
+                    size;           /* width and height of a cell          */
+    FL_Coord        w,              /* form size the grid was set up for   */
+                    h;
+    int             nobjs,          /* number of objects of the form       */
+                    setup_nobjs;    /* ... when the grid was set up        */
+    long            next_order;     /* position of next appended object    */
+    int             marked;         /* objects possibly marked for redraw  */
+    int             valid;          /* unset when the grid must be rebuilt */
+} FLI_OBJ_GRID;
+
 
 /***************************************
  * Returns the "background object" of a form or NULL if there isn't one
@@ -297,6 +327,8 @@ fl_add_object( FL_FORM   * form,
             obj->next = end;
             end->prev = obj;
 
+            add_to_grid( obj );
+
             if ( obj->child )
             {
                 FL_OBJECT * tmp;
@@ -326,6 +358,8 @@ fl_add_object( FL_FORM   * form,
         form->last = obj;
     }
 
+    add_to_grid( obj );
+
     if ( obj->input && obj->active && ! form->focusobj )
         fl_set_focus_object( form, obj );
 
@@ -419,6 +453,8 @@ fli_insert_object( FL_OBJECT * obj,
     before->prev = obj;
     obj->form    = form;
 
+    add_to_grid( obj );
+
     if ( obj->automatic )
     {
         form->num_auto_objects++;
@@ -555,6 +591,7 @@ fl_delete_object( FL_OBJECT * obj )
     if ( obj->objclass != FL_BEGIN_GROUP && obj->objclass != FL_END_GROUP )
         obj->group_id = 0;
 
+    remove_from_grid( obj );
     obj->form = NULL;
 
     if ( obj->prev )
@@ -1959,10 +1996,698 @@ fl_get_focus_object( FL_FORM * form )
 }
 
 
+/*-----------------------------------------------------------------------
+   Spatial index of the objects of a form. A uniform grid of square cells
+   is laid over the form and each cell holds pointers to all objects
+   whose area overlaps it. Hit tests, redraws restricted to a clipping
+   region and the search for objects on top of another one then only
+   have to look at the objects in the cells concerned instead of at all
+   objects of the form. The area registered for an object is its bounding
+   box (including a label outside of it), for child objects united with
+   the one of the top-most parent since composite objects tend to move
+   their children around without telling anybody.
+-----------------------------------------------------------------------*/
+
+/***************************************
+ * Returns the range of grid cells a rectangle overlaps, rectangles
+ * (partially) outside of the form are clamped to the border cells
+ ***************************************/
+
+static void
+grid_cell_range( const FLI_OBJ_GRID * grid,
+                 const XRectangle   * r,
+                 int                * c0,
+                 int                * r0,
+                 int                * c1,
+                 int                * r1 )
+{
+    *c0 = FL_clamp( r->x / grid->size, 0, grid->cols - 1 );
+    *r0 = FL_clamp( r->y / grid->size, 0, grid->rows - 1 );
+    *c1 = FL_clamp( ( r->x + FL_max( r->width, 1 ) - 1 ) / grid->size,
+                    0, grid->cols - 1 );
+    *r1 = FL_clamp( ( r->y + FL_max( r->height, 1 ) - 1 ) / grid->size,
+                    0, grid->rows - 1 );
+}
+
+
+/***************************************
+ * Enters an object into all cells its (already set) area overlaps
+ ***************************************/
+
+static void
+grid_link( FLI_OBJ_GRID * grid,
+           FL_OBJECT    * obj )
+{
+    int c0,
+        r0,
+        c1,
+        r1,
+        c,
+        r;
+
+    grid_cell_range( grid, &obj->grid_area, &c0, &r0, &c1, &r1 );
+
+    for ( r = r0; r <= r1; r++ )
+        for ( c = c0; c <= c1; c++ )
+        {
+            FLI_GRID_CELL *cell = grid->cells + r * grid->cols + c;
+
+            if ( cell->cnt == cell->nalloc )
+            {
+                int nalloc = cell->nalloc ? 2 * cell->nalloc : 8;
+                FL_OBJECT **objs = fl_realloc( cell->objs,
+                                               nalloc * sizeof *objs );
+
+                /* Without memory the grid can't be trusted anymore */
+
+                if ( ! objs )
+                {
+                    grid->valid = 0;
+                    return;
+                }
+
+                cell->objs   = objs;
+                cell->nalloc = nalloc;
+            }
+
+            cell->objs[ cell->cnt++ ] = obj;
+        }
+}
+
+
+/***************************************
+ * Removes an object from all cells it was entered into
+ ***************************************/
+
+static void
+grid_unlink( FLI_OBJ_GRID * grid,
+             FL_OBJECT    * obj )
+{
+    int c0,
+        r0,
+        c1,
+        r1,
+        c,
+        r,
+        i;
+
+    if ( obj->grid_area.width == 0 )
+        return;
+
+    grid_cell_range( grid, &obj->grid_area, &c0, &r0, &c1, &r1 );
+
+    for ( r = r0; r <= r1; r++ )
+        for ( c = c0; c <= c1; c++ )
+        {
+            FLI_GRID_CELL *cell = grid->cells + r * grid->cols + c;
+
+            for ( i = 0; i < cell->cnt; i++ )
+                if ( cell->objs[ i ] == obj )
+                {
+                    cell->objs[ i ] = cell->objs[ --cell->cnt ];
+                    break;
+                }
+        }
+
+    obj->grid_area.width = obj->grid_area.height = 0;
+}
+
+
+/***************************************
+ * Returns the area to be registered for an object in the grid
+ ***************************************/
+
+static void
+get_grid_area( const FL_OBJECT * obj,
+               XRectangle      * area )
+{
+    const FL_OBJECT *top = obj;
+
+    get_object_rect( obj, area, 0 );
+
+    while ( top->parent )
+        top = top->parent;
+
+    if ( top != obj )
+    {
+        XRectangle r;
+
+        get_object_rect( top, &r, 0 );
+        fli_combine_rectangles( area, &r );
+    }
+}
+
+
+/***************************************
+ * (Re)builds the grid for a form from scratch, with a cell size that
+ * is chosen so that on average each cell overlaps a few objects
+ ***************************************/
+
+static void
+rebuild_grid( FL_FORM      * form,
+              FLI_OBJ_GRID * grid )
+{
+    FL_OBJECT *obj;
+    int cnt = 0,
+        size,
+        cols,
+        rows,
+        i;
+
+    for ( obj = form->first; obj; obj = obj->next )
+        cnt++;
+
+    size = 2 * sqrt( ( double ) form->w * form->h / FL_max( cnt, 1 ) );
+    size = FL_clamp( size, GRID_MIN_CELL_SIZE, GRID_MAX_CELL_SIZE );
+    cols = FL_max( ( form->w + size - 1 ) / size, 1 );
+    rows = FL_max( ( form->h + size - 1 ) / size, 1 );
+
+    if ( grid->cells && grid->cols * grid->rows == cols * rows )
+        for ( i = 0; i < cols * rows; i++ )
+            grid->cells[ i ].cnt = 0;
+    else
+    {
+        for ( i = 0; i < grid->cols * grid->rows; i++ )
+            fli_safe_free( grid->cells[ i ].objs );
+        fli_safe_free( grid->cells );
+
+        grid->cols = grid->rows = 0;
+        grid->valid = 0;
+
+        if ( ! ( grid->cells = fl_calloc( cols * rows, sizeof *grid->cells ) ) )
+            return;
+    }
+
+    grid->cols       = cols;
+    grid->rows       = rows;
+    grid->size       = size;
+    grid->w          = form->w;
+    grid->h          = form->h;
+    grid->nobjs      = grid->setup_nobjs = cnt;
+    grid->next_order = cnt;
+    grid->marked     = 0;
+    grid->valid      = 1;
+
+    for ( i = 0, obj = form->first; obj; obj = obj->next )
+    {
+        obj->grid_order = i++;
+        obj->grid_area.width = obj->grid_area.height = 0;
+
+        if ( obj->redraw )
+            grid->marked++;
+
+        if (    obj->objclass == FL_BEGIN_GROUP
+             || obj->objclass == FL_END_GROUP )
+            continue;
+
+        get_grid_area( obj, &obj->grid_area );
+        grid_link( grid, obj );
+    }
+}
+
+
+/***************************************
+ * Returns the grid of a form, creating or rebuilding it if necessary,
+ * or NULL if there's none (only when running out of memory)
+ ***************************************/
+
+static FLI_OBJ_GRID *
+get_grid( FL_FORM * form )
+{
+    FLI_OBJ_GRID *grid = form->obj_grid;
+
+    if ( ! grid )
+    {
+        if ( ! ( grid = fl_calloc( 1, sizeof *grid ) ) )
+            return NULL;
+        form->obj_grid = grid;
+    }
+
+    /* Besides when it's not up to date also rebuild the grid when the form
+       changed its size or has got a lot more objects, the cells would have
+       the wrong size otherwise */
+
+    if (    ! grid->valid
+         || grid->w != form->w
+         || grid->h != form->h
+         || grid->nobjs > 4 * grid->setup_nobjs + 64 )
+        rebuild_grid( form, grid );
+
+    return grid->valid ? grid : NULL;
+}
+
+
+/***************************************
+ * Deletes the grid of a form
+ ***************************************/
+
+void
+fli_free_object_grid( FL_FORM * form )
+{
+    FLI_OBJ_GRID *grid = form->obj_grid;
+    int i;
+
+    if ( ! grid )
+        return;
+
+    for ( i = 0; i < grid->cols * grid->rows; i++ )
+        fli_safe_free( grid->cells[ i ].objs );
+    fli_safe_free( grid->cells );
+    fli_safe_free( form->obj_grid );
+}
+
+
+/***************************************
+ * Enters an object that just got linked into the list of objects of
+ * its form into the grid. As long as it got appended to the end of the
+ * list it just gets the next position number, otherwise the positions
+ * of all following objects would change and the grid gets rebuilt the
+ * next time it's needed.
+ ***************************************/
+
+static void
+add_to_grid( FL_OBJECT * obj )
+{
+    FLI_OBJ_GRID *grid = obj->form->obj_grid;
+
+    if ( ! grid || ! grid->valid )
+        return;
+
+    if ( obj->next )
+    {
+        grid->valid = 0;
+        return;
+    }
+
+    obj->grid_order = grid->next_order++;
+    grid->nobjs++;
+
+    get_grid_area( obj, &obj->grid_area );
+    grid_link( grid, obj );
+}
+
+
+/***************************************
+ * Removes an object that is about to be unlinked from its form
+ * from the grid
+ ***************************************/
+
+static void
+remove_from_grid( FL_OBJECT * obj )
+{
+    FLI_OBJ_GRID *grid = obj->form->obj_grid;
+
+    if ( ! grid || ! grid->valid )
+        return;
+
+    grid_unlink( grid, obj );
+    grid->nobjs--;
+}
+
+
+/***************************************
+ * Updates the area registered for an object and its children after
+ * they may have been moved or resized
+ ***************************************/
+
+static void
+update_grid_area( FL_OBJECT * obj )
+{
+    FLI_OBJ_GRID *grid;
+    XRectangle area;
+    FL_OBJECT *o;
+
+    if ( ! obj->form || ! ( grid = obj->form->obj_grid ) || ! grid->valid )
+        return;
+
+    if ( obj->objclass != FL_BEGIN_GROUP && obj->objclass != FL_END_GROUP )
+    {
+        get_grid_area( obj, &area );
+
+        if (    area.x      != obj->grid_area.x
+             || area.y      != obj->grid_area.y
+             || area.width  != obj->grid_area.width
+             || area.height != obj->grid_area.height )
+        {
+            grid_unlink( grid, obj );
+            obj->grid_area = area;
+            grid_link( grid, obj );
+        }
+    }
+
+    for ( o = obj->child; o; o = o->nc )
+        update_grid_area( o );
+}
+
+
+/***************************************
+ * Collects all objects whose registered area overlaps the cells covered
+ * by a rectangle into an array (that gets enlarged as necessary). Since
+ * an object can be in several cells it's only taken from the first cell
+ * both it and the rectangle overlap. Returns the number of objects found
+ * or -1 when running out of memory.
+ ***************************************/
+
+static int
+query_grid( FLI_OBJ_GRID      * grid,
+            const XRectangle  * rect,
+            FL_OBJECT       *** objs,
+            int               * nalloc )
+{
+    int c0,
+        r0,
+        c1,
+        r1,
+        c,
+        r,
+        i;
+    int cnt = 0;
+
+    grid_cell_range( grid, rect, &c0, &r0, &c1, &r1 );
+
+    for ( r = r0; r <= r1; r++ )
+        for ( c = c0; c <= c1; c++ )
+        {
+            FLI_GRID_CELL *cell = grid->cells + r * grid->cols + c;
+
+            for ( i = 0; i < cell->cnt; i++ )
+            {
+                FL_OBJECT *obj = cell->objs[ i ];
+
+                /* Skip the object if it also is in the cell to the left
+                   or above that's also covered by the rectangle */
+
+                if (    ( c > c0 && obj->grid_area.x < c * grid->size )
+                     || ( r > r0 && obj->grid_area.y < r * grid->size ) )
+                    continue;
+
+                if ( cnt == *nalloc )
+                {
+                    int n = *nalloc ? 2 * *nalloc : 64;
+                    FL_OBJECT **o = fl_realloc( *objs, n * sizeof *o );
+
+                    if ( ! o )
+                        return -1;
+
+                    *objs   = o;
+                    *nalloc = n;
+                }
+
+                ( *objs )[ cnt++ ] = obj;
+            }
+        }
+
+    return cnt;
+}
+
+
+/***************************************
+ * qsort() callback for sorting objects by their position in the form
+ ***************************************/
+
+static int
+cmp_grid_order( const void * a,
+                const void * b )
+{
+    long oa = ( * ( FL_OBJECT * const * ) a )->grid_order,
+         ob = ( * ( FL_OBJECT * const * ) b )->grid_order;
+
+    return oa < ob ? -1 : oa > ob;
+}
+
+
+/***************************************
+ * Tests if two rectangles overlap
+ ***************************************/
+
+static int
+rects_intersect( const XRectangle * r1,
+                 const XRectangle * r2 )
+{
+    return    r1->x + r1->width  > r2->x
+           && r2->x + r2->width  > r1->x
+           && r1->y + r1->height > r2->y
+           && r2->y + r2->height > r1->y;
+}
+
+
+/***************************************
+ * Marks all objects for redraw that are on top of an object (i.e.
+ * come later in the forms list of objects and overlap it), using the
+ * grid to find them. Returns 0 if the grid couldn't be used.
+ ***************************************/
+
+static int
+mark_objects_on_top( FLI_OBJ_GRID * grid,
+                     FL_OBJECT    * obj )
+{
+    FL_OBJECT **objs = NULL;
+    XRectangle r,
+               orect;
+    int nalloc = 0,
+        found = 0,
+        cnt,
+        i;
+
+    get_object_rect( obj, &r, 0 );
+
+    if ( ( cnt = query_grid( grid, &r, &objs, &nalloc ) ) < 0 )
+    {
+        fli_safe_free( objs );
+        return 0;
+    }
+
+    for ( i = 0; i < cnt && found < obj->is_under; i++ )
+    {
+        FL_OBJECT *o = objs[ i ];
+
+        if (    o->grid_order <= obj->grid_order
+             || o->redraw
+             || ! o->visible
+             || ( o->parent && ! o->parent->visible )
+             || o->objclass == FL_BEGIN_GROUP
+             || o->objclass == FL_END_GROUP )
+            continue;
+
+        get_object_rect( o, &orect, 0 );
+
+        if ( rects_intersect( &r, &orect ) )
+        {
+            mark_object_for_redraw( o );
+            found++;
+        }
+    }
+
+    fli_safe_free( objs );
+    return 1;
+}
+
+
+/***************************************
+ * Redraws the objects of a form within the current global clipping
+ * area, using the grid to find them. Returns 0 if that's not possible
+ * since there's no grid or objects may have been marked for a redraw
+ * (in which case all objects have to be looked at since the marks of
+ * those outside of the clipping area must be reset).
+ ***************************************/
+
+static int
+redraw_clipped( FL_FORM * form )
+{
+    FLI_OBJ_GRID *grid = get_grid( form );
+    FL_OBJECT **objs = NULL,
+              *bg = bg_object( form );
+    FL_RECT r;
+    int nalloc = 0,
+        cnt,
+        i;
+
+    if ( ! grid || grid->marked || ! bg )
+        return 0;
+
+    /* is_object_clipped() tests with the objects area enlarged by one
+       pixel in each direction, so do the same */
+
+    r = *fli_get_global_clip_rect( );
+    r.x--;
+    r.y--;
+    r.width  += 2;
+    r.height += 2;
+
+    if ( ( cnt = query_grid( grid, &r, &objs, &nalloc ) ) < 0 )
+    {
+        fli_safe_free( objs );
+        return 0;
+    }
+
+    qsort( objs, cnt, sizeof *objs, cmp_grid_order );
+
+    for ( i = 0; i < cnt; i++ )
+        if ( objs[ i ]->grid_order >= bg->grid_order )
+            draw_form_object( form, objs[ i ] );
+
+    fli_safe_free( objs );
+    return 1;
+}
+
+
+/***************************************
+ * Does the work of fli_recalc_intersections() with the help of the
+ * grid: first the areas of all objects get updated (some object classes
+ * change the positions of their child objects without notice), then for
+ * each object the objects that come later in the forms list and overlap
+ * it are counted - only those in the same grid cells need to be looked
+ * at. Returns 0 if the grid couldn't be used.
+ ***************************************/
+
+static int
+recalc_with_grid( FL_FORM * form )
+{
+    FLI_OBJ_GRID *grid = get_grid( form );
+    FL_OBJECT *obj,
+              **objs = NULL;
+    XRectangle *rects,
+               area;
+    int nalloc = 0,
+        n = 0,
+        cnt,
+        i;
+
+    if ( ! grid )
+        return 0;
+
+    for ( obj = form->first; obj; obj = obj->next )
+        n++;
+
+    if ( ! ( rects = fl_malloc( FL_max( n, 1 ) * sizeof *rects ) ) )
+        return 0;
+
+    /* Renumber the objects (objects may have been deleted) and calculate
+       their bounding boxes */
+
+    for ( i = 0, obj = form->first; obj; obj = obj->next, i++ )
+    {
+        obj->grid_order = i;
+        get_object_rect( obj, rects + i, 0 );
+    }
+
+    grid->next_order = grid->nobjs = n;
+
+    for ( obj = form->first; obj; obj = obj->next )
+    {
+        const FL_OBJECT *top = obj;
+
+        if ( obj->objclass == FL_BEGIN_GROUP || obj->objclass == FL_END_GROUP )
+            continue;
+
+        area = rects[ obj->grid_order ];
+
+        while ( top->parent )
+            top = top->parent;
+
+        if ( top != obj && top->form == form )
+            fli_combine_rectangles( &area, rects + top->grid_order );
+
+        if (    area.x      != obj->grid_area.x
+             || area.y      != obj->grid_area.y
+             || area.width  != obj->grid_area.width
+             || area.height != obj->grid_area.height )
+        {
+            grid_unlink( grid, obj );
+            obj->grid_area = area;
+            grid_link( grid, obj );
+        }
+    }
+
+    if ( ! grid->valid )
+    {
+        fl_free( rects );
+        return 0;
+    }
+
+    for ( obj = bg_object( form ); obj && obj->next; obj = obj->next )
+    {
+        /* The first object of a form is always below all others */
+
+        if ( obj == bg_object( form ) )
+        {
+            obj->is_under = n - 1 - obj->grid_order;
+            continue;
+        }
+
+        obj->is_under = 0;
+
+        if ( obj->objclass == FL_BEGIN_GROUP || obj->objclass == FL_END_GROUP )
+            continue;
+
+        if ( ( cnt = query_grid( grid, rects + obj->grid_order,
+                                 &objs, &nalloc ) ) < 0 )
+        {
+            fli_safe_free( objs );
+            fl_free( rects );
+            return 0;
+        }
+
+        for ( i = 0; i < cnt; i++ )
+            if (    objs[ i ]->grid_order > obj->grid_order
+                 && objs[ i ]->objclass != FL_BEGIN_GROUP
+                 && objs[ i ]->objclass != FL_END_GROUP
+                 && rects_intersect( rects + obj->grid_order,
+                                     rects + objs[ i ]->grid_order ) )
+                obj->is_under++;
+    }
+
+    fli_safe_free( objs );
+    fl_free( rects );
+    return 1;
+}
+
+
 /*-----------------------------------------------------------------------
    Searching in forms
 -----------------------------------------------------------------------*/
 
+/***************************************
+ * Tests if an object is of type 'find'
+ ***************************************/
+
+static int
+is_object_found( FL_OBJECT * obj,
+                 int         find,
+                 FL_Coord    mx,
+                 FL_Coord    my )
+{
+    if (    obj->objclass != FL_BEGIN_GROUP
+         && obj->objclass != FL_END_GROUP
+         && obj->visible
+         && (     obj->active
+              || ( obj->posthandle && ! obj->active )
+              || ( obj->tooltip && *obj->tooltip && ! obj->active ) ) )
+    {
+        if ( find == FLI_FIND_INPUT && obj->input && obj->active )
+            return 1;
+
+        if ( find == FLI_FIND_AUTOMATIC && obj->automatic )
+            return 1;
+
+        if ( find == FLI_FIND_RETURN && obj->type == FL_RETURN_BUTTON )
+            return 1;
+
+        if (    find == FLI_FIND_MOUSE
+             && mx >= obj->x
+             && mx <= obj->x + obj->w
+             && my >= obj->y
+             && my <= obj->y + obj->h )
+            return 1;
+
+        if ( find == FLI_FIND_KEYSPECIAL && obj->wantkey & FL_KEY_SPECIAL )
+            return 1;
+    }
+
+    return 0;
+}
+
+
 /***************************************
  * Returns an object of type 'find' in a form, starting at 'obj'.
  * If the function does not return an object the event that
@@ -1977,37 +2702,9 @@ fli_find_object( FL_OBJECT * obj,
                  FL_Coord    mx,
                  FL_Coord    my )
 {
-    while ( obj )
-    {
-        if (    obj->objclass != FL_BEGIN_GROUP
-             && obj->objclass != FL_END_GROUP
-             && obj->visible
-             && (     obj->active
-                  || ( obj->posthandle && ! obj->active )
-                  || ( obj->tooltip && *obj->tooltip && ! obj->active ) ) )
-        {
-            if ( find == FLI_FIND_INPUT && obj->input && obj->active )
-                return obj;
-
-            if ( find == FLI_FIND_AUTOMATIC && obj->automatic )
-                return obj;
-
-            if ( find == FLI_FIND_RETURN && obj->type == FL_RETURN_BUTTON )
-                return obj;
-
-            if (    find == FLI_FIND_MOUSE
-                 && mx >= obj->x
-                 && mx <= obj->x + obj->w
-                 && my >= obj->y
-                 && my <= obj->y + obj->h )
-                return obj;
-
-            if ( find == FLI_FIND_KEYSPECIAL && obj->wantkey & FL_KEY_SPECIAL )
-                return obj;
-        }
-
-        obj = obj->next;
-    }
+    for ( ; obj; obj = obj->next )
+        if ( is_object_found( obj, find, mx, my ) )
+            return obj;
 
     return NULL;
 }
@@ -2078,6 +2775,31 @@ fli_find_last( FL_FORM * form,
 {
     FL_OBJECT *last,
               *obj;
+    FLI_OBJ_GRID *grid;
+
+    /* For the mouse only the objects in the grid cell the mouse is in
+       need to be checked, of those the one latest in the list wins */
+
+    if ( find == FLI_FIND_MOUSE && ( grid = get_grid( form ) ) )
+    {
+        FLI_GRID_CELL *cell;
+        int i;
+
+        cell =   grid->cells
+               + FL_clamp( my / grid->size, 0, grid->rows - 1 ) * grid->cols
+               + FL_clamp( mx / grid->size, 0, grid->cols - 1 );
+
+        for ( last = NULL, i = 0; i < cell->cnt; i++ )
+        {
+            obj = cell->objs[ i ];
+
+            if (    ( ! last || obj->grid_order > last->grid_order )
+                 && is_object_found( obj, find, mx, my ) )
+                last = obj;
+        }
+
+        return last;
+    }
 
     last = obj = fli_find_first( form, find, mx, my );
 
@@ -2146,6 +2868,9 @@ mark_object_for_redraw( FL_OBJECT * obj )
 
     obj->redraw = 1;
 
+    if ( obj->form->obj_grid )
+        ( ( FLI_OBJ_GRID * ) obj->form->obj_grid )->marked++;
+
     /* Also mark all child objects for redraw */
 
     for ( o = obj->child; o; o = o->nc )
@@ -2172,11 +2897,17 @@ mark_object_for_redraw( FL_OBJECT * obj )
     }
     else if ( obj->is_under )
     {
+        FLI_OBJ_GRID *grid = get_grid( obj->form );
+        int need_finish;
+        int cnt = 0;
+
+        if ( grid && mark_objects_on_top( grid, obj ) )
+            return;
+
         /* If it hasn't been done yet pre-calculate the sizes of all
            objects possibly concerned */
 
-        int need_finish = prep_recalc( obj->form, obj );
-        int cnt = 0;
+        need_finish = prep_recalc( obj->form, obj );
 
         for ( o = obj->next; o; o = o->next )
         {
@@ -2225,10 +2956,10 @@ fl_redraw_object( FL_OBJECT * obj )
     {
         FL_OBJECT *o = obj->next;
 
-        /* If it hasn't been done yet pre-calculate the sizes of all
-            objects possibly concerned */
+        /* If it hasn't been done yet and there's no grid pre-calculate
+           the sizes of all objects possibly concerned */
 
-        int need_finish = prep_recalc( o->form, o );
+        int need_finish = ! get_grid( o->form ) && prep_recalc( o->form, o );
 
         for ( ; o && o->objclass != FL_END_GROUP; o = o->next )
             mark_object_for_redraw( o );
@@ -2271,13 +3002,83 @@ objects_intersect( const FL_OBJECT * obj1,
         get_object_rect( obj2, &r2, 0 );
 
         return    r1.x + r1.width  > r2.x
-               && r2.x + r2.width  > r2.x
+               && r2.x + r2.width  > r1.x
                && r1.y + r1.height > r2.y
                && r2.y + r2.height > r1.y;
     }
 }
 
 
+/***************************************
+ * Draws an object of a form during a redraw of the form if necessary
+ ***************************************/
+
+static void
+draw_form_object( FL_FORM   * form,
+                  FL_OBJECT * obj )
+{
+    int needs_redraw = obj->redraw;
+    int batch_level = -1;
+
+    obj->redraw = 0;
+
+    /* Only draw objects that are visible and, unless we're asked to draw
+       all objects, are marked for a redraw and are within the current
+       clipping area */
+
+    if (    ! obj->visible
+         || ! ( needs_redraw || form->needs_full_redraw )
+         || obj->objclass == FL_BEGIN_GROUP
+         || obj->objclass == FL_END_GROUP
+         || is_object_clipped( obj ) )
+        return;
+
+    /* Set up a pixmap for the object (does nothing if the form already
+       has a pixmap we're drawing to) */
+
+    fli_create_object_pixmap( obj );
+
+    /* Objects whose drawing involves user code may draw directly with Xlib
+       functions, so drawing requests recorded up to now must be output and
+       nothing may be recorded while they're drawn (the order of what they
+       draw with Xlib and with our functions must be kept) */
+
+    if (    obj->objclass == FL_FREE
+         || obj->objclass == FL_CANVAS
+         || obj->objclass == FL_GLCANVAS
+         || obj->objclass >= FL_USER_CLASS_START
+         || obj->prehandle
+         || obj->posthandle )
+        batch_level = fli_suspend_draw_batch( );
+
+    /* Don't allow free objects to draw outside of their boxes. */
+
+    if ( obj->objclass == FL_FREE )
+    {
+        fl_set_clipping( obj->x, obj->y, obj->w, obj->h );
+        fl_set_text_clipping( obj->x, obj->y, obj->w, obj->h );
+    }
+
+    fli_handle_object( obj, FL_DRAW, 0, 0, 0, NULL, 0 );
+
+    if ( obj->objclass == FL_FREE )
+    {
+        fl_unset_clipping( );
+        fl_unset_text_clipping( );
+    }
+
+    /* Copy the objects pixmap to the form window (does nothing if the
+       form has a pixmap we're drawing to since then we've drawn to it) */
+
+    fli_show_object_pixmap( obj );
+
+    fli_handle_object( obj, FL_DRAWLABEL, 0, 0, 0, NULL, 0 );
+
+    if ( batch_level >= 0 )
+        fli_resume_draw_batch( batch_level );
+}
+
+
 /***************************************
  * Redraws a form or only a subset of its objects - when called with the
  * 'draw_all' argument being set it redraws the complete form with all its
@@ -2313,52 +3114,25 @@ redraw( FL_FORM * form,
     fli_set_form_window( form );
     fli_create_form_pixmap( form );
 
-    for ( obj = bg_object( form ); obj; obj = obj->next )
-    {
-        int needs_redraw = obj->redraw;
-
-        obj->redraw = 0;
-
-        /* Only draw objects that are visible and, unless we're asked to draw
-           all objects, are marked for a redraw and are within the current
-           clipping area */
-
-        if (    ! obj->visible
-             || ! ( needs_redraw || form->needs_full_redraw )
-             || obj->objclass == FL_BEGIN_GROUP
-             || obj->objclass == FL_END_GROUP
-             || is_object_clipped( obj ) )
-            continue;
-
-        /* Set up a pixmap for the object (does nothing if the form already
-           has a pixmap we're drawing to) */
-
-        fli_create_object_pixmap( obj );
-
-        /* Don't allow free objects to draw outside of their boxes. */
+    /* Record the drawing requests of all objects and draw them in batches
+       of the same kind and color */
 
-        if ( obj->objclass == FL_FREE )
-        {
-            fl_set_clipping( obj->x, obj->y, obj->w, obj->h );
-            fl_set_text_clipping( obj->x, obj->y, obj->w, obj->h );
-        }
+    fli_begin_draw_batch( );
 
-        fli_handle_object( obj, FL_DRAW, 0, 0, 0, NULL, 0 );
+    /* If only a part of the form is to be redrawn try to find the objects
+       within it via the grid, otherwise check all objects */
 
-        if ( obj->objclass == FL_FREE )
-        {
-            fl_unset_clipping( );
-            fl_unset_text_clipping( );
-        }
-
-        /* Copy the objects pixmap to the form window (does nothing if the
-           form has a pixmap we're drawing to since then we've drawn to it) */
-
-        fli_show_object_pixmap( obj );
+    if ( ! fl_is_global_clipped( ) || ! redraw_clipped( form ) )
+    {
+        if ( form->obj_grid )
+            ( ( FLI_OBJ_GRID * ) form->obj_grid )->marked = 0;
 
-        fli_handle_object( obj, FL_DRAWLABEL, 0, 0, 0, NULL, 0 );
+        for ( obj = bg_object( form ); obj; obj = obj->next )
+            draw_form_object( form, obj );
     }
 
+    fli_end_draw_batch( );
+
     /* Copy the forms pixmap to its window (if double buffering is on) */
 
     fli_show_form_pixmap( form );
@@ -2992,6 +3766,8 @@ fli_scale_object( FL_OBJECT * obj,
 
         if ( obj->child )
             fli_composite_has_been_resized( obj );
+
+        update_grid_area( obj );
     }
 }
 
@@ -3331,6 +4107,9 @@ fli_recalc_intersections( FL_FORM * form )
     if ( fl_current_form || ! form || ( form && form->frozen ) )
         return;
 
+    if ( recalc_with_grid( form ) )
+        return;
+
     prep_recalc( form, NULL );
     for ( obj = bg_object( form ); obj && obj->next; obj = obj->next )
         obj->is_under = object_is_under( obj );
@@ -3466,6 +4245,8 @@ fl_set_object_position( FL_OBJECT * obj,
 
     fli_handle_object( obj, FL_MOVEORIGIN, 0, 0, 0, NULL, 0 );
 
+    update_grid_area( obj );
+
     if ( need_show )
         fl_show_object( obj );
 }
@@ -3578,6 +4359,8 @@ fl_set_object_size( FL_OBJECT * obj,
     if ( obj->child )
         fli_composite_has_been_resized( obj );
 
+    update_grid_area( obj );
+
     if ( need_show )
         fl_show_object( obj );
 }
@@ -385,6 +385,7 @@ show_pixmap( FL_OBJECT * obj,
 
     /* Hopefully, XSetClipMask is smart */
 
+    fli_flush_draw_batch( );
     XSetClipMask( flx->display, psp->gc, mask );
     XSetClipOrigin( flx->display, psp->gc, m_dest_x, m_dest_y );
 
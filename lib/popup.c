@@ -3413,7 +3413,7 @@ popup_interaction( FL_POPUP * popup )
     {
         long msec = fli_context->idle_delta;
 
-        if ( fli_context->timeout_rec )
+        if ( fli_context->num_timeouts )
             fli_handle_timeouts( &msec );
 
         /* Check for new event for the popup window, if there's none deal
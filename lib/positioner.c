@@ -92,6 +92,8 @@ handle_background( FL_OBJECT * obj,
     if ( sp->copy_gc == None )
         sp->copy_gc = XCreateGC( flx->display, FL_ObjWin( obj ), 0, NULL );
 
+    fli_flush_draw_batch( );
+
     /* If there's a pixmap with what was under the horizontal line copy from
        it to the window to restore what's under the line. If we're asked to
        delete the pixmap also do so. */
@@ -19,33 +19,98 @@
 #define PTBOX_H
 
 
+/* Attributes of lines (font, color, alignment etc.). Lines with the
+   same attributes share a single entry in the attribute table of the
+   textbox, so there's only one GC per distinct set of attributes. */
+
 typedef struct {
-    char         * fulltext;         /* text of line with flags */
-    char         * text;             /* text of line without flags */
-    unsigned int   len;              /* line length */
-    int            selected;         /* whether line is selected  */
-    int            selectable;       /* whether line is selectable */
-    int            x;                /* vertical position relative to topline */
-    int            y;                /* horizontal position of text */
-    int            w;                /* length of text in pixels */
-    int            h;                /* height of text in pixels */
     int            size;             /* font size */
     int            style;            /* font style */
     int            asc;              /* font ascent */
     int            desc;             /* font descent */
+    int            h;                /* height of line in pixels */
     FL_COLOR       color;            /* font color */
     int            align;            /* alignment of text */
     int            is_underlined;    /* whether to draw underlined */
-    int            is_separator;     /* is this a separator line? */
     int            is_special;       /* does it need special GC? */
-    GC             specialGC;        /* GC for if not default font/color */
+    GC             specialGC[ 2 ];   /* GCs for unselectable and selectable
+                                        lines if not default font/color */
+} TBOX_ATTR;
+
+
+typedef struct {
+    char         * fulltext;         /* text of line with flags */
+    char         * text;             /* text of line without flags */
+    unsigned int   len;              /* line length */
+    int            y;                /* vertical position relative to start
+                                        of the chunk the line belongs to */
+    int            w;                /* length of text in pixels (-1 if
+                                        not measured yet) */
+    int            attr;             /* index into table of attributes */
+    int            selected;         /* whether line is selected  */
+    int            selectable;       /* whether line is selectable */
+    int            is_separator;     /* is this a separator line? */
     int            incomp_esc;       /* text has incomplete escape sequence */
 } TBOX_LINE;
 
 
+/* Lines are stored (by value) in chunks of up to TBOX_CHUNK_SIZE lines,
+   so inserting or deleting a line only moves lines within a chunk */
+
+#define TBOX_CHUNK_SIZE  512
+
+typedef struct {
+    TBOX_LINE    * lines;            /* lines in this chunk */
+    int            num_lines;        /* number of lines in chunk */
+    int            height;           /* height of all lines in chunk */
+} TBOX_CHUNK;
+
+
+/* Virtual textboxes don't store their lines but request them from the
+   application when needed, keeping only the most recently used ones in
+   a small cache */
+
+#define TBOX_CACHE_SIZE  256
+#define TBOX_CACHE_HASH  512
+
 typedef struct {
-    TBOX_LINE      ** lines;         /* strurctures for lines of text */
-    int               num_lines;     /* number of structures */
+    TBOX_LINE      line;             /* the parsed line */
+    int            index;            /* its index (-1 if entry is unused) */
+    int            prev,             /* neighbours in LRU list */
+                   next;
+    int            hash_next;        /* next entry in hash bucket */
+} TBOX_CACHE_ENTRY;
+
+
+typedef struct {
+    FL_OBJECT        * obj;          /* the textbox */
+    FL_BROWSER_FETCH   fetch;        /* function to fetch text of lines */
+    void             * data;         /* data to pass to that function */
+    int                h;            /* (fixed) height of all lines */
+    TBOX_CACHE_ENTRY   cache[ TBOX_CACHE_SIZE ];
+    int                hash[ TBOX_CACHE_HASH ];
+    int                mru,          /* most and least recently used */
+                       lru;          /* cache entries */
+    int              * selected;     /* sorted list of selected lines */
+    int                num_selected; /* number of selected lines */
+} TBOX_VIRT;
+
+
+typedef struct {
+    TBOX_VIRT       * virt;          /* set for virtual textboxes */
+    TBOX_CHUNK     ** chunks;        /* chunks with the lines of text */
+    int               num_chunks;    /* number of chunks */
+    int               chunks_size;   /* number of chunks there's room for */
+    int             * line_tree;     /* Fenwick trees with the numbers of */
+    int             * height_tree;   /* lines and heights of the chunks */
+    int             * width_tree;    /* Fenwick tree with numbers of lines */
+    int               width_tree_size; /* of each width and its size */
+    int               num_unmeasured; /* lines with still unknown width */
+    int               measure_chunk; /* where to continue measuring lines */
+    int               measure_timeout_id; /* timeout for measuring lines */
+    TBOX_ATTR       * attrs;         /* table of line attributes */
+    int               num_attrs;     /* number of entries in that table */
+    int               num_lines;     /* number of lines */
     int               xoffset;       /* horizontal scroll in pixels    */
     int               yoffset;       /* vertical scroll in pixels    */
     int               x,             /* coordinates and sizes of drawing area */
@@ -122,6 +187,11 @@ extern void fli_tbox_replace_line( FL_OBJECT *,
 
 extern void fli_tbox_clear( FL_OBJECT * );
 
+extern void fli_tbox_set_virtual( FL_OBJECT *,
+                                  int,
+                                  FL_BROWSER_FETCH,
+                                  void * );
+
 extern int fli_tbox_load( FL_OBJECT *,
                           const char * );
 
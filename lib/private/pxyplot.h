@@ -35,6 +35,28 @@
 #define MAX_TIC           200
 
 
+/* Everything not set via fl_set_xyplot_xxx() functions that the cached
+   background (box, axes, tics, labels, grid and key box) depends on */
+
+typedef struct {
+    int                 w,
+                        h,
+                        bw,
+                        boxtype,
+                        lstyle,
+                        lsize,
+                        depth;
+    unsigned long       col1,               /* pixel values of the colors   */
+                        col2,
+                        dbl_background;
+    float               xmin,
+                        xmax,
+                        ymin,
+                        ymax;
+    unsigned long       keys;               /* overlays with data and key   */
+} FLI_XYPLOT_BG_KEY;
+
+
 typedef struct {
     float               xmin,               /* true xbounds                 */
                         xmax;
@@ -86,6 +108,10 @@ typedef struct {
     int               * type;               /* type[over+1]                 */
     int               * n,                  /* total points/viewable points */
                         nxp;
+    int               * nalloc;             /* allocated points [over+1]    */
+    int               * first;              /* offset of x[i] in alloc'ed   */
+    int               * maxpoints;          /* ring buffer capacity or 0    */
+    int                 bounds_stale;       /* autoscale after appending    */
     int                 n1;
     int                 ninterpol;
     int                 nxpi;
@@ -146,6 +172,14 @@ typedef struct {
     int                start_x;
     int                start_y;
     int                react_to[ 3 ];
+
+    /* cached background */
+
+    Pixmap             bg_pixmap;
+    FLI_XYPLOT_BG_KEY  bg_key;
+    int                bg_valid;           /* reset when settings change   */
+    int                bg_x,               /* object position the layout   */
+                       bg_y;               /* was last calculated for      */
 } FLI_XYPLOT_SPEC;
 
 
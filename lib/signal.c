@@ -35,10 +35,20 @@
 #include "flinternal.h"
 #include <stdlib.h>
 #include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 
 void ( * fli_handle_signal )( void ) = NULL;   /* also needed in handling.c */
 
+/* Pipe a byte gets written into whenever a signal is caught. Its read
+   end is watched like any other fd with an IO callback, so a main loop
+   blocking in fli_watch_io() wakes up at once and the signal callbacks
+   get invoked without delay. */
+
+static int sig_pipe[ 2 ] = { -1, -1 };
+
 
 /***************************************
  ***************************************/
@@ -57,6 +67,83 @@ handle_signal( void )
 }
 
 
+/***************************************
+ * IO callback for the read end of the signal pipe, just empties it
+ * (the signal callbacks get invoked from fli_handle_idling() directly
+ * after the wait in fli_watch_io() ends)
+ ***************************************/
+
+static void
+drain_sig_pipe( int    fd,
+                void * data  FL_UNUSED_ARG )
+{
+    char buf[ 64 ];
+
+    while ( read( fd, buf, sizeof buf ) > 0 )
+        /* empty */ ;
+}
+
+
+/***************************************
+ * Creates the signal pipe if it doesn't exist yet
+ ***************************************/
+
+static void
+open_sig_pipe( void )
+{
+    int i;
+
+    if ( sig_pipe[ 0 ] >= 0 )
+        return;
+
+    if ( pipe( sig_pipe ) < 0 )
+    {
+        M_warn( __func__, "Can't create pipe, signal callbacks may be "
+                "delayed" );
+        sig_pipe[ 0 ] = sig_pipe[ 1 ] = -1;
+        return;
+    }
+
+    for ( i = 0; i < 2; i++ )
+    {
+        fcntl( sig_pipe[ i ], F_SETFL,
+               fcntl( sig_pipe[ i ], F_GETFL ) | O_NONBLOCK );
+        fcntl( sig_pipe[ i ], F_SETFD, FD_CLOEXEC );
+    }
+
+    fl_add_io_callback( sig_pipe[ 0 ], FL_READ, drain_sig_pipe, NULL );
+}
+
+
+/***************************************
+ * Gets rid of the signal pipe
+ ***************************************/
+
+static void
+close_sig_pipe( void )
+{
+    if ( sig_pipe[ 0 ] < 0 )
+        return;
+
+    fl_remove_io_callback( sig_pipe[ 0 ], FL_READ, drain_sig_pipe );
+    close( sig_pipe[ 0 ] );
+    close( sig_pipe[ 1 ] );
+    sig_pipe[ 0 ] = sig_pipe[ 1 ] = -1;
+}
+
+
+/***************************************
+ * Returns if a caught signal ends waiting in fli_watch_io(), i.e.
+ * there are no signal callbacks or the signal pipe exists
+ ***************************************/
+
+int
+fli_signals_wake_up( void )
+{
+    return ! fli_context->signal_rec || sig_pipe[ 0 ] >= 0;
+}
+
+
 #ifndef FL_WIN32
 #define IsDangerous( s ) (    ( s ) == SIGBUS   \
                            || ( s ) == SIGSEGV  \
@@ -149,6 +236,8 @@ fl_add_signal_callback( int                 s,
         if ( fli_context->signal_rec )
             sig_rec->next = fli_context->signal_rec;
         fli_context->signal_rec = sig_rec;
+
+        open_sig_pipe( );
     }
 }
 
@@ -186,6 +275,9 @@ fl_remove_signal_callback( int s )
     }
 
     fli_safe_free( rec );
+
+    if ( ! fli_context->signal_rec )
+        close_sig_pipe( );
 }
 
 
@@ -208,6 +300,21 @@ fl_signal_caught( int s )
 
     rec->caught++;
 
+    /* Wake up the main loop, write() is safe to use in a signal handler
+       (but mustn't change errno for the interrupted code) */
+
+    if ( sig_pipe[ 1 ] >= 0 )
+    {
+        int old_errno = errno;
+
+        if ( write( sig_pipe[ 1 ], "", 1 ) < 0 )
+        {
+            /* pipe is full, the main loop is going to wake up anyway */
+        }
+
+        errno = old_errno;
+    }
+
 #if ! defined HAVE_SIGACTION
     if ( ! sig_direct && ! IsDangerous( s ) )
         signal( s, default_signal_handler );
@@ -130,9 +130,11 @@ draw_motion( FL_OBJECT * ob )
             xrec[ 1 ].height = sp->h - knob.y - knob.h + 1;
         }
 
+        fli_flush_draw_batch( );
         XSetClipRectangles( flx->display, flx->gc, 0, 0, xrec, 2, Unsorted );
         fl_draw_box( FL_FLAT_BOX, ob->x + sp->x + abbw, ob->y + sp->y + abbw,
                      sp->w - 2 * abbw, sp->h - 2 * abbw, ob->col1, 0 );
+        fli_flush_draw_batch( );
     }
     else if (    ob->type == FL_HOR_THIN_SLIDER
               || ob->type == FL_VERT_THIN_SLIDER
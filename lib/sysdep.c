@@ -235,6 +235,31 @@ fl_gettime( long * sec,
 }
 
 
+/***************************************
+ * Like fl_gettime(), but from a clock that never jumps (i.e. is not
+ * affected by changes of the system time), if the system has one.
+ * Only useful for measuring intervals, the epoch is unspecified.
+ ***************************************/
+
+void
+fli_get_monotonic_time( long * sec,
+                        long * usec )
+{
+#if defined CLOCK_MONOTONIC && ! defined FL_WIN32
+    struct timespec ts;
+
+    if ( clock_gettime( CLOCK_MONOTONIC, &ts ) == 0 )
+    {
+        *sec  = ts.tv_sec;
+        *usec = ts.tv_nsec / 1000;
+        return;
+    }
+#endif
+
+    fl_gettime( sec, usec );
+}
+
+
 /***************************************
  ***************************************/
 
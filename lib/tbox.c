@@ -53,6 +53,920 @@ static GC create_gc( FL_OBJECT *,
                      int,
                      int  );
 
+static void parse_line( FL_OBJECT *,
+                        char      *,
+                        TBOX_LINE * );
+
+
+/* The lines of a textbox are stored in chunks (see ptbox.h). To find
+   the chunk a line with a certain index or at a certain vertical position
+   belongs to there are two Fenwick trees (binary indexed trees), one for
+   the numbers of lines and one for the heights of the chunks, allowing to
+   locate a line and to update the trees in O(log n) time. The y-position
+   stored with a line is relative to the start of its chunk, so inserting
+   or deleting a line only requires updating the lines in the same chunk. */
+
+
+/***************************************
+ * Rebuilds the Fenwick trees from scratch, needed
+ * after chunks were added or removed
+ ***************************************/
+
+static void
+rebuild_trees( FLI_TBOX_SPEC * sp )
+{
+    int i,
+        j;
+
+    for ( i = 1; i <= sp->num_chunks; i++ )
+    {
+        sp->line_tree[ i ]   = sp->chunks[ i - 1 ]->num_lines;
+        sp->height_tree[ i ] = sp->chunks[ i - 1 ]->height;
+    }
+
+    for ( i = 1; i <= sp->num_chunks; i++ )
+        if ( ( j = i + ( i & - i ) ) <= sp->num_chunks )
+        {
+            sp->line_tree[ j ]   += sp->line_tree[ i ];
+            sp->height_tree[ j ] += sp->height_tree[ i ];
+        }
+}
+
+
+/***************************************
+ * Adds 'delta' to the element with index 'i' in a Fenwick tree
+ * for 'n' elements
+ ***************************************/
+
+static void
+tree_add( int * tree,
+          int   n,
+          int   i,
+          int   delta )
+{
+    for ( i++; i <= n; i += i & - i )
+        tree[ i ] += delta;
+}
+
+
+/***************************************
+ * Returns the sum of the first 'ci' elements of a Fenwick tree
+ ***************************************/
+
+static int
+tree_sum( int * tree,
+          int   ci )
+{
+    int sum = 0;
+
+    for ( ; ci > 0; ci -= ci & - ci )
+        sum += tree[ ci ];
+
+    return sum;
+}
+
+
+/***************************************
+ * Returns the index of the element of a Fenwick tree for 'n' elements
+ * that contains the value pointed to by 'value' (e.g. the chunk for a
+ * line index or a vertical position) and sets 'value' to what remains
+ * after subtracting the sums for all preceeding elements. If the value
+ * is beyond the last element 'n' is returned.
+ ***************************************/
+
+static int
+tree_find( int * tree,
+           int   n,
+           int * value )
+{
+    int pos = 0,
+        step = 1;
+
+    while ( 2 * step <= n )
+        step *= 2;
+
+    for ( ; step > 0; step /= 2 )
+        if ( pos + step <= n && tree[ pos + step ] <= *value )
+        {
+            pos += step;
+            *value -= tree[ pos ];
+        }
+
+    return pos;
+}
+
+
+/* The widths of all lines are also kept in a Fenwick tree, as a
+   histogram indexed by the width. This allows to find the width of the
+   longest remaining line in O(log n) time when the longest line gets
+   deleted. Lines with a width of -1 haven't been measured yet (after a
+   change of the default font) and aren't in the histogram. */
+
+
+/***************************************
+ * Adds a width to the histogram of line widths
+ ***************************************/
+
+static void
+add_width( FLI_TBOX_SPEC * sp,
+           int             w )
+{
+    if ( w >= sp->width_tree_size )
+    {
+        int old_size = sp->width_tree_size;
+        int size = old_size ? old_size : 256;
+
+        while ( size <= w )
+            size *= 2;
+
+        sp->width_tree = fl_realloc( sp->width_tree,
+                                     ( size + 1 ) * sizeof *sp->width_tree );
+        memset( sp->width_tree + old_size + 1, 0,
+                ( size - old_size ) * sizeof *sp->width_tree );
+
+        /* With the size being a power of 2 the last element of the tree
+           holds the sum of all elements, after doubling the size it's the
+           new last element */
+
+        if ( old_size )
+            for ( ; old_size < size; old_size *= 2 )
+                sp->width_tree[ 2 * old_size ] = sp->width_tree[ old_size ];
+
+        sp->width_tree_size = size;
+    }
+
+    tree_add( sp->width_tree, sp->width_tree_size, w, 1 );
+    sp->max_width = FL_max( sp->max_width, w );
+}
+
+
+/***************************************
+ * Sets the maximum width from the histogram of line widths
+ ***************************************/
+
+static void
+update_max_width( FLI_TBOX_SPEC * sp )
+{
+    int count;
+
+    if (    ! sp->width_tree_size
+         || ! ( count = sp->width_tree[ sp->width_tree_size ] ) )
+    {
+        sp->max_width = 0;
+        return;
+    }
+
+    /* Find the width the last of all the measured lines falls into */
+
+    count--;
+    sp->max_width = tree_find( sp->width_tree, sp->width_tree_size, &count );
+}
+
+
+/***************************************
+ * Removes the width of a line from the histogram of line widths,
+ * marking it as unmeasured. update_max_width() must be called
+ * afterwards.
+ ***************************************/
+
+static void
+forget_width( FLI_TBOX_SPEC * sp,
+              TBOX_LINE     * tl )
+{
+    if ( tl->w < 0 )
+        return;
+
+    tree_add( sp->width_tree, sp->width_tree_size, tl->w, -1 );
+    tl->w = -1;
+    sp->num_unmeasured++;
+}
+
+
+/* For virtual textboxes all lines have the same height and the lines
+   are requested from the application when needed. The parsed lines are
+   kept in a cache with TBOX_CACHE_SIZE entries, the least recently used
+   one getting reused when a line not in the cache is requested. Since
+   cached lines can get dropped at any time the selection state of the
+   lines is stored separately in a sorted list of line indices. */
+
+
+/***************************************
+ * Returns if a line of a virtual textbox is selected
+ ***************************************/
+
+static int
+is_virtual_selected( TBOX_VIRT * v,
+                     int         line )
+{
+    int lo = 0,
+        hi = v->num_selected - 1;
+
+    while ( lo <= hi )
+    {
+        int mid = ( lo + hi ) / 2;
+
+        if ( v->selected[ mid ] == line )
+            return 1;
+        else if ( v->selected[ mid ] < line )
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return 0;
+}
+
+
+/***************************************
+ * Adds a line of a virtual textbox to or removes it
+ * from the list of selected lines
+ ***************************************/
+
+static void
+set_virtual_selected( TBOX_VIRT * v,
+                      int         line,
+                      int         state )
+{
+    int i = 0;
+
+    while ( i < v->num_selected && v->selected[ i ] < line )
+        i++;
+
+    if ( state && ( i == v->num_selected || v->selected[ i ] != line ) )
+    {
+        v->selected = fl_realloc( v->selected,
+                                  ++v->num_selected * sizeof *v->selected );
+        memmove( v->selected + i + 1, v->selected + i,
+                 ( v->num_selected - i - 1 ) * sizeof *v->selected );
+        v->selected[ i ] = line;
+    }
+    else if ( ! state && i < v->num_selected && v->selected[ i ] == line )
+    {
+        memmove( v->selected + i, v->selected + i + 1,
+                 ( --v->num_selected - i ) * sizeof *v->selected );
+        if ( ! v->num_selected )
+            fli_safe_free( v->selected );
+    }
+}
+
+
+/***************************************
+ * Makes a cache entry the most recently used one
+ ***************************************/
+
+static void
+touch_cache_entry( TBOX_VIRT * v,
+                   int         i )
+{
+    TBOX_CACHE_ENTRY *e = v->cache + i;
+
+    if ( v->mru == i )
+        return;
+
+    /* Unlink entry from the LRU list... */
+
+    if ( e->next != -1 )
+        v->cache[ e->next ].prev = e->prev;
+    else
+        v->lru = e->prev;
+    v->cache[ e->prev ].next = e->next;
+
+    /* ...and put it at the front */
+
+    e->prev = -1;
+    e->next = v->mru;
+    v->cache[ v->mru ].prev = i;
+    v->mru = i;
+}
+
+
+/***************************************
+ * Empties the cache of a virtual textbox
+ ***************************************/
+
+static void
+flush_cache( TBOX_VIRT * v )
+{
+    int i;
+
+    for ( i = 0; i < TBOX_CACHE_SIZE; i++ )
+    {
+        if ( v->cache[ i ].index >= 0 )
+            fli_safe_free( v->cache[ i ].line.fulltext );
+
+        v->cache[ i ].index     = -1;
+        v->cache[ i ].prev      = i - 1;
+        v->cache[ i ].next      = i < TBOX_CACHE_SIZE - 1 ? i + 1 : -1;
+        v->cache[ i ].hash_next = -1;
+    }
+
+    for ( i = 0; i < TBOX_CACHE_HASH; i++ )
+        v->hash[ i ] = -1;
+
+    v->mru = 0;
+    v->lru = TBOX_CACHE_SIZE - 1;
+}
+
+
+/***************************************
+ * Returns a pointer to the structure for a line of a virtual textbox,
+ * fetching the line from the application if it isn't in the cache yet.
+ * The pointer remains valid until TBOX_CACHE_SIZE - 1 further lines
+ * have been requested.
+ ***************************************/
+
+static TBOX_LINE *
+get_virtual_line( FLI_TBOX_SPEC * sp,
+                  int             line )
+{
+    TBOX_VIRT *v = sp->virt;
+    TBOX_CACHE_ENTRY *e;
+    int bucket = line % TBOX_CACHE_HASH;
+    const char *text;
+    int *ip;
+    int i;
+
+    for ( i = v->hash[ bucket ]; i != -1; i = v->cache[ i ].hash_next )
+        if ( v->cache[ i ].index == line )
+        {
+            touch_cache_entry( v, i );
+            return &v->cache[ i ].line;
+        }
+
+    /* Reuse the least recently used entry, removing it from its bucket */
+
+    e = v->cache + ( i = v->lru );
+
+    if ( e->index >= 0 )
+    {
+        for ( ip = v->hash + e->index % TBOX_CACHE_HASH; *ip != i;
+              ip = &v->cache[ *ip ].hash_next )
+            /* empty */ ;
+        *ip = e->hash_next;
+        fli_safe_free( e->line.fulltext );
+    }
+
+    text = v->fetch( v->obj->parent ? v->obj->parent : v->obj,
+                     line + 1, v->data );
+    parse_line( v->obj, fl_strdup( text ? text : "" ), &e->line );
+    e->line.selected = is_virtual_selected( v, line );
+
+    /* Only the lines that have been looked at are measured, so the width
+       of the longest line can only increase with time */
+
+    sp->max_width = FL_max( sp->max_width, e->line.w );
+
+    e->index = line;
+    e->hash_next = v->hash[ bucket ];
+    v->hash[ bucket ] = i;
+    touch_cache_entry( v, i );
+
+    return &e->line;
+}
+
+
+/***************************************
+ * Returns a pointer to the structure for a line (which must exist).
+ * Please note: the pointer becomes invalid when lines get inserted
+ * or deleted!
+ ***************************************/
+
+static TBOX_LINE *
+get_line( FLI_TBOX_SPEC * sp,
+          int             line )
+{
+    int ci;
+
+    if ( sp->virt )
+        return get_virtual_line( sp, line );
+
+    ci = tree_find( sp->line_tree, sp->num_chunks, &line );
+
+    return sp->chunks[ ci ]->lines + line;
+}
+
+
+/***************************************
+ * Returns the height of a line
+ ***************************************/
+
+#define line_h( sp, tl )   ( ( sp )->virt ? ( sp )->virt->h \
+                             : ( sp )->attrs[ ( tl )->attr ].h )
+
+
+/***************************************
+ * Returns the vertical position of a line (which must exist)
+ ***************************************/
+
+static int
+line_y( FLI_TBOX_SPEC * sp,
+        int             line )
+{
+    int ci;
+
+    if ( sp->virt )
+        return line * sp->virt->h;
+
+    ci = tree_find( sp->line_tree, sp->num_chunks, &line );
+
+    return tree_sum( sp->height_tree, ci ) + sp->chunks[ ci ]->lines[ line ].y;
+}
+
+
+/***************************************
+ * Returns the horizontal position of a line, depending
+ * on its alignment and the length of the longest line
+ ***************************************/
+
+static int
+line_x( FLI_TBOX_SPEC * sp,
+        TBOX_LINE     * tl )
+{
+    int align = sp->attrs[ tl->attr ].align;
+
+    if ( fl_is_center_lalign( align ) )
+        return ( sp->max_width - tl->w ) / 2;
+    else if ( fl_to_outside_lalign( align ) == FL_ALIGN_RIGHT )
+        return sp->max_width - tl->w;
+
+    return 0;
+}
+
+
+/***************************************
+ * Returns the index of the line at vertical position 'y' (or the
+ * number of lines if 'y' is below the last line)
+ ***************************************/
+
+static int
+find_line_at_y( FLI_TBOX_SPEC * sp,
+                int             y )
+{
+    TBOX_CHUNK *chunk;
+    int ci,
+        lo,
+        hi;
+
+    if ( y < 0 )
+        y = 0;
+
+    if ( y >= sp->max_height )
+        return sp->num_lines;
+
+    if ( sp->virt )
+        return y / sp->virt->h;
+
+    ci = tree_find( sp->height_tree, sp->num_chunks, &y );
+    chunk = sp->chunks[ ci ];
+
+    /* Binary search for the last line in the chunk not starting below 'y' */
+
+    lo = 0;
+    hi = chunk->num_lines - 1;
+
+    while ( lo < hi )
+    {
+        int mid = ( lo + hi + 1 ) / 2;
+
+        if ( chunk->lines[ mid ].y <= y )
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    return tree_sum( sp->line_tree, ci ) + lo;
+}
+
+
+/***************************************
+ * Inserts a new, empty chunk at position 'ci' of the list of chunks
+ ***************************************/
+
+static void
+add_chunk( FLI_TBOX_SPEC * sp,
+           int             ci )
+{
+    TBOX_CHUNK *chunk;
+
+    if ( sp->num_chunks == sp->chunks_size )
+    {
+        sp->chunks_size = sp->chunks_size ? 2 * sp->chunks_size : 4;
+        sp->chunks = fl_realloc( sp->chunks,
+                                 sp->chunks_size * sizeof *sp->chunks );
+        sp->line_tree = fl_realloc( sp->line_tree,
+                                    ( sp->chunks_size + 1 )
+                                    * sizeof *sp->line_tree );
+        sp->height_tree = fl_realloc( sp->height_tree,
+                                      ( sp->chunks_size + 1 )
+                                      * sizeof *sp->height_tree );
+    }
+
+    chunk = fl_malloc( sizeof *chunk );
+    chunk->lines = fl_malloc( TBOX_CHUNK_SIZE * sizeof *chunk->lines );
+    chunk->num_lines = 0;
+    chunk->height = 0;
+
+    if ( ci < sp->num_chunks )
+        memmove( sp->chunks + ci + 1, sp->chunks + ci,
+                 ( sp->num_chunks - ci ) * sizeof *sp->chunks );
+
+    sp->chunks[ ci ] = chunk;
+    sp->num_chunks++;
+
+    rebuild_trees( sp );
+}
+
+
+/***************************************
+ * Removes the (empty) chunk at position 'ci'
+ ***************************************/
+
+static void
+remove_chunk( FLI_TBOX_SPEC * sp,
+              int             ci )
+{
+    fl_free( sp->chunks[ ci ]->lines );
+    fl_free( sp->chunks[ ci ] );
+
+    if ( ci < --sp->num_chunks )
+        memmove( sp->chunks + ci, sp->chunks + ci + 1,
+                 ( sp->num_chunks - ci ) * sizeof *sp->chunks );
+
+    rebuild_trees( sp );
+}
+
+
+/***************************************
+ * Splits a (full) chunk into two halves
+ ***************************************/
+
+static void
+split_chunk( FLI_TBOX_SPEC * sp,
+             int             ci )
+{
+    TBOX_CHUNK *old,
+               *new;
+    int half = TBOX_CHUNK_SIZE / 2;
+    int base,
+        i;
+
+    add_chunk( sp, ci + 1 );
+
+    old = sp->chunks[ ci ];
+    new = sp->chunks[ ci + 1 ];
+
+    new->num_lines = old->num_lines - half;
+    memcpy( new->lines, old->lines + half,
+            new->num_lines * sizeof *new->lines );
+    old->num_lines = half;
+
+    base = new->lines[ 0 ].y;
+    for ( i = 0; i < new->num_lines; i++ )
+        new->lines[ i ].y -= base;
+
+    new->height = old->height - base;
+    old->height = base;
+
+    rebuild_trees( sp );
+}
+
+
+/***************************************
+ * Stores a line (already set up except for its vertical position)
+ * at index 'line' (which can be the number of lines for appending)
+ ***************************************/
+
+static void
+store_line( FLI_TBOX_SPEC * sp,
+            int             line,
+            TBOX_LINE     * new_tl )
+{
+    TBOX_CHUNK *chunk;
+    int h = line_h( sp, new_tl );
+    int ci,
+        li,
+        i;
+
+    /* When appending start a new chunk if the last one is full, this way
+       textboxes that are only appended to get completely filled chunks */
+
+    if ( line == sp->num_lines )
+    {
+        if (    ! sp->num_chunks
+             || sp->chunks[ sp->num_chunks - 1 ]->num_lines == TBOX_CHUNK_SIZE )
+            add_chunk( sp, sp->num_chunks );
+
+        ci = sp->num_chunks - 1;
+        li = sp->chunks[ ci ]->num_lines;
+    }
+    else
+    {
+        li = line;
+        ci = tree_find( sp->line_tree, sp->num_chunks, &li );
+
+        if ( sp->chunks[ ci ]->num_lines == TBOX_CHUNK_SIZE )
+        {
+            split_chunk( sp, ci );
+
+            if ( li >= TBOX_CHUNK_SIZE / 2 )
+            {
+                li -= TBOX_CHUNK_SIZE / 2;
+                ci++;
+            }
+        }
+    }
+
+    chunk = sp->chunks[ ci ];
+
+    if ( li < chunk->num_lines )
+        memmove( chunk->lines + li + 1, chunk->lines + li,
+                 ( chunk->num_lines - li ) * sizeof *chunk->lines );
+
+    chunk->lines[ li ] = *new_tl;
+    chunk->lines[ li ].y = li ?
+        chunk->lines[ li - 1 ].y + line_h( sp, chunk->lines + li - 1 ) : 0;
+
+    for ( i = li + 1; i <= chunk->num_lines; i++ )
+        chunk->lines[ i ].y += h;
+
+    chunk->num_lines++;
+    chunk->height += h;
+
+    if ( new_tl->w >= 0 )
+        add_width( sp, new_tl->w );
+    else
+        sp->num_unmeasured++;
+
+    tree_add( sp->line_tree, sp->num_chunks, ci, 1 );
+    tree_add( sp->height_tree, sp->num_chunks, ci, h );
+
+    sp->num_lines++;
+    sp->max_height += h;
+}
+
+
+/***************************************
+ * Removes a line (which must exist), deallocating its text
+ ***************************************/
+
+static void
+remove_line( FLI_TBOX_SPEC * sp,
+             int             line )
+{
+    TBOX_CHUNK *chunk;
+    int li = line;
+    int ci = tree_find( sp->line_tree, sp->num_chunks, &li );
+    int h,
+        i;
+
+    chunk = sp->chunks[ ci ];
+    h = line_h( sp, chunk->lines + li );
+
+    forget_width( sp, chunk->lines + li );
+    sp->num_unmeasured--;
+    update_max_width( sp );
+
+    fli_safe_free( chunk->lines[ li ].fulltext );
+
+    if ( --chunk->num_lines > li )
+        memmove( chunk->lines + li, chunk->lines + li + 1,
+                 ( chunk->num_lines - li ) * sizeof *chunk->lines );
+
+    for ( i = li; i < chunk->num_lines; i++ )
+        chunk->lines[ i ].y -= h;
+
+    chunk->height -= h;
+
+    sp->num_lines--;
+    sp->max_height -= h;
+
+    if ( chunk->num_lines == 0 )
+        remove_chunk( sp, ci );
+    else
+    {
+        tree_add( sp->line_tree, sp->num_chunks, ci, -1 );
+        tree_add( sp->height_tree, sp->num_chunks, ci, - h );
+    }
+}
+
+
+/***************************************
+ * Recalculates the vertical positions of all lines and the heights
+ * of all chunks, needed after the height of lines changed
+ ***************************************/
+
+static void
+recalc_heights( FLI_TBOX_SPEC * sp )
+{
+    int ci,
+        li;
+
+    sp->max_height = 0;
+
+    for ( ci = 0; ci < sp->num_chunks; ci++ )
+    {
+        TBOX_CHUNK *chunk = sp->chunks[ ci ];
+
+        chunk->height = 0;
+
+        for ( li = 0; li < chunk->num_lines; li++ )
+        {
+            chunk->lines[ li ].y = chunk->height;
+            chunk->height += line_h( sp, chunk->lines + li );
+        }
+
+        sp->max_height += chunk->height;
+    }
+
+    rebuild_trees( sp );
+}
+
+
+/***************************************
+ * Deallocates all lines, chunks and line attributes
+ ***************************************/
+
+static void
+free_lines( FLI_TBOX_SPEC * sp )
+{
+    int ci,
+        li,
+        i;
+
+    for ( ci = 0; ci < sp->num_chunks; ci++ )
+    {
+        for ( li = 0; li < sp->chunks[ ci ]->num_lines; li++ )
+            fli_safe_free( sp->chunks[ ci ]->lines[ li ].fulltext );
+
+        fl_free( sp->chunks[ ci ]->lines );
+        fl_free( sp->chunks[ ci ] );
+    }
+
+    fli_safe_free( sp->chunks );
+    fli_safe_free( sp->line_tree );
+    fli_safe_free( sp->height_tree );
+    sp->num_chunks = sp->chunks_size = 0;
+
+    fli_safe_free( sp->width_tree );
+    sp->width_tree_size = 0;
+    sp->num_unmeasured = 0;
+    sp->measure_chunk = 0;
+
+    if ( sp->measure_timeout_id != -1 )
+    {
+        fl_remove_timeout( sp->measure_timeout_id );
+        sp->measure_timeout_id = -1;
+    }
+
+    if ( sp->virt )
+    {
+        flush_cache( sp->virt );
+        fli_safe_free( sp->virt->selected );
+        fli_safe_free( sp->virt );
+    }
+
+    for ( i = 0; i < sp->num_attrs; i++ )
+    {
+        if ( sp->attrs[ i ].specialGC[ 0 ] )
+            XFreeGC( flx->display, sp->attrs[ i ].specialGC[ 0 ] );
+        if ( sp->attrs[ i ].specialGC[ 1 ] )
+            XFreeGC( flx->display, sp->attrs[ i ].specialGC[ 1 ] );
+    }
+
+    fli_safe_free( sp->attrs );
+    sp->num_attrs = 0;
+
+    sp->num_lines = 0;
+}
+
+
+/***************************************
+ * Returns the index of the entry in the table of line attributes
+ * that matches the attributes passed to the function, creating a
+ * new entry if there's none yet
+ ***************************************/
+
+static int
+get_attr( FLI_TBOX_SPEC * sp,
+          TBOX_ATTR     * attr )
+{
+    TBOX_ATTR *a;
+    int i;
+
+    for ( i = 0; i < sp->num_attrs; i++ )
+    {
+        a = sp->attrs + i;
+
+        if (    a->size          == attr->size
+             && a->style         == attr->style
+             && a->color         == attr->color
+             && a->align         == attr->align
+             && a->is_underlined == attr->is_underlined
+             && a->is_special    == attr->is_special )
+            return i;
+    }
+
+    sp->attrs = fl_realloc( sp->attrs, ++sp->num_attrs * sizeof *sp->attrs );
+    a = sp->attrs + i;
+    *a = *attr;
+
+    a->h = fl_get_string_height( a->style, a->size, "X", 1,
+                                 &a->asc, &a->desc );
+    a->specialGC[ 0 ] = a->specialGC[ 1 ] = None;
+
+    return i;
+}
+
+
+/***************************************
+ * Determines the width of the text of a line
+ ***************************************/
+
+static void
+measure_line( FLI_TBOX_SPEC * sp,
+              TBOX_LINE     * tl )
+{
+    TBOX_ATTR *a = sp->attrs + tl->attr;
+
+    if ( ! tl->is_separator && *tl->text )
+        tl->w = fl_get_string_widthTAB( a->style, a->size,
+                                        tl->text, tl->len );
+    else
+        tl->w = 0;
+}
+
+
+/***************************************
+ * Measures a line if its width isn't known yet
+ ***************************************/
+
+static void
+measure_if_needed( FLI_TBOX_SPEC * sp,
+                   TBOX_LINE     * tl )
+{
+    if ( tl->w >= 0 )
+        return;
+
+    measure_line( sp, tl );
+    add_width( sp, tl->w );
+    sp->num_unmeasured--;
+}
+
+
+/***************************************
+ * Callback for the timeout used for measuring lines with unknown widths
+ * in the background, a batch of lines at a time, after the default font
+ * was changed
+ ***************************************/
+
+#define MEASURE_BATCH  1000
+
+static void
+measure_cb( int    id  FL_UNUSED_ARG,
+            void * data )
+{
+    FL_OBJECT *obj = data;
+    FLI_TBOX_SPEC *sp = obj->spec;
+    int old_max_width = sp->max_width;
+    int count = 0;
+
+    sp->measure_timeout_id = -1;
+
+    while ( sp->num_unmeasured > 0 && count < MEASURE_BATCH )
+    {
+        TBOX_CHUNK *chunk;
+        int li;
+
+        if ( sp->measure_chunk >= sp->num_chunks )
+            sp->measure_chunk = 0;
+
+        chunk = sp->chunks[ sp->measure_chunk++ ];
+
+        for ( li = 0; li < chunk->num_lines; li++ )
+            if ( chunk->lines[ li ].w < 0 )
+            {
+                measure_if_needed( sp, chunk->lines + li );
+                count++;
+            }
+    }
+
+    if ( sp->num_unmeasured > 0 )
+        sp->measure_timeout_id = fl_add_timeout( 0, measure_cb, obj );
+
+    /* If the longest line got longer the browser the textbox belongs to
+       must adjust its horizontal scrollbar, same when we're done since
+       lines also get measured when drawn */
+
+    if ( sp->max_width != old_max_width || sp->measure_timeout_id == -1 )
+    {
+        if ( obj->parent )
+            fli_notify_object( obj->parent, FL_ATTRIB );
+
+        if ( ! sp->no_redraw )
+            fl_redraw_object( obj->parent ? obj->parent : obj );
+    }
+}
+
 
 /***************************************
  * Creates a new textbox object
@@ -86,7 +1000,19 @@ fli_create_tbox( int          type,
     sp->h             = 0;
     sp->attrib        = 1;
     sp->no_redraw     = 0;
-    sp->lines         = NULL;
+    sp->virt          = NULL;
+    sp->chunks        = NULL;
+    sp->num_chunks    = 0;
+    sp->chunks_size   = 0;
+    sp->line_tree     = NULL;
+    sp->height_tree   = NULL;
+    sp->width_tree    = NULL;
+    sp->width_tree_size = 0;
+    sp->num_unmeasured = 0;
+    sp->measure_chunk = 0;
+    sp->measure_timeout_id = -1;
+    sp->attrs         = NULL;
+    sp->num_attrs     = 0;
     sp->num_lines     = 0;
     sp->callback      = NULL;
     sp->xoffset       = 0;
@@ -117,6 +1043,23 @@ fli_create_tbox( int          type,
 }
 
 
+/***************************************
+ * Checks if a textbox is virtual (in which case its lines can't
+ * be modified directly), printing an error message if it is
+ ***************************************/
+
+static int
+check_virtual( FL_OBJECT  * obj,
+               const char * func )
+{
+    if ( ! ( ( FLI_TBOX_SPEC * ) obj->spec )->virt )
+        return 0;
+
+    M_err( func, "Can't modify lines of virtual browser" );
+    return 1;
+}
+
+
 /***************************************
  * Deletes a line from the textbox
  ***************************************/
@@ -126,12 +1069,11 @@ fli_tbox_delete_line( FL_OBJECT * obj,
                       int         line )
 {
     FLI_TBOX_SPEC *sp = obj->spec;
-    int recalc_max_width = 0;
-    int i;
+    int old_max_width = sp->max_width;
 
     /* If line number is invalid do nothing */
 
-    if ( line < 0 || line >= sp->num_lines )
+    if ( line < 0 || line >= sp->num_lines || check_virtual( obj, __func__ ) )
         return;
 
     if ( sp->select_line == line )
@@ -144,54 +1086,12 @@ fli_tbox_delete_line( FL_OBJECT * obj,
     else if ( sp->deselect_line > line )
         sp->deselect_line--;
 
-    /* Check if recalculation of maximum line length is necessary */
-
-    if ( sp->max_width == sp->lines[ line ]->w )
-        recalc_max_width = 1;
-
-    /* Set vertical position of following lines */
-
-    for ( i = line + 1; i < sp->num_lines; i++ )
-        sp->lines[ i ]->y -= sp->lines[ line ]->h;
-
-    sp->max_height -= sp->lines[ line ]->h;
-
-    /* Get rid of special GC for the line */
-
-    if ( sp->lines[ line ]->specialGC )
-    {
-        XFreeGC( flx->display, sp->lines[ line ]->specialGC );
-        sp->lines[ line ]->specialGC = None;
-    }
-
-    /* Deallocate memory for the text of the line to delete */
-
-    fli_safe_free( sp->lines[ line ]->fulltext );
-
-    /* Get rid of memory for the structure */
-
-    fl_free( sp->lines[ line ] );
-
-    /* Move pointers to following line structures  one up */
-
-    if ( --sp->num_lines != line )
-        memmove( sp->lines + line, sp->lines + line + 1,
-                 ( sp->num_lines - line ) * sizeof *sp->lines );
-
-    /* Reduce memory for array of structure pointers */
-
-    sp->lines = fl_realloc( sp->lines, sp->num_lines * sizeof *sp->lines );
+    remove_line( sp, line );
 
-    /* If necessary find remaining longest line */
+    /* If the longest line was deleted correct x offset if necessary */
 
-    if ( recalc_max_width )
+    if ( sp->max_width != old_max_width )
     {
-        sp->max_width = 0;
-        for ( i = 0; i < sp->num_lines; i++ )
-            sp->max_width = FL_max( sp->max_width, sp->lines[ i ]->w );
-
-        /* Correct x offset if necessary */
-
         if ( sp->max_width <= sp->w )
             sp->xoffset = 0;
         else if ( sp->xoffset > sp->max_width - sp->w )
@@ -202,8 +1102,7 @@ fli_tbox_delete_line( FL_OBJECT * obj,
 
     if ( sp->num_lines == 0 )
         sp->yoffset = 0;
-    else if (   sp->lines[ sp->num_lines - 1 ]->y
-              + sp->lines[ sp->num_lines - 1 ]->h < sp->yoffset + sp->h )
+    else if ( sp->max_height < sp->yoffset + sp->h )
     {
         int old_no_redraw = sp->no_redraw;
 
@@ -218,87 +1117,22 @@ fli_tbox_delete_line( FL_OBJECT * obj,
 
 
 /***************************************
- * Inserts one or more lines, separated by
- * linefeed characters, into the textbox
- ***************************************/
-
-void
-fli_tbox_insert_lines( FL_OBJECT  * obj,
-                       int          line,
-                       const char * new_text )
-{
-    char *text = fl_strdup( new_text );
-    char *p = text;
-    char *del;
-
-    while ( 1 )
-    {
-        ;
-        if ( ( del = strchr( p, '\n' ) ) )
-            *del = '\0';
-        fli_tbox_insert_line( obj, line++, p );
-        if ( del )
-            p = del + 1;
-        else
-            break;
-    }
-
-    fl_free( text );
-}
-
-
-/***************************************
- * Inserts a single line into the textbox
+ * Sets up a line from its text (including flags), which must have
+ * been allocated and gets owned by the line
  ***************************************/
 
-void
-fli_tbox_insert_line( FL_OBJECT  * obj,
-                      int          line,
-                      const char * new_text )
+static void
+parse_line( FL_OBJECT * obj,
+            char      * text,
+            TBOX_LINE * tl )
 {
     FLI_TBOX_SPEC *sp = obj->spec;
-    char *text;
-    char *p;
+    TBOX_ATTR attr;
+    char *p = text;
     int done = 0;
     char *e;
     int is_bold = 0;
     int is_italic = 0;
-    TBOX_LINE *tl;
-    int i;
-
-    /* Catch invalid 'line' or 'new_text' argument */
-
-    if ( line < 0 || ! new_text )
-        return;
-
-    /* If 'line' is too large correct that by appending to the end */
-
-    if ( line >= sp->num_lines )
-        line = sp->num_lines;
-
-    /* Make sure the lines marked as selected and deselected remain unchanged */
-
-    if ( sp->select_line >= line )
-        sp->select_line++;
-    if ( sp->deselect_line >= line )
-        sp->deselect_line++;
-
-    /* Make a copy of the text of the line */
-
-    p = text = fl_strdup( new_text );
-
-    /* Get memory for one more line */
-
-    sp->lines = fl_realloc( sp->lines,
-                            ++sp->num_lines * sizeof *sp->lines );
-
-    /* If necessary move all following lines one down */
-
-    if ( line < sp->num_lines - 1 )
-        memmove( sp->lines + line + 1, sp->lines + line,
-                 ( sp->num_lines - line - 1 ) * sizeof *sp->lines );
-
-    sp->lines[ line ] = tl = fl_malloc( sizeof **sp->lines );
 
     /* Set up defaults for the line */
 
@@ -308,18 +1142,17 @@ fli_tbox_insert_line( FL_OBJECT  * obj,
     tl->selected      = 0;
     tl->selectable    = 1;
     tl->is_separator  = 0;
-    tl->is_underlined = 0;
-    tl->x             = 0;
     tl->w             = 0;
-    tl->h             = sp->def_size;
-    tl->size          = sp->def_size;
-    tl->style         = sp->def_style;
-    tl->align         = sp->def_align;
-    tl->color         = obj->lcol;
-    tl->is_special    = 0;
-    tl->specialGC     = None;
+    tl->y             = 0;
     tl->incomp_esc    = 0;
 
+    attr.size          = sp->def_size;
+    attr.style         = sp->def_style;
+    attr.align         = sp->def_align;
+    attr.color         = obj->lcol;
+    attr.is_underlined = 0;
+    attr.is_special    = 0;
+
     /* Check for flags at the start of the line. When we're done 'p' will
        points to the start of the string to be shown in the textbox. */
 
@@ -339,108 +1172,108 @@ fli_tbox_insert_line( FL_OBJECT  * obj,
                 break;
 
             case 'h' :
-                tl->size = FL_HUGE_SIZE;
+                attr.size = FL_HUGE_SIZE;
                 p += 2;
                 break;
 
             case 'l' :
-                tl->size = FL_LARGE_SIZE;
+                attr.size = FL_LARGE_SIZE;
                 p += 2;
                 break;
 
             case 'm' :
-                tl->size = FL_MEDIUM_SIZE;
+                attr.size = FL_MEDIUM_SIZE;
                 p += 2;
                 break;
 
             case 's' :
-                tl->size = FL_SMALL_SIZE;
+                attr.size = FL_SMALL_SIZE;
                 p += 2;
                 break;;
 
             case 'L' :
-                tl->size += 6;
+                attr.size += 6;
                 p += 2;
                 break;
 
             case 'M' :
-                tl->size += 4;
+                attr.size += 4;
                 p += 2;
                 break;
 
             case 'S' :
-                tl->size -= 2;
+                attr.size -= 2;
                 p += 2;
                 break;
 
             case 'b' :
-                tl->style |= FL_BOLD_STYLE;
+                attr.style |= FL_BOLD_STYLE;
                 is_bold = 1;
                 p += 2;
                 break;
 
             case 'i' :
-                tl->style |= FL_ITALIC_STYLE;
+                attr.style |= FL_ITALIC_STYLE;
                 is_italic = 1;
                 p += 2;
                 break;
 
             case 'n' :
-                tl->style = FL_NORMAL_STYLE;
+                attr.style = FL_NORMAL_STYLE;
                 if ( is_bold )
-                    tl->style |= FL_BOLD_STYLE;
+                    attr.style |= FL_BOLD_STYLE;
                 if ( is_italic )
-                    tl->style |= FL_ITALIC_STYLE;
+                    attr.style |= FL_ITALIC_STYLE;
                 p += 2;
                 break;
 
             case 'f' :
-                tl->style = FL_FIXED_STYLE;
+                attr.style = FL_FIXED_STYLE;
                 if ( is_bold )
-                    tl->style |= FL_BOLD_STYLE;
+                    attr.style |= FL_BOLD_STYLE;
                 if ( is_italic )
-                    tl->style |= FL_ITALIC_STYLE;
+                    attr.style |= FL_ITALIC_STYLE;
                 p += 2;
                 break;
 
             case 't' :
-                tl->style = FL_TIMES_STYLE;
+                attr.style = FL_TIMES_STYLE;
                 if ( is_bold )
-                    tl->style |= FL_BOLD_STYLE;
+                    attr.style |= FL_BOLD_STYLE;
                 if ( is_italic )
-                    tl->style |= FL_ITALIC_STYLE;
+                    attr.style |= FL_ITALIC_STYLE;
                 p += 2;
                 break;
 
             case 'c' :
-                tl->align = FL_ALIGN_CENTER;
+                attr.align = FL_ALIGN_CENTER;
                 p += 2;
                 break;
 
             case 'r' :
-                tl->align = FL_ALIGN_RIGHT;
+                attr.align = FL_ALIGN_RIGHT;
                 p += 2;
                 break;
 
             case '_' :
-                tl->is_underlined = 1;
+                attr.is_underlined = 1;
                 p += 2;
                 break;
 
             case '-' :
-                sp->lines[ line ]->is_separator = 1;
-                sp->lines[ line ]->selectable   = 0;
+                tl->is_separator = 1;
+                tl->selectable   = 0;
                 done = 1;
                 break;
 
             case 'N' :
-                sp->lines[ line ]->selectable = 0;
-                tl->color = FL_INACTIVE;
+                tl->selectable = 0;
+                attr.color = FL_INACTIVE;
                 p += 2;
                 break;
 
             case 'C' :
-                tl->color = strtol( p + 2, &e, 10 );
+                attr.color = strtol( p + 2, &e, 10 );
                 if ( e == p + 2 )
                 {
                     if ( p[ 2 ] == '\0' )
@@ -451,10 +1284,10 @@ fli_tbox_insert_line( FL_OBJECT  * obj,
                     break;
                 }
 
-                if ( tl->color >= FL_MAX_COLS )
+                if ( attr.color >= FL_MAX_COLS )
                 {
-                    M_err( __func__, "bad color %ld", tl->color );
-                    tl->color = obj->lcol;
+                    M_err( __func__, "bad color %ld", attr.color );
+                    attr.color = obj->lcol;
                 }
                 p = e;
                 break;
@@ -479,68 +1312,113 @@ fli_tbox_insert_line( FL_OBJECT  * obj,
 
     tl->len = strlen( tl->text );
 
-    /* Figure out width and height of string */
+    /* Set flag if the line isn't to be drawn in default style, size and
+       color. We don't create a GC yet since this might be called before
+       the textbox is visible! */
 
-    if ( ! tl->is_separator && *tl->text )
-    {
-        tl->w = fl_get_string_widthTAB( tl->style, tl->size,
-                                        tl->text, tl->len );
-        tl->h = fl_get_string_height( tl->style, tl->size,
-                                      tl->len ? tl->text : " " , tl->len | 1,
-                                      &tl->asc, &tl->desc );
-    }
-    else
-    {
-        tl->w = 0;
-        tl->h = fl_get_string_height( tl->style, tl->size,
-                                      "X", 1, &tl->asc, &tl->desc );
-    }
+    if (    attr.style != sp->def_style
+         || attr.size  != sp->def_size
+         || ( attr.color != obj->lcol && tl->selectable ) )
+        attr.is_special = 1;
 
-    /* If the new line is longer than all others we need to recalculate the
-       horizontal position of all lines that aren't left aligned */
+    tl->attr = get_attr( sp, &attr );
 
-    if ( tl->w > sp->max_width )
-    {
-        sp->max_width = tl->w;
-        for ( i = 0; i < sp->num_lines; i++ )
-            if ( fl_is_center_lalign( sp->lines[ i ]->align ) )
-                sp->lines[ i ]->x = ( sp->max_width - sp->lines[ i ]->w ) / 2;
-            else if ( fl_to_outside_lalign( sp->lines[ i ]->align ) ==
-                                                             FL_ALIGN_RIGHT )
-                sp->lines[ i ]->x = sp->max_width - sp->lines[ i ]->w;
-    }
-    else
-    {
-        if ( fl_is_center_lalign( tl->align ) )
-            tl->x = ( sp->max_width - tl->w ) / 2;
-        else if ( fl_to_outside_lalign( tl->align ) == FL_ALIGN_RIGHT )
-            tl->x = sp->max_width - tl->w;
-    }
+    /* Figure out width of string */
 
-    /* Calculate the vertical position of the line, shifting that of lines
-       that may come afterwards */
+    measure_line( sp, tl );
+}
 
-    if ( sp->num_lines == 1 )
-        tl->y = 0;
-    else if ( line == sp->num_lines - 1 )
-        tl->y = sp->lines[ line - 1 ]->y + sp->lines[ line - 1 ]->h;
-    else
+
+/***************************************
+ * Inserts a single line into the textbox without redrawing, the
+ * text must have been allocated and gets owned by the textbox
+ ***************************************/
+
+static void
+insert_line( FL_OBJECT * obj,
+             int         line,
+             char      * text )
+{
+    FLI_TBOX_SPEC *sp = obj->spec;
+    TBOX_LINE tl;
+
+    /* If 'line' is too large correct that by appending to the end */
+
+    if ( line >= sp->num_lines )
+        line = sp->num_lines;
+
+    /* Make sure the lines marked as selected and deselected remain unchanged */
+
+    if ( sp->select_line >= line )
+        sp->select_line++;
+    if ( sp->deselect_line >= line )
+        sp->deselect_line++;
+
+    parse_line( obj, text, &tl );
+
+    /* The horizontal positions of lines aren't stored but calculated when
+       needed from the width of the longest line, so if the new line is the
+       longest one nothing else needs to be done here */
+
+    store_line( sp, line, &tl );
+}
+
+
+/***************************************
+ * Inserts one or more lines, separated by
+ * linefeed characters, into the textbox
+ ***************************************/
+
+void
+fli_tbox_insert_lines( FL_OBJECT  * obj,
+                       int          line,
+                       const char * new_text )
+{
+    FLI_TBOX_SPEC *sp = obj->spec;
+    const char *p = new_text;
+    const char *del;
+
+    if ( line < 0 || ! new_text || check_virtual( obj, __func__ ) )
+        return;
+
+    while ( 1 )
     {
-        tl->y = sp->lines[ line + 1 ]->y;
-        for ( i = line + 1; i < sp->num_lines; i++ )
-            sp->lines[ i ]->y += tl->h;
+        size_t len = ( del = strchr( p, '\n' ) ) ? ( size_t ) ( del - p )
+                                                 : strlen( p );
+        char *text = fl_malloc( len + 1 );
+
+        memcpy( text, p, len );
+        text[ len ] = '\0';
+        insert_line( obj, line++, text );
+
+        if ( del )
+            p = del + 1;
+        else
+            break;
     }
 
-    sp->max_height += tl->h;
+    if ( ! sp->no_redraw )
+        fl_redraw_object( obj );
+}
 
-    /* Set flag if the line isn't to be drawn in default style, size and
-       color. We don't create a GC yet since this might be called before
-       the textbox is visible! */
 
-    if (    tl->style != sp->def_style
-         || tl->size  != sp->def_size
-         || ( tl->color != obj->lcol && tl->selectable ) )
-        tl->is_special = 1;
+/***************************************
+ * Inserts a single line into the textbox
+ ***************************************/
+
+void
+fli_tbox_insert_line( FL_OBJECT  * obj,
+                      int          line,
+                      const char * new_text )
+{
+    FLI_TBOX_SPEC *sp = obj->spec;
+
+    /* Catch invalid 'line' or 'new_text' argument */
+
+    if ( line < 0 || ! new_text || check_virtual( obj, __func__ ) )
+        return;
+
+    insert_line( obj, line, fl_strdup( new_text ) );
 
     if ( ! sp->no_redraw )
         fl_redraw_object( obj );
@@ -562,13 +1440,8 @@ fli_tbox_add_line( FL_OBJECT  * obj,
 
    /* Make last line visible if asked for */
 
-   if ( show && sp->num_lines )
-   {
-       TBOX_LINE *tl = sp->lines[ sp->num_lines - 1 ];
-
-       if ( tl->y + tl->h - sp->yoffset >= sp->h )
-           fli_tbox_set_bottomline( obj, sp->num_lines - 1 );
-   }
+   if ( show && sp->num_lines && sp->max_height - sp->yoffset >= sp->h )
+       fli_tbox_set_bottomline( obj, sp->num_lines - 1 );
 }
 
 
@@ -591,7 +1464,7 @@ fli_tbox_add_chars( FL_OBJECT  * obj,
 
     /* If there's nothing to add return */
 
-    if ( ! add || ! *add )
+    if ( ! add || ! *add || check_virtual( obj, __func__ ) )
         return;
 
     /* If there aren't any lines yet it's equivalent to inserting a new one */
@@ -602,7 +1475,7 @@ fli_tbox_add_chars( FL_OBJECT  * obj,
         return;
     }
 
-    tl = sp->lines[ sp->num_lines - 1 ];
+    tl = get_line( sp, sp->num_lines - 1 );
 
     /* If there's no text or the line has an incomplete escape sequence that
        possibly could become completed due to the new text assemble the text
@@ -639,7 +1512,7 @@ fli_tbox_add_chars( FL_OBJECT  * obj,
             if ( insert )
                 memcpy( new_text + old_len, "@ ", 2 );
         }
-        memcpy( new_text + old_len + insert, add, len ); 
+        memcpy( new_text + old_len + insert, add, len );
         sp->no_redraw = 1;
 
         fli_tbox_delete_line( obj, sp->num_lines - 1 );
@@ -679,44 +1552,20 @@ fli_tbox_add_chars( FL_OBJECT  * obj,
     if ( tl->is_separator )
         return;
 
-    /* Figure out the new length of the line */
-
-    if ( *tl->text )
-        tl->w = fl_get_string_widthTAB( tl->style, tl->size,
-                                        tl->text, tl->len );
-
-    /* If line is now longer than all others we need to recalculate the
-       horizontal position of all lines that aren't left aligned */
+    /* Figure out the new length of the line, if it's now longer than all
+       others it determines the maximum width */
 
-    if ( tl->w > sp->max_width )
-    {
-        int i;
-
-        sp->max_width = tl->w;
-        for ( i = 0; i < sp->num_lines; i++ )
-            if ( fl_is_center_lalign( sp->lines[ i ]->align ) )
-                sp->lines[ i ]->x = ( sp->max_width - sp->lines[ i ]->w ) / 2;
-            else if ( fl_to_outside_lalign( sp->lines[ i ]->align ) ==
-                                                              FL_ALIGN_RIGHT )
-                sp->lines[ i ]->x = sp->max_width - sp->lines[ i ]->w;
-    }
-    else
-    {
-        if ( fl_is_center_lalign( tl->align ) )
-            tl->x = ( sp->max_width - tl->w ) / 2;
-        else if ( fl_to_outside_lalign( tl->align ) == FL_ALIGN_RIGHT )
-            tl->x = sp->max_width - tl->w;
-    }
+    forget_width( sp, tl );
+    measure_if_needed( sp, tl );
+    update_max_width( sp );
 
     /* If there was no newline in the string to be appended we're done,
        otherwise the remaining stuff has to be added as new lines */
 
     if ( ! del )
     {
-       TBOX_LINE *tl = sp->lines[ sp->num_lines - 1 ];
-
-       if ( tl->y + tl->h - sp->yoffset >= sp->h )
-           fli_tbox_set_bottomline( obj, sp->num_lines - 1 );
+        if ( sp->max_height - sp->yoffset >= sp->h )
+            fli_tbox_set_bottomline( obj, sp->num_lines - 1 );
     }
     else
     {
@@ -739,14 +1588,17 @@ fli_tbox_replace_line( FL_OBJECT  * obj,
    int old_select_line = sp->select_line;
    int old_no_redraw = sp->no_redraw;
 
-   if ( line < 0 || line >= sp->num_lines || ! text )
+   if (    line < 0
+        || line >= sp->num_lines
+        || ! text
+        || check_virtual( obj, __func__ ) )
        return;
 
    sp->no_redraw = 1;
    fli_tbox_delete_line( obj, line );
    sp->no_redraw = old_no_redraw;
    fli_tbox_insert_line( obj, line, text );
-   if ( line == old_select_line && sp->lines[ line ]->selectable )
+   if ( line == old_select_line && get_line( sp, line )->selectable )
        fli_tbox_select_line( obj, line );
 }
 
@@ -759,31 +1611,97 @@ void
 fli_tbox_clear( FL_OBJECT * obj )
 {
     FLI_TBOX_SPEC *sp = obj->spec;
-    int i;
 
-    sp->select_line = sp->deselect_line = -1;
+    sp->select_line = sp->deselect_line = -1;
+
+    if ( sp->num_lines == 0 && ! sp->virt )
+        return;
+
+    free_lines( sp );
+
+    sp->max_width  = 0;
+    sp->max_height = 0;
+    sp->xoffset    = 0;
+    sp->yoffset    = 0;
+
+    if ( ! sp->no_redraw )
+        fl_redraw_object( obj );
+}
+
+
+/***************************************
+ * Makes the textbox a virtual one with 'num_lines' lines which get
+ * requested via the 'fetch' function when needed. If the textbox
+ * already is virtual only the number of lines, the function and its
+ * data get changed and all cached lines get discarded (to be used when
+ * the data shown have changed). Passing NULL for 'fetch' clears the
+ * textbox and makes it a normal one again.
+ ***************************************/
+
+void
+fli_tbox_set_virtual( FL_OBJECT        * obj,
+                      int                num_lines,
+                      FL_BROWSER_FETCH   fetch,
+                      void             * data )
+{
+    FLI_TBOX_SPEC *sp = obj->spec;
+    TBOX_VIRT *v = sp->virt;
+    int old_no_redraw = sp->no_redraw;
+    int dummy;
+
+    if ( ! fetch )
+    {
+        fli_tbox_clear( obj );
+        return;
+    }
+
+    if ( num_lines < 0 )
+    {
+        M_err( __func__, "Invalid number of lines" );
+        num_lines = 0;
+    }
+
+    if ( ! v )
+    {
+        sp->no_redraw = 1;
+        fli_tbox_clear( obj );
+        sp->no_redraw = old_no_redraw;
+
+        v = sp->virt = fl_malloc( sizeof *v );
+        v->obj          = obj;
+        v->selected     = NULL;
+        v->num_selected = 0;
+        flush_cache( v );
+    }
+    else
+    {
+        flush_cache( v );
+
+        /* Forget about selected lines that don't exist anymore */
 
-    if ( sp->num_lines == 0 )
-        return;
+        while ( v->num_selected && v->selected[ v->num_selected - 1 ]
+                                                                >= num_lines )
+            set_virtual_selected( v, v->selected[ v->num_selected - 1 ], 0 );
 
-    for ( i = 0; i < sp->num_lines; i++ )
-    {
-        if ( sp->lines[ i ]->specialGC )
-        {
-            XFreeGC( flx->display, sp->lines[ i ]->specialGC );
-            sp->lines[ i ]->specialGC = None;
-        }
-        fli_safe_free( sp->lines[ i ]->fulltext );
-        fli_safe_free( sp->lines[ i ] );
+        if ( sp->select_line >= num_lines )
+            sp->select_line = -1;
+        if ( sp->deselect_line >= num_lines )
+            sp->deselect_line = -1;
     }
 
-    fli_safe_free( sp->lines );
+    v->fetch = fetch;
+    v->data  = data;
+    v->h = fl_get_string_height( sp->def_style, sp->def_size, "X", 1,
+                                 &dummy, &dummy );
 
-    sp->num_lines  = 0;
-    sp->max_width  = 0;
-    sp->max_height = 0;
-    sp->xoffset    = 0;
-    sp->yoffset    = 0;
+    sp->num_lines  = num_lines;
+    sp->max_height = num_lines * v->h;
+
+    /* Make sure the vertical offset is still reasonable */
+
+    sp->no_redraw = 1;
+    fli_tbox_set_yoffset( obj, sp->yoffset );
+    sp->no_redraw = old_no_redraw;
 
     if ( ! sp->no_redraw )
         fl_redraw_object( obj );
@@ -794,40 +1712,71 @@ fli_tbox_clear( FL_OBJECT * obj )
  * Loads all lines from a file into the textbox
  ***********************************************/
 
+#define LOAD_BUFFER_SIZE  65536
+
 int
 fli_tbox_load( FL_OBJECT  * obj,
                const char * filename )
 {
     FLI_TBOX_SPEC *sp = obj->spec;
     FILE *fp;
-    char *text;
-    char *del;
+    char *buf;
+    size_t size = LOAD_BUFFER_SIZE,
+           used = 0,
+           n;
 
     /* Load the file */
 
-    if ( ! filename || ! *filename )
+    if ( ! filename || ! *filename || check_virtual( obj, __func__ ) )
         return 0;
 
     if ( ! ( fp = fopen( filename, "r" ) ) )
         return 0;
 
-    while ( ( text = fli_read_line( fp ) ) && *text )
+    /* Read the file in large blocks and append the lines directly, that's
+       a lot faster than reading it line by line and inserting each line on
+       its own. The buffer only needs to be enlarged if there's a line that
+       doesn't fit into it. */
+
+    buf = fl_malloc( size );
+
+    while ( ( n = fread( buf + used, 1, size - used, fp ) ) > 0 )
     {
-        int old_no_redraw = sp->no_redraw;
+        char *start = buf,
+             *del;
 
-        /* Get rid of linefeed at end of line */
+        used += n;
 
-        if ( ( del = strrchr( text, '\n' ) ) )
-            *del = '\0';
+        while ( ( del = memchr( start, '\n', buf + used - start ) ) )
+        {
+            char *text = fl_malloc( del - start + 1 );
 
-        sp->no_redraw = 1;
-        fli_tbox_insert_line( obj, sp->num_lines, text );
-        sp->no_redraw = old_no_redraw;
-        fl_free( text );
+            memcpy( text, start, del - start );
+            text[ del - start ] = '\0';
+            insert_line( obj, sp->num_lines, text );
+            start = del + 1;
+        }
+
+        used -= start - buf;
+        if ( used && start != buf )
+            memmove( buf, start, used );
+
+        if ( used == size )
+            buf = fl_realloc( buf, size *= 2 );
     }
 
-    fli_safe_free( text );
+    /* Deal with a last line without a linefeed */
+
+    if ( used )
+    {
+        char *text = fl_malloc( used + 1 );
+
+        memcpy( text, buf, used );
+        text[ used ] = '\0';
+        insert_line( obj, sp->num_lines, text );
+    }
 
+    fl_free( buf );
     fclose( fp );
 
     if ( ! sp->no_redraw )
@@ -851,31 +1800,41 @@ fli_tbox_get_line( FL_OBJECT * obj,
    if ( line < 0 || line >= sp->num_lines )
        return NULL;
 
-   return sp->lines[ line ]->fulltext;
+   return get_line( sp, line )->fulltext;
 }
 
 
-/*************************************
- * Sets a new font size for all lines
- * drawn with default settings
- *************************************/
+/***************************************
+ * Recalculates the sizes of all lines drawn with default settings
+ * after the default font size or style was changed
+ ***************************************/
 
-void
-fli_tbox_set_fontsize( FL_OBJECT * obj,
-                       int         size )
+static void
+remeasure_default_lines( FL_OBJECT * obj )
 {
     FLI_TBOX_SPEC *sp = obj->spec;
     double old_xrel;
     double old_yrel;
     int old_no_redraw = sp->no_redraw;
-    int i;
+    int ci,
+        li,
+        i;
 
-    if ( size < FL_TINY_SIZE || size > FL_HUGE_SIZE )
-        return;
+    /* Lines with default settings all share attributes with the 'is_special'
+       flag not set, so it's enough to change those */
 
-    sp->def_size = size;
+    for ( i = 0; i < sp->num_attrs; i++ )
+    {
+        TBOX_ATTR *a = sp->attrs + i;
 
-    sp->attrib = 1;
+        if ( a->is_special )
+            continue;
+
+        a->size  = sp->def_size;
+        a->style = sp->def_style;
+        a->h = fl_get_string_height( a->style, a->size, "X", 1,
+                                     &a->asc, &a->desc );
+    }
 
     if ( sp->num_lines == 0 )
         return;
@@ -883,138 +1842,110 @@ fli_tbox_set_fontsize( FL_OBJECT * obj,
     old_xrel = fli_tbox_get_rel_xoffset( obj );
     old_yrel = fli_tbox_get_rel_yoffset( obj );
 
-    /* Calculate width and height for all lines */
+    /* For virtual textboxes it's enough to drop all cached lines, they
+       get measured again when they're needed */
 
-    for ( i = 0; i < sp->num_lines; i++ )
+    if ( sp->virt )
     {
-        TBOX_LINE *tl = sp->lines[ i ];
-
-        if ( tl->is_special )
-            continue;
+        int dummy;
 
-        tl->size = size;
+        flush_cache( sp->virt );
+        sp->virt->h = fl_get_string_height( sp->def_style, sp->def_size,
+                                            "X", 1, &dummy, &dummy );
+        sp->max_height = sp->num_lines * sp->virt->h;
+        sp->max_width = 0;
+    }
 
-        /* Figure out width and height of string */
+    /* Measuring the widths of all lines can take quite some time for
+       large textboxes, so the lines drawn with default settings are just
+       marked as unmeasured. They get measured when drawn and, in the
+       background, via a timeout. Lines without text have a width of 0
+       anyway. */
 
-        if ( ! tl->is_separator && *tl->text )
-        {
-            tl->w = fl_get_string_widthTAB( tl->style, tl->size,
-                                            tl->text, tl->len );
-            tl->h = fl_get_string_height( tl->style, tl->size,
-                                          tl->len ? tl->text : " ",
-                                          tl->len | 1,
-                                          &tl->asc, &tl->desc );
-        }
-        else
+    for ( ci = 0; ci < sp->num_chunks; ci++ )
+        for ( li = 0; li < sp->chunks[ ci ]->num_lines; li++ )
         {
-            tl->w = 0;
-            tl->h = fl_get_string_height( tl->style, tl->size,
-                                          "X", 1, &tl->asc, &tl->desc );
+            TBOX_LINE *tl = sp->chunks[ ci ]->lines + li;
+
+            if (    ! sp->attrs[ tl->attr ].is_special
+                 && ! tl->is_separator
+                 && *tl->text )
+                forget_width( sp, tl );
         }
-    }
 
-    /* Calculate vertical positions of all lines and maximum width */
+    /* Calculate vertical positions of all lines and the new height of
+       all the text (that's cheap since the heights of lines only depend
+       on their attributes) */
+
+    sp->no_redraw = 1;
+
+    if ( ! sp->virt )
+        recalc_heights( sp );
+
+    fli_tbox_set_rel_yoffset( obj, old_yrel );
 
-    sp->max_width = sp->lines[ 0 ]->w;
+    /* Measure the lines that are going to be visible right now */
 
-    for ( i = 1; i < sp->num_lines; i++ )
+    if ( ! sp->virt )
     {
-        sp->lines[ i ]->y = sp->lines[ i - 1 ]->y + sp->lines[ i - 1 ]->h;
-        sp->max_width = FL_max( sp->max_width, sp->lines[ i ]->w );
-    }
+        int last = find_line_at_y( sp, sp->yoffset + sp->h );
 
-    /* Determine new height of all the text */
+        for ( li = find_line_at_y( sp, sp->yoffset );
+              li <= last && li < sp->num_lines; li++ )
+            measure_if_needed( sp, get_line( sp, li ) );
 
-    sp->max_height =   sp->lines[ sp->num_lines - 1 ]->y
-                     + sp->lines[ sp->num_lines - 1 ]->h;
+        update_max_width( sp );
+
+        if ( sp->num_unmeasured && sp->measure_timeout_id == -1 )
+            sp->measure_timeout_id = fl_add_timeout( 0, measure_cb, obj );
+    }
 
-    sp->no_redraw = 1;
     fli_tbox_set_rel_xoffset( obj, old_xrel );
-    fli_tbox_set_rel_yoffset( obj, old_yrel );
     sp->no_redraw = old_no_redraw;
 }
 
 
-/**************************************
- * Sets a new font style for all lines
+/*************************************
+ * Sets a new font size for all lines
  * drawn with default settings
- **************************************/
+ *************************************/
 
 void
-fli_tbox_set_fontstyle( FL_OBJECT * obj,
-                        int         style )
+fli_tbox_set_fontsize( FL_OBJECT * obj,
+                       int         size )
 {
     FLI_TBOX_SPEC *sp = obj->spec;
-    double old_xrel;
-    double old_yrel;
-    int old_no_redraw = sp->no_redraw;
-    int i;
 
-    if ( style < FL_NORMAL_STYLE || style > FL_TIMESBOLDITALIC_STYLE )
+    if ( size < FL_TINY_SIZE || size > FL_HUGE_SIZE )
         return;
 
-    sp->def_style = style;
+    sp->def_size = size;
 
     sp->attrib = 1;
 
-    if ( sp->num_lines == 0 )
-        return;
-
-    old_xrel = fli_tbox_get_rel_xoffset( obj );
-    old_yrel = fli_tbox_get_rel_yoffset( obj );
-
-    /* Calculate width and height for all lines */
-
-    for ( i = 0; i < sp->num_lines; i++ )
-    {
-        TBOX_LINE *tl = sp->lines[ i ];
-
-        if ( tl->is_special )
-            continue;
-
-        tl->style = style;
-
-        /* Figure out width and height of string */
-
-        if ( ! tl->is_separator && *tl->text )
-        {
-            tl->w = fl_get_string_widthTAB( tl->style, tl->size,
-                                            tl->text, tl->len );
-            tl->h = fl_get_string_height( tl->style, tl->size,
-                                          tl->len ? tl->text : " ",
-                                          tl->len | 1,
-                                          &tl->asc, &tl->desc );
-        }
-        else
-        {
-            tl->w = 0;
-            tl->h = fl_get_string_height( tl->style, tl->size,
-                                          "X", 1, &tl->asc, &tl->desc );
-        }
-    }
+    remeasure_default_lines( obj );
+}
 
-    /* Calculate vertical positions of all lines and the width of the
-       longest line */
 
-    sp->max_width = sp->lines[ 0 ]->w;
+/**************************************
+ * Sets a new font style for all lines
+ * drawn with default settings
+ **************************************/
 
-    for ( i = 1; i < sp->num_lines; i++ )
-    {
-        sp->lines[ i ]->y = sp->lines[ i - 1 ]->y + sp->lines[ i - 1 ]->h;
-        sp->max_width = FL_max( sp->max_width, sp->lines[ i ]->w );
-    }
+void
+fli_tbox_set_fontstyle( FL_OBJECT * obj,
+                        int         style )
+{
+    FLI_TBOX_SPEC *sp = obj->spec;
 
-    /* Determine new height of total text */
+    if ( style < FL_NORMAL_STYLE || style > FL_TIMESBOLDITALIC_STYLE )
+        return;
 
-    sp->max_height =   sp->lines[ sp->num_lines - 1 ]->y
-                     + sp->lines[ sp->num_lines - 1 ]->h;
+    sp->def_style = style;
 
     sp->attrib = 1;
 
-    sp->no_redraw = 1;
-    fli_tbox_set_rel_xoffset( obj, old_xrel );
-    fli_tbox_set_rel_yoffset( obj, old_yrel );
-    sp->no_redraw = old_no_redraw;
+    remeasure_default_lines( obj );
 }
 
 
@@ -1190,7 +2121,7 @@ fli_tbox_get_line_yoffset( FL_OBJECT * obj,
     if ( line < 0 || line >= sp->num_lines )
         return -1;
 
-    return sp->lines[ line ]->y;
+    return line_y( sp, line );
 }
 
 
@@ -1212,7 +2143,7 @@ fli_tbox_set_topline( FL_OBJECT * obj,
     else if ( line >= sp->num_lines )
         line = sp->num_lines - 1;
 
-    fli_tbox_set_yoffset( obj, sp->lines[ line ]->y );
+    fli_tbox_set_yoffset( obj, line_y( sp, line ) );
 }
 
 
@@ -1235,8 +2166,8 @@ fli_tbox_set_bottomline( FL_OBJECT * obj,
         line = sp->num_lines - 1;
 
     fli_tbox_set_yoffset( obj,
-                            sp->lines[ line ]->y
-                          + sp->lines[ line ]->h - sp->h );
+                            line_y( sp, line )
+                          + line_h( sp, get_line( sp, line ) ) - sp->h );
 }
 
 
@@ -1260,8 +2191,8 @@ fli_tbox_set_centerline( FL_OBJECT * obj,
         line = sp->num_lines - 1;
 
     fli_tbox_set_yoffset( obj,
-                            sp->lines[ line ]->y
-                          + ( sp->lines[ line ]->h - sp->h ) / 2 );
+                            line_y( sp, line )
+                          + ( line_h( sp, get_line( sp, line ) ) - sp->h ) / 2 );
 }
 
 
@@ -1273,10 +2204,21 @@ void
 fli_tbox_deselect( FL_OBJECT * obj )
 {
     FLI_TBOX_SPEC *sp = obj->spec;
-    int i;
+    int ci,
+        li;
+
+    for ( ci = 0; ci < sp->num_chunks; ci++ )
+        for ( li = 0; li < sp->chunks[ ci ]->num_lines; li++ )
+            sp->chunks[ ci ]->lines[ li ].selected = 0;
+
+    if ( sp->virt )
+    {
+        for ( li = 0; li < TBOX_CACHE_SIZE; li++ )
+            sp->virt->cache[ li ].line.selected = 0;
 
-    for ( i = 0; i < sp->num_lines; i++ )
-        sp->lines[ i ]->selected = 0;
+        fli_safe_free( sp->virt->selected );
+        sp->virt->num_selected = 0;
+    }
 
     sp->select_line = -1;
     sp->deselect_line = -1;
@@ -1295,11 +2237,16 @@ fli_tbox_deselect_line( FL_OBJECT * obj,
                          int         line )
 {
     FLI_TBOX_SPEC *sp = obj->spec;
+    TBOX_LINE *tl;
 
-    if ( line < 0 || line >= sp->num_lines || ! sp->lines[ line ]->selected )
+    if (    line < 0
+         || line >= sp->num_lines
+         || ! ( tl = get_line( sp, line ) )->selected )
         return;
 
-    sp->lines[ line ]->selected = 0;
+    tl->selected = 0;
+    if ( sp->virt )
+        set_virtual_selected( sp->virt, line, 0 );
 
     /* Don't mark as deselected for FL_SELECT_BROWSER since otherwise it
        would be impossible for the user to retrieve the selection */
@@ -1324,17 +2271,26 @@ fli_tbox_select_line( FL_OBJECT * obj,
                       int         line )
 {
     FLI_TBOX_SPEC *sp = obj->spec;
+    TBOX_LINE *tl;
 
-    if (    line < 0
-         || line >= sp->num_lines
-         || sp->lines[ line ]->selected
-         || ! sp->lines[ line ]->selectable )
+    if ( line < 0 || line >= sp->num_lines )
+        return;
+
+    tl = get_line( sp, line );
+
+    if ( tl->selected || ! tl->selectable )
         return;
 
     if ( sp->select_line != -1 && obj->type != FL_MULTI_BROWSER )
-        sp->lines[ sp->select_line ]->selected = 0;
+    {
+        get_line( sp, sp->select_line )->selected = 0;
+        if ( sp->virt )
+            set_virtual_selected( sp->virt, sp->select_line, 0 );
+    }
 
-    sp->lines[ line ]->selected = 1;
+    tl->selected = 1;
+    if ( sp->virt )
+        set_virtual_selected( sp->virt, line, 1 );
 
     sp->select_line = line;
     sp->deselect_line = -1;
@@ -1354,9 +2310,15 @@ fli_tbox_is_line_selected( FL_OBJECT * obj,
 {
     FLI_TBOX_SPEC *sp = obj->spec;
 
-    return    line >= 0
-           && line < sp->num_lines
-           && sp->lines[ line ]->selected;
+    if ( line < 0 || line >= sp->num_lines )
+        return 0;
+
+    /* No need to fetch the line for a virtual textbox */
+
+    if ( sp->virt )
+        return is_virtual_selected( sp->virt, line );
+
+    return get_line( sp, line )->selected;
 }
 
 
@@ -1372,13 +2334,17 @@ fli_tbox_make_line_selectable( FL_OBJECT * obj,
     FLI_TBOX_SPEC *sp = obj->spec;
     TBOX_LINE *tl;
 
+    /* For virtual textboxes this information would get lost when the
+       line is dropped from the cache */
+
     if (    line < 0
          || line >= sp->num_lines
-         || sp->lines[ line ]->is_separator
+         || check_virtual( obj, __func__ )
+         || get_line( sp, line )->is_separator
          || obj->type == FL_NORMAL_BROWSER )
         return;
 
-    tl = sp->lines[ line ];
+    tl = get_line( sp, line );
     state = state ? 1 : 0;
 
     if ( ! state )
@@ -1389,24 +2355,10 @@ fli_tbox_make_line_selectable( FL_OBJECT * obj,
             sp->deselect_line = -1;
     }
 
-    if ( tl->selectable != state )
-    {
-        tl->selectable = state;
-
-        if ( tl->is_special )
-        {
-            if ( tl->specialGC )
-            {
-                XFreeGC( flx->display, tl->specialGC );
-                sp->lines[ line ]->specialGC = None;
-            }
+    /* The attributes of the line have GCs for both the selectable and
+       the non-selectable state, so there's nothing else to do */
 
-            if ( FL_ObjWin( obj ) )
-                tl->specialGC = create_gc( obj, tl->style, tl->size,
-                                           state ? obj->lcol : FL_INACTIVE,
-                                           sp->x, sp->y, sp->w, sp->h );
-        }
-    }
+    tl->selectable = state;
 
     if ( ! sp->no_redraw )
         fl_redraw_object( obj );
@@ -1546,15 +2498,6 @@ fli_tbox_prepare_drawing( FL_OBJECT * obj )
 
     fli_tbox_recalc_area( obj );
 
-    /* Recalculate horizontal positions of all lines */
-
-    for ( i = 0; i < sp->num_lines; i++ )
-        if ( fl_is_center_lalign( sp->lines[ i ]->align ) )
-            sp->lines[ i ]->x = ( sp->max_width - sp->lines[ i ]->w ) / 2;
-        else if ( fl_to_outside_lalign( sp->lines[ i ]->align ) ==
-                                                          FL_ALIGN_RIGHT )
-            sp->lines[ i ]->x = sp->max_width - sp->lines[ i ]->w;
-
     /* We might get called before the textbox is shown and then the
        window is still unknown and GCs can't be created */
 
@@ -1609,23 +2552,24 @@ fli_tbox_prepare_drawing( FL_OBJECT * obj )
                                      sp->w + ( LEFT_MARGIN > 0 ), sp->h );
     }
 
-    /* Lines with non-default fonts or colors have their own GCs */
+    /* Lines with non-default fonts or colors use GCs stored with their
+       attributes, get rid of them, they get created anew when needed */
 
-    for ( i = 0; i < sp->num_lines;  i++ )
+    for ( i = 0; i < sp->num_attrs; i++ )
     {
-        TBOX_LINE *tl = sp->lines[ i ];
+        TBOX_ATTR *a = sp->attrs + i;
 
-        if ( ! tl->is_special )
-            continue;
-
-        if ( tl->specialGC )
+        if ( a->specialGC[ 0 ] )
         {
-            XFreeGC( flx->display, tl->specialGC );
-            tl->specialGC = None;
+            XFreeGC( flx->display, a->specialGC[ 0 ] );
+            a->specialGC[ 0 ] = None;
         }
 
-        tl->specialGC = create_gc( obj, tl->style, tl->size, tl->color,
-                                   sp->x, sp->y, sp->w, sp->h );
+        if ( a->specialGC[ 1 ] )
+        {
+            XFreeGC( flx->display, a->specialGC[ 1 ] );
+            a->specialGC[ 1 ] = None;
+        }
     }
 
     sp->no_redraw = 1;
@@ -1643,18 +2587,8 @@ static void
 free_tbox_spec( FL_OBJECT * obj )
 {
     FLI_TBOX_SPEC *sp = obj->spec;
-    int i;
-
-    for ( i = 0; i < sp->num_lines; i++ )
-    {
-        if ( sp->lines[ i ]->specialGC )
-            XFreeGC( flx->display, sp->lines[ i ]->specialGC );
-
-        fli_safe_free( sp->lines[ i ]->fulltext );
-        fli_safe_free( sp->lines[ i ] );
-    }
 
-    fli_safe_free( sp->lines );
+    free_lines( sp );
 
     if ( sp->defaultGC )
         XFreeGC( flx->display, sp->defaultGC );
@@ -1676,117 +2610,170 @@ free_tbox_spec( FL_OBJECT * obj )
 
 
 /***************************************
- * Draws the complete textbox
+ * Draws a single line of the textbox, 'y' being its vertical position
  ***************************************/
 
 static void
-draw_tbox( FL_OBJECT * obj )
+draw_line( FL_OBJECT * obj,
+           TBOX_LINE * tl,
+           int         y )
 {
     FLI_TBOX_SPEC *sp = obj->spec;
-    int i;
+    TBOX_ATTR *a = sp->attrs + tl->attr;
+    GC activeGC = sp->defaultGC;
+    int h = line_h( sp, tl );
+    int x;
 
-    fl_draw_box( obj->boxtype, obj->x, obj->y, obj->w, obj->h,
-                 obj->col1, obj->bw );
+    /* The line may not have been measured yet after a font change */
 
-    XFillRectangle( flx->display, FL_ObjWin( obj ),
-                    sp->backgroundGC,
-                    obj->x + sp->x - ( LEFT_MARGIN > 0 ),
-                    obj->y + sp->y + sp->w - sp->yoffset,
-                    sp->w + ( LEFT_MARGIN > 0 ), sp->h );
+    measure_if_needed( sp, tl );
 
-    if ( sp->num_lines == 0 )
+    /* Separator lines obviously need to be treated differently from
+       normal text */
+
+    if ( tl->is_separator )
+    {
+        /* The extra horizontal pixels here are due to the function called
+           subtracting them! */
+
+        fl_draw_text( 0, obj->x + sp->x - 3,
+                      obj->y + sp->y - sp->yoffset + y + h / 2,
+                      sp->w + 6, 1,
+                      FL_COL1, FL_NORMAL_STYLE, sp->def_size, "@DnLine" );
         return;
+    }
 
-    fl_set_clipping( obj->x, obj->y, obj->w, obj->h );
+    /* Draw background of line in selection color if necessary*/
 
-    for ( i = 0; i < sp->num_lines; i++ )
+    if ( tl->selected )
     {
-        TBOX_LINE *tl;
-        GC activeGC = sp->defaultGC;
+        fli_flush_draw_batch( );
+        XFillRectangle( flx->display, FL_ObjWin( obj ), sp->selectGC,
+                        obj->x + sp->x - ( LEFT_MARGIN > 0 ),
+                        obj->y + sp->y + y - sp->yoffset,
+                        sp->w + ( LEFT_MARGIN > 0 ), h );
+    }
 
-        tl = sp->lines[ i ];
+    /* If there's no text or the text isn't visible within the textbox
+       nothing needs to be drawn */
 
-        if ( tl->y + tl->h < sp->yoffset )   /* if line is above tbox */
-            continue;
+    x = line_x( sp, tl );
 
-        if ( tl->y >= sp->h + sp->yoffset )  /* if line is below tbox */
-            break;
+    if (    ! *tl->text
+         || x - sp->xoffset >= sp->w
+         || x + tl->w - sp->xoffset < 0 )
+        return;
 
-        /* Separator lines obviously need to be treated differently from
-           normal text */
+    /* If the line needs a different font or color than the default use
+       the special GC shared by all lines with the same attributes */
 
-        if ( tl->is_separator )
-        {
-            /* The extra horizontal pixels here are due to the function called
-               subtracting them! */
+    if ( ! tl->selectable )
+        activeGC = sp->nonselectGC;
 
-            fl_draw_text( 0, obj->x + sp->x - 3,
-                          obj->y + sp->y - sp->yoffset + tl->y + tl->h / 2,
-                          sp->w + 6, 1,
-                          FL_COL1, FL_NORMAL_STYLE, sp->def_size, "@DnLine" );
-            continue;
-        }
+    if ( a->is_special )
+    {
+        if ( ! a->specialGC[ tl->selectable ] )
+            a->specialGC[ tl->selectable ] =
+                create_gc( obj, a->style, a->size,
+                           tl->selectable ? a->color : FL_INACTIVE,
+                           sp->x, sp->y, sp->w, sp->h );
 
-        /* Draw background of line in selection color if necessary*/
+        activeGC = a->specialGC[ tl->selectable ];
+    }
 
-        if ( tl->selected )
-            XFillRectangle( flx->display, FL_ObjWin( obj ), sp->selectGC,
-                            obj->x + sp->x - ( LEFT_MARGIN > 0 ),
-                            obj->y + sp->y + tl->y - sp->yoffset,
-                            sp->w + ( LEFT_MARGIN > 0 ), tl->h );
+    /* Set up GC for selected lines in B&W each time round - a bit slow,
+       but I guess there are hardly any machines left with a B&W display */
 
+    if ( fli_dithered( fl_vmode ) && tl->selected )
+    {
+        XFontStruct *xfs = fl_get_fntstruct( a->style, a->size );
 
-        /* If there's no text or the text isn't visible within the textbox
-           nothing needs to be drawn */
+        XSetFont( flx->display, sp->bw_selectGC, xfs->fid );
+        XSetForeground( flx->display, sp->bw_selectGC,
+                        fl_get_flcolor( FL_WHITE ) );
+        activeGC = sp->bw_selectGC;
+    }
 
-        if (    ! *tl->text
-             || tl->x - sp->xoffset >= sp->w
-             || tl->x + tl->w - sp->xoffset < 0 )
-            continue;
+    /* Now draw the line, underlined if necessary */
 
-        /* If the line needs a different font or color than the default use
-           a special GC just for that line */
+    if ( a->is_underlined )
+        fl_diagline( obj->x + sp->x - sp->xoffset + x,
+                     obj->y + sp->y - sp->yoffset + y + h - 1,
+                     FL_min( sp->w + sp->xoffset - x, tl->w ), 1,
+                     ( fli_dithered( fl_vmode ) && tl->selected ) ?
+                     FL_WHITE : a->color );
 
-        if ( ! tl->selectable )
-            activeGC = sp->nonselectGC;
+    fli_draw_stringTAB( FL_ObjWin( obj ), activeGC,
+                        obj->x + sp->x - sp->xoffset + x,
+                        obj->y + sp->y - sp->yoffset + y + a->asc,
+                        a->style, a->size, tl->text, tl->len, 0 );
+}
 
-        if ( tl->is_special )
-        {
-            if ( ! tl->specialGC )
-                tl->specialGC = create_gc( obj, tl->style, tl->size,
-                                           tl->selectable ?
-                                           tl->color : FL_INACTIVE,
-                                           sp->x, sp->y, sp->w, sp->h );
 
-            activeGC = tl->specialGC;
-        }
+/***************************************
+ * Draws the complete textbox
+ ***************************************/
+
+static void
+draw_tbox( FL_OBJECT * obj )
+{
+    FLI_TBOX_SPEC *sp = obj->spec;
+    int ci,
+        li,
+        base;
+
+    fl_draw_box( obj->boxtype, obj->x, obj->y, obj->w, obj->h,
+                 obj->col1, obj->bw );
+
+    fli_flush_draw_batch( );
+    XFillRectangle( flx->display, FL_ObjWin( obj ),
+                    sp->backgroundGC,
+                    obj->x + sp->x - ( LEFT_MARGIN > 0 ),
+                    obj->y + sp->y + sp->w - sp->yoffset,
+                    sp->w + ( LEFT_MARGIN > 0 ), sp->h );
+
+    if ( sp->num_lines == 0 || sp->yoffset >= sp->max_height )
+        return;
 
-        /* Set up GC for selected lines in B&W each time round - a bit slow,
-           but I guess there are hardly any machines left with a B&W display */
+    fl_set_clipping( obj->x, obj->y, obj->w, obj->h );
+
+    /* Start with the line at the top of the textbox, there's no need to
+       look at any of the lines above it. For a virtual textbox only the
+       lines that are visible get fetched. */
 
-        if ( fli_dithered( fl_vmode ) && tl->selected )
+    li = find_line_at_y( sp, sp->yoffset );
+
+    if ( sp->virt )
+    {
+        for ( ; li < sp->num_lines; li++ )
         {
-            XFontStruct *xfs = fl_get_fntstruct( tl->style, tl->size );
-            
-            XSetFont( flx->display, sp->bw_selectGC, xfs->fid );
-            XSetForeground( flx->display, sp->bw_selectGC,
-                            fl_get_flcolor( FL_WHITE ) );
-            activeGC = sp->bw_selectGC;
+            if ( line_y( sp, li ) >= sp->h + sp->yoffset )
+                break;
+
+            draw_line( obj, get_line( sp, li ), line_y( sp, li ) );
         }
 
-        /* Now draw the line, underlined if necessary */
+        fl_unset_clipping( );
+        return;
+    }
+
+    ci = tree_find( sp->line_tree, sp->num_chunks, &li );
+    base = tree_sum( sp->height_tree, ci );
+
+    for ( ; ci < sp->num_chunks; base += sp->chunks[ ci++ ]->height, li = 0 )
+    {
+        TBOX_CHUNK *chunk = sp->chunks[ ci ];
+
+        if ( base >= sp->h + sp->yoffset )  /* if chunk is below tbox */
+            break;
 
-        if ( tl->is_underlined )
-            fl_diagline( obj->x + sp->x - sp->xoffset + tl->x,
-                         obj->y + sp->y - sp->yoffset + tl->y + tl->h - 1,
-                         FL_min( sp->w + sp->xoffset - tl->x, tl->w ), 1,
-                         ( fli_dithered( fl_vmode ) && tl->selected ) ?
-                         FL_WHITE : tl->color );
+        for ( ; li < chunk->num_lines; li++ )
+        {
+            if ( base + chunk->lines[ li ].y >= sp->h + sp->yoffset )
+                break;
 
-        fli_draw_stringTAB( FL_ObjWin( obj ), activeGC,
-                            obj->x + sp->x - sp->xoffset + tl->x,
-                            obj->y + sp->y - sp->yoffset + tl->y + tl->asc,
-                            tl->style, tl->size, tl->text, tl->len, 0 );
+            draw_line( obj, chunk->lines + li, base + chunk->lines[ li ].y );
+        }
     }
 
     fl_unset_clipping( );
@@ -1808,7 +2795,7 @@ find_next_selectable( FL_OBJECT * obj,
         line = -1;
 
     while ( ++line < sp->num_lines )
-        if ( sp->lines[ line ]->selectable )
+        if ( get_line( sp, line )->selectable )
             break;
 
     return line < sp->num_lines ? line : -1;
@@ -1830,7 +2817,7 @@ find_previous_selectable( FL_OBJECT * obj,
         line = sp->num_lines;
 
     while ( --line >= 0 )
-        if ( sp->lines[ line ]->selectable )
+        if ( get_line( sp, line )->selectable )
             break;
 
     return line;
@@ -1870,24 +2857,17 @@ fli_tbox_get_topline( FL_OBJECT * obj )
     if ( ! sp->def_height )
         return 0;
 
-    i = FL_min( sp->yoffset / sp->def_height, sp->num_lines - 1 );
+    /* Get the line at the top of the textbox, if it's only partially
+       visible use the next one unless that's not visible at all */
 
-    if ( sp->lines[ i ]->y < sp->yoffset )
-    {
-        while ( ++i < sp->num_lines && sp->lines[ i ]->y < sp->yoffset )
-            /* empty */ ;
-        if ( i == sp->num_lines || sp->lines[ i ]->y > sp->yoffset + sp->h )
-            i--;
-    }
-    else if ( sp->lines[ i ]->y > sp->yoffset )
-    {
-        while ( i-- > 0 && sp->lines[ i ]->y > sp->yoffset )
-            /* empty */ ;
-        if ( i < 0 || sp->lines[ i ]->y < sp->yoffset )
-            i++;
-    }
+    i = FL_min( find_line_at_y( sp, sp->yoffset ), sp->num_lines - 1 );
 
-    return i < sp->num_lines ? i : -1;
+    if (    line_y( sp, i ) < sp->yoffset
+         && i < sp->num_lines - 1
+         && line_y( sp, i + 1 ) <= sp->yoffset + sp->h )
+        i++;
+
+    return i;
 }
 
 
@@ -1900,14 +2880,15 @@ int
 fli_tbox_get_bottomline( FL_OBJECT * obj )
 {
     FLI_TBOX_SPEC *sp = obj->spec;
-    int i = sp->num_lines;
+    int i;
 
-    while ( --i >= 0
-            && sp->lines[ i ]->y > sp->yoffset
-            && sp->lines[ i ]->y + sp->lines[ i ]->h > sp->yoffset + sp->h )
-        /* empty */ ;
+    /* The last completely visible line is the one before the line at the
+       bottom of the textbox - unless that's also the line at the top */
 
-    return i;
+    i = find_line_at_y( sp, sp->yoffset + sp->h ) - 1;
+
+    return FL_max( i, FL_min( find_line_at_y( sp, sp->yoffset ),
+                              sp->num_lines - 1 ) );
 }
 
 
@@ -1962,31 +2943,34 @@ handle_keyboard( FL_OBJECT * obj,
             int topline = fli_tbox_get_topline( obj );
 
             if ( --topline >= 0 )
-                fli_tbox_set_yoffset( obj, sp->lines[ topline ]->y );
+                fli_tbox_set_yoffset( obj, line_y( sp, topline ) );
         }
         else if (    obj->type == FL_HOLD_BROWSER
                   || obj->type == FL_DESELECTABLE_HOLD_BROWSER )
         {
-            TBOX_LINE *tl;
+            int y,
+                h;
             int line = find_previous_selectable( obj, sp->select_line );
 
             if ( line >= 0 )
             {
-                tl = sp->lines[ line ];
+                y = line_y( sp, line );
+                h = line_h( sp, get_line( sp, line ) );
 
                 if ( sp->react_to_vert
-                     || ( tl->y + tl->h >= sp->yoffset
-                          && tl->y < sp->h + sp->yoffset ) )
+                     || ( y + h >= sp->yoffset
+                          && y < sp->h + sp->yoffset ) )
                 {
                     fli_tbox_select_line( obj, line );
 
-                    tl = sp->lines[ sp->select_line ];
+                    y = line_y( sp, sp->select_line );
+                    h = line_h( sp, get_line( sp, sp->select_line ) );
 
                     /* Bring the selection into view if necessary */
 
-                    if ( tl->y < sp->yoffset )
+                    if ( y < sp->yoffset )
                         fli_tbox_set_topline( obj, sp->select_line );
-                    else if ( tl->y + tl->h - sp->yoffset >= sp->h )
+                    else if ( y + h - sp->yoffset >= sp->h )
                         fli_tbox_set_bottomline( obj, sp->select_line );
                 }
             }
@@ -2003,10 +2987,10 @@ handle_keyboard( FL_OBJECT * obj,
 
             if ( topline >= 0 && topline < sp->num_lines - 1 )
             {
-                if ( sp->lines[ topline ]->y - sp->yoffset == 0 )
+                if ( line_y( sp, topline ) - sp->yoffset == 0 )
                     topline++;
 
-                fli_tbox_set_yoffset( obj, sp->lines[ topline ]->y );
+                fli_tbox_set_yoffset( obj, line_y( sp, topline ) );
             }
             else
                 fli_tbox_set_yoffset( obj, sp->max_height );
@@ -2014,26 +2998,29 @@ handle_keyboard( FL_OBJECT * obj,
         else if (    obj->type == FL_HOLD_BROWSER
                   || obj->type == FL_DESELECTABLE_HOLD_BROWSER )
         {
-            TBOX_LINE *tl;
+            int y,
+                h;
             int line = find_next_selectable( obj, sp->select_line );
 
             if ( line >= 0 )
             {
-                tl = sp->lines[ line ];
+                y = line_y( sp, line );
+                h = line_h( sp, get_line( sp, line ) );
 
                 if ( sp->react_to_vert
-                     || ( tl->y + tl->h >= sp->yoffset
-                          && tl->y < sp->h + sp->yoffset ) )
+                     || ( y + h >= sp->yoffset
+                          && y < sp->h + sp->yoffset ) )
                 {
                     fli_tbox_select_line( obj, line );
 
-                    tl = sp->lines[ sp->select_line ];
+                    y = line_y( sp, sp->select_line );
+                    h = line_h( sp, get_line( sp, sp->select_line ) );
 
                     /* Bring the selection into view if necessary */
 
-                    if ( tl->y + tl->h < sp->yoffset )
+                    if ( y + h < sp->yoffset )
                         fli_tbox_set_topline( obj, sp->select_line );
-                    else if ( tl->y + tl->h - sp->yoffset >= sp->h )
+                    else if ( y + h - sp->yoffset >= sp->h )
                         fli_tbox_set_bottomline( obj, sp->select_line );
                 }
             }
@@ -2066,22 +3053,9 @@ find_mouse_line( FL_OBJECT * obj,
 
     my += sp->yoffset - sp->y - obj->y;
 
-    line = FL_min( sp->num_lines - 1, 
-                   obj->y / ( ( double ) sp->max_height / sp->num_lines ) );
-
-    if ( sp->lines[ line ]->y > my )
-        while ( line-- > 0
-                && sp->lines[ line ]->y > my )
-            /* empty */ ;
-    else
-        while ( sp->lines[ line ]->y + sp->lines[ line ]->h < my
-                && ++line < sp->num_lines )
-            /* empty */ ;
-
-    if ( line < 0 || line >= sp->num_lines )
-        return -1;
+    line = find_line_at_y( sp, my );
 
-    return line;
+    return line < sp->num_lines ? line : -1;
 }
 
 
@@ -2188,7 +3162,7 @@ handle_mouse( FL_OBJECT * obj,
             return ret;
         }
 
-        if ( line < 0 || ! sp->lines[ line ]->selectable )
+        if ( line < 0 || ! get_line( sp, line )->selectable )
             return ret;
 
         if ( ev == FL_PUSH )
@@ -2228,10 +3202,10 @@ handle_mouse( FL_OBJECT * obj,
 
         if ( ev == FL_PUSH )
         {
-            if ( ! sp->lines[ line ]->selectable )
+            if ( ! get_line( sp, line )->selectable )
                 return ret;
 
-            mode = sp->lines[ line ]->selected ? DESELECT : SELECT;
+            mode = get_line( sp, line )->selected ? DESELECT : SELECT;
 
             if ( mode == SELECT )
             {
@@ -2256,16 +3230,16 @@ handle_mouse( FL_OBJECT * obj,
                 int incr = line - last_multi > 1 ? 1 : -1;
 
                 while ( ( last_multi += incr ) != line )
-                    if ( sp->lines[ last_multi ]->selectable )
+                    if ( get_line( sp, last_multi )->selectable )
                     {
                         if (    mode == SELECT
-                             && ! sp->lines[ last_multi ]->selected )
+                             && ! get_line( sp, last_multi )->selected )
                         {
                             fli_tbox_select_line( obj, last_multi );
                             ret |= FL_RETURN_SELECTION;
                         }
                         else if (    mode == DESELECT
-                                  && sp->lines[ last_multi ]->selected )
+                                  && get_line( sp, last_multi )->selected )
                         {
                             fli_tbox_deselect_line( obj, last_multi );
                             ret |= FL_RETURN_DESELECTION;
@@ -2273,16 +3247,16 @@ handle_mouse( FL_OBJECT * obj,
                     }
             }
 
-            if ( sp->lines[ line ]->selectable )
+            if ( get_line( sp, line )->selectable )
             {
                 if (    mode == SELECT
-                     && ! sp->lines[ line ]->selected )
+                     && ! get_line( sp, line )->selected )
                 {
                     fli_tbox_select_line( obj, line );
                     ret |= FL_RETURN_SELECTION;
                 }
                 else if (    mode == DESELECT
-                          && sp->lines[ line ]->selected )
+                          && get_line( sp, line )->selected )
                 {
                     fli_tbox_deselect_line( obj, line );
                     ret |= FL_RETURN_DESELECTION;
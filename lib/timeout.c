@@ -41,6 +41,173 @@
 long msec0 = 0;
 
 
+/* Timeouts are kept in a binary min-heap, ordered by their time of
+   expiry (and, for identical times, by the order they were created in),
+   so that the next timeout to expire is always at the top of the heap
+   and adding or removing one is O(log n). To make removal by ID fast
+   there's also a hash table (with chaining) that maps IDs to records. */
+
+#define TIMEOUT_HASH_MIN  64
+
+static unsigned long next_serial = 0;
+
+
+/***************************************
+ * Returns if timeout 'a' is due before timeout 'b'
+ ***************************************/
+
+static int
+expires_before( const FLI_TIMEOUT_REC * a,
+                const FLI_TIMEOUT_REC * b )
+{
+    if ( a->expire_sec != b->expire_sec )
+        return a->expire_sec < b->expire_sec;
+    if ( a->expire_usec != b->expire_usec )
+        return a->expire_usec < b->expire_usec;
+    return a->serial < b->serial;
+}
+
+
+/***************************************
+ * Puts a record at a position in the heap and updates its index
+ ***************************************/
+
+static void
+heap_set( int               i,
+          FLI_TIMEOUT_REC * rec )
+{
+    fli_context->timeout_heap[ i ] = rec;
+    rec->heap_index = i;
+}
+
+
+/***************************************
+ * Moves the record at position 'i' of the heap upwards
+ * until it's not due before its parent anymore
+ ***************************************/
+
+static void
+heap_sift_up( int i )
+{
+    FLI_TIMEOUT_REC **heap = fli_context->timeout_heap;
+    FLI_TIMEOUT_REC *rec = heap[ i ];
+
+    while ( i > 0 )
+    {
+        int parent = ( i - 1 ) / 2;
+
+        if ( ! expires_before( rec, heap[ parent ] ) )
+            break;
+
+        heap_set( i, heap[ parent ] );
+        i = parent;
+    }
+
+    heap_set( i, rec );
+}
+
+
+/***************************************
+ * Moves the record at position 'i' of the heap downwards
+ * until none of its children is due before it
+ ***************************************/
+
+static void
+heap_sift_down( int i )
+{
+    FLI_TIMEOUT_REC **heap = fli_context->timeout_heap;
+    FLI_TIMEOUT_REC *rec = heap[ i ];
+    int n = fli_context->num_timeouts;
+
+    while ( 1 )
+    {
+        int child = 2 * i + 1;
+
+        if ( child >= n )
+            break;
+
+        if (    child + 1 < n
+             && expires_before( heap[ child + 1 ], heap[ child ] ) )
+            child++;
+
+        if ( ! expires_before( heap[ child ], rec ) )
+            break;
+
+        heap_set( i, heap[ child ] );
+        i = child;
+    }
+
+    heap_set( i, rec );
+}
+
+
+/***************************************
+ * Returns the bucket a timeout with the given ID belongs to
+ ***************************************/
+
+static FLI_TIMEOUT_REC **
+hash_bucket( int id )
+{
+    return fli_context->timeout_hash
+           + ( ( unsigned int ) id & ( fli_context->timeout_hash_size - 1 ) );
+}
+
+
+/***************************************
+ * Doubles the size of the ID hash table (or creates it) and
+ * redistributes the records over the new buckets
+ ***************************************/
+
+static void
+hash_grow( void )
+{
+    FLI_TIMEOUT_REC **old = fli_context->timeout_hash;
+    int old_size = fli_context->timeout_hash_size;
+    int i;
+
+    fli_context->timeout_hash_size = old_size ?
+                                     2 * old_size : TIMEOUT_HASH_MIN;
+    fli_context->timeout_hash =
+                fl_calloc( fli_context->timeout_hash_size, sizeof *old );
+
+    for ( i = 0; i < old_size; i++ )
+    {
+        FLI_TIMEOUT_REC *rec,
+                        *next;
+
+        for ( rec = old[ i ]; rec; rec = next )
+        {
+            FLI_TIMEOUT_REC **bucket = hash_bucket( rec->id );
+
+            next = rec->hash_next;
+            rec->hash_next = *bucket;
+            *bucket = rec;
+        }
+    }
+
+    fli_safe_free( old );
+}
+
+
+/***************************************
+ * Returns the record for a timeout ID or NULL if there's none
+ ***************************************/
+
+static FLI_TIMEOUT_REC *
+find_timeout( int id )
+{
+    FLI_TIMEOUT_REC *rec;
+
+    if ( ! fli_context->timeout_hash )
+        return NULL;
+
+    for ( rec = *hash_bucket( id ); rec && rec->id != id; rec = rec->hash_next )
+        /* empty */ ;
+
+    return rec;
+}
+
+
 /***************************************
  ***************************************/
 
@@ -49,30 +216,61 @@ fl_add_timeout( long                  msec,
                 FL_TIMEOUT_CALLBACK   callback,
                 void                * data )
 {
-    FLI_TIMEOUT_REC *rec;
+    FLI_TIMEOUT_REC *rec,
+                    **bucket;
     static int id = 1;
 
+    /* Deal with wrap around of IDs - rather unlikely to happen but if it
+       does skip IDs that are still in use */
+
+    while ( find_timeout( id ) )
+        if ( ++id <= 0 )
+            id = 1;
+
     rec = fl_malloc( sizeof *rec );
-    fl_gettime( &rec->start_sec, &rec->start_usec );
 
-    rec->id         = id;
-    rec->ms_to_wait = FL_max( msec, 0 );
-    rec->callback   = callback;
-    rec->data       = data;
-    rec->prev       = NULL;
+    msec = FL_max( msec, 0 );
+    fli_get_monotonic_time( &rec->expire_sec, &rec->expire_usec );
+    rec->expire_sec  += msec / 1000;
+    rec->expire_usec += 1000 * ( msec % 1000 );
+    if ( rec->expire_usec >= 1000000 )
+    {
+        rec->expire_sec++;
+        rec->expire_usec -= 1000000;
+    }
+
+    rec->id       = id;
+    rec->serial   = next_serial++;
+    rec->callback = callback;
+    rec->data     = data;
+
+    /* Append it to the heap (making the heap larger if necessary) and
+       move it up to where it belongs */
+
+    if ( fli_context->num_timeouts == fli_context->timeout_heap_size )
+    {
+        fli_context->timeout_heap_size = fli_context->timeout_heap_size ?
+                                  2 * fli_context->timeout_heap_size : 16;
+        fli_context->timeout_heap =
+                fl_realloc( fli_context->timeout_heap,
+                            fli_context->timeout_heap_size
+                            * sizeof *fli_context->timeout_heap );
+    }
+
+    fli_context->timeout_heap[ fli_context->num_timeouts ] = rec;
+    heap_sift_up( fli_context->num_timeouts++ );
 
-    /* Make it the start of the (doubly) linked list */
+    /* Also make it findable via its ID, keeping the average length of
+       the hash chains below 1 */
 
-    rec->next = fli_context->timeout_rec;
-    if ( fli_context->timeout_rec )
-        fli_context->timeout_rec->prev = rec;
-    fli_context->timeout_rec = rec;
+    if ( fli_context->num_timeouts > fli_context->timeout_hash_size )
+        hash_grow( );
 
-    /* Deal with wrap around of IDs- rather unlikely to happen but if it does
-       it's not a 100% safe way to do it, we can only bet on the chance that
-       the timeouts with the re-used numbers have expired a long time ago... */
+    bucket = hash_bucket( id );
+    rec->hash_next = *bucket;
+    *bucket = rec;
 
-    if ( id++ <= 0 )
+    if ( ++id <= 0 )
         id = 1;
 
     return rec->id;
@@ -80,26 +278,34 @@ fl_add_timeout( long                  msec,
 
 
 /***************************************
- * Internal function for remving a timeout - remove
- * it from the (doubly) linked list and free memory
+ * Internal function for removing a timeout - take it
+ * out of the heap and the hash table and free memory
  ***************************************/
 
 static void
 remove_timeout( FLI_TIMEOUT_REC * rec )
 {
-    if ( rec == fli_context->timeout_rec )
-    {
-        fli_context->timeout_rec = rec->next;
-        if ( rec->next )
-            fli_context->timeout_rec->prev = NULL;
-    }
-    else
+    FLI_TIMEOUT_REC **bucket = hash_bucket( rec->id );
+    FLI_TIMEOUT_REC **heap = fli_context->timeout_heap;
+    int i = rec->heap_index;
+    int last = --fli_context->num_timeouts;
+
+    /* Replace it in the heap by the last element and then move that
+       one either up or down to restore the heap property */
+
+    if ( i != last )
     {
-        rec->prev->next = rec->next;
-        if ( rec->next )
-            rec->next->prev = rec->prev;
+        heap_set( i, heap[ last ] );
+        if ( i > 0 && expires_before( heap[ i ], heap[ ( i - 1 ) / 2 ] ) )
+            heap_sift_up( i );
+        else
+            heap_sift_down( i );
     }
 
+    while ( *bucket != rec )
+        bucket = &( *bucket )->hash_next;
+    *bucket = rec->hash_next;
+
     fl_free( rec );
 }
 
@@ -111,10 +317,7 @@ remove_timeout( FLI_TIMEOUT_REC * rec )
 void
 fl_remove_timeout( int id )
 {
-    FLI_TIMEOUT_REC *rec = fli_context->timeout_rec;
-
-    while ( rec && rec->id != id )
-        rec = rec->next;
+    FLI_TIMEOUT_REC *rec = find_timeout( id );
 
     if ( rec )
         remove_timeout( rec );
@@ -133,43 +336,58 @@ fl_remove_timeout( int id )
 void
 fli_handle_timeouts( long * msec )
 {
-    FLI_TIMEOUT_REC *rec,
-                    *next;
-    long sec = 0,
+    FLI_TIMEOUT_REC *rec;
+    unsigned long serial_limit = next_serial;
+    long sec,
          usec,
-         elapsed,
          diff;
 
-    if ( ! fli_context->timeout_rec )
+    if ( ! fli_context->num_timeouts )
         return;
 
-    fl_gettime( &sec, &usec );
+    fli_get_monotonic_time( &sec, &usec );
 
-    /* Loop over all candidates, dealing with those that expired and
-       removing them, while also keeping looking for the time the next
-       one is going to expire */
+    /* Deal with all timeouts that had expired when we got called. Timeouts
+       newly created from within the callbacks are left alone until the next
+       round, otherwise a callback that sets up a new timeout of 0 ms would
+       keep us here forever. Since their expiry can't be earlier than the
+       current time they're never in front of an old, expired timeout. */
 
-    for ( rec = fli_context->timeout_rec; rec; rec = next )
+    while ( fli_context->num_timeouts )
     {
-        next = rec->next;
+        FL_TIMEOUT_CALLBACK callback;
+        void *data;
+        int id;
 
-        elapsed =   1000 * ( sec - rec->start_sec )
-                  + ( usec - rec->start_usec ) / 1000;
-        diff = rec->ms_to_wait - elapsed;
+        rec = fli_context->timeout_heap[ 0 ];
 
-        if ( diff <= 0 )
-        {
-            if ( rec->callback )
-            {
-                rec->callback( rec->id, rec->data );
-                fl_gettime( &sec, &usec );
-            }
+        if (    rec->serial >= serial_limit
+             || rec->expire_sec > sec
+             || ( rec->expire_sec == sec && rec->expire_usec > usec ) )
+            break;
 
-            remove_timeout( rec );
-        }
-        else
-            *msec = FL_min( *msec, diff );
+        /* Remove the timeout before invoking the callback so the callback
+           is free to add and remove timeouts as it likes */
+
+        callback = rec->callback;
+        data     = rec->data;
+        id       = rec->id;
+        remove_timeout( rec );
+
+        if ( callback )
+            callback( id, data );
     }
+
+    if ( ! fli_context->num_timeouts )
+        return;
+
+    /* Determine how long it's going to take until the next one expires */
+
+    fli_get_monotonic_time( &sec, &usec );
+    rec = fli_context->timeout_heap[ 0 ];
+    diff =   1000 * ( rec->expire_sec - sec )
+           + ( rec->expire_usec - usec ) / 1000;
+    *msec = FL_min( *msec, FL_max( diff, 0 ) );
 }
 
 
@@ -179,8 +397,13 @@ fli_handle_timeouts( long * msec )
 void
 fli_remove_all_timeouts( void )
 {
-    while ( fli_context->timeout_rec )
-        fl_remove_timeout( fli_context->timeout_rec->id );
+    while ( fli_context->num_timeouts )
+        remove_timeout( fli_context->timeout_heap[ 0 ] );
+
+    fli_safe_free( fli_context->timeout_heap );
+    fli_context->timeout_heap_size = 0;
+    fli_safe_free( fli_context->timeout_hash );
+    fli_context->timeout_hash_size = 0;
 }
 
 
@@ -89,7 +89,16 @@ FL_ERROR_FUNC fli_error_setup( int,
                                const char *,
                                int );
 
-extern FL_ERROR_FUNC efp_;
+/* Where a message comes from is kept per thread where the compiler
+   allows, so messages from threads reading images don't get mixed up */
+
+#if defined __GNUC__ || defined __clang__
+# define FLI_THREAD_LOCAL  __thread
+#else
+# define FLI_THREAD_LOCAL
+#endif
+
+extern FLI_THREAD_LOCAL FL_ERROR_FUNC efp_;
 extern FL_ERROR_FUNC user_error_function_;
 
 
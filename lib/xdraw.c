@@ -38,6 +38,34 @@
 
 static int fli_mono_dither( unsigned long );
 static void fli_set_current_gc( GC );
+static int record_rectangle( int,
+                             FL_Coord,
+                             FL_Coord,
+                             FL_Coord,
+                             FL_Coord,
+                             FL_COLOR );
+static int record_points( int,
+                          FL_POINT *,
+                          int,
+                          FL_COLOR );
+static int record_segment( FL_Coord,
+                           FL_Coord,
+                           FL_Coord,
+                           FL_Coord,
+                           FL_COLOR );
+static void draw_lines( Drawable,
+                        FL_POINT *,
+                        int );
+
+/* Kinds of drawing requests recorded while a form gets redrawn */
+
+enum {
+    BATCH_FILLED_RECTS,
+    BATCH_RECTS,
+    BATCH_SEGMENTS,
+    BATCH_FILLED_POLYGONS,
+    BATCH_LINES
+};
 
 static GC dithered_gc;
 
@@ -74,6 +102,12 @@ fl_rectangle( int      fill,
 
     fli_canonicalize_rect( &x, &y, &w, &h );
 
+    /* While a form gets redrawn the rectangle is only recorded and drawn
+       together with all others of the same color later on */
+
+    if ( ! bw && record_rectangle( fill, x, y, w, h, col ) )
+        return;
+
     draw_as = fill ? XFillRectangle : XDrawRectangle;
 
     if ( bw && fill )
@@ -117,20 +151,28 @@ fl_polygon( int        fill,
     if ( flx->win == None || n <= 0 )
         return;
 
+    if ( ! fill )
+    {
+        xp[ n ].x = xp[ 0 ].x;
+        xp[ n ].y = xp[ 0 ].y;
+    }
+
+    if (    ! bw
+         && record_points( fill ? BATCH_FILLED_POLYGONS : BATCH_LINES,
+                           xp, fill ? n : n + 1, col ) )
+        return;
+
     if ( bw )
     {
+        fli_flush_draw_batch( );
         flx->gc = dithered_gc;
         fl_color( FL_WHITE );
         if ( fill )
             XFillPolygon( flx->display, flx->win, flx->gc, xp, n,
                           Nonconvex, CoordModeOrigin );
         else
-        {
-            xp[ n ].x = xp[ 0 ].x;
-            xp[ n ].y = xp[ 0 ].y;
             XDrawLines( flx->display, flx->win, flx->gc, xp, n + 1,
                         CoordModeOrigin );
-        }
     }
 
     fl_color( bw ? FL_BLACK : col );
@@ -139,12 +181,8 @@ fl_polygon( int        fill,
         XFillPolygon( flx->display, flx->win, flx->gc, xp, n,
                       Nonconvex, CoordModeOrigin );
     else
-    {
-        xp[ n ].x = xp[ 0 ].x;
-        xp[ n ].y = xp[ 0 ].y;
         XDrawLines( flx->display, flx->win, flx->gc, xp, n + 1,
                     CoordModeOrigin );
-    }
 
     if ( bw )
         flx->gc = gc;
@@ -413,12 +451,30 @@ fl_lines( FL_POINT * xp,
     if ( flx->win == None  || n <= 0 )
         return;
 
+    if ( n == 2 && record_segment( xp[ 0 ].x, xp[ 0 ].y,
+                                   xp[ 1 ].x, xp[ 1 ].y, col ) )
+        return;
+
+    if ( n > 2 && record_points( BATCH_LINES, xp, n, col ) )
+        return;
+
     fl_color( col );
+    draw_lines( flx->win, xp, n );
+}
 
-    /* We may need to break up the request into smaller pieces */
 
+/***************************************
+ * Draws connected lines through the n points, breaking up the
+ * request into smaller pieces if necessary
+ ***************************************/
+
+static void
+draw_lines( Drawable   win,
+            FL_POINT * xp,
+            int        n )
+{
     if ( fli_context->ext_request_size >= n )
-        XDrawLines( flx->display, flx->win, flx->gc, xp, n, CoordModeOrigin );
+        XDrawLines( flx->display, win, flx->gc, xp, n, CoordModeOrigin );
     else
     {
         int req = fli_context->ext_request_size;
@@ -428,7 +484,7 @@ fl_lines( FL_POINT * xp,
         FL_POINT *p = xp;
 
         for ( i = 0; i < nchunks; i++, p += req - 1 )
-            XDrawLines( flx->display, flx->win, flx->gc, p, req,
+            XDrawLines( flx->display, win, flx->gc, p, req,
                         CoordModeOrigin );
 
         left = xp + n - p;
@@ -441,7 +497,7 @@ fl_lines( FL_POINT * xp,
                 left++;
             }
 
-            XDrawLines( flx->display, flx->win, flx->gc, p, left,
+            XDrawLines( flx->display, win, flx->gc, p, left,
                         CoordModeOrigin );
         }
     }
@@ -459,7 +515,7 @@ fl_line( FL_Coord xi,
          FL_Coord yf,
          FL_COLOR c )
 {
-    if ( flx->win == None )
+    if ( flx->win == None || record_segment( xi, yi, xf, yf, c ) )
         return;
 
     fl_color( c );
@@ -527,6 +583,8 @@ fl_linewidth( int n )
     if ( lw == n )
         return;
 
+    fli_flush_draw_batch( );
+
     gcmask = GCLineWidth;
     gcvalue.line_width = lw = n;
     XChangeGC( flx->display, flx->gc, gcmask, &gcvalue );
@@ -565,6 +623,9 @@ fli_xlinestyle( Display * d,
     if ( ls == n )
         return;
 
+    if ( gc == flx->gc )
+        fli_flush_draw_batch( );
+
     ls = n;
 
     gcmask = GCLineStyle;
@@ -620,7 +681,10 @@ void
 fl_drawmode( int request )
 {
     if ( drmode != request )
+    {
+        fli_flush_draw_batch( );
         XSetFunction( flx->display, flx->gc, drmode = request );
+    }
 }
 
 
@@ -679,6 +743,7 @@ fl_dashedlinestyle( const char * dash,
         ndash = 2;
     }
 
+    fli_flush_draw_batch( );
     XSetDashes( flx->display, flx->gc, 0, ( char * ) dash, ndash );
 }
 
@@ -775,6 +840,8 @@ fli_set_global_clipping( FL_Coord x,
         return;
     }
 
+    fli_flush_draw_batch( );
+
     SET_RECT( fli_clip_rect[ FLI_GLOBAL_CLIP ], x, y, w, h );
 
     /* If normal clipping is already on intersect the new global and the
@@ -841,6 +908,8 @@ fli_unset_global_clipping( void )
     if ( ! fli_is_clipped[ FLI_GLOBAL_CLIP ] )
         return;
 
+    fli_flush_draw_batch( );
+
     SET_RECT( fli_clip_rect[ FLI_GLOBAL_CLIP ], 0, 0, 0, 0 );
 
     /* If normal clipping is also on set the clipping rectangle to that set
@@ -901,6 +970,12 @@ static void
 unset_clipping( int type,
                 GC  gc )
 {
+    /* Also flush if clipping isn't on, the clip mask of the GC may have
+       been set directly */
+
+    if ( gc == flx->gc )
+        fli_flush_draw_batch( );
+
     if ( ! fli_is_clipped[ type ] )
         return;
 
@@ -938,6 +1013,9 @@ set_clipping( int      type,
         return;
     }
 
+    if ( gc == flx->gc )
+        fli_flush_draw_batch( );
+
     SET_RECT( fli_clip_rect[ type ], x, y, w, h );
 
     if ( fli_is_clipped[ FLI_GLOBAL_CLIP ] )
@@ -1210,6 +1288,8 @@ fli_set_current_gc( GC gc )
     if ( flx->gc == gc )
         return;
 
+    fli_flush_draw_batch( );
+
     flx->gc    = gc;
     flx->color = FL_NoColor;
 
@@ -1295,6 +1375,468 @@ fli_mono_dither( unsigned long col )
 }
 
 
+/*******************************************************************
+ * Batching of drawing requests
+ *
+ * While a form gets redrawn (between fli_begin_draw_batch() and
+ * fli_end_draw_batch()) rectangles, lines and polygons aren't drawn
+ * immediately but recorded in batches of requests of the same kind
+ * and color. On flushing each batch needs just a single change of the
+ * foreground color and rectangles and line segments are drawn with a
+ * single XFillRectangles(), XDrawRectangles() or XDrawSegments() call.
+ * A request may join an older batch only if it doesn't overlap with
+ * anything recorded after that batch, so the result is identical to
+ * drawing everything in the original order. Everything that changes
+ * the GC or draws directly (i.e. also fl_color()) flushes the batches
+ * first.
+ ****************************************************************{**/
+
+#define BATCH_MAX_BATCHES   32      /* batches pending at most         */
+#define BATCH_MAX_ITEMS     4096    /* requests pending at most        */
+#define BATCH_MAX_POINTS    512     /* longer lines are drawn directly */
+
+typedef struct {
+    int x1,
+        y1,
+        x2,
+        y2;
+} FLI_BATCH_BOX;
+
+typedef struct {
+    int             kind;
+    Drawable        win;
+    FL_COLOR        col;
+    FLI_BATCH_BOX   box;        /* bounding box of all items */
+    FLI_BATCH_BOX * boxes;      /* bounding boxes of the items */
+    char          * items;      /* XRectangles, XSegments or point counts */
+    int             n;
+    int             nalloc;
+    FL_POINT      * points;     /* points of polygons and lines */
+    int             npoints;
+    int             npoints_alloc;
+} FLI_DRAW_BATCH;
+
+static FLI_DRAW_BATCH batches[ BATCH_MAX_BATCHES ];
+static int nbatches;
+static int nitems;
+static int batch_level;
+static int in_flush;
+
+
+/***************************************
+ * Starts recording of drawing requests (calls may be nested)
+ ***************************************/
+
+void
+fli_begin_draw_batch( void )
+{
+    batch_level++;
+}
+
+
+/***************************************
+ * Stops recording (when the outermost call is reached) and draws
+ * everything still pending
+ ***************************************/
+
+void
+fli_end_draw_batch( void )
+{
+    if ( batch_level > 0 && --batch_level == 0 )
+        fli_flush_draw_batch( );
+}
+
+
+/***************************************
+ * Draws everything still pending and stops recording until
+ * fli_resume_draw_batch() gets called with the returned value. Used
+ * around code that may draw directly with Xlib functions
+ ***************************************/
+
+int
+fli_suspend_draw_batch( void )
+{
+    int level = batch_level;
+
+    fli_flush_draw_batch( );
+    batch_level = 0;
+    return level;
+}
+
+
+/***************************************
+ * Restarts recording after fli_suspend_draw_batch()
+ ***************************************/
+
+void
+fli_resume_draw_batch( int level )
+{
+    batch_level = level;
+}
+
+
+/***************************************
+ ***************************************/
+
+static int
+boxes_overlap( const FLI_BATCH_BOX * b1,
+               const FLI_BATCH_BOX * b2 )
+{
+    return    b1->x1 <= b2->x2 && b2->x1 <= b1->x2
+           && b1->y1 <= b2->y2 && b2->y1 <= b1->y2;
+}
+
+
+/***************************************
+ * Checks if anything in a batch overlaps with a box in a window -
+ * the batches bounding box is tested first, but since it quickly
+ * grows when the items are spread out that's not good enough
+ ***************************************/
+
+static int
+batch_overlaps( FLI_DRAW_BATCH      * b,
+                Drawable              win,
+                const FLI_BATCH_BOX * box )
+{
+    int i;
+
+    if ( b->win != win || ! boxes_overlap( &b->box, box ) )
+        return 0;
+
+    for ( i = 0; i < b->n; i++ )
+        if ( boxes_overlap( b->boxes + i, box ) )
+            return 1;
+
+    return 0;
+}
+
+
+/***************************************
+ * Draws all requests of a batch
+ ***************************************/
+
+static void
+draw_batch( FLI_DRAW_BATCH * b )
+{
+    FL_POINT *p = b->points;
+    int *cnt = ( int * ) b->items;
+    int i;
+
+    fl_color( b->col );
+
+    switch ( b->kind )
+    {
+        case BATCH_FILLED_RECTS :
+            XFillRectangles( flx->display, b->win, flx->gc,
+                             ( XRectangle * ) b->items, b->n );
+            break;
+
+        case BATCH_RECTS :
+            XDrawRectangles( flx->display, b->win, flx->gc,
+                             ( XRectangle * ) b->items, b->n );
+            break;
+
+        case BATCH_SEGMENTS :
+            XDrawSegments( flx->display, b->win, flx->gc,
+                           ( XSegment * ) b->items, b->n );
+            break;
+
+        case BATCH_FILLED_POLYGONS :
+            for ( i = 0; i < b->n; p += cnt[ i++ ] )
+                XFillPolygon( flx->display, b->win, flx->gc, p, cnt[ i ],
+                              Nonconvex, CoordModeOrigin );
+            break;
+
+        case BATCH_LINES :
+            for ( i = 0; i < b->n; p += cnt[ i++ ] )
+                draw_lines( b->win, p, cnt[ i ] );
+            break;
+    }
+}
+
+
+/***************************************
+ * Draws the first 'count' batches and removes them from the list
+ ***************************************/
+
+static void
+flush_batches( int count )
+{
+    FLI_DRAW_BATCH tmp;
+    int i;
+
+    if ( count <= 0 || in_flush )
+        return;
+
+    /* fl_color(), called for each batch, would otherwise try to flush */
+
+    in_flush = 1;
+
+    for ( i = 0; i < count; i++ )
+    {
+        draw_batch( batches + i );
+        nitems -= batches[ i ].n;
+    }
+
+    in_flush = 0;
+
+    /* Move the remaining batches to the front while keeping the
+       buffers of the drawn ones for reuse */
+
+    for ( i = 0; i + count < nbatches; i++ )
+    {
+        tmp = batches[ i ];
+        batches[ i ] = batches[ i + count ];
+        batches[ i + count ] = tmp;
+    }
+
+    nbatches -= count;
+}
+
+
+/***************************************
+ * Draws all pending requests
+ ***************************************/
+
+void
+fli_flush_draw_batch( void )
+{
+    flush_batches( nbatches );
+}
+
+
+/***************************************
+ * Draws all pending requests that have to be drawn before something
+ * within the given rectangle of the current window can be drawn
+ * directly (e.g. text that uses a different GC)
+ ***************************************/
+
+void
+fli_flush_draw_batch_area( FL_Coord x,
+                           FL_Coord y,
+                           FL_Coord w,
+                           FL_Coord h )
+{
+    FLI_BATCH_BOX box;
+    int i;
+
+    box.x1 = x;
+    box.y1 = y;
+    box.x2 = x + w - 1;
+    box.y2 = y + h - 1;
+
+    for ( i = nbatches - 1; i >= 0; i-- )
+        if ( batch_overlaps( batches + i, flx->win, &box ) )
+            break;
+
+    flush_batches( i + 1 );
+}
+
+
+/***************************************
+ * Returns the batch a new request of the given kind and color and
+ * with the given bounding box is to be added to, with room for the
+ * request in its list of items. Returns NULL if requests aren't to
+ * be recorded at the moment.
+ ***************************************/
+
+static FLI_DRAW_BATCH *
+get_batch( int      kind,
+           FL_COLOR col,
+           int      x1,
+           int      y1,
+           int      x2,
+           int      y2 )
+{
+    FLI_DRAW_BATCH *b = NULL;
+    FLI_BATCH_BOX box;
+    int i;
+
+    if ( ! batch_level || in_flush || drmode != GXcopy || flx->win == None )
+        return NULL;
+
+    if ( nitems >= BATCH_MAX_ITEMS )
+        fli_flush_draw_batch( );
+
+    box.x1 = x1;
+    box.y1 = y1;
+    box.x2 = x2;
+    box.y2 = y2;
+
+    /* Look for a batch for the same kind of request and color that none
+       of the requests recorded later overlap with */
+
+    for ( i = nbatches - 1; i >= 0; i-- )
+    {
+        if (    batches[ i ].kind == kind
+             && batches[ i ].col  == col
+             && batches[ i ].win  == flx->win )
+        {
+            b = batches + i;
+            break;
+        }
+
+        if ( batch_overlaps( batches + i, flx->win, &box ) )
+            break;
+    }
+
+    if ( b )
+    {
+        b->box.x1 = FL_min( b->box.x1, x1 );
+        b->box.y1 = FL_min( b->box.y1, y1 );
+        b->box.x2 = FL_max( b->box.x2, x2 );
+        b->box.y2 = FL_max( b->box.y2, y2 );
+    }
+    else
+    {
+        /* If there's no room for another batch draw the older half, the
+           newer ones are those new requests are most likely to join */
+
+        if ( nbatches == BATCH_MAX_BATCHES )
+            flush_batches( BATCH_MAX_BATCHES / 2 );
+
+        b = batches + nbatches++;
+        b->kind    = kind;
+        b->win     = flx->win;
+        b->col     = col;
+        b->box     = box;
+        b->n       = 0;
+        b->npoints = 0;
+    }
+
+    /* Items are allocated with the size of the largest kind of item */
+
+    if ( b->n == b->nalloc )
+    {
+        b->nalloc = b->nalloc ? 2 * b->nalloc : 64;
+        b->items = fl_realloc( b->items,
+                               b->nalloc * sizeof( XRectangle ) );
+        b->boxes = fl_realloc( b->boxes, b->nalloc * sizeof *b->boxes );
+    }
+
+    b->boxes[ b->n ] = box;
+
+    nitems++;
+    return b;
+}
+
+
+/***************************************
+ * Records a (possibly filled) rectangle, returns 0 if it has to be
+ * drawn directly
+ ***************************************/
+
+static int
+record_rectangle( int      fill,
+                  FL_Coord x,
+                  FL_Coord y,
+                  FL_Coord w,
+                  FL_Coord h,
+                  FL_COLOR col )
+{
+    FLI_DRAW_BATCH *b;
+    XRectangle *r;
+    int m = fill ? 0 : lw + 1;
+
+    if ( ! ( b = get_batch( fill ? BATCH_FILLED_RECTS : BATCH_RECTS, col,
+                            x - m, y - m, x + w + m, y + h + m ) ) )
+        return 0;
+
+    r = ( XRectangle * ) b->items + b->n++;
+    r->x      = x;
+    r->y      = y;
+    r->width  = w;
+    r->height = h;
+
+    return 1;
+}
+
+
+/***************************************
+ * Records a line segment, returns 0 if it has to be drawn directly
+ ***************************************/
+
+static int
+record_segment( FL_Coord x1,
+                FL_Coord y1,
+                FL_Coord x2,
+                FL_Coord y2,
+                FL_COLOR col )
+{
+    FLI_DRAW_BATCH *b;
+    XSegment *s;
+    int m = lw + 1;
+
+    if ( ! ( b = get_batch( BATCH_SEGMENTS, col,
+                            FL_min( x1, x2 ) - m, FL_min( y1, y2 ) - m,
+                            FL_max( x1, x2 ) + m, FL_max( y1, y2 ) + m ) ) )
+        return 0;
+
+    s = ( XSegment * ) b->items + b->n++;
+    s->x1 = x1;
+    s->y1 = y1;
+    s->x2 = x2;
+    s->y2 = y2;
+
+    return 1;
+}
+
+
+/***************************************
+ * Records a filled polygon or connected lines, returns 0 if they
+ * have to be drawn directly
+ ***************************************/
+
+static int
+record_points( int        kind,
+               FL_POINT * xp,
+               int        n,
+               FL_COLOR   col )
+{
+    FLI_DRAW_BATCH *b;
+    int x1 = xp[ 0 ].x,
+        y1 = xp[ 0 ].y,
+        x2 = x1,
+        y2 = y1;
+    int m,
+        i;
+
+    if ( ! batch_level || n > BATCH_MAX_POINTS )
+        return 0;
+
+    for ( i = 1; i < n; i++ )
+    {
+        x1 = FL_min( x1, xp[ i ].x );
+        y1 = FL_min( y1, xp[ i ].y );
+        x2 = FL_max( x2, xp[ i ].x );
+        y2 = FL_max( y2, xp[ i ].y );
+    }
+
+    /* Miter joins of wide lines may stick out quite a bit */
+
+    m = kind == BATCH_LINES ? 6 * lw + 1 : 1;
+
+    if ( ! ( b = get_batch( kind, col, x1 - m, y1 - m, x2 + m, y2 + m ) ) )
+        return 0;
+
+    if ( b->npoints + n > b->npoints_alloc )
+    {
+        b->npoints_alloc = FL_max( 2 * b->npoints_alloc, b->npoints + n );
+        b->points = fl_realloc( b->points,
+                                b->npoints_alloc * sizeof *b->points );
+    }
+
+    memcpy( b->points + b->npoints, xp, n * sizeof *xp );
+    b->npoints += n;
+    ( ( int * ) b->items )[ b->n++ ] = n;
+
+    return 1;
+}
+
+
+/************** End of batching of drawing requests ************}**/
+
+
 /*
  * Local variables:
  * tab-width: 4
@@ -276,7 +276,8 @@ reset_max_width( PopUP * m )
         b = t = fl_strdup( m->title );
         while ( ( b = strchr( b, '\b' ) ) )
             memmove( b, b + 1, strlen( b ) );
-        m->title_width = XTextWidth( pup_title_font_struct, t, strlen( t ) );
+        m->title_width = fli_get_string_widthfs( pup_title_font_struct,
+                                                 t, strlen( t ) );
         fl_free( t );
     }
     else
@@ -481,8 +482,8 @@ parse_entry( int          n,
             b = t = fl_strdup( c );
             while ( ( b = strchr( b, '\b' ) ) )
                 memmove( b, b + 1, strlen( b ) );
-            m->title_width = XTextWidth( pup_title_font_struct,
-                                         t, strlen( t ) );
+            m->title_width = fli_get_string_widthfs( pup_title_font_struct,
+                                                     t, strlen( t ) );
             fl_free( t );
             fl_free( item );
             m->item[ m->nitems ] = NULL;
@@ -1132,7 +1133,7 @@ pup_interact( PopUP * m )
     {
         long msec = fli_context->idle_delta;
 
-        if ( fli_context->timeout_rec )
+        if ( fli_context->num_timeouts )
             fli_handle_timeouts( &msec );
 
         if ( ! XCheckWindowEvent( flx->display, m->win, m->event_mask, &ev ) )
@@ -1580,7 +1581,8 @@ fl_setpup_title( int          nm,
     b = t = fl_strdup( title ? title : "" );
     while ( ( b = strchr( b, '\b' ) ) )
         memmove( b, b + 1, strlen( b ) );
-    m->title_width = XTextWidth( pup_title_font_struct, t, strlen( t ) );
+    m->title_width = fli_get_string_widthfs( pup_title_font_struct,
+                                             t, strlen( t ) );
     fl_free( t );
 }
 
@@ -343,6 +343,7 @@ fli_show_object_pixmap( FL_OBJECT * obj )
          || NON_SQB( obj ) )
         return;
 
+    fli_flush_draw_batch( );
     XCopyArea( flx->display, p->pixmap, p->win, flx->gc,
                0, 0, p->w, p->h, p->x, p->y );
 
@@ -362,6 +363,7 @@ fli_free_flpixmap( FL_pixmap * p )
 {
     if ( p && p->pixmap )
     {
+        fli_flush_draw_batch( );
         XFreePixmap( flx->display, p->pixmap );
         p->pixmap = None;
     }
@@ -458,6 +460,7 @@ fli_show_form_pixmap( FL_FORM * form )
          || p->h <= 0 )
         return;
 
+    fli_flush_draw_batch( );
     XCopyArea( flx->display, p->pixmap, p->win, flx->gc,
                0, 0, p->w, p->h, 0, 0 );
 
@@ -62,6 +62,7 @@ static struct LINE_INFO {
     int    underline_index;
     int    x;
     int    y;
+    int    width;
 } * lines = NULL;
     
 static int nlines;
@@ -273,7 +274,8 @@ fli_draw_string( int           align,
 
         /* Determine the width (in pixel) of the line) */
 
-        width = XTextWidth( flx->fs, line->str, line->len );
+        width = line->width =
+                       fli_get_string_widthfs( flx->fs, line->str, line->len );
 
         if ( width > max_pixels )
         {
@@ -352,8 +354,13 @@ fli_draw_string( int           align,
                 break;
         }
 
-        /* Draw the text */
+        /* Draw the text (after everything recorded for drawing below it,
+           with some room for characters sticking out of their boxes) */
 
+        fli_flush_draw_batch_area( line->x - flx->fheight,
+                                   line->y - flx->fasc - 1,
+                                   line->width + 2 * flx->fheight,
+                                   flx->fheight + 2 );
         drawIt( flx->display, flx->win, flx->textgc,
                 line->x, line->y, line->str, line->len );
 
@@ -391,9 +398,11 @@ fli_draw_string( int           align,
                region (the -1 in the calculation  of wsel is a fudge factor
                to make it look a bit better) */
 
-            xsel = line->x + XTextWidth( flx->fs, line->str, start );
+            xsel =   line->x
+                   + fli_get_string_widthfs( flx->fs, line->str, start );
 
-            wsel = XTextWidth( flx->fs, line->str + start, len ) - 1;
+            wsel = fli_get_string_widthfs( flx->fs, line->str + start,
+                                           len ) - 1;
             if ( xsel + wsel > x + w )
                 wsel = x + w - xsel;
 
@@ -403,6 +412,8 @@ fli_draw_string( int           align,
                       flx->fheight, forecol );
 
             fli_textcolor( backcol );
+            fli_flush_draw_batch_area( xsel, line->y - flx->fasc,
+                                       wsel, flx->fheight );
             drawIt( flx->display, flx->win, flx->textgc, xsel,
                     line->y, line->str + start, len );
             fli_textcolor( forecol );
@@ -446,8 +457,8 @@ fli_draw_string( int           align,
         if (    curspos >= line->index
              && curspos <= line->index + line->len )
         {
-            int tt = XTextWidth( flx->fs, line->str,
-                                 curspos - line->index );
+            int tt = fli_get_string_widthfs( flx->fs, line->str,
+                                             curspos - line->index );
 
             fl_rectf( line->x + tt, line->y - flx->fasc,
                       2, flx->fheight, curscol );
@@ -665,7 +676,7 @@ fli_get_pos_in_string( int          align,
 
     /* Calculate width and start x-coordinate of the line */
 
-    width = XTextWidth( flx->fs, line->str, line->len );
+    width = fli_get_string_widthfs( flx->fs, line->str, line->len );
 
     switch ( horalign )
     {
@@ -710,7 +721,7 @@ fli_get_pos_in_string( int          align,
 
     *xp = ( double ) ( xpos * line->len ) / width;
 
-    xlen = XTextWidth( flx->fs, line->str, ++*xp );
+    xlen = fli_get_string_widthfs( flx->fs, line->str, ++*xp );
 
     /* If we don't have hit it directly search to the left or right */
 
@@ -719,7 +730,7 @@ fli_get_pos_in_string( int          align,
         do
         {
             *xp -= 1;
-            xlen = XTextWidth( flx->fs, line->str, *xp );
+            xlen = fli_get_string_widthfs( flx->fs, line->str, *xp );
         }
         while ( *xp > 0 && xlen > xpos );
         *xp += 1;
@@ -728,7 +739,7 @@ fli_get_pos_in_string( int          align,
         do
         {
             *xp += 1;
-            xlen = XTextWidth( flx->fs, line->str, *xp );
+            xlen = fli_get_string_widthfs( flx->fs, line->str, *xp );
         }
         while ( *xp < lines->len && xlen < xpos );
 
@@ -1005,8 +1016,8 @@ fli_get_underline_rect( XFontStruct * fs,
        of D. Of course, if UL_width == proportional, this really does not
        matter */
 
-    ul_width = XTextWidth( fs, NARROW( ch ) ? "h" : "D", 1 );
-    ul_rwidth = XTextWidth( fs, str + n, 1 );
+    ul_width = fli_get_string_widthfs( fs, NARROW( ch ) ? "h" : "D", 1 );
+    ul_rwidth = fli_get_string_widthfs( fs, str + n, 1 );
 
     pre = str[ 0 ] == *fl_ul_magic_char;
 
@@ -1081,7 +1092,7 @@ do_underline_all( FL_Coord        x,
     if ( ! XGetFontProperty( flx->fs, XA_UNDERLINE_POSITION, ul_pos ) )
         *ul_pos = has_desc( str ) ? ( 1 + flx->fdesc ) : 1;
 
-    ul_width = XTextWidth( flx->fs, str, n );
+    ul_width = fli_get_string_widthfs( flx->fs, str, n );
 
     /* Draw it */
 
@@ -1117,13 +1128,14 @@ fli_draw_stringTAB( Window       win,
 
     tab = fli_get_tabpixels( fs );
 
+    fli_flush_draw_batch( );
     XSetFont( flx->display, gc, fs->fid );
 
     for ( w = 0, q = s; *q && ( p = strchr( q, '\t' ) ) && p - s < len;
           q = p + 1 )
     {
         drawIt( flx->display, win, gc, x + w, y, ( char * ) q, p - q );
-        w += XTextWidth( fs, q, p - q );
+        w += fli_get_string_widthfs( fs, q, p - q );
         w = ( w / tab + 1 ) * tab;
     }
 
@@ -65,6 +65,8 @@ static void find_xbounds( FLI_XYPLOT_SPEC * );
 
 static void find_ybounds( FLI_XYPLOT_SPEC * );
 
+static void update_bounds( FLI_XYPLOT_SPEC * );
+
 static int allocate_spec( FLI_XYPLOT_SPEC *,
                           int );
 
@@ -108,15 +110,112 @@ static void
 free_overlay_data( FLI_XYPLOT_SPEC * sp,
                    int               id )
 {
-    if ( sp->x && sp->y && sp->n && sp->n[ id ] )
+    if ( sp->x && sp->y && sp->n )
     {
-        fli_safe_free( sp->x[ id ] );
-        fli_safe_free( sp->y[ id ] );
-        sp->n[ id ] = 0;
+        if ( sp->x[ id ] )
+            fl_free( sp->x[ id ] - sp->first[ id ] );
+        if ( sp->y[ id ] )
+            fl_free( sp->y[ id ] - sp->first[ id ] );
+        sp->x[ id ] = sp->y[ id ] = NULL;
+        sp->n[ id ] = sp->nalloc[ id ] = sp->first[ id ] = 0;
     }
 }
 
 
+/***************************************
+ * Called after new x- and y-arrays of 'n' points have been set for
+ * an overlay. If the overlay has a limited capacity only the newest
+ * points are kept, older ones are just skipped over
+ ***************************************/
+
+static void
+set_overlay_size( FLI_XYPLOT_SPEC * sp,
+                  int               id,
+                  int               n )
+{
+    int drop;
+
+    sp->n[ id ] = sp->nalloc[ id ] = n;
+    sp->first[ id ] = 0;
+
+    if ( sp->maxpoints[ id ] > 0 && n > sp->maxpoints[ id ] )
+    {
+        drop = n - sp->maxpoints[ id ];
+        sp->x[ id ] += drop;
+        sp->y[ id ] += drop;
+        sp->first[ id ] = drop;
+        sp->n[ id ] -= drop;
+    }
+}
+
+
+/***************************************
+ * Makes sure there's room for 'cnt' more points at the end of the data
+ * of an overlay. Storage grows geometrically, so appending is amortized
+ * O(1). For an overlay with a limited capacity the oldest points get
+ * dropped by advancing the start of the data within a buffer twice the
+ * capacity, only when its end is reached are the remaining points moved
+ * back to the start. Thus the data always stay contiguous and all other
+ * code can use sp->x[id] and sp->y[id] as before.
+ ***************************************/
+
+static int
+reserve_overlay_data( FLI_XYPLOT_SPEC * sp,
+                      int               id,
+                      int               cnt )
+{
+    float *xb,
+          *yb;
+    int max = sp->maxpoints[ id ],
+        drop,
+        size;
+
+    if ( max > 0 && sp->n[ id ] + cnt > max )
+    {
+        drop = FL_min( sp->n[ id ], sp->n[ id ] + cnt - max );
+        sp->x[ id ] += drop;
+        sp->y[ id ] += drop;
+        sp->first[ id ] += drop;
+        sp->n[ id ] -= drop;
+    }
+
+    if ( sp->first[ id ] + sp->n[ id ] + cnt <= sp->nalloc[ id ] )
+        return 0;
+
+    xb = sp->x[ id ] ? sp->x[ id ] - sp->first[ id ] : NULL;
+    yb = sp->y[ id ] ? sp->y[ id ] - sp->first[ id ] : NULL;
+
+    if ( sp->first[ id ] > 0 )
+    {
+        memmove( xb, sp->x[ id ], sp->n[ id ] * sizeof *xb );
+        memmove( yb, sp->y[ id ], sp->n[ id ] * sizeof *yb );
+        sp->x[ id ] = xb;
+        sp->y[ id ] = yb;
+        sp->first[ id ] = 0;
+
+        if ( sp->n[ id ] + cnt <= sp->nalloc[ id ] )
+            return 0;
+    }
+
+    if ( max > 0 )
+        size = 2 * max;
+    else
+        size = FL_max( sp->n[ id ] + cnt,
+                       FL_max( 2 * sp->nalloc[ id ], 64 ) );
+
+    if ( ! ( xb = fl_realloc( xb, size * sizeof *xb ) ) )
+        return -1;
+    sp->x[ id ] = xb;
+
+    if ( ! ( yb = fl_realloc( yb, size * sizeof *yb ) ) )
+        return -1;
+    sp->y[ id ] = yb;
+
+    sp->nalloc[ id ] = size;
+    return 0;
+}
+
+
 /***************************************
  * Free strings for alpha-tics
  ***************************************/
@@ -140,6 +239,7 @@ extend_screen_data( FLI_XYPLOT_SPEC * sp,
 {
     if ( n > sp->cur_nxp )
     {
+        n = FL_max( n, sp->cur_nxp + sp->cur_nxp / 2 );
         sp->xp--;
         sp->xp = fl_realloc( sp->xp, ( n + 3 ) * sizeof *sp->xp );
         sp->xp++;                 /* Need one extra point for fill */
@@ -185,6 +285,12 @@ free_xyplot( FL_OBJECT * ob )
     fli_safe_free( sp->ymargin1 );
     fli_safe_free( sp->ymargin2 );
 
+    if ( sp->bg_pixmap )
+    {
+        XFreePixmap( flx->display, sp->bg_pixmap );
+        sp->bg_pixmap = None;
+    }
+
     free_spec_dynamic_mem( sp );
 }
 
@@ -429,6 +535,82 @@ fli_xyplot_compute_data_bounds( FL_OBJECT * ob,
 }
 
 
+/***************************************
+ * Returns if an xyplot type just draws lines (or a filled area) between
+ * the points without marking the points themselves
+ ***************************************/
+
+static int
+is_line_type( int type )
+{
+    return    type == FL_NORMAL_XYPLOT
+           || type == FL_DOTTED_XYPLOT
+           || type == FL_DOTDASHED_XYPLOT
+           || type == FL_LONGDASHED_XYPLOT
+           || type == FL_DASHED_XYPLOT
+           || type == FL_FILL_XYPLOT
+           || type == FL_IMPULSE_XYPLOT;
+}
+
+
+/***************************************
+ * Reduces screen points to at most four per pixel column: the first,
+ * the lowest, the highest and the last one, kept in their original
+ * order. Drawn as lines this gives the same picture as all the points,
+ * but the number of points sent to the X server is bounded by the width
+ * of the plot instead of the number of data. This only works if the
+ * x-coordinates never decrease, otherwise the points are left alone.
+ * Returns the new number of points.
+ ***************************************/
+
+static int
+decimate_points( FL_POINT * p,
+                 int        n )
+{
+    FL_POINT q[ 4 ];
+    int i,
+        j,
+        k,
+        m,
+        s,
+        imin,
+        imax;
+
+    for ( i = 1; i < n; i++ )
+        if ( p[ i ].x < p[ i - 1 ].x )
+            return n;
+
+    for ( k = 0, s = 0; s < n; s = i )
+    {
+        imin = imax = s;
+
+        for ( i = s + 1; i < n && p[ i ].x == p[ s ].x; i++ )
+            if ( p[ i ].y < p[ imin ].y )
+                imin = i;
+            else if ( p[ i ].y > p[ imax ].y )
+                imax = i;
+
+        /* Collect the points of the column before any of them can get
+           overwritten, k never exceeds s */
+
+        m = 0;
+        q[ m++ ] = p[ s ];
+        j = FL_min( imin, imax );
+        if ( j > s )
+            q[ m++ ] = p[ j ];
+        if ( imin != imax && FL_max( imin, imax ) > s )
+            q[ m++ ] = p[ FL_max( imin, imax ) ];
+        if ( i - 1 > FL_max( imin, imax ) )
+            q[ m++ ] = p[ i - 1 ];
+
+        for ( j = 0; j < m; j++ )
+            p[ k++ ] = q[ j ];
+    }
+
+    return k;
+}
+
+
 /***************************************
  * Draw curves of data and all overlays
  ***************************************/
@@ -461,15 +643,6 @@ draw_curve_only( FL_OBJECT * ob )
     fl_set_text_clipping( sp->xi, sp->yi, sp->xf - sp->xi + 1,
                           sp->yf - sp->yi + 1 );
 
-    if ( sp->xgrid != FL_GRID_NONE && sp->xtic > 0 )
-        add_xgrid( ob );
-
-    if ( sp->ygrid != FL_GRID_NONE && sp->ytic > 0 )
-        add_ygrid( ob );
-
-    compute_key_position( ob );
-    fl_rect( sp->key_xs, sp->key_ys, sp->key_maxw, sp->key_maxh, *sp->col );
-
     key_xs = sp->key_xs + 2;
     key_ys = sp->key_ys + sp->key_ascend - sp->key_descend;
 
@@ -489,6 +662,8 @@ draw_curve_only( FL_OBJECT * ob )
         fli_xyplot_compute_data_bounds( ob, &n1, &n2, nplot );
         sp->n1 = n1;
 
+        type = nplot > 0 ? sp->type[ nplot ] : ob->type;
+
         /* Convert data. If interpolate is requested do it here */
 
         if (    sp->interpolate[ nplot ] > 1
@@ -521,13 +696,16 @@ draw_curve_only( FL_OBJECT * ob )
             nxp = sp->nxp = n2 - n1;
 
             if (    ( sp->active || sp->inspect )
-                 && sp->iactive == nplot
-                 && ! sp->update )
-                memcpy( sp->xpactive, sp->xp, sp->nxp * sizeof *xp );
+                 && sp->iactive == nplot )
+            {
+                if ( ! sp->update )
+                    memcpy( sp->xpactive, sp->xp, sp->nxp * sizeof *xp );
+            }
+            else if (    nxp > 4 * ( sp->xf - sp->xi + 1 )
+                      && is_line_type( type ) )
+                nxp = sp->nxp = decimate_points( xp, nxp );
         }
 
-        type = nplot > 0 ? sp->type[ nplot ] : ob->type;
-
         if ( cur_lw != sp->thickness[ nplot ] )
         {
             cur_lw = sp->thickness[ nplot ];
@@ -603,8 +781,13 @@ draw_curve_only( FL_OBJECT * ob )
         if ( ! noline )
             fl_lines( xp, nxp, col );
 
+        /* Symbols get drawn directly with the current foreground color */
+
         if ( drawsymbol )
+        {
+            fl_color( col );
             drawsymbol( ob, nplot, sp->xp, sp->nxp, sp->ssize, sp->ssize );
+        }
 
         /* Do keys */
 
@@ -1665,26 +1848,19 @@ round_yminmax( FLI_XYPLOT_SPEC * sp )
 
 
 /***************************************
+ * Draws everything but the data and the keys, i.e., the box, axes,
+ * tics, labels, grid and the box around the keys. Also sets up the
+ * mapping from data to screen coordinates.
  ***************************************/
 
 static void
-draw_xyplot( FL_OBJECT * ob )
+draw_background( FL_OBJECT * ob )
 {
     FLI_XYPLOT_SPEC *sp = ob->spec;
     FL_Coord bw = FL_abs( ob->bw );
 
-    draw_to_pixmap =    ob->use_pixmap
-                     && ob->flpixmap
-                     && ob->form->window == ob->flpixmap->pixmap;
-
     fl_draw_box( ob->boxtype, ob->x, ob->y, ob->w, ob->h, ob->col1, ob->bw );
 
-    fl_draw_text_beside( ob->align, ob->x, ob->y, ob->w, ob->h,
-                         ob->lcol, ob->lstyle, ob->lsize, ob->label );
-
-    if ( *sp->n <= 0 || ! *sp->x || ! *sp->y )
-        return;
-
     sp->xtic   = sp->ytic = -1;
     sp->xscmin = sp->xmin;
     sp->xscmax = sp->xmax;
@@ -1715,7 +1891,17 @@ draw_xyplot( FL_OBJECT * ob )
 
     convert_coord( ob, sp );
     add_border( sp, ob->col2 );
-    draw_curve_only( ob );
+
+    fl_set_clipping( sp->xi, sp->yi, sp->xf - sp->xi + 1, sp->yf - sp->yi + 1 );
+
+    if ( sp->xgrid != FL_GRID_NONE && sp->xtic > 0 )
+        add_xgrid( ob );
+
+    if ( sp->ygrid != FL_GRID_NONE && sp->ytic > 0 )
+        add_ygrid( ob );
+
+    compute_key_position( ob );
+    fl_rect( sp->key_xs, sp->key_ys, sp->key_maxw, sp->key_maxh, *sp->col );
 
     fl_set_text_clipping( ob->x + bw, ob->y + bw,
                           ob->w - 2 * bw, ob->h - 2 * bw );
@@ -1761,6 +1947,204 @@ draw_xyplot( FL_OBJECT * ob )
 }
 
 
+/***************************************
+ * Moves the screen coordinates calculated by draw_background() for
+ * an object at (sp->bg_x, sp->bg_y) to the objects current position
+ ***************************************/
+
+static void
+move_layout( FL_OBJECT * ob )
+{
+    FLI_XYPLOT_SPEC *sp = ob->spec;
+    int dx = ob->x - sp->bg_x,
+        dy = ob->y - sp->bg_y,
+        i;
+
+    if ( ! dx && ! dy )
+        return;
+
+    sp->xi += dx;
+    sp->xf += dx;
+    sp->yi += dy;
+    sp->yf += dy;
+
+    sp->bx = sp->bxm = sp->xi - sp->ax * sp->xscmin;
+    sp->by = sp->bym = sp->yi - sp->ay * sp->yscmax;
+
+    sp->key_xs += dx;
+    sp->key_ys += dy;
+
+    for ( i = 0; i < sp->num_xminor; i++ )
+        sp->xtic_minor[ i ] += dx;
+    for ( i = 0; i < sp->num_xmajor; i++ )
+        sp->xtic_major[ i ] += dx;
+    for ( i = 0; i < sp->num_yminor; i++ )
+        sp->ytic_minor[ i ] += dy;
+    for ( i = 0; i < sp->num_ymajor; i++ )
+        sp->ytic_major[ i ] += dy;
+
+    sp->bg_x = ob->x;
+    sp->bg_y = ob->y;
+}
+
+
+/***************************************
+ * Collects what the background depends on besides the settings that
+ * can only be changed via fl_set_xyplot_xxx() functions (these reset
+ * sp->bg_valid instead)
+ ***************************************/
+
+static void
+get_background_key( FL_OBJECT         * ob,
+                    FLI_XYPLOT_BG_KEY * key )
+{
+    FLI_XYPLOT_SPEC *sp = ob->spec;
+    int i;
+
+    memset( key, 0, sizeof *key );
+
+    key->w              = ob->w;
+    key->h              = ob->h;
+    key->bw             = ob->bw;
+    key->boxtype        = ob->boxtype;
+    key->lstyle         = sp->lstyle;
+    key->lsize          = sp->lsize;
+    key->depth          = fli_depth( fl_vmode );
+    key->col1           = fl_get_pixel( ob->col1 );
+    key->col2           = fl_get_pixel( ob->col2 );
+    key->dbl_background = fl_get_pixel( ob->dbl_background );
+    key->xmin           = sp->xmin;
+    key->xmax           = sp->xmax;
+    key->ymin           = sp->ymin;
+    key->ymax           = sp->ymax;
+
+    /* Which overlays get a key influences the size of the key box */
+
+    for ( i = 0; i <= sp->maxoverlay; i++ )
+        key->keys = ( key->keys ^ ( sp->key[ i ] && sp->n[ i ] ) )
+                    * 16777619UL + i;
+}
+
+
+/***************************************
+ * Copies the background from a pixmap, drawing it into the pixmap first
+ * if anything it depends on has changed. For a plot where just the data
+ * change (e.g., when points get appended continuously) this avoids
+ * having to redo all the tics, labels and grid lines on each redraw.
+ * Returns 0 if no pixmap can be used.
+ ***************************************/
+
+static int
+draw_cached_background( FL_OBJECT * ob )
+{
+    FLI_XYPLOT_SPEC *sp = ob->spec;
+    FLI_XYPLOT_BG_KEY key;
+    Window win = fl_winget( );
+    FL_Coord x = ob->x,
+             y = ob->y;
+    FL_Coord cx,
+             cy,
+             cw,
+             ch;
+    int clipped;
+
+    /* Objects without a box don't cover what's beneath them */
+
+    if ( win == None || ob->boxtype == FL_NO_BOX || ob->w <= 0 || ob->h <= 0 )
+        return 0;
+
+    get_background_key( ob, &key );
+
+    if (    ! sp->bg_valid
+         || ! sp->bg_pixmap
+         || memcmp( &key, &sp->bg_key, sizeof key ) )
+    {
+        if (    sp->bg_pixmap
+             && (    key.w != sp->bg_key.w
+                  || key.h != sp->bg_key.h
+                  || key.depth != sp->bg_key.depth ) )
+        {
+            XFreePixmap( flx->display, sp->bg_pixmap );
+            sp->bg_pixmap = None;
+        }
+
+        if ( ! sp->bg_pixmap )
+            sp->bg_pixmap = XCreatePixmap( flx->display, win, ob->w, ob->h,
+                                           key.depth );
+
+        /* Draw with the object at the origin of the pixmap, then tell
+           move_layout() the coordinates are relative to it. Clipping to
+           an exposed region is in window coordinates and would leave
+           holes in what gets cached, so switch it off meanwhile. */
+
+        clipped = fl_get_global_clipping( &cx, &cy, &cw, &ch );
+        if ( clipped )
+            fli_unset_global_clipping( );
+
+        ob->x = ob->y = 0;
+        fl_winset( sp->bg_pixmap );
+        fl_rectf( 0, 0, ob->w, ob->h, ob->dbl_background );
+        draw_background( ob );
+        fl_winset( win );
+        ob->x = x;
+        ob->y = y;
+
+        if ( clipped )
+            fli_set_global_clipping( cx, cy, cw, ch );
+
+        sp->bg_x = sp->bg_y = 0;
+        sp->bg_key = key;
+        sp->bg_valid = 1;
+    }
+
+    move_layout( ob );
+
+    fli_flush_draw_batch( );
+    XCopyArea( flx->display, sp->bg_pixmap, win, flx->gc,
+               0, 0, ob->w, ob->h, ob->x, ob->y );
+
+    return 1;
+}
+
+
+/***************************************
+ ***************************************/
+
+static void
+draw_xyplot( FL_OBJECT * ob )
+{
+    FLI_XYPLOT_SPEC *sp = ob->spec;
+
+    draw_to_pixmap =    ob->use_pixmap
+                     && ob->flpixmap
+                     && ob->form->window == ob->flpixmap->pixmap;
+
+    if ( *sp->n <= 0 || ! *sp->x || ! *sp->y )
+    {
+        fl_draw_box( ob->boxtype, ob->x, ob->y, ob->w, ob->h,
+                     ob->col1, ob->bw );
+        fl_draw_text_beside( ob->align, ob->x, ob->y, ob->w, ob->h,
+                             ob->lcol, ob->lstyle, ob->lsize, ob->label );
+        return;
+    }
+
+    update_bounds( sp );
+
+    if ( ! draw_cached_background( ob ) )
+    {
+        draw_background( ob );
+        sp->bg_x = ob->x;
+        sp->bg_y = ob->y;
+        sp->bg_valid = 0;
+    }
+
+    fl_draw_text_beside( ob->align, ob->x, ob->y, ob->w, ob->h,
+                         ob->lcol, ob->lstyle, ob->lsize, ob->label );
+
+    draw_curve_only( ob );
+}
+
+
 /***************************************
  * Find the data point the mouse falls on. Since log scale is
  * non-linear, can't do search in world coordinates given pixel-delta,
@@ -2061,6 +2445,10 @@ allocate_spec( FLI_XYPLOT_SPEC * sp,
     sp->x           = fl_realloc( sp->x, ( n + 1 ) * sizeof *sp->x );
     sp->y           = fl_realloc( sp->y, ( n + 1 ) * sizeof *sp->y );
     sp->n           = fl_realloc( sp->n, ( n + 1 ) * sizeof *sp->n );
+    sp->nalloc      = fl_realloc( sp->nalloc, ( n + 1 ) * sizeof *sp->nalloc );
+    sp->first       = fl_realloc( sp->first, ( n + 1 ) * sizeof *sp->first );
+    sp->maxpoints   = fl_realloc( sp->maxpoints,
+                                  ( n + 1 ) * sizeof *sp->maxpoints );
     sp->grid        = fl_realloc( sp->grid, ( n + 1 ) * sizeof *sp->grid );
     sp->col         = fl_realloc( sp->col, ( n + 1 ) * sizeof *sp->col );
     sp->tcol        = fl_realloc( sp->tcol, ( n + 1 ) * sizeof *sp->tcol );
@@ -2079,7 +2467,8 @@ allocate_spec( FLI_XYPLOT_SPEC * sp,
     {
         sp->text[ i ]   = sp->key[ i ]         = NULL;
         sp->x[ i ]      = sp->y[ i ]           = NULL;
-        sp->n[ i ]      = 0;
+        sp->n[ i ]      = sp->nalloc[ i ]      = sp->first[ i ]    = 0;
+        sp->maxpoints[ i ] = 0;
         sp->type[ i ]   = -1;
         sp->xt[ i ]     = sp->yt[ i ]          = sp->grid[ i ]     = 0.0;
         sp->col[ i ]    = sp->tcol[ i ]        = 0;
@@ -2118,6 +2507,9 @@ free_spec_dynamic_mem( FLI_XYPLOT_SPEC * sp )
     fli_safe_free( sp->x );
     fli_safe_free( sp->y );
     fli_safe_free( sp->n );
+    fli_safe_free( sp->nalloc );
+    fli_safe_free( sp->first );
+    fli_safe_free( sp->maxpoints );
 
     if ( sp->text )
     {
@@ -2148,6 +2540,7 @@ init_spec( FL_OBJECT * obj )
     sp->xt     = sp->yt          = sp->grid      = NULL;
     sp->col    = sp->tcol        = NULL;
     sp->type   = sp->n           = NULL;
+    sp->nalloc = sp->first       = sp->maxpoints = NULL;
     sp->talign = sp->interpolate = sp->thickness = NULL;
     sp->symbol = NULL;
 
@@ -2495,6 +2888,7 @@ fl_set_xyplot_xtics( FL_OBJECT * ob,
         sp->xmajor = major;
         sp->xminor = minor;
         free_atic( sp->axtic );
+        sp->bg_valid = 0;
         fl_redraw_object( ob );
     }
 }
@@ -2539,6 +2933,7 @@ fl_set_xyplot_ytics( FL_OBJECT * ob,
         sp->ymajor = major;
         sp->yminor = minor;
         free_atic( sp->aytic );
+        sp->bg_valid = 0;
         fl_redraw_object( ob );
     }
 }
@@ -2556,6 +2951,7 @@ fl_set_xyplot_xgrid( FL_OBJECT * ob,
     if ( sp->xgrid != xgrid )
     {
         sp->xgrid = xgrid;
+        sp->bg_valid = 0;
         fl_redraw_object( ob );
     }
 }
@@ -2573,6 +2969,7 @@ fl_set_xyplot_ygrid( FL_OBJECT * ob,
     if ( sp->ygrid != ygrid )
     {
         sp->ygrid = ygrid;
+        sp->bg_valid = 0;
         fl_redraw_object( ob );
     }
 }
@@ -2591,6 +2988,7 @@ fl_set_xyplot_grid_linestyle( FL_OBJECT * ob,
     if ( sp->grid_linestyle != style )
     {
         sp->grid_linestyle = style;
+        sp->bg_valid = 0;
         fl_redraw_object( ob );
     }
 
@@ -2633,6 +3031,7 @@ fl_get_xyplot_xbounds( FL_OBJECT * ob,
 {
     FLI_XYPLOT_SPEC *sp = ob->spec;
 
+    update_bounds( sp );
     *xmin = sp->xmin;
     *xmax = sp->xmax;
 }
@@ -2648,6 +3047,7 @@ fl_get_xyplot_ybounds( FL_OBJECT * ob,
 {
     FLI_XYPLOT_SPEC *sp = ob->spec;
 
+    update_bounds( sp );
     *ymin = sp->ymin;
     *ymax = sp->ymax;
 }
@@ -2734,6 +3134,22 @@ find_ybounds( FLI_XYPLOT_SPEC * sp )
 }
 
 
+/***************************************
+ * Recalculates autoscaled bounds if data were appended since
+ ***************************************/
+
+static void
+update_bounds( FLI_XYPLOT_SPEC * sp )
+{
+    if ( sp->bounds_stale )
+    {
+        find_xbounds( sp );
+        find_ybounds( sp );
+        sp->bounds_stale = 0;
+    }
+}
+
+
 /***************************************
  * Overloading would've been nice ...
  ***************************************/
@@ -2767,14 +3183,15 @@ fl_set_xyplot_data_double( FL_OBJECT  * ob,
     sp->xlabel = fl_strdup( xlabel ? xlabel : "" );
     sp->ylabel = fl_strdup( ylabel ? ylabel : "" );
     sp->title  = fl_strdup( title ? title : "" );
+    sp->bg_valid = 0;
 
     *sp->x = fl_malloc( n * sizeof **sp->x );
     *sp->y = fl_malloc( n * sizeof **sp->y );
 
     if ( ! *sp->x || ! *sp->y )
     {
-        if ( *sp->x )
-            fl_free( *sp->x );
+        fli_safe_free( *sp->x );
+        fli_safe_free( *sp->y );
         M_err( __func__, "Can't allocate memory" );
         return;
     }
@@ -2787,7 +3204,7 @@ fl_set_xyplot_data_double( FL_OBJECT  * ob,
         sp->y[ 0 ][ i ] = y[ i ];
     }
 
-    *sp->n = n;
+    set_overlay_size( sp, 0, n );
 
     find_xbounds( sp );
     find_ybounds( sp );
@@ -2827,14 +3244,15 @@ fl_set_xyplot_data( FL_OBJECT  * ob,
     sp->xlabel = fl_strdup( xlabel ? xlabel : "" );
     sp->ylabel = fl_strdup( ylabel ? ylabel : "" );
     sp->title  = fl_strdup( title ? title : "" );
+    sp->bg_valid = 0;
 
     *sp->x = fl_malloc( n * sizeof **sp->x );
     *sp->y = fl_malloc( n * sizeof **sp->y );
 
     if ( ! *sp->x || ! *sp->y )
     {
-        if ( *sp->x )
-            fli_safe_free( *sp->x );
+        fli_safe_free( *sp->x );
+        fli_safe_free( *sp->y );
         M_err( __func__, "Can't allocate memory" );
         return;
     }
@@ -2843,7 +3261,7 @@ fl_set_xyplot_data( FL_OBJECT  * ob,
 
     memcpy( *sp->x, x, n * sizeof **sp->x );
     memcpy( *sp->y, y, n * sizeof **sp->y );
-    *sp->n = n;
+    set_overlay_size( sp, 0, n );
 
     find_xbounds( sp );
     find_ybounds( sp );
@@ -2864,8 +3282,7 @@ fl_insert_xyplot_data( FL_OBJECT * ob,
                        double      y )
 {
     FLI_XYPLOT_SPEC *sp = ob->spec;
-    float *xx,
-          *yy;
+    int oldn;
 
     if ( id < 0 || id > sp->maxoverlay )
     {
@@ -2879,49 +3296,162 @@ fl_insert_xyplot_data( FL_OBJECT * ob,
         n = sp->n[ id ] - 1;
 
     n = n + 1;
-    sp->n[ id ] += 1;
 
-    if ( n == sp->n[ id ] - 1 )
+    /* A point in front of a full ring buffer would be dropped at once */
+
+    if (    n == 0
+         && sp->maxpoints[ id ] > 0
+         && sp->n[ id ] >= sp->maxpoints[ id ] )
+        return;
+
+    oldn = sp->n[ id ];
+
+    if ( reserve_overlay_data( sp, id, 1 ) < 0 )
     {
-        sp->x[ id ] = fl_realloc( sp->x[ id ],
-                                  sp->n[ id ] * sizeof **sp->x );
-        sp->y[ id ] = fl_realloc( sp->y[ id ],
-                                  sp->n[ id ] * sizeof **sp->y );
-        sp->x[ id ][ n ] = x;
-        sp->y[ id ][ n ] = y;
+        M_err( __func__, "Can't allocate memory" );
+        return;
     }
-    else
+
+    n -= oldn - sp->n[ id ];
+
+    if ( n < sp->n[ id ] )
     {
-        xx = fl_malloc( sp->n[ id ] * sizeof *xx );
-        yy = fl_malloc( sp->n[ id ] * sizeof *yy );
+        memmove( sp->x[ id ] + n + 1, sp->x[ id ] + n,
+                 ( sp->n[ id ] - n ) * sizeof **sp->x );
+        memmove( sp->y[ id ] + n + 1, sp->y[ id ] + n,
+                 ( sp->n[ id ] - n ) * sizeof **sp->y );
+    }
 
-        if ( n )
-        {
-            memcpy( xx, sp->x[ id ], n * sizeof *xx );
-            memcpy( yy, sp->y[ id ], n * sizeof *yy );
-        }
+    sp->x[ id ][ n ] = x;
+    sp->y[ id ][ n ] = y;
+    sp->n[ id ] += 1;
 
-        xx[ n ] = x;
-        yy[ n ] = y;
+    extend_screen_data( sp, sp->n[ id ] );
 
-        memcpy( xx + n + 1, sp->x[ id ] + n,
-                ( sp->n[ id ] - n - 1 ) * sizeof *xx );
-        memcpy( yy + n + 1, sp->y[ id ] + n,
-                ( sp->n[ id ] - n - 1 ) * sizeof *yy );
+    fl_redraw_object( ob );
+}
 
-        fl_free( sp->x[ id ] );
-        fl_free( sp->y[ id ] );
 
-        sp->x[ id ] = xx;
-        sp->y[ id ] = yy;
+/***************************************
+ * Appends 'n' points to the end of the data of an overlay and redraws
+ * once. Appending is amortized O(1) per point and, if a capacity was
+ * set with fl_set_xyplot_maxpoints(), the oldest points get dropped.
+ * In contrast to fl_insert_xyplot_data() the bounds of the base data
+ * follow the new data when autoscaling.
+ ***************************************/
+
+void
+fl_append_xyplot_data( FL_OBJECT * ob,
+                       int         id,
+                       float     * x,
+                       float     * y,
+                       int         n )
+{
+    FLI_XYPLOT_SPEC *sp;
+
+#if FL_DEBUG >= ML_ERR
+    if ( ! IsValidClass( ob, FL_XYPLOT ) )
+    {
+        M_err( __func__, "object %s not an xyplot", ob ? ob->label : "" );
+        return;
     }
+#endif
+
+    sp = ob->spec;
+
+    if ( id < 0 || id > sp->maxoverlay )
+    {
+        M_err( __func__, "ID %d is not in range (0,%d)", id, sp->maxoverlay );
+        return;
+    }
+
+    if ( n <= 0 )
+        return;
+
+    /* Of more points than fit into a ring buffer only the newest count */
+
+    if ( sp->maxpoints[ id ] > 0 && n > sp->maxpoints[ id ] )
+    {
+        x += n - sp->maxpoints[ id ];
+        y += n - sp->maxpoints[ id ];
+        n = sp->maxpoints[ id ];
+    }
+
+    if ( reserve_overlay_data( sp, id, n ) < 0 )
+    {
+        M_err( __func__, "Can't allocate memory" );
+        return;
+    }
+
+    memcpy( sp->x[ id ] + sp->n[ id ], x, n * sizeof *x );
+    memcpy( sp->y[ id ] + sp->n[ id ], y, n * sizeof *y );
+    sp->n[ id ] += n;
 
     extend_screen_data( sp, sp->n[ id ] );
 
+    /* Only the base data determine the bounds, to keep appending cheap
+       they're recalculated when the plot gets drawn next time */
+
+    if ( id == 0 && ( sp->xautoscale || sp->yautoscale ) )
+        sp->bounds_stale = 1;
+
+    /* Set default type the first time data are added to an overlay */
+
+    if ( id > 0 && sp->type[ id ] == -1 )
+        sp->type[ id ] = ob->type;
+
     fl_redraw_object( ob );
 }
 
 
+/***************************************
+ * Sets the maximum number of points an overlay keeps, when more points
+ * are added the oldest ones are dropped. Setting it to 0 or a negative
+ * value removes the limit. Returns the previous setting.
+ ***************************************/
+
+int
+fl_set_xyplot_maxpoints( FL_OBJECT * ob,
+                         int         id,
+                         int         maxpoints )
+{
+    FLI_XYPLOT_SPEC *sp;
+    int old;
+
+#if FL_DEBUG >= ML_ERR
+    if ( ! IsValidClass( ob, FL_XYPLOT ) )
+    {
+        M_err( __func__, "object %s not an xyplot", ob ? ob->label : "" );
+        return -1;
+    }
+#endif
+
+    sp = ob->spec;
+
+    if ( id < 0 || id > sp->maxoverlay )
+    {
+        M_err( __func__, "ID %d is not in range (0,%d)", id, sp->maxoverlay );
+        return -1;
+    }
+
+    old = sp->maxpoints[ id ];
+    sp->maxpoints[ id ] = FL_max( maxpoints, 0 );
+
+    if ( sp->maxpoints[ id ] > 0 && sp->n[ id ] > sp->maxpoints[ id ] )
+    {
+        reserve_overlay_data( sp, id, 0 );
+        if ( id == 0 )
+        {
+            find_xbounds( sp );
+            find_ybounds( sp );
+        }
+        fl_redraw_object( ob );
+    }
+
+    return old;
+}
+
+
 /***************************************
  ***************************************/
 
@@ -2964,7 +3494,7 @@ fl_add_xyplot_overlay( FL_OBJECT * ob,
     memcpy( sp->x[ id ], x, n * sizeof **sp->x );
     memcpy( sp->y[ id ], y, n * sizeof **sp->y );
 
-    sp->n[ id ] = n;
+    set_overlay_size( sp, id, n );
 
     /* Extend screen points if needed. */
 
@@ -3636,6 +4166,7 @@ fl_set_xyplot_xscale( FL_OBJECT * ob,
             sp->lxbase = log10( base );
         }
 
+        sp->bg_valid = 0;
         fl_redraw_object( ob );
     }
 }
@@ -3667,6 +4198,7 @@ fl_set_xyplot_yscale( FL_OBJECT * ob,
             sp->lybase = log10( base );
         }
 
+        sp->bg_valid = 0;
         fl_redraw_object( ob );
     }
 }
@@ -3693,6 +4225,8 @@ fl_set_xyplot_fixed_xaxis( FL_OBJECT  * ob,
 
     if ( sp->xmargin1 && ! sp->xmargin2 )
         sp->xmargin2 = fl_strdup( "" );
+
+    sp->bg_valid = 0;
 }
 
 
@@ -3717,6 +4251,8 @@ fl_set_xyplot_fixed_yaxis( FL_OBJECT  * ob,
 
     if ( sp->ymargin1 && ! sp->ymargin2 )
         sp->ymargin2 = fl_strdup( "" );
+
+    sp->bg_valid = 0;
 }
 
 
@@ -3746,6 +4282,7 @@ fl_set_xyplot_alphaxtics( FL_OBJECT  * ob,
     sp->xmajor = n;
     sp->xminor = 1;
 
+    sp->bg_valid = 0;
     fl_redraw_object( ob );
 }
 
@@ -3776,6 +4313,7 @@ fl_set_xyplot_alphaytics( FL_OBJECT  * ob,
     sp->ymajor = n;
     sp->yminor = 1;
 
+    sp->bg_valid = 0;
     fl_redraw_object( ob );
 }
 
@@ -3822,6 +4360,8 @@ fl_set_xyplot_key( FL_OBJECT  * ob,
 
     if ( key && *key )
         sp->key[ id ] = fl_strdup( key );
+
+    sp->bg_valid = 0;
 }
 
 
@@ -3840,6 +4380,7 @@ fl_set_xyplot_key_position( FL_OBJECT * ob,
     sp->key_y = y;
     sp->key_align = fl_to_outside_lalign( align );
 
+    sp->bg_valid = 0;
     fl_redraw_object( ob );
 }
 
@@ -3879,6 +4420,7 @@ fl_set_xyplot_key_font( FL_OBJECT * ob,
         sp->key_lstyle = style;
         sp->key_lsize = size;
 
+        sp->bg_valid = 0;
         fl_redraw_object( ob );
     }
 }
@@ -3963,6 +4505,7 @@ fl_set_xyplot_log_minor_xtics( FL_OBJECT * obj,
     if ( old_state != yesno )
     {
         sp->log_minor_xtics = yesno ? 1 : 0;
+        sp->bg_valid = 0;
         fl_redraw_object( obj );
     }
 
@@ -3983,6 +4526,7 @@ fl_set_xyplot_log_minor_ytics( FL_OBJECT * obj,
     if ( old_state != yesno )
     {
         sp->log_minor_ytics = yesno ? 1 : 0;
+        sp->bg_valid = 0;
         fl_redraw_object( obj );
     }
 